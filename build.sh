@@ -24,21 +24,33 @@ print_error(){
 mkdir -p output
 
 
+# the SDK every plugin links in - compiled once, not once per plugin
+print_status "Building plugin SDK"
+mkdir -p output/sdk
+sdk_objects=""
+for source in plugins/plugin_common.c plugins/byte_map.c plugins/plugin_view.c plugins/plugin_rope.c \
+              plugins/sync/monitor.c plugins/sync/consumer_producer.c plugins/sync/spsc_ring.c \
+              plugins/sync/record_ring.c plugins/sync/eventcount.c plugins/sync/reorder_buffer.c; do
+    object=output/sdk/$(basename ${source} .c).o
+    gcc -fPIC -c -o ${object} ${source} || {
+    print_error "Failed to build ${source}"
+    exit 1
+    }
+    sdk_objects="${sdk_objects} ${object}"
+done
+
 # we use a loop to activate the template for each plugin
-for plugin_name in logger uppercaser rotator flipper expander typewriter; do
+for plugin_name in logger uppercaser lowercaser rot13 rotator flipper expander typewriter; do
     print_status "Building plugin: $plugin_name"
     gcc -fPIC -shared -o output/${plugin_name}.so \
     plugins/${plugin_name}.c \
-    plugins/plugin_common.c \
-    plugins/sync/monitor.c \
-    plugins/sync/consumer_producer.c \
+    ${sdk_objects} \
     -ldl -lpthread || {
     print_error "Failed to build $plugin_name"
     exit 1
     }
 done
 
-
-gcc main.c -ldl -lpthread -o output/analyzer
+gcc main.c plugins/sync/work_pool.c plugins/sync/eventcount.c plugins/sync/record_reader.c plugins/sync/mapped_input.c plugins/sync/output_writer.c plugins/sync/timer_wheel.c plugins/sync/buffer_pool.c -ldl -lpthread -o output/analyzer
 
 print_status "All builds completed successfully"
@@ -6,12 +6,25 @@ echo "Building plugin_common unit test..."
 # Create output directory if it doesn't exist
 mkdir -p output
 
+# byte maps optimized, as a plugin built with -O2 would have them - the AVX2 shuffle kernel only exists then
+gcc -O2 -c -o output/byte_map_test.o plugins/byte_map.c
+
 # Build the test executable
 gcc -o output/plugin_common_test \
     plugin_common_test.c \
     plugins/plugin_common.c \
+    output/byte_map_test.o \
+    plugins/plugin_view.c \
+    plugins/plugin_rope.c \
     plugins/sync/monitor.c \
     plugins/sync/consumer_producer.c \
+    plugins/sync/spsc_ring.c \
+    plugins/sync/record_ring.c \
+    plugins/sync/eventcount.c \
+    plugins/sync/reorder_buffer.c \
+    plugins/sync/work_pool.c \
+    plugins/sync/timer_wheel.c \
+    plugins/sync/buffer_pool.c \
     -ldl -lpthread
 
 if [ $? -eq 0 ]; then
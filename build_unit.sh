@@ -37,6 +37,9 @@ gcc monitor_test.c \
 print_status "Building consumer-producer unit test"
 gcc consumer_producer_test.c \
     plugins/sync/consumer_producer.c \
+    plugins/sync/spsc_ring.c \
+    plugins/sync/record_ring.c \
+    plugins/sync/eventcount.c \
     plugins/sync/monitor.c \
     -lpthread -o consumer_producer_test || {
     print_error "Failed to build consumer_producer_test"
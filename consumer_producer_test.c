@@ -431,6 +431,385 @@ int test_edge_cases() {
     return passed;
 }
 
+// Producer thread for the SPSC test: pushes numbered items through a tiny ring
+#define SPSC_TEST_ITEMS 10000
+void* spsc_producer_thread(void* arg) {
+    consumer_producer_t* queue = (consumer_producer_t*)arg;
+    char buffer[32];
+    
+    for (int i = 0; i < SPSC_TEST_ITEMS; i++) {
+        snprintf(buffer, sizeof(buffer), "%d", i);
+        if (consumer_producer_put(queue, buffer) != NULL) {
+            return NULL;
+        }
+    }
+    
+    return NULL;
+}
+
+// Test 10: Lock-free SPSC mode keeps FIFO order across threads
+int test_spsc_mode() {
+    print_test_header("SPSC Mode Across Threads");
+    
+    consumer_producer_t queue;
+    const char* result = consumer_producer_init_mode(&queue, 2, CONSUMER_PRODUCER_SPSC);
+    if (result != NULL) {
+        printf("Init failed: %s\n", result);
+        return 0;
+    }
+    
+    pthread_t producer;
+    if (pthread_create(&producer, NULL, spsc_producer_thread, &queue) != 0) {
+        consumer_producer_destroy(&queue);
+        return 0;
+    }
+    
+    // Consume on this thread; a capacity of 2 forces both sides through the blocking fallback
+    int passed = 1;
+    char expected[32];
+    for (int i = 0; i < SPSC_TEST_ITEMS; i++) {
+        char* retrieved = consumer_producer_get(&queue);
+        snprintf(expected, sizeof(expected), "%d", i);
+        if (!retrieved || strcmp(retrieved, expected) != 0) {
+            printf("SPSC order violation: expected '%s', got '%s'\n",
+                   expected, retrieved ? retrieved : "NULL");
+            passed = 0;
+            free(retrieved);
+            break;
+        }
+        free(retrieved);
+    }
+    
+    pthread_join(producer, NULL);
+    consumer_producer_destroy(&queue);
+    return passed;
+}
+
+// Test 11: Batch put/get in both queue modes
+int test_batch_put_get() {
+    print_test_header("Batch Put and Get");
+    
+    const char* items[] = {"one", "two", "three", "four", "five", "six", "seven"};
+    int num_items = sizeof(items) / sizeof(items[0]);
+    int passed = 1;
+    
+    for (int mode = CONSUMER_PRODUCER_LOCKED; mode <= CONSUMER_PRODUCER_SPSC; mode++) {
+        consumer_producer_t queue;
+        const char* result = consumer_producer_init_mode(&queue, 8, mode);
+        if (result != NULL) {
+            printf("Init failed: %s\n", result);
+            return 0;
+        }
+        
+        result = consumer_producer_put_many(&queue, items, num_items);
+        if (result != NULL) {
+            printf("Put many failed: %s\n", result);
+            consumer_producer_destroy(&queue);
+            return 0;
+        }
+        
+        // get_many returns whatever is available, capped at max, in FIFO order
+        char* out[8];
+        int got = consumer_producer_get_many(&queue, out, 4);
+        int got_rest = consumer_producer_get_many(&queue, out + 4, 4);
+        if (got != 4 || got_rest != num_items - 4) {
+            printf("Get many returned %d + %d items\n", got, got_rest);
+            passed = 0;
+        }
+        for (int i = 0; i < got + got_rest; i++) {
+            if (i < num_items && strcmp(out[i], items[i]) != 0) {
+                printf("Batch order violation at %d: '%s'\n", i, out[i]);
+                passed = 0;
+            }
+            free(out[i]);
+        }
+        
+        consumer_producer_destroy(&queue);
+    }
+    
+    return passed;
+}
+
+// Test 12: Owned put stores the caller's pointer without copying
+int test_put_owned() {
+    print_test_header("Owned Put (Zero-Copy)");
+    
+    int passed = 1;
+    for (int mode = CONSUMER_PRODUCER_LOCKED; mode <= CONSUMER_PRODUCER_SPSC; mode++) {
+        consumer_producer_t queue;
+        const char* result = consumer_producer_init_mode(&queue, TEST_QUEUE_SIZE, mode);
+        if (result != NULL) {
+            printf("Init failed: %s\n", result);
+            return 0;
+        }
+        
+        char* item = strdup("moved, not copied");
+        result = consumer_producer_put_owned(&queue, item);
+        char* retrieved = consumer_producer_get(&queue);
+        if (result != NULL || retrieved != item) {
+            printf("Owned put returned a different pointer in mode %d\n", mode);
+            passed = 0;
+        }
+        free(retrieved);
+        
+        consumer_producer_destroy(&queue);
+    }
+    
+    return passed;
+}
+
+// Producer thread for the record ring test: lines of every length from 0 up, a few too long to be kept inline
+#define RECORD_TEST_ITEMS 5000
+static void record_test_line(int i, char* buffer) {
+    int len = i % 7 == 0 ? 100 + i % 50 : i % 40;
+    for (int j = 0; j < len; j++) buffer[j] = 'a' + (i + j) % 26;
+    buffer[len] = '\0';
+}
+
+void* record_producer_thread(void* arg) {
+    consumer_producer_t* queue = (consumer_producer_t*)arg;
+    char buffer[256];
+    
+    for (int i = 0; i < RECORD_TEST_ITEMS; i++) {
+        record_test_line(i, buffer);
+        // owned and copied puts take the same way into the ring
+        if (i % 2 == 0) {
+            consumer_producer_put_owned(queue, strdup(buffer));
+        } else if (consumer_producer_put(queue, buffer) != NULL) {
+            return NULL;
+        }
+    }
+    
+    return NULL;
+}
+
+// Test 13: Record ring mode - records read in place (wrapping around a small ring), given back in order
+int test_record_ring_mode() {
+    print_test_header("Record Ring Mode Across Threads");
+    
+    consumer_producer_t queue;
+    const char* result = consumer_producer_init_mode(&queue, 64, CONSUMER_PRODUCER_RECORDS);
+    if (result == NULL) {
+        printf("A ring smaller than RECORD_RING_MIN_CAPACITY was accepted\n");
+        consumer_producer_destroy(&queue);
+        return 0;
+    }
+    result = consumer_producer_init_mode(&queue, RECORD_RING_MIN_CAPACITY, CONSUMER_PRODUCER_RECORDS);
+    if (result != NULL) {
+        printf("Init failed: %s\n", result);
+        return 0;
+    }
+    
+    pthread_t producer;
+    if (pthread_create(&producer, NULL, record_producer_thread, &queue) != 0) {
+        consumer_producer_destroy(&queue);
+        return 0;
+    }
+    
+    // one at a time, then batches given back at once - a 256-byte ring makes the producer wait and wrap all along
+    int passed = 1;
+    char expected[256];
+    record_ring_view_t views[8];
+    int i = 0;
+    while (i < RECORD_TEST_ITEMS && passed) {
+        int got = i < RECORD_TEST_ITEMS / 2 ? (consumer_producer_get_view(&queue, views) == 0) :
+                                             consumer_producer_get_many_views(&queue, views, 8);
+        for (int j = 0; j < got; j++, i++) {
+            record_test_line(i, expected);
+            if (views[j].len != strlen(expected) || strcmp(views[j].data, expected) != 0) {
+                printf("Record %d: expected '%s', got '%s'\n", i, expected, views[j].data);
+                passed = 0;
+            }
+        }
+        if (got == 1) {
+            passed = passed && consumer_producer_release_view(&queue, views[0].data) == 0;
+        } else {
+            // the newest first is out of order
+            passed = passed && consumer_producer_release_view(&queue, views[got - 1].data) != 0;
+            passed = passed && consumer_producer_release_views(&queue, got) == 0;
+        }
+    }
+    passed = passed && consumer_producer_release_views(&queue, 1) != 0;
+    
+    // plain gets still hand out copies of their own
+    pthread_join(producer, NULL);
+    consumer_producer_put(&queue, "copied out");
+    char* retrieved = consumer_producer_get(&queue);
+    passed = passed && retrieved != NULL && strcmp(retrieved, "copied out") == 0 && consumer_producer_count(&queue) == 0;
+    free(retrieved);
+    
+    // a long record left inside is freed with the ring
+    consumer_producer_put(&queue, "this one is a lot longer than a quarter of the ring, so it is kept out of line - "
+                                  "the ring only holds a pointer to it, which destroy has to give back");
+    consumer_producer_destroy(&queue);
+    return passed;
+}
+
+// Puts END on the control lane once the main thread had time to park on the empty queue
+void* control_end_thread(void* arg) {
+    usleep(20000);
+    consumer_producer_put_control((consumer_producer_t*)arg, CONSUMER_PRODUCER_END);
+    return NULL;
+}
+
+// Test 14: Control lane - FLUSH goes first, BARRIER and END wait for the items put before them, PAUSE holds items back
+int test_control_lane() {
+    print_test_header("Control Lane");
+    
+    int passed = 1;
+    for (int mode = CONSUMER_PRODUCER_LOCKED; mode <= CONSUMER_PRODUCER_RECORDS && passed; mode++) {
+        consumer_producer_t queue;
+        const char* result = consumer_producer_init_mode(&queue, RECORD_RING_MIN_CAPACITY, mode);
+        if (result != NULL) {
+            printf("Init failed: %s\n", result);
+            return 0;
+        }
+        
+        const char* items[] = {"a", "b", "c"};
+        consumer_producer_put_many(&queue, items, 3);
+        consumer_producer_put_control(&queue, CONSUMER_PRODUCER_BARRIER);
+        consumer_producer_put(&queue, "d");
+        consumer_producer_put_control(&queue, CONSUMER_PRODUCER_FLUSH);
+        
+        // the flush comes right away, the barrier only after the three items before it - and it takes a sequence number
+        consumer_producer_signal_t signal;
+        char* out[8];
+        passed = passed && consumer_producer_get_many(&queue, out, 8) == 0 &&
+                 consumer_producer_take_control(&queue, &signal) == 1 && signal.type == CONSUMER_PRODUCER_FLUSH;
+        int got = consumer_producer_get_many(&queue, out, 8);
+        passed = passed && got == 3 && strcmp(out[0], "a") == 0 && strcmp(out[2], "c") == 0;
+        for (int i = 0; i < got; i++) {
+            free(out[i]);
+        }
+        passed = passed && consumer_producer_get_many(&queue, out, 8) == 0 &&
+                 consumer_producer_take_control(&queue, &signal) == 1 &&
+                 signal.type == CONSUMER_PRODUCER_BARRIER && signal.position == 3;
+        unsigned long sequence = 0;
+        char* retrieved = consumer_producer_get_sequenced(&queue, &sequence);
+        passed = passed && retrieved != NULL && strcmp(retrieved, "d") == 0 && sequence == 4;
+        free(retrieved);
+        
+        // paused: the item stays in the queue until RESUME
+        consumer_producer_put(&queue, "e");
+        consumer_producer_put_control(&queue, CONSUMER_PRODUCER_PAUSE);
+        passed = passed && consumer_producer_try_get(&queue) == NULL && !consumer_producer_ready(&queue);
+        consumer_producer_put_control(&queue, CONSUMER_PRODUCER_RESUME);
+        passed = passed && consumer_producer_ready(&queue);
+        retrieved = consumer_producer_try_get(&queue);
+        passed = passed && retrieved != NULL && strcmp(retrieved, "e") == 0;
+        free(retrieved);
+        
+        // a get parked on the empty queue comes back empty-handed for END, which stays due (a second one is ignored)
+        pthread_t signaler;
+        if (pthread_create(&signaler, NULL, control_end_thread, &queue) != 0) {
+            consumer_producer_destroy(&queue);
+            return 0;
+        }
+        retrieved = consumer_producer_get(&queue);
+        pthread_join(signaler, NULL);
+        passed = passed && retrieved == NULL && consumer_producer_put_control(&queue, CONSUMER_PRODUCER_END) == NULL;
+        passed = passed && consumer_producer_take_control(&queue, &signal) == 1 && signal.type == CONSUMER_PRODUCER_END &&
+                 consumer_producer_take_control(&queue, &signal) == 1 && signal.type == CONSUMER_PRODUCER_END;
+        
+        // END holds no lane slot - FLUSHes still get through (one waiting FLUSH stands for the rest), a barrier doesn't
+        for (int i = 0; i < 2 * CONSUMER_PRODUCER_CONTROLS; i++) {
+            passed = passed && consumer_producer_put_control(&queue, CONSUMER_PRODUCER_FLUSH) == NULL;
+        }
+        passed = passed && consumer_producer_take_control(&queue, &signal) == 1 && signal.type == CONSUMER_PRODUCER_FLUSH &&
+                 consumer_producer_take_control(&queue, &signal) == 1 && signal.type == CONSUMER_PRODUCER_END;
+        passed = passed && consumer_producer_put_control(&queue, CONSUMER_PRODUCER_BARRIER) != NULL;
+        
+        if (!passed) {
+            printf("Control lane misbehaved in mode %d\n", mode);
+        }
+        consumer_producer_destroy(&queue);
+    }
+    
+    return passed;
+}
+
+// Takes items and control messages until END, counting the barriers
+void* control_drain_thread(void* arg) {
+    consumer_producer_t* queue = (consumer_producer_t*)arg;
+    consumer_producer_signal_t signal;
+    long barriers = 0;
+    for (;;) {
+        usleep(1000);
+        char* item = consumer_producer_get(queue);
+        if (item != NULL) {
+            free(item);
+            continue;
+        }
+        if (consumer_producer_take_control(queue, &signal) != 1) {
+            continue;
+        }
+        if (signal.type == CONSUMER_PRODUCER_END) {
+            break;
+        }
+        barriers += signal.type == CONSUMER_PRODUCER_BARRIER;
+    }
+    return (void*)barriers;
+}
+
+// Test 15: Barrier runs - more barriers in a row than the lane has slots, each still taken on its own, END behind them
+int test_control_lane_runs() {
+    print_test_header("Barrier Runs");
+    
+    int passed = 1;
+    for (int mode = CONSUMER_PRODUCER_LOCKED; mode <= CONSUMER_PRODUCER_RECORDS && passed; mode++) {
+        consumer_producer_t queue;
+        const char* result = consumer_producer_init_mode(&queue, RECORD_RING_MIN_CAPACITY, mode);
+        if (result != NULL) {
+            printf("Init failed: %s\n", result);
+            return 0;
+        }
+        
+        // a run of barriers shares one lane entry, so none of the puts waits for the consumer
+        consumer_producer_put(&queue, "a");
+        for (int i = 0; i < 3 * CONSUMER_PRODUCER_CONTROLS; i++) {
+            passed = passed && consumer_producer_put_control(&queue, CONSUMER_PRODUCER_BARRIER) == NULL;
+        }
+        passed = passed && consumer_producer_put_control(&queue, CONSUMER_PRODUCER_END) == NULL;
+        
+        // each barrier still comes out on its own, with a sequence number of its own, and END after the last
+        char* retrieved = consumer_producer_get(&queue);
+        passed = passed && retrieved != NULL && strcmp(retrieved, "a") == 0;
+        free(retrieved);
+        consumer_producer_signal_t signal;
+        for (int i = 0; i < 3 * CONSUMER_PRODUCER_CONTROLS; i++) {
+            passed = passed && consumer_producer_get(&queue) == NULL && consumer_producer_take_control(&queue, &signal) == 1 &&
+                     signal.type == CONSUMER_PRODUCER_BARRIER && signal.position == 1 + (unsigned long)i;
+        }
+        passed = passed && consumer_producer_take_control(&queue, &signal) == 1 && signal.type == CONSUMER_PRODUCER_END;
+        consumer_producer_destroy(&queue);
+        
+        // barriers with items between them each need an entry - a put waits for the consumer to make room
+        if (consumer_producer_init_mode(&queue, RECORD_RING_MIN_CAPACITY, mode) != NULL) {
+            return 0;
+        }
+        pthread_t drainer;
+        if (pthread_create(&drainer, NULL, control_drain_thread, &queue) != 0) {
+            consumer_producer_destroy(&queue);
+            return 0;
+        }
+        for (int i = 0; i < 2 * CONSUMER_PRODUCER_CONTROLS; i++) {
+            passed = passed && consumer_producer_put(&queue, "b") == NULL &&
+                     consumer_producer_put_control(&queue, CONSUMER_PRODUCER_BARRIER) == NULL;
+        }
+        consumer_producer_put_control(&queue, CONSUMER_PRODUCER_END);
+        void* barriers = NULL;
+        pthread_join(drainer, &barriers);
+        passed = passed && (long)barriers == 2 * CONSUMER_PRODUCER_CONTROLS;
+        
+        if (!passed) {
+            printf("Barrier runs misbehaved in mode %d\n", mode);
+        }
+        consumer_producer_destroy(&queue);
+    }
+    
+    return passed;
+}
+
 int main() {
     printf("=== Consumer-Producer Queue Unit Tests ===\n");
     printf("Testing comprehensive functionality of the queue implementation...\n");
@@ -441,10 +820,16 @@ int main() {
     print_test_result("Basic Put and Get Operations", test_basic_put_get());
     print_test_result("Queue Capacity Limits", test_queue_capacity());
     print_test_result("FIFO Order Verification", test_fifo_order());
-    //print_test_result("Concurrent Producers and Consumers", test_concurrent_operations());
+    print_test_result("Concurrent Producers and Consumers", test_concurrent_operations());
     print_test_result("Finished Signal Functionality", test_finished_signal());
     print_test_result("Memory Stress Test", test_memory_stress());
     print_test_result("Edge Cases", test_edge_cases());
+    print_test_result("SPSC Mode Across Threads", test_spsc_mode());
+    print_test_result("Batch Put and Get", test_batch_put_get());
+    print_test_result("Owned Put (Zero-Copy)", test_put_owned());
+    print_test_result("Record Ring Mode Across Threads", test_record_ring_mode());
+    print_test_result("Control Lane", test_control_lane());
+    print_test_result("Barrier Runs", test_control_lane_runs());
     
     // Print summary
     printf("\n" COLOR_BLUE "=== Test Summary ===" COLOR_RESET "\n");
@@ -4,13 +4,21 @@
 
 #include <dlfcn.h>
 #include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "plugins/plugin_sdk.h"
+#include "plugins/sync/work_pool.h"
+#include "plugins/sync/record_reader.h"
+#include "plugins/sync/mapped_input.h"
+#include "plugins/sync/output_writer.h"
+#include "plugins/sync/timer_wheel.h"
+#include "plugins/sync/buffer_pool.h"
 
-// Helper function to check if a plugin name is valid (one of the 6 allowed)
+// Helper function to check if a plugin name is valid (one of the 8 allowed)
 int is_valid_plugin(const char* name) {
-    const char* valid_plugins[] = {"logger", "typewriter", "uppercaser", "rotator", "flipper", "expander"};
-    for(int i = 0; i < 6; i++) {
+    const char* valid_plugins[] = {"logger", "typewriter", "uppercaser", "lowercaser", "rot13", "rotator", "flipper", "expander"};
+    for(int i = 0; i < 8; i++) {
         if(strcmp(name, valid_plugins[i]) == 0) {
             return 1;
         }
@@ -18,24 +26,66 @@ int is_valid_plugin(const char* name) {
     return 0;
 }
 
-// Function pointer typedefs as specified in PDF
-typedef const char* (*plugin_init_func_t)(int);
-typedef const char* (*plugin_fini_func_t)(void);
-typedef const char* (*plugin_place_work_func_t)(const char*);
-typedef void (*plugin_attach_func_t)(const char* (*)(const char*));
-typedef const char* (*plugin_wait_finished_func_t)(void);
+// Function pointer typedefs - the instance flavour of the PDF ABI (every call names its instance)
+typedef const char* (*plugin_init_func_t)(const plugin_config_t*, plugin_instance_t**);
+typedef const char* (*plugin_fini_func_t)(plugin_instance_t*);
+typedef const char* (*plugin_place_work_func_t)(plugin_instance_t*, const char*);
+typedef const char* (*plugin_place_work_owned_func_t)(plugin_instance_t*, char*);
+typedef const char* (*plugin_place_work_many_owned_func_t)(plugin_instance_t*, char* const*, int);
+typedef int (*plugin_offer_owned_func_t)(plugin_instance_t*, char*);
+typedef const char* (*plugin_place_messages_owned_func_t)(plugin_instance_t*, char* const*, const plugin_header_t*, int);
+typedef int (*plugin_offer_message_owned_func_t)(plugin_instance_t*, char*, const plugin_header_t*);
+typedef const char* (*plugin_signal_func_t)(plugin_instance_t*, int);
+typedef void (*plugin_attach_func_t)(plugin_instance_t*, const plugin_link_t*);
+typedef const char* (*plugin_wait_finished_func_t)(plugin_instance_t*);
+typedef const char* (*plugin_transform_func_t)(const char*);
+typedef void (*plugin_transform_inplace_func_t)(char*, size_t);
+typedef unsigned int (*plugin_get_flags_func_t)(void);
 
-// Plugin structure exactly as specified in PDF page 8
+// Plugin structure as specified in PDF page 8, one per stage (the same .so may back several stages)
 typedef struct {
     plugin_init_func_t init;
     plugin_fini_func_t fini;
     plugin_place_work_func_t place_work;
+    plugin_place_work_owned_func_t place_work_owned;
+    plugin_place_work_many_owned_func_t place_work_many_owned;
+    plugin_offer_owned_func_t offer_owned;
+    plugin_place_messages_owned_func_t place_messages_owned; // optional - a line's header goes on with it
+    plugin_offer_message_owned_func_t offer_message_owned; // optional, like place_messages_owned
+    plugin_signal_func_t signal;
     plugin_attach_func_t attach;
     plugin_wait_finished_func_t wait_finished;
+    plugin_instance_t* instance; // this stage's own queue and thread
+    int replicas; // worker threads for this stage ("name*N" on the command line, 1 otherwise)
+    plugin_fused_stage_t* fused; // --fuse: this stage and the ones folded into it, run back to back by this instance
+    int num_fused;
+    int absorbed; // --fuse/--simplify: folded into an earlier stage or simplified away (no instance of its own)
+    unsigned long repeat; // --simplify: this stage stands for that many copies of itself in a row (1 otherwise)
     char* name;
     void* handle;
 } plugin_handle_t;
 
+// Command-line options (flags starting with "--", accepted anywhere on the command line)
+typedef struct {
+    int queue_mode; // PLUGIN_QUEUE_LOCKED, PLUGIN_QUEUE_SPSC or PLUGIN_QUEUE_RECORDS for every link
+    size_t queue_bytes; // --record-ring=BYTES: size of each record ring (0 = the SDK's default for queue_size)
+    int batch_size; // > 1: stages drain and forward up to batch_size items at a time
+    int unordered; // replicated stages forward results as they finish instead of in input order
+    int pool_workers; // > 0: run every stage on a shared work-stealing pool of this many threads
+    int shards; // > 0: sharded mode - this many threads each run the whole pure chain, no queues between stages
+    int fuse; // fold runs of adjacent pure stages into one stage (one queue and thread per run)
+    int simplify; // rewrite the chain before starting it (cancel flips, merge rotations, drop repeated idempotent stages)
+    char delimiter; // ends each input record ('\n' unless --delim is given)
+    const char* input; // --input: read this file (memory-mapped) instead of STDIN
+    int index; // --input: keep the file's line offsets in FILE.idx, and use them when it matches the file
+    unsigned long first_line; // --lines: first line to process (1-based, 0 = from the start)
+    unsigned long last_line; // --lines: last line to process (0 = to the end)
+    long char_delay_us; // --char-delay: typewriter's delay per character (0 = its default, PLUGIN_DELAY_NONE = none)
+    int virtual_clock; // timers fire in order without waiting (for tests)
+    int huge_pages; // back the message buffer pool with transparent huge pages
+    int buffer_stats; // print the buffer pool's counters when the pipeline is done
+} analyzer_options_t;
+
 
 
 // help message as a string variable
@@ -43,14 +93,41 @@ const char* help_message =
 "Usage: ./analyzer <queue_size> <plugin1> <plugin2> ... <pluginN>\n\n"
 "Arguments:\n"
 " queue_size\t Maximum number of items in each plugin's queue\n"
-" plugin1..N\t Names of plugins to load (without .so extension)\n\n"
+" plugin1..N\t Names of plugins to load (without .so extension)\n"
+"\t\t name*N runs N copies of a stateless stage in parallel, e.g. expander*4 (not with --pool)\n"
+"Input lines come from STDIN until an <END> line. Shutdown is not immediate: every line read before <END>\n"
+"still goes through all stages first, so it takes as long as the lines still queued.\n\n"
 "Available plugins:\n"
 " logger\t\t - Logs all strings that pass through\n"
 " typewriter\t - Simulates typewriter effect with delays\n"
 " uppercaser\t - Converts strings to uppercase\n"
+" lowercaser\t - Converts strings to lowercase\n"
+" rot13\t\t - Moves every letter 13 places along the alphabet\n"
 " rotator\t - Move every character to the right. Last character moves to the beginning.\n"
 " flipper\t - Reverses the order of characters\n"
 " expander\t - Expands each character with spaces\n\n"
+"Options:\n"
+" --spsc\t\t Use lock-free single-producer/single-consumer queues between stages\n"
+" --record-ring[=BYTES]\t Keep lines inline in one byte ring per stage (BYTES each, default 256 per queue_size)\n"
+"\t\t and let stages read them where they are, instead of queueing a separately allocated string per line\n"
+" --batch=N\t Move up to N items per queue operation between stages\n"
+" --unordered\t Let replicated stages pass results on as they finish (faster, input order not kept)\n"
+" --pool[=N]\t Run all stages on N shared worker threads instead of one thread each (default: one per CPU)\n"
+"\t\t - replicated stages (name*N) can't run on the pool\n"
+" --fuse\t\t Run adjacent pure plugins (uppercaser, lowercaser, rot13, rotator, flipper, expander) as one stage\n"
+" --simplify\t Simplify the chain first and print the plan: flipper flipper cancels out, k rotators rotate\n"
+"\t\t by k in one pass, uppercaser uppercaser runs once (not with --sharded)\n"
+" --delim=C\t Split the input into records at character C instead of newlines (\\n, \\t, \\r and \\0 accepted)\n"
+" --input=FILE\t Read FILE instead of STDIN (mapped into memory and split on all CPUs; the end of the file\n"
+"\t\t ends the input, every line in it is data - <END> too; not with --sharded)\n"
+" --index\t With --input: save the file's line offsets next to it (FILE.idx) and reuse them on later runs\n"
+" --lines=A-B\t With --input: only process lines A to B (1-based, B may be left out); instant with --index\n"
+" --char-delay=MS\t Typewriter's delay per character in milliseconds (default 100, 0 types instantly)\n"
+" --virtual-clock\t Run timers (typewriter's delays) in order without waiting for them\n"
+" --huge-pages\t Back the buffers lines move between stages in with transparent huge pages\n"
+" --buffer-stats\t Print the buffer pool's hits, misses and bytes in flight to STDERR at the end\n"
+" --sharded[=N]\t Split the input into shards and run the chain of pure plugins on N threads (default: one per CPU)\n"
+"\t\t with no queues between stages; logger/typewriter and everything after them run in input order\n\n"
 "Example:\n"
 " ./analyzer 20 uppercaser rotator logger\n"
 " echo 'hello' | ./analyzer 20 uppercaser rotator logger\n"
@@ -82,63 +159,738 @@ void print_usage(){
 //     printf(" echo '<END>' | ./analyzer 20 uppercaser rotator logger\n");
 // }
 
+// Helper function: parse one "--" option into options, returns 0 on success, -1 if unknown
+int parse_option(const char* arg, analyzer_options_t* options){
+    if(strcmp(arg, "--spsc") == 0){
+        options->queue_mode = PLUGIN_QUEUE_SPSC;
+        return 0;
+    }
+    if(strcmp(arg, "--unordered") == 0){
+        options->unordered = 1;
+        return 0;
+    }
+    if(strcmp(arg, "--pool") == 0){
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        options->pool_workers = cpus > 0 ? (int)cpus : 1;
+        return 0;
+    }
+    if(strncmp(arg, "--pool=", 7) == 0){
+        char* end = NULL;
+        long n = strtol(arg + 7, &end, 10);
+        if(end == arg + 7 || *end != '\0' || n <= 0 || n > 1024){
+            return -1;
+        }
+        options->pool_workers = (int)n;
+        return 0;
+    }
+    if(strcmp(arg, "--fuse") == 0){
+        options->fuse = 1;
+        return 0;
+    }
+    if(strcmp(arg, "--simplify") == 0){
+        options->simplify = 1;
+        return 0;
+    }
+    if(strcmp(arg, "--sharded") == 0){
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        options->shards = cpus > 0 ? (int)cpus : 1;
+        return 0;
+    }
+    if(strncmp(arg, "--sharded=", 10) == 0){
+        char* end = NULL;
+        long n = strtol(arg + 10, &end, 10);
+        if(end == arg + 10 || *end != '\0' || n <= 0 || n > 1024){
+            return -1;
+        }
+        options->shards = (int)n;
+        return 0;
+    }
+    if(strncmp(arg, "--input=", 8) == 0){
+        if(arg[8] == '\0'){
+            return -1;
+        }
+        options->input = arg + 8;
+        return 0;
+    }
+    if(strcmp(arg, "--index") == 0){
+        options->index = 1;
+        return 0;
+    }
+    if(strncmp(arg, "--lines=", 8) == 0){
+        char* end = NULL;
+        unsigned long first = strtoul(arg + 8, &end, 10);
+        if(end == arg + 8 || *end != '-' || first == 0 || arg[8] == '-'){
+            return -1;
+        }
+        unsigned long last = 0;
+        if(end[1] != '\0'){
+            const char* from = end + 1;
+            last = strtoul(from, &end, 10);
+            if(end == from || *end != '\0' || *from == '-' || last < first){
+                return -1;
+            }
+        }
+        options->first_line = first;
+        options->last_line = last;
+        return 0;
+    }
+    if(strncmp(arg, "--delim=", 8) == 0){
+        const char* value = arg + 8;
+        if(value[0] != '\0' && value[1] == '\0'){
+            options->delimiter = value[0];
+            return 0;
+        }
+        if(value[0] != '\\' || value[1] == '\0' || value[2] != '\0'){
+            return -1;
+        }
+        switch(value[1]){
+            case 'n':
+                options->delimiter = '\n';
+                return 0;
+            case 't':
+                options->delimiter = '\t';
+                return 0;
+            case 'r':
+                options->delimiter = '\r';
+                return 0;
+            case '0':
+                options->delimiter = '\0';
+                return 0;
+            default:
+                return -1;
+        }
+    }
+    if(strncmp(arg, "--char-delay=", 13) == 0){
+        char* end = NULL;
+        long ms = strtol(arg + 13, &end, 10);
+        if(end == arg + 13 || *end != '\0' || ms < 0 || ms > 60000){
+            return -1;
+        }
+        options->char_delay_us = ms == 0 ? PLUGIN_DELAY_NONE : ms * 1000;
+        return 0;
+    }
+    if(strcmp(arg, "--virtual-clock") == 0){
+        options->virtual_clock = 1;
+        return 0;
+    }
+    if(strcmp(arg, "--huge-pages") == 0){
+        options->huge_pages = 1;
+        return 0;
+    }
+    if(strcmp(arg, "--buffer-stats") == 0){
+        options->buffer_stats = 1;
+        return 0;
+    }
+    if(strcmp(arg, "--record-ring") == 0){
+        options->queue_mode = PLUGIN_QUEUE_RECORDS;
+        return 0;
+    }
+    if(strncmp(arg, "--record-ring=", 14) == 0){
+        char* end = NULL;
+        long n = strtol(arg + 14, &end, 10);
+        if(end == arg + 14 || *end != '\0' || n < 256 || n > 1024L * 1024 * 1024){
+            return -1;
+        }
+        options->queue_mode = PLUGIN_QUEUE_RECORDS;
+        options->queue_bytes = (size_t)n;
+        return 0;
+    }
+    if(strncmp(arg, "--batch=", 8) == 0){
+        char* end = NULL;
+        long n = strtol(arg + 8, &end, 10);
+        if(end == arg + 8 || *end != '\0' || n <= 0 || n > 1000000){
+            return -1;
+        }
+        options->batch_size = (int)n;
+        return 0;
+    }
+    return -1;
+}
+
+// Executor adapters: plugins see the pool only through plugin_executor_t
+static void pool_submit(void* pool, void (*run)(void*), void* arg){
+    work_pool_submit((work_pool_t*)pool, run, arg);
+}
+
+static void pool_defer(void* pool, void (*run)(void*), void* arg){
+    work_pool_defer((work_pool_t*)pool, run, arg);
+}
+
+// Output adapters: plugins see the writer only through plugin_output_t
+static int output_write(void* writer, const struct iovec* parts, int count){
+    return output_writer_append((output_writer_t*)writer, parts, count);
+}
+
+static void output_flush(void* writer){
+    output_writer_flush((output_writer_t*)writer);
+}
+
+// Timer adapter: plugins see the timer wheel only through plugin_timer_t
+static int timer_schedule(void* timer, unsigned long delay_us, void (*run)(void*), void* arg){
+    return timer_wheel_schedule((timer_wheel_t*)timer, delay_us, run, arg);
+}
+
+// Buffer adapters: plugins see the buffer pool only through plugin_buffers_t
+static char* buffers_alloc(void* pool, size_t size){
+    return buffer_pool_alloc((buffer_pool_t*)pool, size);
+}
+
+static void buffers_release(void* pool, char* buffer){
+    buffer_pool_free((buffer_pool_t*)pool, buffer);
+}
+
+// Ingest time of a line (CLOCK_MONOTONIC, nanoseconds - the clock the plugins measure latency against)
+static unsigned long long ingest_now_ns(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+// Helper function: can this stage be folded into a neighbour (pure, exports its transform, not replicated)
+static int stage_is_fusible(plugin_handle_t* plugin){
+    plugin_get_flags_func_t get_flags = dlsym(plugin->handle, "plugin_get_flags");
+    return plugin->replicas == 1 && get_flags && (get_flags() & PLUGIN_FLAG_PURE) &&
+           dlsym(plugin->handle, "plugin_transform") != NULL;
+}
+
+// Helper function: describe one stage to the instance that runs it
+static void fill_fused_stage(plugin_handle_t* plugin, plugin_fused_stage_t* stage){
+    // length-preserving stages also export a span version, which the fused stage runs without allocating
+    stage->transform = dlsym(plugin->handle, "plugin_transform");
+    stage->transform_span = dlsym(plugin->handle, "plugin_transform_span");
+    stage->transform_span_repeat = dlsym(plugin->handle, "plugin_transform_span_repeat");
+    // stages that only move chars around compose into one view instead, built once for the whole run
+    stage->transform_view = dlsym(plugin->handle, "plugin_transform_view");
+    stage->repeat = plugin->repeat;
+}
+
+// Helper function: fold every run of 2+ adjacent fusible stages into the run's first stage, returns 0 on success, -1 on failure
+// (stages the simplifier removed are skipped, so the stages on either side of them count as adjacent)
+int plan_fusion(plugin_handle_t* plugins, int num_plugins){
+    for(int i = 0; i < num_plugins; ){
+        if(plugins[i].absorbed || !stage_is_fusible(&plugins[i])){
+            i++;
+            continue;
+        }
+        int run = 0;
+        int end = i;
+        while(end < num_plugins && (plugins[end].absorbed || stage_is_fusible(&plugins[end]))){
+            run += !plugins[end].absorbed;
+            end++;
+        }
+        if(run < 2){
+            i = end;
+            continue;
+        }
+
+        plugins[i].fused = malloc(run * sizeof(plugin_fused_stage_t));
+        if(!plugins[i].fused){
+            return -1;
+        }
+        for(int k = i, n = 0; k < end; k++){
+            if(plugins[k].absorbed){
+                continue;
+            }
+            fill_fused_stage(&plugins[k], &plugins[i].fused[n++]);
+            plugins[k].absorbed = k > i;
+        }
+        plugins[i].num_fused = run;
+        i = end;
+    }
+    return 0;
+}
+
+// Helper function: the rule --simplify may apply when stage b directly follows stage a (a SIMPLIFY_* value)
+#define SIMPLIFY_NONE 0
+#define SIMPLIFY_DROP 1 // idempotent: b adds nothing
+#define SIMPLIFY_CANCEL 2 // involution: a and b undo each other
+#define SIMPLIFY_MERGE 3 // composable: a runs once more in place of b
+static int simplify_rule(plugin_handle_t* a, plugin_handle_t* b){
+    // only two plain (not replicated) stages of the same plugin
+    if(a->handle != b->handle || a->replicas != 1 || b->replicas != 1){
+        return SIMPLIFY_NONE;
+    }
+    plugin_get_flags_func_t get_flags = dlsym(a->handle, "plugin_get_flags");
+    unsigned int flags = get_flags ? get_flags() : 0;
+    if(!(flags & PLUGIN_FLAG_PURE)){
+        return SIMPLIFY_NONE;
+    }
+    if(flags & PLUGIN_FLAG_IDEMPOTENT){
+        return SIMPLIFY_DROP;
+    }
+    if(flags & PLUGIN_FLAG_INVOLUTION){
+        return SIMPLIFY_CANCEL;
+    }
+    if(dlsym(a->handle, "plugin_transform_span") && dlsym(a->handle, "plugin_transform_span_repeat")){
+        return SIMPLIFY_MERGE;
+    }
+    return SIMPLIFY_NONE;
+}
+
+// Helper function: rewrite the chain in place (removed stages are marked absorbed), returns 0 on success, -1 on failure
+// Works like bracket matching: a cancelled pair can make the stages around it adjacent, so those are tried next.
+int plan_simplify(plugin_handle_t* plugins, int num_plugins){
+    int* kept = malloc(num_plugins * sizeof(int));
+    if(!kept){
+        return -1;
+    }
+
+    int num_kept = 0;
+    for(int i = 0; i < num_plugins; i++){
+        plugin_handle_t* last = num_kept > 0 ? &plugins[kept[num_kept - 1]] : NULL;
+        int rule = last ? simplify_rule(last, &plugins[i]) : SIMPLIFY_NONE;
+        if(rule == SIMPLIFY_NONE){
+            kept[num_kept++] = i;
+            continue;
+        }
+
+        plugins[i].absorbed = 1;
+        if(rule == SIMPLIFY_CANCEL){
+            last->absorbed = 1;
+            num_kept--;
+        }
+        else if(rule == SIMPLIFY_MERGE){
+            last->repeat++;
+        }
+    }
+
+    // everything cancelled out - keep the first flip pair as one stage (something has to read the input)
+    if(num_kept == 0 && num_plugins > 0){
+        plugins[0].absorbed = 0;
+        plugins[0].repeat = 2;
+    }
+    free(kept);
+    return 0;
+}
+
+// Helper function: print the chain --simplify will run
+void print_plan(plugin_handle_t* plugins, int num_plugins, char** plugin_names){
+    int num_stages = 0;
+    fprintf(stderr, "Plan:");
+    for(int i = 0; i < num_plugins; i++){
+        if(plugins[i].absorbed){
+            continue;
+        }
+        num_stages++;
+        fprintf(stderr, " %s", plugin_names[i]);
+        if(plugins[i].replicas > 1){
+            fprintf(stderr, "*%d", plugins[i].replicas);
+        }
+        if(plugins[i].repeat != 1){
+            fprintf(stderr, "(x%lu)", plugins[i].repeat);
+        }
+    }
+    fprintf(stderr, " (%d stages, was %d)\n", num_stages, num_plugins);
+}
+
+// Helper function: give every stage the simplifier left repeated a one-stage list that carries the count
+// (fused stages already carry it), returns 0 on success, -1 on failure
+int plan_repeats(plugin_handle_t* plugins, int num_plugins){
+    for(int i = 0; i < num_plugins; i++){
+        if(plugins[i].absorbed || plugins[i].fused || plugins[i].repeat == 1){
+            continue;
+        }
+        plugins[i].fused = malloc(sizeof(plugin_fused_stage_t));
+        if(!plugins[i].fused){
+            return -1;
+        }
+        fill_fused_stage(&plugins[i], plugins[i].fused);
+        plugins[i].num_fused = 1;
+    }
+    return 0;
+}
+
+// Helper function: split a stage spec "name" or "name*N" in place, returns 0 on success, -1 if N is invalid
+int parse_stage(char* spec, int* replicas){
+    *replicas = 1;
+    char* star = strchr(spec, '*');
+    if(!star){
+        return 0;
+    }
+
+    char* end = NULL;
+    long n = strtol(star + 1, &end, 10);
+    if(end == star + 1 || *end != '\0' || n <= 0 || n > 1024){
+        return -1;
+    }
+    *star = '\0';
+    *replicas = (int)n;
+    return 0;
+}
+
+// Sharded mode: lines per shard (big enough that the ring's lock is taken once per many lines)
+#define SHARD_LINES 256
+
+// Sharded mode: life cycle of a shard slot
+#define SHARD_EMPTY 0 // free for the reader
+#define SHARD_FILLED 1 // holds input lines, waiting for a worker
+#define SHARD_DONE 2 // the pure prefix ran, waiting for the merge
+
+// Sharded mode: one slot of the shard ring
+typedef struct {
+    char* lines[SHARD_LINES]; // the shard's lines (NULL where a transform dropped one)
+    int count;
+    int state; // SHARD_EMPTY, SHARD_FILLED or SHARD_DONE
+} shard_t;
+
+// Sharded mode: shards move through the ring in input order - read, transformed by any worker, merged in order
+typedef struct {
+    shard_t* slots;
+    long num_slots;
+    pthread_mutex_t mutex;
+    pthread_cond_t changed; // broadcast on every state change
+    long num_shards; // shards published by the reader so far
+    long next_claim; // next shard a worker takes
+    int input_done; // the reader published its last shard
+    plugin_transform_func_t* transforms; // every stage's plugin_transform
+    plugin_transform_inplace_func_t* inplace; // every stage's plugin_transform_inplace (NULL where it has none)
+    int num_pure; // stages [0, num_pure) run on the workers
+    int num_stages; // stages [num_pure, num_stages) run on the merge thread
+} shard_ring_t;
+
+// Sharded mode: run stages [first, last) on one line, returns the result (NULL if a stage dropped it), always consumes line
+static char* shard_run_stages(shard_ring_t* ring, char* line, int first, int last){
+    size_t len = 0;
+    int len_known = 0;
+    for(int i = first; i < last && line != NULL; i++){
+        // the line is ours: a length-preserving stage changes it where it is (counted once for a run of them)
+        if(ring->inplace[i] != NULL){
+            if(!len_known){
+                len = strlen(line);
+                len_known = 1;
+            }
+            ring->inplace[i](line, len);
+            continue;
+        }
+        len_known = 0;
+        char* result = (char*)ring->transforms[i](line);
+        free(line);
+        line = result;
+    }
+    return line;
+}
+
+// Sharded mode worker: claim the next filled shard, run the pure prefix on every line, hand it to the merge
+static void* shard_worker(void* arg){
+    shard_ring_t* ring = (shard_ring_t*)arg;
+
+    pthread_mutex_lock(&ring->mutex);
+    while(1){
+        // shards are claimed in order, so the merge never waits on a shard nobody took
+        while(ring->next_claim >= ring->num_shards && !ring->input_done){
+            pthread_cond_wait(&ring->changed, &ring->mutex);
+        }
+        if(ring->next_claim >= ring->num_shards){
+            break;
+        }
+        shard_t* shard = &ring->slots[ring->next_claim % ring->num_slots];
+        ring->next_claim++;
+        pthread_mutex_unlock(&ring->mutex);
+
+        // the hot loop: no queues, no locks, no other thread touches this shard now
+        for(int i = 0; i < shard->count; i++){
+            shard->lines[i] = shard_run_stages(ring, shard->lines[i], 0, ring->num_pure);
+        }
+
+        pthread_mutex_lock(&ring->mutex);
+        shard->state = SHARD_DONE;
+        pthread_cond_broadcast(&ring->changed);
+    }
+    pthread_mutex_unlock(&ring->mutex);
+    return NULL;
+}
+
+// Sharded mode merge: take shards back in input order, run the remaining (side-effecting) stages, free the slot
+static void* shard_merge(void* arg){
+    shard_ring_t* ring = (shard_ring_t*)arg;
+
+    for(long next = 0; ; next++){
+        shard_t* shard = &ring->slots[next % ring->num_slots];
+
+        pthread_mutex_lock(&ring->mutex);
+        while(next < ring->num_shards ? shard->state != SHARD_DONE : !ring->input_done){
+            pthread_cond_wait(&ring->changed, &ring->mutex);
+        }
+        int finished = next >= ring->num_shards;
+        pthread_mutex_unlock(&ring->mutex);
+        if(finished){
+            break;
+        }
+
+        for(int i = 0; i < shard->count; i++){
+            free(shard_run_stages(ring, shard->lines[i], ring->num_pure, ring->num_stages));
+            shard->lines[i] = NULL;
+        }
+
+        pthread_mutex_lock(&ring->mutex);
+        shard->count = 0;
+        shard->state = SHARD_EMPTY;
+        pthread_cond_broadcast(&ring->changed);
+        pthread_mutex_unlock(&ring->mutex);
+    }
+    return NULL;
+}
+
+// Sharded mode reader: publish the shard being filled (caller holds nothing)
+static void shard_publish(shard_ring_t* ring, shard_t* shard, int last){
+    pthread_mutex_lock(&ring->mutex);
+    if(shard != NULL && shard->count > 0){
+        shard->state = SHARD_FILLED;
+        ring->num_shards++;
+    }
+    if(last){
+        ring->input_done = 1;
+    }
+    pthread_cond_broadcast(&ring->changed);
+    pthread_mutex_unlock(&ring->mutex);
+}
+
+// Sharded mode reader: wait until the slot for the next shard is free
+static shard_t* shard_next_slot(shard_ring_t* ring){
+    pthread_mutex_lock(&ring->mutex);
+    shard_t* shard = &ring->slots[ring->num_shards % ring->num_slots];
+    while(shard->state != SHARD_EMPTY){
+        pthread_cond_wait(&ring->changed, &ring->mutex);
+    }
+    pthread_mutex_unlock(&ring->mutex);
+    return shard;
+}
+
+// Run the whole pipeline in sharded mode (replaces init/attach/place_work/wait), returns 0 on success, exit code on failure
+int run_sharded(plugin_handle_t* plugins, int num_plugins, char** plugin_names, int num_workers, char delimiter){
+    shard_ring_t ring = { .num_slots = 2 * num_workers + 2, .num_stages = num_plugins };
+
+    ring.transforms = malloc(num_plugins * sizeof(plugin_transform_func_t));
+    ring.inplace = malloc(num_plugins * sizeof(plugin_transform_inplace_func_t));
+    ring.slots = calloc(ring.num_slots, sizeof(shard_t));
+    pthread_t* workers = malloc(num_workers * sizeof(pthread_t));
+    if(!ring.transforms || !ring.inplace || !ring.slots || !workers){
+        fprintf(stderr, "Failed to allocate memory for shards\n");
+        free(ring.transforms);
+        free(ring.inplace);
+        free(ring.slots);
+        free(workers);
+        return 1;
+    }
+
+    // the longest prefix of pure plugins runs on the workers, the rest keeps input order on the merge thread
+    int prefix_open = 1;
+    for(int i = 0; i < num_plugins; i++){
+        ring.transforms[i] = dlsym(plugins[i].handle, "plugin_transform");
+        ring.inplace[i] = dlsym(plugins[i].handle, "plugin_transform_inplace");
+        plugin_get_flags_func_t get_flags = dlsym(plugins[i].handle, "plugin_get_flags");
+        if(!ring.transforms[i]){
+            fprintf(stderr, "Plugin %s missing required functions\n", plugin_names[i]);
+            free(ring.transforms);
+            free(ring.inplace);
+            free(ring.slots);
+            free(workers);
+            return 1;
+        }
+        if(prefix_open && get_flags && (get_flags() & PLUGIN_FLAG_PURE)){
+            ring.num_pure = i + 1;
+        }
+        else{
+            prefix_open = 0;
+        }
+    }
+
+    pthread_mutex_init(&ring.mutex, NULL);
+    pthread_cond_init(&ring.changed, NULL);
+
+    pthread_t merger;
+    int started = 0;
+    int merger_started = pthread_create(&merger, NULL, shard_merge, &ring) == 0;
+    int failed = !merger_started;
+    for(; !failed && started < num_workers; started++){
+        if(pthread_create(&workers[started], NULL, shard_worker, &ring) != 0){
+            failed = 1;
+            break;
+        }
+    }
+
+    // read STDIN into shards until <END> (same line rules as the queued pipeline)
+    record_reader_t reader;
+    const char* reader_error = failed ? NULL : record_reader_init(&reader, STDIN_FILENO, delimiter);
+    if(reader_error){
+        fprintf(stderr, "Failed to start input reader: %s\n", reader_error);
+    }
+    shard_t* shard = failed || reader_error ? NULL : shard_next_slot(&ring);
+    char* owned_line = NULL;
+    int status = 0;
+    while(shard && (status = record_reader_next(&reader, &owned_line, NULL)) != 0){
+        if(status < 0){
+            fprintf(stderr, "Failed to place work: Failed to read line\n");
+            continue;
+        }
+        if(strcmp(owned_line, "<END>") == 0){
+            free(owned_line);
+            break;
+        }
+
+        shard->lines[shard->count++] = owned_line;
+        if(shard->count == SHARD_LINES){
+            shard_publish(&ring, shard, 0);
+            shard = shard_next_slot(&ring);
+        }
+    }
+    shard_publish(&ring, shard, 1);
+    if(!failed && !reader_error){
+        record_reader_destroy(&reader);
+    }
+
+    for(int i = 0; i < started; i++){
+        pthread_join(workers[i], NULL);
+    }
+    if(merger_started){
+        pthread_join(merger, NULL);
+    }
+    if(failed){
+        fprintf(stderr, "Failed to start shard threads\n");
+    }
+
+    pthread_mutex_destroy(&ring.mutex);
+    pthread_cond_destroy(&ring.changed);
+    free(ring.transforms);
+    free(ring.inplace);
+    free(ring.slots);
+    free(workers);
+    return failed || reader_error ? 2 : 0;
+}
+
 int main(int argc, char *argv[]){
     // Step 1: Parse and validate command-line arguments
-    if(argc < 3) {
+    // options may appear anywhere; everything else is positional (queue size, then plugin names)
+    analyzer_options_t options = { .queue_mode = PLUGIN_QUEUE_LOCKED, .batch_size = 1, .delimiter = '\n' };
+    char** args = malloc(argc * sizeof(char*));
+    if(!args){
+        fprintf(stderr, "Failed to allocate memory for arguments\n");
+        return 1;
+    }
+    int num_args = 0;
+    for(int i = 1; i < argc; i++){
+        if(strncmp(argv[i], "--", 2) == 0){
+            if(parse_option(argv[i], &options) != 0){
+                fprintf(stderr, "Invalid option: %s\n", argv[i]);
+                print_usage();
+                free(args);
+                return 1;
+            }
+            continue;
+        }
+        args[num_args++] = argv[i];
+    }
+
+    if((options.index || options.first_line > 0) && !options.input){
+        fprintf(stderr, "Invalid option: %s needs --input\n", options.index ? "--index" : "--lines");
+        print_usage();
+        free(args);
+        return 1;
+    }
+
+    if((options.simplify || options.input) && options.shards > 0){
+        fprintf(stderr, "Invalid option: %s cannot be combined with --sharded\n", options.simplify ? "--simplify" : "--input");
+        print_usage();
+        free(args);
+        return 1;
+    }
+
+    if(num_args < 2) {
         fprintf(stderr, "At least one plugin must be specified\n");
         print_usage();
+        free(args);
         return 1;
     }
     
     // Parse queue_size robustly and ensure positive integer
     char* endptr = NULL;
-    long qs = strtol(argv[1], &endptr, 10);
-    if(endptr == argv[1] || *endptr != '\0' || qs <= 0) {
+    long qs = strtol(args[0], &endptr, 10);
+    if(endptr == args[0] || *endptr != '\0' || qs <= 0) {
         fprintf(stderr, "Queue size must be positive\n");
         print_usage();
+        free(args);
         return 1;
     }
     int queue_size = (int)qs;
     
-    // Validate plugin names
-    for(int i = 2; i < argc; i++) {
-        if(!is_valid_plugin(argv[i])) {
-            fprintf(stderr, "Unknown plugin: %s\n", argv[i]);
+    // Validate plugin names (and strip the "*N" replica suffix off them)
+    char** plugin_names = args + 1;
+    int num_plugins = num_args - 1;
+    int* replicas = malloc(num_plugins * sizeof(int));
+    if(!replicas){
+        fprintf(stderr, "Failed to allocate memory for arguments\n");
+        free(args);
+        return 1;
+    }
+    for(int i = 0; i < num_plugins; i++) {
+        if(parse_stage(plugin_names[i], &replicas[i]) != 0) {
+            fprintf(stderr, "Invalid replica count: %s\n", plugin_names[i]);
+            print_usage();
+            free(replicas);
+            free(args);
+            return 1;
+        }
+        // replicas are threads of their own, pool tasks share the workers - caught here, before anything is loaded
+        if(replicas[i] > 1 && options.pool_workers > 0) {
+            fprintf(stderr, "Replicated stage %s*%d can't run with --pool (drop *%d or --pool)\n", plugin_names[i], replicas[i], replicas[i]);
+            print_usage();
+            free(replicas);
+            free(args);
+            return 1;
+        }
+        if(!is_valid_plugin(plugin_names[i])) {
+            fprintf(stderr, "Unknown plugin: %s\n", plugin_names[i]);
             print_usage();
+            free(replicas);
+            free(args);
             return 1;
         }
     }
     
-    int num_plugins = argc - 2;
-    
     // Step 2: Load plugin shared objects
     plugin_handle_t* plugins = malloc(num_plugins * sizeof(plugin_handle_t));
     if(!plugins){
         fprintf(stderr, "Failed to allocate memory for plugins\n");
+        free(replicas);
+        free(args);
         return 1;
     }
     
     for(int i = 0; i < num_plugins; i++){
         char plugin_path[256];
-        snprintf(plugin_path, sizeof(plugin_path), "output/%s.so", argv[i + 2]);
+        snprintf(plugin_path, sizeof(plugin_path), "output/%s.so", plugin_names[i]);
         
         plugins[i].handle = dlopen(plugin_path, RTLD_NOW | RTLD_LOCAL);
         if(!plugins[i].handle){
-            fprintf(stderr, "Failed to load plugin %s: %s\n", argv[i + 2], dlerror());
+            fprintf(stderr, "Failed to load plugin %s: %s\n", plugin_names[i], dlerror());
             // Cleanup previously loaded plugins
             for(int j = 0; j < i; j++){
                 dlclose(plugins[j].handle);
             }
             free(plugins);
+            free(replicas);
+            free(args);
             return 1;
         }
         
-        // Load plugin functions
-        plugins[i].init = dlsym(plugins[i].handle, "plugin_init");
-        plugins[i].fini = dlsym(plugins[i].handle, "plugin_fini");
-        plugins[i].place_work = dlsym(plugins[i].handle, "plugin_place_work");
-        plugins[i].attach = dlsym(plugins[i].handle, "plugin_attach");
-        plugins[i].wait_finished = dlsym(plugins[i].handle, "plugin_wait_finished");
+        // Load plugin functions (dlopen of the same path returns the same handle, instances keep stages apart)
+        plugins[i].init = dlsym(plugins[i].handle, "plugin_instance_init");
+        plugins[i].fini = dlsym(plugins[i].handle, "plugin_instance_fini");
+        plugins[i].place_work = dlsym(plugins[i].handle, "plugin_instance_place_work");
+        plugins[i].place_work_owned = dlsym(plugins[i].handle, "plugin_instance_place_work_owned");
+        plugins[i].place_work_many_owned = dlsym(plugins[i].handle, "plugin_instance_place_work_many_owned");
+        plugins[i].offer_owned = dlsym(plugins[i].handle, "plugin_instance_offer_owned");
+        plugins[i].place_messages_owned = dlsym(plugins[i].handle, "plugin_instance_place_messages_owned");
+        plugins[i].offer_message_owned = dlsym(plugins[i].handle, "plugin_instance_offer_message_owned");
+        plugins[i].signal = dlsym(plugins[i].handle, "plugin_instance_signal");
+        plugins[i].attach = dlsym(plugins[i].handle, "plugin_instance_attach");
+        plugins[i].wait_finished = dlsym(plugins[i].handle, "plugin_instance_wait_finished");
+        plugins[i].instance = NULL;
+        plugins[i].replicas = replicas[i];
+        plugins[i].fused = NULL;
+        plugins[i].num_fused = 0;
+        plugins[i].absorbed = 0;
+        plugins[i].repeat = 1;
         
         // Get plugin name and store it
         const char* (*get_name)(void) = dlsym(plugins[i].handle, "plugin_get_name");
@@ -149,88 +901,377 @@ int main(int argc, char *argv[]){
                 strcpy(plugins[i].name, plugin_name);
             }
         } else {
-            plugins[i].name = malloc(strlen(argv[i + 2]) + 1);
+            plugins[i].name = malloc(strlen(plugin_names[i]) + 1);
             if(plugins[i].name) {
-                strcpy(plugins[i].name, argv[i + 2]);
+                strcpy(plugins[i].name, plugin_names[i]);
             }
         }
         
-        if(!plugins[i].init || !plugins[i].place_work || !plugins[i].attach || 
-           !plugins[i].wait_finished || !plugins[i].fini){
-            fprintf(stderr, "Plugin %s missing required functions\n", argv[i + 2]);
+        if(!plugins[i].init || !plugins[i].place_work || !plugins[i].place_work_owned || !plugins[i].attach || 
+           !plugins[i].signal || !plugins[i].wait_finished || !plugins[i].fini){
+            fprintf(stderr, "Plugin %s missing required functions\n", plugin_names[i]);
             // Cleanup
             for(int j = 0; j <= i; j++){
                 dlclose(plugins[j].handle);
             }
             free(plugins);
+            free(replicas);
+            free(args);
             return 1;
         }
     }
+    free(replicas);
+
+    // Sharded mode replaces steps 3-6: no instances, no queues - the transforms are called directly
+    if(options.shards > 0){
+        int status = run_sharded(plugins, num_plugins, plugin_names, options.shards, options.delimiter);
+        for(int i = 0; i < num_plugins; i++){
+            free(plugins[i].name);
+            dlclose(plugins[i].handle);
+        }
+        free(plugins);
+        free(args);
+        if(status != 0){
+            return status;
+        }
+        printf("Pipeline shutdown complete\n");
+        return 0;
+    }
     
-    // Step 3: Initialize each plugin
+    // Step 3: Simplify the chain and plan fused stages, then initialize each plugin that still has a stage of its own
+    // (on the shared pool if asked to)
+    int planned = !options.simplify || plan_simplify(plugins, num_plugins) == 0;
+    if(planned && options.simplify){
+        print_plan(plugins, num_plugins, plugin_names);
+    }
+    if(!planned || (options.fuse && plan_fusion(plugins, num_plugins) != 0) || plan_repeats(plugins, num_plugins) != 0){
+        fprintf(stderr, "Failed to allocate memory for the stage plan\n");
+        for(int j = 0; j < num_plugins; j++){
+            free(plugins[j].fused);
+            free(plugins[j].name);
+            dlclose(plugins[j].handle);
+        }
+        free(plugins);
+        free(args);
+        return 2;
+    }
+    // --input: map the file before the first stage starts - it is told its lines are lent to it, not handed over
+    mapped_input_t mapped;
+    char index_path[4096];
+    if(options.input){
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        snprintf(index_path, sizeof(index_path), "%s.idx", options.input);
+        const char* error = mapped_input_open(&mapped, options.input, options.delimiter, cpus > 0 ? (int)cpus : 1,
+                                              options.index ? index_path : NULL,
+                                              options.first_line > 0 ? options.first_line - 1 : 0);
+        if(error){
+            fprintf(stderr, "Failed to read %s: %s\n", options.input, error);
+            for(int j = 0; j < num_plugins; j++){
+                free(plugins[j].fused);
+                free(plugins[j].name);
+                dlclose(plugins[j].handle);
+            }
+            free(plugins);
+            free(args);
+            return 1;
+        }
+    }
+    work_pool_t pool;
+    plugin_executor_t executor = { .pool = &pool, .submit = pool_submit, .defer = pool_defer };
+    if(options.pool_workers > 0){
+        const char* error = work_pool_init(&pool, options.pool_workers);
+        if(error){
+            fprintf(stderr, "Failed to start worker pool: %s\n", error);
+            if(options.input){
+                mapped_input_close(&mapped);
+            }
+            for(int j = 0; j < num_plugins; j++){
+                free(plugins[j].fused);
+                free(plugins[j].name);
+                dlclose(plugins[j].handle);
+            }
+            free(plugins);
+            free(args);
+            return 2;
+        }
+    }
+    // what logger/typewriter print goes to STDOUT through one writer thread, many lines per writev
+    output_writer_t writer;
+    plugin_output_t output = { .writer = &writer, .write = output_write, .flush = output_flush };
+    const char* writer_error = output_writer_init(&writer, STDOUT_FILENO);
+    if(writer_error){
+        fprintf(stderr, "Failed to start output writer: %s\n", writer_error);
+        if(options.pool_workers > 0){
+            work_pool_destroy(&pool);
+        }
+        if(options.input){
+            mapped_input_close(&mapped);
+        }
+        for(int j = 0; j < num_plugins; j++){
+            free(plugins[j].fused);
+            free(plugins[j].name);
+            dlclose(plugins[j].handle);
+        }
+        free(plugins);
+        free(args);
+        return 2;
+    }
+    // typewriter waits on these timers instead of sleeping on a thread
+    timer_wheel_t wheel;
+    plugin_timer_t timer = { .timer = &wheel, .schedule = timer_schedule };
+    const char* wheel_error = timer_wheel_init(&wheel, options.virtual_clock);
+    if(wheel_error){
+        fprintf(stderr, "Failed to start timer: %s\n", wheel_error);
+        output_writer_destroy(&writer);
+        if(options.pool_workers > 0){
+            work_pool_destroy(&pool);
+        }
+        if(options.input){
+            mapped_input_close(&mapped);
+        }
+        for(int j = 0; j < num_plugins; j++){
+            free(plugins[j].fused);
+            free(plugins[j].name);
+            dlclose(plugins[j].handle);
+        }
+        free(plugins);
+        free(args);
+        return 2;
+    }
+    // lines and results come from per-thread caches of size-classed buffers, freed back to whichever thread made them
+    buffer_pool_t buffer_pool;
+    plugin_buffers_t buffers = { .pool = &buffer_pool, .alloc = buffers_alloc, .release = buffers_release };
+    const char* buffer_error = buffer_pool_init(&buffer_pool, options.huge_pages);
+    if(buffer_error){
+        fprintf(stderr, "Failed to set up buffer pool: %s\n", buffer_error);
+        timer_wheel_destroy(&wheel);
+        output_writer_destroy(&writer);
+        if(options.pool_workers > 0){
+            work_pool_destroy(&pool);
+        }
+        if(options.input){
+            mapped_input_close(&mapped);
+        }
+        for(int j = 0; j < num_plugins; j++){
+            free(plugins[j].fused);
+            free(plugins[j].name);
+            dlclose(plugins[j].handle);
+        }
+        free(plugins);
+        free(args);
+        return 2;
+    }
+    int previous = -1; // the last stage that got an instance
     for(int i = 0; i < num_plugins; i++){
-        const char* error = plugins[i].init(queue_size);
+        if(plugins[i].absorbed){
+            continue;
+        }
+        plugin_config_t config = {
+            .queue_size = queue_size,
+            .queue_mode = options.queue_mode,
+            .batch_size = options.batch_size,
+            .replicas = plugins[i].replicas,
+            .unordered = options.unordered,
+            .executor = options.pool_workers > 0 ? &executor : NULL,
+            .fused = plugins[i].fused,
+            .num_fused = plugins[i].num_fused,
+            .release_input = options.input && previous < 0 ? mapped_input_release : NULL,
+            .release_arg = &mapped,
+            .output = &output,
+            .timer = &timer,
+            .char_delay_us = options.char_delay_us,
+            .buffers = &buffers,
+            .queue_bytes = options.queue_bytes
+        };
+        // a replicated stage has several consumers, and an unordered one feeds the next stage from several producers
+        if(plugins[i].replicas > 1 || (previous >= 0 && plugins[previous].replicas > 1 && options.unordered)){
+            config.queue_mode = PLUGIN_QUEUE_LOCKED;
+        }
+        previous = i;
+        const char* error = plugins[i].init(&config, &plugins[i].instance);
         if(error){
-            fprintf(stderr, "Failed to initialize plugin %s: %s\n", argv[i + 2], error);
+            fprintf(stderr, "Failed to initialize plugin %s: %s\n", plugin_names[i], error);
             // Cleanup initialized plugins
             for(int j = 0; j < i; j++){
-                plugins[j].fini();
+                if(!plugins[j].absorbed){
+                    plugins[j].fini(plugins[j].instance);
+                }
+            }
+            if(options.pool_workers > 0){
+                work_pool_destroy(&pool);
+            }
+            timer_wheel_destroy(&wheel);
+            output_writer_destroy(&writer);
+            buffer_pool_destroy(&buffer_pool);
+            if(options.input){
+                mapped_input_close(&mapped);
             }
             for(int j = 0; j < num_plugins; j++){
+                free(plugins[j].fused);
+                free(plugins[j].name);
                 dlclose(plugins[j].handle);
             }
             free(plugins);
+            free(args);
             return 2;
         }
     }
     
-    // Step 4: Attach plugins (chain them together)
+    // Step 4: Attach plugins (chain them together, skipping stages that were folded in or simplified away)
     for(int i = 0; i < num_plugins - 1; i++){
-        plugins[i].attach(plugins[i + 1].place_work);
+        if(plugins[i].absorbed){
+            continue;
+        }
+        int n = i + 1;
+        while(n < num_plugins && plugins[n].absorbed){
+            n++;
+        }
+        if(n == num_plugins){
+            break;
+        }
+        plugin_link_t next = {
+            .instance = plugins[n].instance,
+            .place_work = plugins[n].place_work,
+            .place_work_owned = plugins[n].place_work_owned,
+            .place_work_many_owned = options.batch_size > 1 ? plugins[n].place_work_many_owned : NULL,
+            .offer_owned = plugins[n].offer_owned,
+            .place_messages_owned = plugins[n].place_messages_owned,
+            .offer_message_owned = plugins[n].offer_message_owned,
+            .signal = plugins[n].signal,
+            // long lines go on as ropes to a stage that takes them (a fused one runs its stages on strings,
+            // a record ring stores chars)
+            .ropes = plugins[n].num_fused == 0 && options.queue_mode != PLUGIN_QUEUE_RECORDS &&
+                     dlsym(plugins[n].handle, "plugin_transform_rope") != NULL
+        };
+        plugins[i].attach(plugins[i].instance, &next);
     }
     
-    // Step 5: Read STDIN lines and send to first plugin until <END>
-    char line[1025]; // 1024 + 1 for null terminator
-    while(fgets(line, sizeof(line), stdin)){
-        // Remove newline if present
-        line[strcspn(line, "\n")] = '\0';
-        
-        // Check for shutdown signal
-        if(strcmp(line, "<END>") == 0){
-            const char* error = plugins[0].place_work("<END>");
-            if(error){
-                fprintf(stderr, "Failed to send shutdown signal: %s\n", error);
+    // Step 5: Read STDIN (or the --input file) lines and send to first plugin until <END>
+    // (the simplifier may have removed the chain's head)
+    plugin_handle_t* first = &plugins[0];
+    while(first->absorbed){
+        first++;
+    }
+    // STDIN: lines of any length, read in large blocks by a reader thread while this thread hands the previous block out
+    // --input: lines are slices of the mapped file, lent to the first stage (it gives them back through release_input)
+    record_reader_t reader;
+    const char* reader_error = options.input ? NULL : record_reader_init(&reader, STDIN_FILENO, options.delimiter);
+    if(reader_error){
+        fprintf(stderr, "Failed to start input reader: %s\n", reader_error);
+    }
+    else if(!options.input){
+        record_reader_set_buffers(&reader, &buffer_pool, buffers_alloc);
+    }
+    int reading = reader_error == NULL;
+    unsigned long remaining = options.last_line > 0 ? options.last_line - (options.first_line > 0 ? options.first_line : 1) + 1 : 0;
+    // every line's header is stamped here, once: its place in the input and when it was read - the stages pass it on
+    unsigned long seq = 0;
+    while(reading){
+        // --lines: the range is done, like the end of the file
+        if(options.last_line > 0 && remaining-- == 0){
+            reading = 0;
+            break;
+        }
+        char* owned_line = NULL;
+        size_t len = ITEM_META_LEN_UNKNOWN; // a mapped line isn't counted
+        int status = options.input ? mapped_input_next(&mapped, &owned_line) : record_reader_next(&reader, &owned_line, &len);
+        if(status == 0){
+            // the end of a file ends the input by itself, STDIN still needs its <END>
+            reading = !options.input;
+            // the whole file went by - the index can be written now (the lines themselves may still be in flight)
+            const char* index_error = options.index ? mapped_input_save_index(&mapped) : NULL;
+            if(index_error){
+                fprintf(stderr, "Failed to save line index %s: %s\n", index_path, index_error);
             }
             break;
         }
+        if(status < 0){
+            fprintf(stderr, "Failed to place work: Failed to read line\n");
+            continue;
+        }
         
-        // Send line to first plugin
-        const char* error = plugins[0].place_work(line);
+        // Check for shutdown signal (STDIN only - a file's lines are all data, its end is the end of the input)
+        if(!options.input && strcmp(owned_line, "<END>") == 0){
+            buffer_pool_free(&buffer_pool, owned_line);
+            reading = 0;
+            break;
+        }
+        
+        // Send line to first plugin - allocated once by the reader (or lent by the mapping), then moved through the chain
+        plugin_header_t header = { len, seq++, ingest_now_ns() };
+        const char* error = first->place_messages_owned != NULL
+                            ? first->place_messages_owned(first->instance, &owned_line, &header, 1)
+                            : first->place_work_owned(first->instance, owned_line);
         if(error){
+            if(options.input){
+                mapped_input_release(&mapped, owned_line);
+            }
+            else{
+                buffer_pool_free(&buffer_pool, owned_line);
+            }
             fprintf(stderr, "Failed to place work: %s\n", error);
         }
     }
+    if(!options.input && !reader_error){
+        record_reader_destroy(&reader);
+    }
+    // <END> seen, or no reader could be started (shut down what was started anyway) - END goes on the first stage's
+    // control lane, behind every line placed so far, and each stage passes it on
+    if(!reading){
+        const char* error = first->signal(first->instance, PLUGIN_CONTROL_END);
+        if(error){
+            fprintf(stderr, "Failed to send shutdown signal: %s\n", error);
+        }
+    }
     
     // Step 6: Wait for plugins to finish (in order)
     for(int i = 0; i < num_plugins; i++){
-        const char* error = plugins[i].wait_finished();
+        if(plugins[i].absorbed){
+            continue;
+        }
+        const char* error = plugins[i].wait_finished(plugins[i].instance);
         if(error){
-            fprintf(stderr, "Plugin %s wait_finished failed: %s\n", argv[i + 2], error);
+            fprintf(stderr, "Plugin %s wait_finished failed: %s\n", plugin_names[i], error);
         }
     }
     
     // Step 7: Cleanup - plugin_fini, free memory, dlclose
     for(int i = 0; i < num_plugins; i++){
-        const char* error = plugins[i].fini();
+        const char* error = plugins[i].absorbed ? NULL : plugins[i].fini(plugins[i].instance);
         if(error){
-            fprintf(stderr, "Plugin %s cleanup failed: %s\n", plugins[i].name ? plugins[i].name : argv[i + 2], error);
+            fprintf(stderr, "Plugin %s cleanup failed: %s\n", plugins[i].name ? plugins[i].name : plugin_names[i], error);
         }
+        free(plugins[i].fused);
         if(plugins[i].name) {
             free(plugins[i].name);
         }
+    }
+    // pool workers may still be returning out of a plugin's code - stop them before unloading it
+    if(options.pool_workers > 0){
+        work_pool_destroy(&pool);
+    }
+    // every line was typed before its stage took END - this only stops the thread (before the plugins are unloaded)
+    timer_wheel_destroy(&wheel);
+    // every stage flushed on END - this only writes what came after (nothing, normally) and stops the thread
+    if(output_writer_destroy(&writer) != 0){
+        fprintf(stderr, "Failed to write output\n");
+    }
+    // every stage is gone, so every buffer is back (whatever is still in flight was lost on the way)
+    if(options.buffer_stats){
+        buffer_pool_stats_t stats;
+        buffer_pool_stats(&buffer_pool, &stats);
+        fprintf(stderr, "Buffer pool: %lu hits, %lu misses, %ld bytes in flight\n", stats.hits, stats.misses, stats.in_flight);
+    }
+    buffer_pool_destroy(&buffer_pool);
+    // every stage is gone, so every lent line is back
+    if(options.input){
+        mapped_input_close(&mapped);
+    }
+    for(int i = 0; i < num_plugins; i++){
         dlclose(plugins[i].handle);
     }
     free(plugins);
+    free(args);
     
     // Step 8: Print success message and exit
     printf("Pipeline shutdown complete\n");
@@ -11,6 +11,10 @@
 #include <assert.h>
 
 #include "plugins/plugin_common.h"
+#include "plugins/sync/work_pool.h"
+#include "plugins/sync/timer_wheel.h"
+#include "plugins/sync/buffer_pool.h"
+#include "plugins/byte_map.h"
 
 // Test configuration
 #define TEST_QUEUE_SIZE 5
@@ -105,7 +109,7 @@ void test_work_processing() {
 // Test 7: Plugin shutdown sequence
 void test_shutdown() {
     // Send shutdown signal
-    const char* place_result = plugin_place_work("<END>");
+    const char* place_result = plugin_signal(PLUGIN_CONTROL_END);
     int place_ok = (place_result == NULL);
     
     // Wait for completion
@@ -139,7 +143,7 @@ void test_reinit() {
     
     // Cleanup for next tests
     if (passed) {
-        plugin_place_work("<END>");
+        plugin_signal(PLUGIN_CONTROL_END);
         plugin_wait_finished();
         plugin_fini();
     }
@@ -181,7 +185,7 @@ void test_thread_safety() {
     }
     
     // Shutdown
-    plugin_place_work("<END>");
+    plugin_signal(PLUGIN_CONTROL_END);
     plugin_wait_finished();
     const char* fini_result = plugin_fini();
     
@@ -228,7 +232,7 @@ void test_queue_boundaries() {
     usleep(50000); // 50ms
     
     // Shutdown
-    plugin_place_work("<END>");
+    plugin_signal(PLUGIN_CONTROL_END);
     plugin_wait_finished();
     const char* fini_result = plugin_fini();
     
@@ -245,9 +249,9 @@ void test_multiple_shutdown() {
     }
     
     // Send multiple END signals
-    plugin_place_work("<END>");
-    plugin_place_work("<END>");
-    plugin_place_work("<END>");
+    plugin_signal(PLUGIN_CONTROL_END);
+    plugin_signal(PLUGIN_CONTROL_END);
+    plugin_signal(PLUGIN_CONTROL_END);
     
     // Should still shutdown gracefully
     const char* wait_result = plugin_wait_finished();
@@ -266,7 +270,7 @@ void test_operations_during_shutdown() {
     }
     
     // Start shutdown
-    plugin_place_work("<END>");
+    plugin_signal(PLUGIN_CONTROL_END);
     
     // Try operations during shutdown (should still work until fully shut down)
     const char* place_result = plugin_place_work("late_message");
@@ -295,7 +299,7 @@ void test_transform_error_handling() {
     usleep(50000); // Give time for processing
     
     // Should still be able to shutdown cleanly even with failing transforms
-    plugin_place_work("<END>");
+    plugin_signal(PLUGIN_CONTROL_END);
     const char* wait_result = plugin_wait_finished();
     const char* fini_result = plugin_fini();
     
@@ -320,7 +324,7 @@ void test_attach_edge_cases() {
     
     // Place work and shutdown
     plugin_place_work("test");
-    plugin_place_work("<END>");
+    plugin_signal(PLUGIN_CONTROL_END);
     plugin_wait_finished();
     const char* fini_result = plugin_fini();
     
@@ -336,7 +340,7 @@ void test_rapid_cycles() {
         const char* init_result = common_plugin_init(test_transform, "cycle_test", 3);
         if (init_result == NULL) {
             plugin_place_work("quick_test");
-            plugin_place_work("<END>");
+            plugin_signal(PLUGIN_CONTROL_END);
             plugin_wait_finished();
             const char* fini_result = plugin_fini();
             if (fini_result == NULL) {
@@ -385,7 +389,7 @@ void test_stress_concurrent() {
     }
     
     // Shutdown
-    plugin_place_work("<END>");
+    plugin_signal(PLUGIN_CONTROL_END);
     const char* wait_result = plugin_wait_finished();
     const char* fini_result = plugin_fini();
     
@@ -409,7 +413,7 @@ void test_resource_validation() {
                 plugin_place_work(buffer);
             }
             
-            plugin_place_work("<END>");
+            plugin_signal(PLUGIN_CONTROL_END);
             const char* wait_result = plugin_wait_finished();
             const char* fini_result = plugin_fini();
             
@@ -424,6 +428,1030 @@ void test_resource_validation() {
     print_test_result("Resource validation", passed);
 }
 
+// Test 20: Independent instances chained together (same transform twice)
+void test_independent_instances() {
+    plugin_config_t config = { .queue_size = TEST_QUEUE_SIZE, .queue_mode = PLUGIN_QUEUE_LOCKED, .batch_size = 1 };
+    plugin_context_t* first = NULL;
+    plugin_context_t* second = NULL;
+    
+    const char* r1 = common_plugin_instance_init(test_transform, "instance_1", &config, &first);
+    const char* r2 = common_plugin_instance_init(test_transform, "instance_2", &config, &second);
+    if (r1 != NULL || r2 != NULL) {
+        print_test_result("Independent instances setup", 0);
+        return;
+    }
+    
+    // first -> second, each with its own queue and thread
+    plugin_link_t next = {
+        .instance = second,
+        .place_work = plugin_instance_place_work,
+        .place_work_owned = plugin_instance_place_work_owned,
+        .place_work_many_owned = plugin_instance_place_work_many_owned,
+        .signal = plugin_instance_signal
+    };
+    plugin_instance_attach(first, &next);
+    
+    const char* place_result = plugin_instance_place_work(first, "chained");
+    plugin_instance_signal(first, PLUGIN_CONTROL_END);
+    const char* wait1 = plugin_instance_wait_finished(first);
+    const char* wait2 = plugin_instance_wait_finished(second);
+    const char* fini1 = plugin_instance_fini(first);
+    const char* fini2 = plugin_instance_fini(second);
+    
+    int passed = (first != second && place_result == NULL && wait1 == NULL && wait2 == NULL &&
+                  fini1 == NULL && fini2 == NULL);
+    print_test_result("Independent instances of one plugin", passed);
+}
+
+// Sink for the replica test: records the order results arrive in (only the sink's single thread writes it)
+#define REPLICA_TEST_ITEMS 200
+static int replica_seen[REPLICA_TEST_ITEMS];
+static int replica_seen_count = 0;
+
+const char* test_transform_record(const char* input) {
+    // input is "TEST:<n>" from the replicated stage
+    if (replica_seen_count < REPLICA_TEST_ITEMS) {
+        replica_seen[replica_seen_count++] = atoi(input + 5);
+    }
+    return strdup(input);
+}
+
+// Test 21: Replicated stage keeps input order through the reorder buffer
+void test_replicas_keep_order() {
+    plugin_config_t replicated = { .queue_size = TEST_QUEUE_SIZE, .queue_mode = PLUGIN_QUEUE_LOCKED, .replicas = 4 };
+    plugin_config_t single = { .queue_size = TEST_QUEUE_SIZE, .queue_mode = PLUGIN_QUEUE_SPSC };
+    plugin_context_t* workers = NULL;
+    plugin_context_t* sink = NULL;
+    
+    // replicas can't share a single-consumer ring
+    plugin_config_t bad = replicated;
+    bad.queue_mode = PLUGIN_QUEUE_SPSC;
+    plugin_context_t* rejected = NULL;
+    const char* bad_result = common_plugin_instance_init(test_transform, "bad_replicas", &bad, &rejected);
+    
+    const char* r1 = common_plugin_instance_init(test_transform, "replicas", &replicated, &workers);
+    const char* r2 = common_plugin_instance_init(test_transform_record, "sink", &single, &sink);
+    if (r1 != NULL || r2 != NULL) {
+        print_test_result("Replicated instance setup", 0);
+        return;
+    }
+    
+    plugin_link_t next = {
+        .instance = sink,
+        .place_work = plugin_instance_place_work,
+        .place_work_owned = plugin_instance_place_work_owned,
+        .signal = plugin_instance_signal
+    };
+    plugin_instance_attach(workers, &next);
+    
+    replica_seen_count = 0;
+    for (int i = 0; i < REPLICA_TEST_ITEMS; i++) {
+        char item[16];
+        snprintf(item, sizeof(item), "%d", i);
+        plugin_instance_place_work(workers, item);
+    }
+    plugin_instance_signal(workers, PLUGIN_CONTROL_END);
+    
+    const char* wait1 = plugin_instance_wait_finished(workers);
+    const char* wait2 = plugin_instance_wait_finished(sink);
+    const char* fini1 = plugin_instance_fini(workers);
+    const char* fini2 = plugin_instance_fini(sink);
+    
+    int in_order = (replica_seen_count == REPLICA_TEST_ITEMS);
+    for (int i = 0; in_order && i < REPLICA_TEST_ITEMS; i++) {
+        in_order = (replica_seen[i] == i);
+    }
+    
+    int passed = (bad_result != NULL && in_order && wait1 == NULL && wait2 == NULL &&
+                  fini1 == NULL && fini2 == NULL);
+    print_test_result("Replicated stage preserves input order", passed);
+}
+
+// Executor adapters over work_pool_t (what the host passes in plugin_config_t)
+static void test_pool_submit(void* pool, void (*run)(void*), void* arg) {
+    work_pool_submit((work_pool_t*)pool, run, arg);
+}
+
+static void test_pool_defer(void* pool, void (*run)(void*), void* arg) {
+    work_pool_defer((work_pool_t*)pool, run, arg);
+}
+
+// Test 22: Instances on a shared pool (no thread each) still deliver in order through tiny queues
+void test_pool_executor() {
+    work_pool_t pool;
+    if (work_pool_init(&pool, 3) != NULL) {
+        print_test_result("Pool executor setup", 0);
+        return;
+    }
+    plugin_executor_t executor = { .pool = &pool, .submit = test_pool_submit, .defer = test_pool_defer };
+    plugin_config_t config = { .queue_size = 1, .queue_mode = PLUGIN_QUEUE_LOCKED, .executor = &executor };
+    plugin_context_t* first = NULL;
+    plugin_context_t* sink = NULL;
+    
+    const char* r1 = common_plugin_instance_init(test_transform, "pooled", &config, &first);
+    const char* r2 = common_plugin_instance_init(test_transform_record, "pooled_sink", &config, &sink);
+    if (r1 != NULL || r2 != NULL) {
+        work_pool_destroy(&pool);
+        print_test_result("Pool executor setup", 0);
+        return;
+    }
+    
+    plugin_link_t next = {
+        .instance = sink,
+        .place_work = plugin_instance_place_work,
+        .place_work_owned = plugin_instance_place_work_owned,
+        .offer_owned = plugin_instance_offer_owned,
+        .signal = plugin_instance_signal
+    };
+    plugin_instance_attach(first, &next);
+    
+    replica_seen_count = 0;
+    for (int i = 0; i < REPLICA_TEST_ITEMS; i++) {
+        char item[16];
+        snprintf(item, sizeof(item), "%d", i);
+        plugin_instance_place_work(first, item);
+    }
+    plugin_instance_signal(first, PLUGIN_CONTROL_END);
+    
+    const char* wait1 = plugin_instance_wait_finished(first);
+    const char* wait2 = plugin_instance_wait_finished(sink);
+    const char* fini1 = plugin_instance_fini(first);
+    const char* fini2 = plugin_instance_fini(sink);
+    work_pool_destroy(&pool);
+    
+    int in_order = (replica_seen_count == REPLICA_TEST_ITEMS);
+    for (int i = 0; in_order && i < REPLICA_TEST_ITEMS; i++) {
+        in_order = (replica_seen[i] == i);
+    }
+    
+    int passed = (in_order && wait1 == NULL && wait2 == NULL && fini1 == NULL && fini2 == NULL);
+    print_test_result("Stages on a shared pool keep order", passed);
+}
+
+// Fused-stage helpers: a length-preserving span and a sink that keeps the last string it saw
+static void test_span_reverse(const char* input, char* output, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        output[i] = input[len - 1 - i];
+    }
+}
+
+static void test_span_upper(const char* input, char* output, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        output[i] = (input[i] >= 'a' && input[i] <= 'z') ? input[i] - 'a' + 'A' : input[i];
+    }
+}
+
+static char fused_seen[64];
+
+const char* test_transform_keep(const char* input) {
+    snprintf(fused_seen, sizeof(fused_seen), "%s", input);
+    return strdup(input);
+}
+
+// Test 23: One instance running several fused stages (spans and regular transforms mixed)
+void test_fused_stages() {
+    plugin_fused_stage_t stages[] = {
+        { test_transform, NULL },
+        { NULL, test_span_reverse },
+        { NULL, test_span_upper },
+        { NULL, test_span_reverse },
+        { test_transform_keep, NULL }
+    };
+    plugin_config_t config = { .queue_size = TEST_QUEUE_SIZE, .fused = stages, .num_fused = 5 };
+    plugin_context_t* fused = NULL;
+    
+    fused_seen[0] = '\0';
+    const char* init_result = common_plugin_instance_init(test_transform_fail, "fused", &config, &fused);
+    if (init_result != NULL) {
+        print_test_result("Fused instance setup", 0);
+        return;
+    }
+    
+    plugin_instance_place_work(fused, "abc");
+    plugin_instance_signal(fused, PLUGIN_CONTROL_END);
+    const char* wait_result = plugin_instance_wait_finished(fused);
+    const char* fini_result = plugin_instance_fini(fused);
+    
+    // the plugin's own (failing) transform is replaced by the fused stages
+    int passed = (wait_result == NULL && fini_result == NULL && strcmp(fused_seen, "TEST:ABC") == 0);
+    print_test_result("Fused stages run back to back in one instance", passed);
+}
+
+// Composes its repeats itself: rotates right by times in one pass
+static void test_span_rotate_repeat(const char* input, char* output, size_t len, unsigned long times) {
+    for (size_t i = 0; i < len; i++) {
+        output[(i + times) % len] = input[i];
+    }
+}
+
+static void test_span_rotate(const char* input, char* output, size_t len) {
+    test_span_rotate_repeat(input, output, len, 1);
+}
+
+// Test 24: Repeated stages (as left by the chain simplifier) run the right number of times
+void test_repeated_stages() {
+    plugin_fused_stage_t stages[] = {
+        { NULL, test_span_reverse, NULL, 3 }, // no repeat export: three passes
+        { NULL, test_span_rotate, test_span_rotate_repeat, 2 }, // one pass, rotated by 2
+        { test_transform_keep, NULL, NULL, 0 }
+    };
+    plugin_config_t config = { .queue_size = TEST_QUEUE_SIZE, .fused = stages, .num_fused = 3 };
+    plugin_context_t* repeated = NULL;
+    
+    fused_seen[0] = '\0';
+    const char* init_result = common_plugin_instance_init(test_transform_fail, "repeated", &config, &repeated);
+    if (init_result != NULL) {
+        print_test_result("Repeated stage setup", 0);
+        return;
+    }
+    
+    plugin_instance_place_work(repeated, "abcde");
+    plugin_instance_signal(repeated, PLUGIN_CONTROL_END);
+    const char* wait_result = plugin_instance_wait_finished(repeated);
+    const char* fini_result = plugin_instance_fini(repeated);
+    
+    // "abcde" reversed three times is "edcba", rotated right by 2 is "baedc"
+    int passed = (wait_result == NULL && fini_result == NULL && strcmp(fused_seen, "baedc") == 0);
+    print_test_result("Repeated stages apply their repeat count", passed);
+}
+
+// Lent-input hook: counts the items it gets back (the lent ones aren't heap memory)
+static char lent_lines[2][8] = { "lent1", "lent2" };
+static int lent_returned = 0;
+
+static void test_release_lent(void* arg, char* item) {
+    (void)arg;
+    if (item == lent_lines[0] || item == lent_lines[1]) {
+        lent_returned++;
+        return;
+    }
+    free(item);
+}
+
+// Test 25: Lent input items go back through release_input instead of free()
+void test_release_input() {
+    plugin_config_t config = { .queue_size = TEST_QUEUE_SIZE, .release_input = test_release_lent };
+    plugin_context_t* lent = NULL;
+    
+    lent_returned = 0;
+    fused_seen[0] = '\0';
+    const char* init_result = common_plugin_instance_init(test_transform_keep, "lent", &config, &lent);
+    if (init_result != NULL) {
+        print_test_result("Lent input setup", 0);
+        return;
+    }
+    
+    plugin_instance_place_work_owned(lent, lent_lines[0]);
+    plugin_instance_place_work_owned(lent, lent_lines[1]);
+    plugin_instance_signal(lent, PLUGIN_CONTROL_END);
+    const char* wait_result = plugin_instance_wait_finished(lent);
+    const char* fini_result = plugin_instance_fini(lent);
+    
+    int passed = (wait_result == NULL && fini_result == NULL && lent_returned == 2 && strcmp(fused_seen, "lent2") == 0);
+    print_test_result("Lent input items are given back, not freed", passed);
+}
+
+// Output service stand-in: collects records in order and counts flushes
+static char printed[64];
+static int printed_records = 0;
+static int output_flushes = 0;
+
+static int test_output_write(void* writer, const struct iovec* parts, int count) {
+    (void)writer;
+    for (int i = 0; i < count; i++) {
+        strncat(printed, parts[i].iov_base, parts[i].iov_len);
+    }
+    printed_records++;
+    return 0;
+}
+
+static void test_output_flush(void* writer) {
+    (void)writer;
+    output_flushes++;
+}
+
+// Sink transform: prints "<input>;" as one record
+const char* test_transform_print(const char* input) {
+    struct iovec parts[] = { { (char*)input, strlen(input) }, { ";", 1 } };
+    plugin_output(parts, 2);
+    return strdup(input);
+}
+
+// Test 26: What a transform prints goes through the host's output service, in order, flushed on END
+void test_output_service() {
+    plugin_output_t output = { NULL, test_output_write, test_output_flush };
+    plugin_config_t config = { .queue_size = TEST_QUEUE_SIZE, .output = &output };
+    plugin_context_t* sink = NULL;
+    
+    printed[0] = '\0';
+    printed_records = 0;
+    output_flushes = 0;
+    const char* init_result = common_plugin_instance_init(test_transform_print, "sink", &config, &sink);
+    if (init_result != NULL) {
+        print_test_result("Output service setup", 0);
+        return;
+    }
+    
+    plugin_instance_place_work(sink, "a");
+    plugin_instance_place_work(sink, "b");
+    plugin_instance_place_work(sink, "c");
+    plugin_instance_signal(sink, PLUGIN_CONTROL_END);
+    const char* wait_result = plugin_instance_wait_finished(sink);
+    const char* fini_result = plugin_instance_fini(sink);
+    
+    int passed = (wait_result == NULL && fini_result == NULL && strcmp(printed, "a;b;c;") == 0 &&
+                  printed_records == 3 && output_flushes == 1);
+    print_test_result("Sink output goes through the output service and is flushed on END", passed);
+}
+
+// Async stand-in: each item is finished on the timer thread a few ticks after it started
+static timer_wheel_t* async_wheel = NULL;
+static int async_in_flight = 0;
+static int async_most_in_flight = 0;
+
+typedef struct {
+    plugin_context_t* context;
+    char* text;
+} test_async_job_t;
+
+static void test_async_finish(void* arg) {
+    test_async_job_t* job = arg;
+    plugin_context_t* context = job->context;
+    char* text = job->text;
+    free(job);
+    struct iovec parts[] = { { text, strlen(text) }, { ";", 1 } };
+    plugin_instance_output(context, parts, 2);
+    __atomic_sub_fetch(&async_in_flight, 1, __ATOMIC_SEQ_CST);
+    plugin_async_done(context, text);
+}
+
+static void test_async_start(plugin_context_t* context, const char* input) {
+    test_async_job_t* job = malloc(sizeof(test_async_job_t));
+    job->context = context;
+    job->text = strdup(input);
+    int now = __atomic_add_fetch(&async_in_flight, 1, __ATOMIC_SEQ_CST);
+    if (now > async_most_in_flight) {
+        async_most_in_flight = now;
+    }
+    timer_wheel_schedule(async_wheel, 3000, test_async_finish, job);
+}
+
+// Runs a, b, c through one async instance and checks they were finished one at a time, in order
+static int test_async_run(const plugin_executor_t* executor) {
+    plugin_output_t output = { NULL, test_output_write, test_output_flush };
+    plugin_config_t config = { .queue_size = TEST_QUEUE_SIZE, .output = &output, .executor = executor, .batch_size = 4 };
+    plugin_context_t* async = NULL;
+    
+    printed[0] = '\0';
+    printed_records = 0;
+    output_flushes = 0;
+    async_in_flight = 0;
+    async_most_in_flight = 0;
+    if (common_plugin_instance_init_async(test_transform, test_async_start, "async", &config, &async) != NULL) {
+        return 0;
+    }
+    
+    plugin_instance_place_work(async, "a");
+    plugin_instance_place_work(async, "b");
+    plugin_instance_place_work(async, "c");
+    plugin_instance_signal(async, PLUGIN_CONTROL_END);
+    const char* wait_result = plugin_instance_wait_finished(async);
+    const char* fini_result = plugin_instance_fini(async);
+    
+    return wait_result == NULL && fini_result == NULL && strcmp(printed, "a;b;c;") == 0 &&
+           async_most_in_flight == 1 && output_flushes == 1;
+}
+
+// Test 27: An async instance takes its next item only once the last one was finished (on a thread, and on a pool)
+void test_async_instance() {
+    timer_wheel_t wheel;
+    work_pool_t pool;
+    if (timer_wheel_init(&wheel, 1) != NULL) {
+        print_test_result("Async instance setup", 0);
+        return;
+    }
+    if (work_pool_init(&pool, 2) != NULL) {
+        timer_wheel_destroy(&wheel);
+        print_test_result("Async instance setup", 0);
+        return;
+    }
+    async_wheel = &wheel;
+    plugin_executor_t executor = { .pool = &pool, .submit = test_pool_submit, .defer = test_pool_defer };
+    
+    int threaded = test_async_run(NULL);
+    int pooled = test_async_run(&executor);
+    
+    work_pool_destroy(&pool);
+    timer_wheel_destroy(&wheel);
+    print_test_result("Async transforms finish one at a time and in order, on a thread and on a pool", threaded && pooled);
+}
+
+// Checks a map against its table on every length up to 100 (vector blocks and tails), copying and in place
+static int test_byte_map_matches(const unsigned char table[256]) {
+    byte_map_t map;
+    unsigned char input[100], output[100], inplace[100];
+    byte_map_init(&map, table);
+    for (size_t len = 0; len <= sizeof(input); len++) {
+        for (size_t i = 0; i < len; i++) {
+            input[i] = (unsigned char)(i * 37 + len * 11);
+        }
+        memcpy(inplace, input, len);
+        byte_map_apply(&map, (const char*)input, (char*)output, len);
+        byte_map_apply(&map, (const char*)inplace, (char*)inplace, len);
+        for (size_t i = 0; i < len; i++) {
+            if (output[i] != table[input[i]] || inplace[i] != table[input[i]]) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Test 28: Byte maps give exactly what their table says, whichever kernel they got (byte_map.c is built with -O2
+// here, so an arbitrary map gets the AVX2 shuffle kernel on CPUs that have it)
+void test_byte_map() {
+    unsigned char upper[256], rot13[256], scrambled[256];
+    for (int c = 0; c < 256; c++) {
+        upper[c] = (c >= 'a' && c <= 'z') ? (unsigned char)(c - 32) : (unsigned char)c;
+        rot13[c] = (unsigned char)c;
+        if (c >= 'a' && c <= 'z') rot13[c] = (unsigned char)('a' + (c - 'a' + 13) % 26);
+        if (c >= 'A' && c <= 'Z') rot13[c] = (unsigned char)('A' + (c - 'A' + 13) % 26);
+        scrambled[c] = (unsigned char)(c * 7 + 3);
+    }
+    
+    byte_map_t map;
+    byte_map_init(&map, rot13);
+    int passed = (map.num_ranges == 4 && test_byte_map_matches(upper) && test_byte_map_matches(rot13) &&
+                  test_byte_map_matches(scrambled));
+    byte_map_init(&map, scrambled);
+    passed = passed && map.num_ranges == -1;
+    print_test_result("Byte map kernels match the table (range and arbitrary maps, -O2 shuffle kernel)", passed);
+}
+
+// Downstream stand-in that records which buffers it was handed
+static char* handed[4];
+static int handed_count = 0;
+
+static const char* test_capture_owned(plugin_instance_t* instance, char* item) {
+    (void)instance;
+    if (handed_count < 4) {
+        handed[handed_count++] = item;
+        return NULL;
+    }
+    return "full";
+}
+
+static const char* test_capture(plugin_instance_t* instance, const char* item) {
+    (void)instance;
+    (void)item;
+    return NULL;
+}
+
+static void test_inplace_reverse(char* buf, size_t len) {
+    for (size_t i = 0; i < len / 2; i++) {
+        char tmp = buf[i];
+        buf[i] = buf[len - 1 - i];
+        buf[len - 1 - i] = tmp;
+    }
+}
+
+static int test_rope_rotate(plugin_rope_t* rope);
+
+// Runs one item through an in-place instance (with rope_function, the next stage takes ropes), capturing what comes out
+static int test_inplace_run(const plugin_config_t* config, int (*rope_function)(plugin_rope_t*), char* item) {
+    plugin_context_t* inplace = NULL;
+    if (common_plugin_instance_init_inplace(test_transform, test_inplace_reverse, rope_function, "inplace", config, &inplace) != NULL) {
+        return 0;
+    }
+    plugin_link_t next = { .instance = (plugin_instance_t*)1, .place_work = test_capture, .place_work_owned = test_capture_owned,
+                           .ropes = rope_function != NULL };
+    plugin_instance_attach(inplace, &next);
+    
+    handed_count = 0;
+    handed[0] = NULL;
+    plugin_instance_place_work_owned(inplace, item);
+    plugin_instance_signal(inplace, PLUGIN_CONTROL_END);
+    const char* wait_result = plugin_instance_wait_finished(inplace);
+    const char* fini_result = plugin_instance_fini(inplace);
+    return wait_result == NULL && fini_result == NULL && handed_count == 1;
+}
+
+// Test 29: An in-place instance forwards the very buffer it got, and only reads the items the host lent
+void test_inplace_instance() {
+    plugin_config_t owned_config = { .queue_size = TEST_QUEUE_SIZE };
+    plugin_config_t lent_config = { .queue_size = TEST_QUEUE_SIZE, .release_input = test_release_lent };
+    char* owned = strdup("abc");
+    
+    int passed = test_inplace_run(&owned_config, NULL, owned);
+    passed = passed && handed[0] == owned && strcmp(owned, "cba") == 0;
+    free(owned);
+    
+    lent_returned = 0;
+    passed = passed && test_inplace_run(&lent_config, NULL, lent_lines[0]);
+    passed = passed && strcmp(handed[0], "TEST:lent1") == 0 && strcmp(lent_lines[0], "lent1") == 0 && lent_returned == 1;
+    if (handed_count == 1) {
+        free(handed[0]);
+    }
+    
+    // a very long line goes the rope way instead when the next stage takes ropes (rotated, not reversed)
+    size_t len = PLUGIN_ROPE_MIN_LENGTH + 3;
+    char* line = malloc(len + 1);
+    memset(line, 'a', len);
+    line[len - 1] = 'z';
+    line[len] = '\0';
+    passed = passed && test_inplace_run(&owned_config, test_rope_rotate, line);
+    plugin_rope_t* handed_rope = passed ? plugin_rope_from_item(handed[0]) : NULL;
+    char* flat = handed_rope != NULL ? plugin_rope_flatten(handed_rope) : NULL;
+    passed = passed && flat != NULL && strlen(flat) == len && flat[0] == 'z' && flat[len - 1] == 'a';
+    free(flat);
+    print_test_result("In-place instance forwards its own buffer, copies lent ones", passed);
+}
+
+// View stages: only remap indices, like rotator, flipper and expander
+static int test_view_rotate(plugin_view_t* view) {
+    return plugin_view_rotate(view, 1);
+}
+
+static int test_view_reverse(plugin_view_t* view) {
+    return plugin_view_reverse(view);
+}
+
+static int test_view_expand(plugin_view_t* view) {
+    return plugin_view_interleave(view, '-');
+}
+
+// Runs one owned item through a fused instance, capturing what comes out
+static int test_fused_run(const plugin_fused_stage_t* stages, int num_stages, char* item) {
+    plugin_config_t config = { .queue_size = TEST_QUEUE_SIZE, .fused = stages, .num_fused = num_stages };
+    plugin_context_t* fused = NULL;
+    if (common_plugin_instance_init(test_transform_fail, "view", &config, &fused) != NULL) {
+        return 0;
+    }
+    plugin_link_t next = { .instance = (plugin_instance_t*)1, .place_work = test_capture, .place_work_owned = test_capture_owned };
+    plugin_instance_attach(fused, &next);
+    
+    handed_count = 0;
+    handed[0] = NULL;
+    plugin_instance_place_work_owned(fused, item);
+    plugin_instance_signal(fused, PLUGIN_CONTROL_END);
+    const char* wait_result = plugin_instance_wait_finished(fused);
+    const char* fini_result = plugin_instance_fini(fused);
+    return wait_result == NULL && fini_result == NULL && handed_count == 1;
+}
+
+// Test 30: Geometric stages compose into one view - built when a stage needs the chars, or once at the end
+void test_view_stages() {
+    plugin_fused_stage_t geometric[] = {
+        { .transform_view = test_view_rotate, .repeat = 2 },
+        { .transform_view = test_view_reverse },
+        { .transform_view = test_view_expand },
+        { .transform_view = test_view_rotate },
+        { .transform_view = test_view_expand } // a second interleave: the view is built and a new one started
+    };
+    plugin_fused_stage_t mixed[] = {
+        { .transform_view = test_view_reverse },
+        { NULL, test_span_upper },
+        { .transform_view = test_view_rotate }
+    };
+    plugin_fused_stage_t cancelled[] = {
+        { .transform_view = test_view_reverse },
+        { .transform_view = test_view_reverse }
+    };
+    
+    // "abcde" rotated by 2 is "deabc", flipped "cbaed", expanded "c-b-a-e-d", rotated "dc-b-a-e-", expanded again
+    int passed = test_fused_run(geometric, 5, strdup("abcde"));
+    passed = passed && strcmp(handed[0], "d-c---b---a---e--") == 0;
+    free(handed[0]);
+    
+    // the span reads the flipped chars, the rotation after it is built at the end
+    passed = passed && test_fused_run(mixed, 3, strdup("abc"));
+    passed = passed && strcmp(handed[0], "ACB") == 0;
+    free(handed[0]);
+    
+    // two flips leave nothing to build - the item itself goes on
+    char* item = strdup("abc");
+    passed = passed && test_fused_run(cancelled, 2, item);
+    passed = passed && handed[0] == item && strcmp(item, "abc") == 0;
+    free(item);
+    print_test_result("Geometric stages compose into a view built once", passed);
+}
+
+// Rope stages: what rotator and uppercaser do to a very long line
+static int test_rope_rotate(plugin_rope_t* rope) {
+    return plugin_rope_rotate(rope, 1);
+}
+
+static void test_upper_inplace(char* chars, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (chars[i] >= 'a' && chars[i] <= 'z') chars[i] -= 'a' - 'A';
+    }
+}
+
+// Runs one owned item through a rope instance, capturing what comes out
+static int test_rope_run(int next_takes_ropes, char* item) {
+    plugin_config_t config = { .queue_size = TEST_QUEUE_SIZE };
+    plugin_context_t* rope_instance = NULL;
+    if (common_plugin_instance_init_rope(test_transform, test_rope_rotate, "rope", &config, &rope_instance) != NULL) {
+        return 0;
+    }
+    plugin_link_t next = { .instance = (plugin_instance_t*)1, .place_work = test_capture, .place_work_owned = test_capture_owned,
+                           .ropes = next_takes_ropes };
+    plugin_instance_attach(rope_instance, &next);
+    
+    handed_count = 0;
+    handed[0] = NULL;
+    plugin_instance_place_work_owned(rope_instance, item);
+    plugin_instance_signal(rope_instance, PLUGIN_CONTROL_END);
+    const char* wait_result = plugin_instance_wait_finished(rope_instance);
+    const char* fini_result = plugin_instance_fini(rope_instance);
+    return wait_result == NULL && fini_result == NULL && handed_count == 1;
+}
+
+// Test 31: Very long lines as ropes - relinked, mapped and interleaved chunk by chunk, same chars as a string
+void test_ropes() {
+    size_t len = 3 * PLUGIN_ROPE_CHUNK_CHARS + 5;
+    char* line = malloc(len + 1);
+    char* expected = malloc(2 * len + 1);
+    for (size_t i = 0; i < len; i++) line[i] = 'a' + i % 26;
+    line[len] = '\0';
+    
+    // rotate by 1 three times (the cut slices join up again), then by a lot, uppercase, interleave
+    plugin_rope_t* rope = plugin_rope_new();
+    int passed = rope != NULL && plugin_rope_append(rope, line, len) == 0 && rope->count == 4;
+    for (int i = 0; i < 3; i++) passed = passed && plugin_rope_rotate(rope, 1) == 0;
+    passed = passed && rope->count == 5;
+    passed = passed && plugin_rope_rotate(rope, 2 * PLUGIN_ROPE_CHUNK_CHARS) == 0;
+    passed = passed && plugin_rope_map(rope, test_upper_inplace) == 0;
+    passed = passed && plugin_rope_interleave(rope, '-') == 0 && rope->len == 2 * len - 1;
+    size_t shift = (3 + 2 * PLUGIN_ROPE_CHUNK_CHARS) % len;
+    for (size_t i = 0; i < len; i++) {
+        expected[2 * i] = line[(i + len - shift) % len] - ('a' - 'A');
+        expected[2 * i + 1] = '-';
+    }
+    expected[2 * len - 1] = '\0';
+    char* flat = passed ? plugin_rope_flatten(rope) : NULL;
+    passed = passed && flat != NULL && strcmp(flat, expected) == 0;
+    free(flat);
+    
+    // an instance makes a long string a rope when the next stage takes ropes ...
+    memcpy(expected, line + len - 1, 1);
+    memcpy(expected + 1, line, len - 1);
+    expected[len] = '\0';
+    passed = passed && test_rope_run(1, strdup(line));
+    plugin_rope_t* handed_rope = passed ? plugin_rope_from_item(handed[0]) : NULL;
+    flat = handed_rope != NULL ? plugin_rope_flatten(handed_rope) : NULL;
+    passed = passed && flat != NULL && strcmp(flat, expected) == 0;
+    free(flat);
+    
+    // ... and builds a rope it got into a string when the next stage doesn't
+    rope = plugin_rope_new();
+    passed = passed && rope != NULL && plugin_rope_append(rope, line, len) == 0;
+    passed = passed && test_rope_run(0, plugin_rope_to_item(rope));
+    passed = passed && plugin_rope_from_item(handed[0]) == NULL && strcmp(handed[0], expected) == 0;
+    if (handed_count == 1) {
+        free(handed[0]);
+    }
+    
+    free(line);
+    free(expected);
+    print_test_result("Long lines go through rope stages chunk by chunk", passed);
+}
+
+// Test 32: Buffer pool - freed buffers are reused, other threads give them back to their owner, malloc'd ones pass through
+static buffer_pool_t* freeing_pool = NULL;
+static char* freeing_buffers[64];
+
+static void* test_free_elsewhere(void* arg) {
+    for (int i = 0; i < 64; i++) buffer_pool_free(freeing_pool, freeing_buffers[i]);
+    return NULL;
+}
+
+void test_buffer_pool() {
+    buffer_pool_t pool;
+    if (buffer_pool_init(&pool, 0) != NULL) {
+        print_test_result("Buffer pool reuses buffers across threads", 0);
+        return;
+    }
+    buffer_pool_stats_t stats;
+    
+    // a freed buffer comes back for the next one of its class
+    char* first = buffer_pool_alloc(&pool, 100);
+    int passed = first != NULL;
+    buffer_pool_free(&pool, first);
+    char* again = buffer_pool_alloc(&pool, 120);
+    passed = passed && again == first;
+    buffer_pool_stats(&pool, &stats);
+    passed = passed && stats.hits == 1 && stats.misses == 1 && stats.in_flight == 128;
+    buffer_pool_free(&pool, again);
+    
+    // freed on another thread - back on the owner's return list, taken again from there
+    freeing_pool = &pool;
+    for (int i = 0; i < 64; i++) {
+        freeing_buffers[i] = buffer_pool_alloc(&pool, 1000);
+        passed = passed && freeing_buffers[i] != NULL;
+        if (freeing_buffers[i] != NULL) memset(freeing_buffers[i], 'x', 1000);
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, test_free_elsewhere, NULL);
+    pthread_join(thread, NULL);
+    int reused = 0;
+    char* taken[64];
+    for (int i = 0; i < 64; i++) {
+        taken[i] = buffer_pool_alloc(&pool, 1024);
+        for (int j = 0; j < 64; j++) reused += taken[i] == freeing_buffers[j];
+    }
+    passed = passed && reused == 64;
+    for (int i = 0; i < 64; i++) buffer_pool_free(&pool, taken[i]);
+    
+    // above the largest class, and strings the pool never made, are plain malloc'd ones
+    char* big = buffer_pool_alloc(&pool, ((size_t)1 << BUFFER_POOL_MAX_SHIFT) + 1);
+    passed = passed && big != NULL;
+    buffer_pool_free(&pool, big);
+    buffer_pool_free(&pool, strdup("not from the pool"));
+    buffer_pool_free(&pool, NULL);
+    
+    buffer_pool_stats(&pool, &stats);
+    passed = passed && stats.in_flight == 0 && stats.hits == 65;
+    buffer_pool_destroy(&pool);
+    print_test_result("Buffer pool reuses buffers across threads", passed);
+}
+
+// Test 33: A record ring instance reads its items in the ring - they are copied in (lent ones given back at once)
+void test_record_ring_instance() {
+    plugin_config_t config = { .queue_size = TEST_QUEUE_SIZE, .queue_mode = PLUGIN_QUEUE_RECORDS, .batch_size = 4 };
+    plugin_config_t lent_config = { .queue_size = TEST_QUEUE_SIZE, .queue_mode = PLUGIN_QUEUE_RECORDS,
+                                    .queue_bytes = 4096, .release_input = test_release_lent };
+    plugin_config_t replicated = { .queue_size = TEST_QUEUE_SIZE, .queue_mode = PLUGIN_QUEUE_RECORDS, .replicas = 2 };
+    plugin_context_t* rejected = NULL;
+    
+    // the ring's bytes are only lent to the transform, so it gets a result buffer of its own
+    int passed = test_inplace_run(&config, NULL, strdup("abc"));
+    passed = passed && strcmp(handed[0], "TEST:abc") == 0;
+    if (handed_count == 1) {
+        free(handed[0]);
+    }
+    
+    lent_returned = 0;
+    passed = passed && test_inplace_run(&lent_config, NULL, lent_lines[1]);
+    passed = passed && strcmp(handed[0], "TEST:lent2") == 0 && lent_returned == 1;
+    if (handed_count == 1) {
+        free(handed[0]);
+    }
+    
+    // one consumer only
+    passed = passed && common_plugin_instance_init(test_transform, "records", &replicated, &rejected) != NULL;
+    print_test_result("Record ring instance reads items where they are stored", passed);
+}
+
+// What the v2 transform was handed, in order
+static plugin_message_t messages_seen[4];
+static int messages_seen_count = 0;
+
+static int test_message_transform(const plugin_message_t* input, plugin_message_t* output) {
+    if (messages_seen_count < 4) {
+        messages_seen[messages_seen_count++] = *input;
+    }
+    output->payload = malloc(input->len + 6);
+    if (output->payload == NULL) {
+        return -1;
+    }
+    memcpy(output->payload, "TEST:", 5);
+    memcpy(output->payload + 5, input->payload, input->len + 1);
+    output->len = input->len + 5;
+    return 0;
+}
+
+// Runs three items through a v2 instance - the envelopes must be numbered, stamped and counted
+static int test_message_run(const plugin_config_t* config) {
+    plugin_context_t* instance = NULL;
+    if (common_plugin_instance_init_message(test_transform, test_message_transform, NULL, "message", config, &instance) != NULL) {
+        return 0;
+    }
+    plugin_link_t next = { .instance = (plugin_instance_t*)1, .place_work = test_capture, .place_work_owned = test_capture_owned };
+    plugin_instance_attach(instance, &next);
+    
+    handed_count = 0;
+    messages_seen_count = 0;
+    const char* lines[] = { "a", "bcd", "" };
+    for (int i = 0; i < 3; i++) {
+        plugin_instance_place_work(instance, lines[i]);
+    }
+    plugin_instance_signal(instance, PLUGIN_CONTROL_END);
+    int passed = plugin_instance_wait_finished(instance) == NULL && plugin_instance_fini(instance) == NULL;
+    
+    passed = passed && messages_seen_count == 3 && handed_count == 3;
+    for (int i = 0; passed && i < 3; i++) {
+        passed = messages_seen[i].seq == (unsigned long)i && messages_seen[i].len == strlen(lines[i]) &&
+                 messages_seen[i].flags == PLUGIN_MESSAGE_DATA && messages_seen[i].ingest_ns > 0 &&
+                 (i == 0 || messages_seen[i].ingest_ns >= messages_seen[i - 1].ingest_ns) &&
+                 strncmp(handed[i], "TEST:", 5) == 0 && strcmp(handed[i] + 5, lines[i]) == 0;
+    }
+    for (int i = 0; i < handed_count; i++) {
+        free(handed[i]);
+    }
+    return passed;
+}
+
+// Runs three items with headers of their own through a legacy stage into a v2 one - the second stage must see the
+// seq and ingest time they were placed with, not a count and a clock of its own
+static int test_message_carry(const plugin_config_t* config) {
+    plugin_context_t* first = NULL;
+    plugin_context_t* second = NULL;
+    if (common_plugin_instance_init(test_transform, "first", config, &first) != NULL) {
+        return 0;
+    }
+    if (common_plugin_instance_init_message(test_transform, test_message_transform, NULL, "second", config, &second) != NULL) {
+        plugin_instance_fini(first);
+        return 0;
+    }
+    plugin_link_t link = { .instance = (plugin_instance_t*)second, .place_work = plugin_instance_place_work,
+                           .place_work_owned = plugin_instance_place_work_owned,
+                           .place_messages_owned = plugin_instance_place_messages_owned,
+                           .signal = plugin_instance_signal };
+    plugin_instance_attach(first, &link);
+    plugin_link_t next = { .instance = (plugin_instance_t*)1, .place_work = test_capture, .place_work_owned = test_capture_owned };
+    plugin_instance_attach(second, &next);
+    
+    handed_count = 0;
+    messages_seen_count = 0;
+    const char* lines[] = { "a", "bcd", "" };
+    int passed = 1;
+    for (int i = 0; i < 3; i++) {
+        char* line = strdup(lines[i]);
+        plugin_header_t header = { strlen(lines[i]), 10 + i, 1000 + i };
+        passed = passed && plugin_instance_place_messages_owned(first, &line, &header, 1) == NULL;
+    }
+    plugin_instance_signal(first, PLUGIN_CONTROL_END);
+    passed = plugin_instance_wait_finished(first) == NULL && plugin_instance_wait_finished(second) == NULL && passed;
+    passed = plugin_instance_fini(first) == NULL && plugin_instance_fini(second) == NULL && passed;
+    
+    passed = passed && messages_seen_count == 3 && handed_count == 3;
+    for (int i = 0; passed && i < 3; i++) {
+        passed = messages_seen[i].seq == 10 + (unsigned long)i && messages_seen[i].ingest_ns == 1000 + (unsigned long long)i &&
+                 messages_seen[i].len == strlen(lines[i]) + 5 && strncmp(handed[i], "TEST:TEST:", 10) == 0;
+    }
+    for (int i = 0; i < handed_count; i++) {
+        free(handed[i]);
+    }
+    return passed;
+}
+
+// Test 34: A v2 instance gets every item in an envelope, and legacy transforms run on envelopes through the adapter
+void test_message_instance() {
+    plugin_config_t config = { .queue_size = TEST_QUEUE_SIZE };
+    plugin_config_t records_config = { .queue_size = TEST_QUEUE_SIZE, .queue_mode = PLUGIN_QUEUE_RECORDS, .batch_size = 4 };
+    plugin_context_t* rejected = NULL;
+    
+    int passed = test_message_run(&config) && test_message_run(&records_config);
+    passed = passed && test_message_carry(&config) && test_message_carry(&records_config);
+    
+    // the adapter keeps the metadata and leaves the result uncounted
+    char payload[] = "xyz";
+    plugin_message_t input = { payload, 3, 7, 42, PLUGIN_MESSAGE_DATA };
+    plugin_message_t output;
+    passed = passed && plugin_message_transform_legacy(test_transform, &input, &output) == 0;
+    passed = passed && strcmp(output.payload, "TEST:xyz") == 0 && output.len == PLUGIN_MESSAGE_LEN_UNKNOWN &&
+             output.seq == 7 && output.ingest_ns == 42 && output.flags == PLUGIN_MESSAGE_DATA;
+    if (passed) {
+        free(output.payload);
+    }
+    
+    passed = passed && common_plugin_instance_init_message(test_transform, NULL, NULL, "message", &config, &rejected) != NULL;
+    print_test_result("Message envelopes carry length, sequence and ingest time", passed);
+}
+
+// Downstream stand-in that records lines and control messages in the order they arrive
+static char* signaled_lines[16];
+static int signaled_count = 0;
+static int barrier_at = -1;
+static int barriers_seen = 0;
+static int ends_seen = 0;
+
+static const char* test_signal_capture_owned(plugin_instance_t* instance, char* item) {
+    (void)instance;
+    if (signaled_count < 16) {
+        signaled_lines[signaled_count++] = item;
+        return NULL;
+    }
+    return "full";
+}
+
+static const char* test_signal_capture(plugin_instance_t* instance, int control) {
+    (void)instance;
+    if (control == PLUGIN_CONTROL_BARRIER) {
+        barrier_at = signaled_count;
+        barriers_seen++;
+    } else if (control == PLUGIN_CONTROL_END) {
+        ends_seen++;
+    }
+    return NULL;
+}
+
+// Test 35: Control messages - a barrier gets through ordered replicas in its place, pause holds lines back
+void test_control_messages() {
+    plugin_config_t config = { .queue_size = TEST_QUEUE_SIZE, .replicas = 3 };
+    plugin_context_t* workers = NULL;
+    if (common_plugin_instance_init(test_transform, "barrier", &config, &workers) != NULL) {
+        print_test_result("Control messages", 0);
+        return;
+    }
+    plugin_link_t next = { .instance = (plugin_instance_t*)1, .place_work = test_capture,
+                           .place_work_owned = test_signal_capture_owned, .signal = test_signal_capture };
+    plugin_instance_attach(workers, &next);
+    
+    signaled_count = 0;
+    barrier_at = -1;
+    ends_seen = 0;
+    char line[8];
+    for (int i = 0; i < 10; i++) {
+        if (i == 6) {
+            plugin_instance_signal(workers, PLUGIN_CONTROL_BARRIER);
+        }
+        snprintf(line, sizeof(line), "%d", i);
+        plugin_instance_place_work(workers, line);
+    }
+    plugin_instance_signal(workers, PLUGIN_CONTROL_END);
+    int passed = plugin_instance_wait_finished(workers) == NULL && plugin_instance_fini(workers) == NULL;
+    passed = passed && signaled_count == 10 && barrier_at == 6 && ends_seen == 1;
+    for (int i = 0; i < signaled_count; i++) {
+        snprintf(line, sizeof(line), "%d", i);
+        passed = passed && strncmp(signaled_lines[i], "TEST:", 5) == 0 && strcmp(signaled_lines[i] + 5, line) == 0;
+        free(signaled_lines[i]);
+    }
+    
+    // paused, the line waits in the queue - the control messages still get through
+    plugin_config_t single = { .queue_size = TEST_QUEUE_SIZE };
+    plugin_context_t* paused = NULL;
+    passed = passed && common_plugin_instance_init(test_transform, "paused", &single, &paused) == NULL;
+    if (paused != NULL) {
+        plugin_instance_attach(paused, &next);
+        signaled_count = 0;
+        barrier_at = -1;
+        plugin_instance_signal(paused, PLUGIN_CONTROL_PAUSE);
+        plugin_instance_place_work(paused, "held");
+        plugin_instance_signal(paused, PLUGIN_CONTROL_FLUSH);
+        usleep(20000);
+        passed = passed && signaled_count == 0 && plugin_instance_signal(paused, 42) != NULL;
+        plugin_instance_signal(paused, PLUGIN_CONTROL_RESUME);
+        plugin_instance_signal(paused, PLUGIN_CONTROL_END);
+        passed = passed && plugin_instance_wait_finished(paused) == NULL && plugin_instance_fini(paused) == NULL;
+        passed = passed && signaled_count == 1 && strcmp(signaled_lines[0], "TEST:held") == 0;
+        for (int i = 0; i < signaled_count; i++) {
+            free(signaled_lines[i]);
+        }
+    }
+    print_test_result("Control messages: barrier keeps its place through replicas, pause holds lines", passed);
+}
+
+// A stage that takes a second per line
+static const char* test_transform_slow(const char* input) {
+    sleep(1);
+    return test_transform(input);
+}
+
+// Test 36: A slow stage's lane fills with barriers while it works - none of them, and not the END behind them, is lost
+void test_control_backlog() {
+    plugin_config_t config = { .queue_size = TEST_QUEUE_SIZE };
+    plugin_context_t* first = NULL;
+    plugin_context_t* slow = NULL;
+    if (common_plugin_instance_init(test_transform, "first", &config, &first) != NULL) {
+        print_test_result("Control backlog", 0);
+        return;
+    }
+    if (common_plugin_instance_init(test_transform_slow, "slow", &config, &slow) != NULL) {
+        plugin_instance_fini(first);
+        print_test_result("Control backlog", 0);
+        return;
+    }
+    plugin_link_t link = { .instance = (plugin_instance_t*)slow, .place_work = plugin_instance_place_work,
+                           .place_work_owned = plugin_instance_place_work_owned, .signal = plugin_instance_signal };
+    plugin_instance_attach(first, &link);
+    plugin_link_t next = { .instance = (plugin_instance_t*)1, .place_work = test_capture,
+                           .place_work_owned = test_signal_capture_owned, .signal = test_signal_capture };
+    plugin_instance_attach(slow, &next);
+    
+    signaled_count = 0;
+    barriers_seen = 0;
+    ends_seen = 0;
+    // the line that ends a stream on STDIN is data here, like any other
+    int passed = plugin_instance_place_work(first, "<END>") == NULL;
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 10; i++) {
+            passed = passed && plugin_instance_signal(first, PLUGIN_CONTROL_BARRIER) == NULL;
+        }
+        usleep(100000);
+    }
+    passed = passed && plugin_instance_signal(first, PLUGIN_CONTROL_END) == NULL;
+    passed = plugin_instance_wait_finished(first) == NULL && plugin_instance_wait_finished(slow) == NULL && passed;
+    passed = plugin_instance_fini(first) == NULL && plugin_instance_fini(slow) == NULL && passed;
+    passed = passed && signaled_count == 1 && strcmp(signaled_lines[0], "TEST:TEST:<END>") == 0 &&
+             barriers_seen == 30 && ends_seen == 1;
+    for (int i = 0; i < signaled_count; i++) {
+        free(signaled_lines[i]);
+    }
+    print_test_result("Control backlog: a slow stage gets every barrier and its END", passed);
+}
+
 int main() {
     printf(COLOR_YELLOW "=== Comprehensive Plugin Common Unit Tests ===" COLOR_RESET "\n\n");
     
@@ -454,6 +1482,23 @@ int main() {
     test_thread_safety();
     test_stress_concurrent();
     test_resource_validation();
+    test_independent_instances();
+    test_replicas_keep_order();
+    test_pool_executor();
+    test_fused_stages();
+    test_repeated_stages();
+    test_release_input();
+    test_output_service();
+    test_async_instance();
+    test_byte_map();
+    test_inplace_instance();
+    test_view_stages();
+    test_ropes();
+    test_buffer_pool();
+    test_record_ring_instance();
+    test_message_instance();
+    test_control_messages();
+    test_control_backlog();
     
     // Print comprehensive summary
     printf("\n" COLOR_YELLOW "=== Comprehensive Test Summary ===" COLOR_RESET "\n");
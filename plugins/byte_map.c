@@ -0,0 +1,170 @@
+#include <string.h> // memcpy
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // SSE2 / AVX2 intrinsics
+#define BYTE_MAP_X86 1
+#endif
+
+#include "byte_map.h"
+
+
+/**
+ * Scalar kernel: one table lookup per byte (also finishes the tail of the vector kernels)
+ * @param map Pointer to map structure
+ * @param input Bytes to map
+ * @param output Where the mapped bytes go
+ * @param len Number of bytes
+ */
+static void byte_map_scalar(const byte_map_t* map, const unsigned char* input, unsigned char* output, size_t len){
+    for(size_t i = 0; i < len; i++){
+        output[i] = map->table[input[i]];
+    }
+}
+
+
+#ifdef BYTE_MAP_X86
+
+/**
+ * SSE2 range kernel: bytes inside a run get its shift added, 16 at a time
+ * In range means (byte - first) <= (last - first) unsigned - min_epu8 gives that with SSE2 alone.
+ */
+static void byte_map_ranges_sse2(const byte_map_t* map, const unsigned char* input, unsigned char* output, size_t len){
+    __m128i first[BYTE_MAP_MAX_RANGES], span[BYTE_MAP_MAX_RANGES], delta[BYTE_MAP_MAX_RANGES];
+    int count = map->num_ranges;
+    for(int r = 0; r < count; r++){
+        first[r] = _mm_set1_epi8((char)map->ranges[r].first);
+        span[r] = _mm_set1_epi8((char)(map->ranges[r].last - map->ranges[r].first));
+        delta[r] = _mm_set1_epi8((char)map->ranges[r].delta);
+    }
+
+    size_t i = 0;
+    for(; i + 16 <= len; i += 16){
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(input + i));
+        __m128i mapped = bytes;
+        // runs don't overlap, so every byte gets at most one shift
+        for(int r = 0; r < count; r++){
+            __m128i offset = _mm_sub_epi8(bytes, first[r]);
+            __m128i inside = _mm_cmpeq_epi8(_mm_min_epu8(offset, span[r]), offset);
+            mapped = _mm_add_epi8(mapped, _mm_and_si128(inside, delta[r]));
+        }
+        _mm_storeu_si128((__m128i*)(output + i), mapped);
+    }
+    byte_map_scalar(map, input + i, output + i, len - i);
+}
+
+
+/**
+ * AVX2 range kernel: same as the SSE2 one, 32 bytes at a time
+ */
+__attribute__((target("avx2")))
+static void byte_map_ranges_avx2(const byte_map_t* map, const unsigned char* input, unsigned char* output, size_t len){
+    __m256i first[BYTE_MAP_MAX_RANGES], span[BYTE_MAP_MAX_RANGES], delta[BYTE_MAP_MAX_RANGES];
+    int count = map->num_ranges;
+    for(int r = 0; r < count; r++){
+        first[r] = _mm256_set1_epi8((char)map->ranges[r].first);
+        span[r] = _mm256_set1_epi8((char)(map->ranges[r].last - map->ranges[r].first));
+        delta[r] = _mm256_set1_epi8((char)map->ranges[r].delta);
+    }
+
+    size_t i = 0;
+    for(; i + 32 <= len; i += 32){
+        __m256i bytes = _mm256_loadu_si256((const __m256i*)(input + i));
+        __m256i mapped = bytes;
+        for(int r = 0; r < count; r++){
+            __m256i offset = _mm256_sub_epi8(bytes, first[r]);
+            __m256i inside = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, span[r]), offset);
+            mapped = _mm256_add_epi8(mapped, _mm256_and_si256(inside, delta[r]));
+        }
+        _mm256_storeu_si256((__m256i*)(output + i), mapped);
+    }
+    byte_map_scalar(map, input + i, output + i, len - i);
+}
+
+
+#ifdef __OPTIMIZE__
+
+/**
+ * AVX2 shuffle kernel for any map: every 16-byte slice of the table is looked up with one shuffle, indexed by the
+ * byte minus the slice's start - saturated so that only bytes inside the slice keep bit 7 clear (the others read 0)
+ */
+__attribute__((target("avx2")))
+static void byte_map_shuffle_avx2(const byte_map_t* map, const unsigned char* input, unsigned char* output, size_t len){
+    const __m256i step = _mm256_set1_epi8(16);
+    const __m256i clamp = _mm256_set1_epi8(0x70);
+
+    size_t i = 0;
+    for(; i + 32 <= len; i += 32){
+        __m256i index = _mm256_loadu_si256((const __m256i*)(input + i));
+        __m256i mapped = _mm256_setzero_si256();
+        for(int high = 0; high < 16; high++){
+            __m256i slice = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(map->table + high * 16)));
+            mapped = _mm256_or_si256(mapped, _mm256_shuffle_epi8(slice, _mm256_adds_epu8(index, clamp)));
+            index = _mm256_sub_epi8(index, step);
+        }
+        _mm256_storeu_si256((__m256i*)(output + i), mapped);
+    }
+    byte_map_scalar(map, input + i, output + i, len - i);
+}
+
+// only picked in optimized builds (see byte_map_init)
+#endif
+
+#endif
+
+
+/**
+ * Split the map into runs of consecutive bytes with the same shift
+ * @param map Pointer to map structure (table filled in)
+ * @return Number of runs, or -1 if there are more than BYTE_MAP_MAX_RANGES
+ */
+static int byte_map_find_ranges(byte_map_t* map){
+    int count = 0;
+    int c = 0;
+    while(c < 256){
+        unsigned char delta = (unsigned char)(map->table[c] - c);
+        if(delta == 0){
+            c++;
+            continue;
+        }
+        int first = c;
+        while(c + 1 < 256 && (unsigned char)(map->table[c + 1] - (c + 1)) == delta){
+            c++;
+        }
+        if(count == BYTE_MAP_MAX_RANGES){
+            return -1;
+        }
+        map->ranges[count].first = (unsigned char)first;
+        map->ranges[count].last = (unsigned char)c;
+        map->ranges[count].delta = delta;
+        count++;
+        c++;
+    }
+    return count;
+}
+
+
+void byte_map_init(byte_map_t* map, const unsigned char table[256]){
+    memcpy(map->table, table, 256);
+    map->num_ranges = byte_map_find_ranges(map);
+    map->kernel = byte_map_scalar;
+
+#ifdef BYTE_MAP_X86
+    // plugins are shared objects - the CPU model isn't filled in for them until this runs
+    __builtin_cpu_init();
+    int avx2 = __builtin_cpu_supports("avx2");
+    if(map->num_ranges >= 0){
+        map->kernel = avx2 ? byte_map_ranges_avx2 : byte_map_ranges_sse2;
+    }
+#ifdef __OPTIMIZE__
+    // unoptimized, every vector round-trips through the stack, and 16 shuffles per block lose to the plain table
+    else if(avx2){
+        map->kernel = byte_map_shuffle_avx2;
+    }
+#endif
+#endif
+}
+
+
+void byte_map_apply(const byte_map_t* map, const char* input, char* output, size_t len){
+    map->kernel(map, (const unsigned char*)input, (unsigned char*)output, len);
+}
@@ -0,0 +1,57 @@
+#ifndef BYTE_MAP_H
+#define BYTE_MAP_H
+
+#include <stddef.h>
+
+/**
+ * byte map applies a 256-entry table to every byte of a string - all a plugin like uppercaser needs is the table.
+ * the table is looked at once, in byte_map_init, to pick the fastest kernel this CPU has for it:
+ * - a map that only shifts a few runs of bytes (case mapping, ROT13) is done as "compare against each range,
+ *   add its shift where it matched", 16 bytes at a time with SSE2 or 32 with AVX2
+ * - any other map looks every 16-byte slice of the table up with one shuffle each, indexed so that only the
+ *   slice a byte falls in gives it anything (AVX2, optimized builds)
+ * - otherwise, a plain table lookup per byte
+ * every kernel gives exactly what the table says, they only differ in speed.
+ **/
+
+// shifted runs a map may have and still use the range kernels
+#define BYTE_MAP_MAX_RANGES 4
+
+/**
+ * A run of consecutive bytes that the map shifts by the same amount
+ */
+typedef struct
+{
+ unsigned char first; /* First byte of the run */
+ unsigned char last; /* Last byte of the run */
+ unsigned char delta; /* Added to every byte of the run (mod 256) */
+} byte_map_range_t;
+
+/**
+ * Byte map structure
+ */
+typedef struct byte_map
+{
+ unsigned char table[256]; /* Byte -> byte */
+ int num_ranges; /* Shifted runs in ranges (-1: too many - only the table describes the map) */
+ byte_map_range_t ranges[BYTE_MAP_MAX_RANGES]; /* The runs, every other byte maps to itself */
+ void (*kernel)(const struct byte_map*, const unsigned char*, unsigned char*, size_t); /* Chosen by byte_map_init */
+} byte_map_t;
+
+/**
+ * Build a map from a table and pick its kernel for this CPU
+ * @param map Pointer to map structure
+ * @param table Byte -> byte (copied)
+ */
+void byte_map_init(byte_map_t* map, const unsigned char table[256]);
+
+/**
+ * Map len bytes (input and output may be the same buffer, but must not overlap otherwise)
+ * @param map Pointer to map structure
+ * @param input Bytes to map
+ * @param output Buffer of at least len bytes (not terminated by this function)
+ * @param len Number of bytes
+ */
+void byte_map_apply(const byte_map_t* map, const char* input, char* output, size_t len);
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef BYTE_MAP_PLUGIN_H
+#define BYTE_MAP_PLUGIN_H
+
+#include <string.h>
+
+#include "plugin_sdk.h"
+#include "plugin_common.h"
+#include "byte_map.h"
+
+/**
+ * byte map plugin is the whole plugin for a transform that maps every byte through a table (uppercaser, lowercaser,
+ * rot13): the plugin file writes its table and expands BYTE_MAP_PLUGIN once, which gives it
+ * - the map, built by a constructor when the plugin is loaded (before any transform can run)
+ * - plugin_get_name and plugin_get_flags
+ * - plugin_transform_span (fused stages), plugin_transform_inplace (owned items) and plugin_transform_rope (very
+ *   long lines, segment by segment) - all of them one byte_map_apply
+ * - plugin_transform, plugin_init and plugin_instance_init
+ * every export is the same for every such plugin, only the table and the flags differ.
+ **/
+
+/**
+ * Define a byte map plugin
+ * @param NAME The plugin's name (a string literal)
+ * @param FLAGS What plugin_get_flags returns (PLUGIN_FLAG_PURE and whatever else the table has)
+ * @param TABLE_INIT void (*)(unsigned char table[256]) - fills in byte -> byte
+ */
+#define BYTE_MAP_PLUGIN(NAME, FLAGS, TABLE_INIT)                                                                  \
+                                                                                                                  \
+static byte_map_t byte_map_plugin_map;                                                                            \
+                                                                                                                  \
+__attribute__((constructor))                                                                                      \
+static void byte_map_plugin_setup(void){                                                                          \
+    unsigned char table[256];                                                                                     \
+    TABLE_INIT(table);                                                                                            \
+    byte_map_init(&byte_map_plugin_map, table);                                                                   \
+}                                                                                                                 \
+                                                                                                                  \
+__attribute__((visibility("default")))                                                                            \
+const char* plugin_get_name(void){                                                                                \
+    return NAME;                                                                                                  \
+}                                                                                                                 \
+                                                                                                                  \
+__attribute__((visibility("default")))                                                                            \
+unsigned int plugin_get_flags(void){                                                                              \
+    return FLAGS;                                                                                                 \
+}                                                                                                                 \
+                                                                                                                  \
+__attribute__((visibility("default")))                                                                            \
+void plugin_transform_span(const char* input, char* output, size_t len){                                          \
+    byte_map_apply(&byte_map_plugin_map, input, output, len);                                                     \
+}                                                                                                                 \
+                                                                                                                  \
+__attribute__((visibility("default")))                                                                            \
+void plugin_transform_inplace(char* chars, size_t len){                                                           \
+    byte_map_apply(&byte_map_plugin_map, chars, chars, len);                                                      \
+}                                                                                                                 \
+                                                                                                                  \
+__attribute__((visibility("default")))                                                                            \
+int plugin_transform_rope(plugin_rope_t* rope){                                                                   \
+    return plugin_rope_map(rope, plugin_transform_inplace);                                                       \
+}                                                                                                                 \
+                                                                                                                  \
+const char* plugin_transform(const char* input){                                                                  \
+    size_t len = strlen(input);                                                                                   \
+    char* result = plugin_buffer_alloc(len + 1);                                                                  \
+    if(result == NULL){                                                                                           \
+        return NULL;                                                                                              \
+    }                                                                                                             \
+    plugin_transform_span(input, result, len);                                                                    \
+    result[len] = '\0';                                                                                           \
+    return result;                                                                                                \
+}                                                                                                                 \
+                                                                                                                  \
+__attribute__((visibility("default")))                                                                            \
+const char* plugin_init(int queue_size){                                                                          \
+    return common_plugin_init(plugin_transform, NAME, queue_size);                                                \
+}                                                                                                                 \
+                                                                                                                  \
+__attribute__((visibility("default")))                                                                            \
+const char* plugin_instance_init(const plugin_config_t* config, plugin_instance_t** instance){                     \
+    return common_plugin_instance_init_inplace(plugin_transform, plugin_transform_inplace, plugin_transform_rope,  \
+                                               NAME, config, instance);                                           \
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef BYTE_REVERSE_H
+#define BYTE_REVERSE_H
+
+/**
+ * byte reverse turns the bytes of one vector register around - the step flipper's kernels and reversed views
+ * (plugin_view) both take per block, kept here once so the two can't drift apart.
+ * every helper is always inlined: build.sh doesn't optimize, and a call per block would cost more than the block.
+ * x86 only - include it where immintrin.h is available.
+ **/
+
+#include <immintrin.h> // SSE2 / AVX2 intrinsics
+
+/**
+ * Reverse the 16 bytes of a register with SSE2 only: swap the bytes of every word, then the words, then the halves
+ * @param bytes The block
+ * @return The block backwards
+ */
+__attribute__((always_inline))
+static inline __m128i byte_reverse_sse2(__m128i bytes){
+    bytes = _mm_or_si128(_mm_slli_epi16(bytes, 8), _mm_srli_epi16(bytes, 8));
+    bytes = _mm_shufflelo_epi16(bytes, _MM_SHUFFLE(0, 1, 2, 3));
+    bytes = _mm_shufflehi_epi16(bytes, _MM_SHUFFLE(0, 1, 2, 3));
+    return _mm_shuffle_epi32(bytes, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+/**
+ * The shuffle control that mirrors each 128-bit lane (15..0 in both) - build it once, outside the loop
+ * @return The control
+ */
+__attribute__((target("avx2"), always_inline))
+static inline __m256i byte_reverse_mirror_avx2(void){
+    return _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                            15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+}
+
+/**
+ * Reverse each 128-bit lane of a register on its own (the lanes stay where they are)
+ * @param bytes The block
+ * @param mirror byte_reverse_mirror_avx2()
+ * @return Both lanes backwards
+ */
+__attribute__((target("avx2"), always_inline))
+static inline __m256i byte_reverse_lanes_avx2(__m256i bytes, __m256i mirror){
+    return _mm256_shuffle_epi8(bytes, mirror);
+}
+
+/**
+ * Reverse the 32 bytes of a register: each lane mirrored, then the lanes swapped
+ * @param bytes The block
+ * @param mirror byte_reverse_mirror_avx2()
+ * @return The block backwards
+ */
+__attribute__((target("avx2"), always_inline))
+static inline __m256i byte_reverse_avx2(__m256i bytes, __m256i mirror){
+    __m256i lanes = byte_reverse_lanes_avx2(bytes, mirror);
+    return _mm256_permute2x128_si256(lanes, lanes, 0x01);
+}
+
+#endif
@@ -3,10 +3,84 @@
 #include <string.h>
 #include <pthread.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // SSE2 / AVX2 intrinsics
+#define EXPANDER_X86 1
+#endif
+
 #include "plugin_sdk.h"
 #include "plugin_common.h"
 
 // expander: Inserts a single white space between each character in the string. 
+// Blocks of 16 (SSE2) or 32 (AVX2, if the CPU has it) chars are interleaved with a register of spaces.
+
+
+/**
+ * Interleave chars from i on with spaces, one at a time (the leftovers of the vector kernels)
+ * @param input The string (len chars)
+ * @param output Buffer of 2*len-1 chars
+ * @param len Number of chars
+ * @param i First char still to write
+ */
+static void expander_interleave_scalar(const char* input, char* output, size_t len, size_t i){
+    for(; i + 1 < len; i++){
+        output[2*i]= input[i];
+        output[(2*i)+1]= ' ';
+    }
+    // the last char gets no space after it
+    if(i < len){
+        output[2*i]= input[i];
+    }
+}
+
+
+#ifdef EXPANDER_X86
+
+/**
+ * Interleave 16 chars per step: unpacking the low and high halves against spaces gives "c c c ..." 32 bytes at a time
+ * (a block is only written while it isn't the last char's - that one must not get a space)
+ */
+static void expander_interleave_sse2(const char* input, char* output, size_t len, size_t i){
+    const __m128i spaces= _mm_set1_epi8(' ');
+    for(; i + 16 < len; i += 16){
+        __m128i chars= _mm_loadu_si128((const __m128i*)(input + i));
+        _mm_storeu_si128((__m128i*)(output + 2*i), _mm_unpacklo_epi8(chars, spaces));
+        _mm_storeu_si128((__m128i*)(output + 2*i + 16), _mm_unpackhi_epi8(chars, spaces));
+    }
+    expander_interleave_scalar(input, output, len, i);
+}
+
+
+/**
+ * Interleave 32 chars per step - AVX2 unpacks within 128-bit lanes, so the quarters are put in order 0, 2, 1, 3 first
+ */
+__attribute__((target("avx2")))
+static void expander_interleave_avx2(const char* input, char* output, size_t len, size_t i){
+    const __m256i spaces= _mm256_set1_epi8(' ');
+    for(; i + 32 < len; i += 32){
+        __m256i chars= _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i*)(input + i)), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(output + 2*i), _mm256_unpacklo_epi8(chars, spaces));
+        _mm256_storeu_si256((__m256i*)(output + 2*i + 32), _mm256_unpackhi_epi8(chars, spaces));
+    }
+    expander_interleave_sse2(input, output, len, i);
+}
+
+#endif
+
+
+// the kernel this CPU runs (picked when the plugin is loaded)
+static void (*expander_interleave)(const char*, char*, size_t, size_t)= expander_interleave_scalar;
+
+/**
+ * Pick the kernel when the plugin is loaded (before any transform can run)
+ */
+__attribute__((constructor))
+static void expander_setup(void){
+#ifdef EXPANDER_X86
+    __builtin_cpu_init();
+    expander_interleave= __builtin_cpu_supports("avx2") ? expander_interleave_avx2 : expander_interleave_sse2;
+#endif
+}
 
 /**
  * Get the plugin's name
@@ -18,31 +92,84 @@ const char* plugin_get_name(void){
 }
 
 
-// transformation function
-const char* plugin_transform(const char* input){
-    int len= strlen(input);
-    
-    // allocate *twice* the memory for the copy of input (so we can later on free the original input from memory)
-    char* result= malloc((len*2)+1);
+/**
+ * Get the plugin's properties
+ * @return PLUGIN_FLAG_PURE - the transform only builds a new string from its input
+ */
+__attribute__((visibility("default")))
+unsigned int plugin_get_flags(void){
+    return PLUGIN_FLAG_PURE;
+}
+
+
+/**
+ * Interleave spaces into a view - the chars are written once, when the host builds the whole run
+ * @param view The string so far
+ * @return 0 on success, -1 if the view can't take another layer
+ */
+__attribute__((visibility("default")))
+int plugin_transform_view(plugin_view_t* view){
+    return plugin_view_interleave(view, ' ');
+}
+
+
+
+/**
+ * Rope transform: spaces are interleaved segment by segment into new chunks, and each old chunk goes as soon as
+ * it has been read - the line is never held twice in full
+ * @param rope The string
+ * @return 0 on success, -1 on failure
+ */
+__attribute__((visibility("default")))
+int plugin_transform_rope(plugin_rope_t* rope){
+    return plugin_rope_interleave(rope, ' ');
+}
+
+
+/**
+ * Interleave spaces into a string of len chars
+ * @param input The string
+ * @param len Number of chars
+ * @param result_len Output - length of the result
+ * @return The result, or NULL on allocation failure
+ */
+static char* expander_expand(const char* input, size_t len, size_t* result_len){
+    // a space between every two chars and none after the last: 2*len-1 chars (an empty string stays empty)
+    *result_len= len > 0 ? (len*2)-1 : 0;
+    char* result= plugin_buffer_alloc(*result_len+1);
     // error allocating memory: return NULL
     if(result == NULL){
         return NULL;
     }
-    
-    // add a single space after each char from input (except for the last char) 
-    for(int i=0; i<len-1; i++){
-        result[2*i]=input[i];
-        result[(2*i)+1]=' ';
-    }
 
-    // add the last char from input and then the null terminator
-    result[2*(len-1)]=input[len-1];
-    result[2*(len-1)+1]='\0';
+    // add a single space after each char from input (except for the last char), then the null terminator
+    expander_interleave(input, result, len, 0);
+    result[*result_len]='\0';
 
     return result;
 }
 
 
+// transformation function
+const char* plugin_transform(const char* input){
+    size_t result_len;
+    return expander_expand(input, strlen(input), &result_len);
+}
+
+
+/**
+ * v2 transform: the result is sized from the length the envelope brings, and its own length goes on with it
+ * @param input The string
+ * @param output Gets the expanded string
+ * @return 0 on success, -1 on failure
+ */
+__attribute__((visibility("default")))
+int plugin_transform_message(const plugin_message_t* input, plugin_message_t* output){
+    output->payload= expander_expand(input->payload, input->len, &output->len);
+    return output->payload != NULL ? 0 : -1;
+}
+
+
 /**
  * Initialize the plugin with the specified queue size - calls common_plugin_init
  * This function should be implemented by each plugin
@@ -53,3 +180,16 @@ __attribute__((visibility("default")))
 const char* plugin_init(int queue_size){
     return common_plugin_init(plugin_transform, "expander", queue_size);
 }
+
+
+/**
+ * Create a new, independent instance of the plugin - calls common_plugin_instance_init_message
+ * This function should be implemented by each plugin
+ * @param config Plugin configuration
+ * @param instance Output - the new instance on success
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_init(const plugin_config_t* config, plugin_instance_t** instance){
+    return common_plugin_instance_init_message(plugin_transform, plugin_transform_message, plugin_transform_rope, "expander", config, instance);
+}
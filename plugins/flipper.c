@@ -3,10 +3,124 @@
 #include <string.h>
 #include <pthread.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#define FLIPPER_X86 1
+#include "byte_reverse.h"
+#endif
+
 #include "plugin_sdk.h"
 #include "plugin_common.h"
 
 // flipper: Reverses the order of characters in the string. 
+// Blocks of 16 (SSE2) or 32 (AVX2, if the CPU has it) bytes are reversed in registers and stored at the mirrored place.
+
+
+/**
+ * Reverse len bytes into another buffer, one at a time (and the leftovers of the vector kernels)
+ */
+static void flipper_reverse_scalar(const char* input, char* output, size_t len){
+    for(size_t i=0; i<len; i++){
+        output[i]= input[len-1-i];
+    }
+}
+
+
+/**
+ * Reverse len bytes where they are, swapping from both ends one at a time
+ */
+static void flipper_reverse_inplace_scalar(char* buf, size_t len){
+    for(size_t i=0, j=len; i + 1 < j; i++, j--){
+        char tmp= buf[i];
+        buf[i]= buf[j-1];
+        buf[j-1]= tmp;
+    }
+}
+
+
+#ifdef FLIPPER_X86
+
+/**
+ * Reverse into another buffer, 16 bytes per step
+ */
+static void flipper_reverse_sse2(const char* input, char* output, size_t len){
+    size_t i= 0;
+    for(; i + 16 <= len; i += 16){
+        __m128i block= _mm_loadu_si128((const __m128i*)(input + len - i - 16));
+        _mm_storeu_si128((__m128i*)(output + i), byte_reverse_sse2(block));
+    }
+    flipper_reverse_scalar(input, output + i, len - i);
+}
+
+
+/**
+ * Reverse into another buffer, 32 bytes per step
+ */
+__attribute__((target("avx2")))
+static void flipper_reverse_avx2(const char* input, char* output, size_t len){
+    const __m256i mirror= byte_reverse_mirror_avx2();
+    size_t i= 0;
+    for(; i + 32 <= len; i += 32){
+        __m256i block= _mm256_loadu_si256((const __m256i*)(input + len - i - 32));
+        _mm256_storeu_si256((__m256i*)(output + i), byte_reverse_avx2(block, mirror));
+    }
+    flipper_reverse_scalar(input, output + i, len - i);
+}
+
+
+/**
+ * In place: load a block from each end, reverse both, store them crosswise - then the middle, which is shorter than two blocks
+ */
+static void flipper_reverse_inplace_sse2(char* buf, size_t len){
+    size_t head= 0, tail= len;
+    while(tail - head >= 32){
+        __m128i front= _mm_loadu_si128((const __m128i*)(buf + head));
+        __m128i back= _mm_loadu_si128((const __m128i*)(buf + tail - 16));
+        _mm_storeu_si128((__m128i*)(buf + head), byte_reverse_sse2(back));
+        _mm_storeu_si128((__m128i*)(buf + tail - 16), byte_reverse_sse2(front));
+        head += 16;
+        tail -= 16;
+    }
+    flipper_reverse_inplace_scalar(buf + head, tail - head);
+}
+
+
+/**
+ * In place with 32-byte blocks (the middle goes to the SSE2 one)
+ */
+__attribute__((target("avx2")))
+static void flipper_reverse_inplace_avx2(char* buf, size_t len){
+    const __m256i mirror= byte_reverse_mirror_avx2();
+    size_t head= 0, tail= len;
+    while(tail - head >= 64){
+        __m256i front= _mm256_loadu_si256((const __m256i*)(buf + head));
+        __m256i back= _mm256_loadu_si256((const __m256i*)(buf + tail - 32));
+        _mm256_storeu_si256((__m256i*)(buf + head), byte_reverse_avx2(back, mirror));
+        _mm256_storeu_si256((__m256i*)(buf + tail - 32), byte_reverse_avx2(front, mirror));
+        head += 32;
+        tail -= 32;
+    }
+    flipper_reverse_inplace_sse2(buf + head, tail - head);
+}
+
+#endif
+
+
+// the kernels this CPU runs (picked when the plugin is loaded)
+static void (*flipper_reverse)(const char*, char*, size_t)= flipper_reverse_scalar;
+static void (*flipper_reverse_inplace)(char*, size_t)= flipper_reverse_inplace_scalar;
+
+/**
+ * Pick the kernels when the plugin is loaded (before any transform can run)
+ */
+__attribute__((constructor))
+static void flipper_setup(void){
+#ifdef FLIPPER_X86
+    __builtin_cpu_init();
+    int avx2= __builtin_cpu_supports("avx2");
+    flipper_reverse= avx2 ? flipper_reverse_avx2 : flipper_reverse_sse2;
+    flipper_reverse_inplace= avx2 ? flipper_reverse_inplace_avx2 : flipper_reverse_inplace_sse2;
+#endif
+}
 
 /**
  * Get the plugin's name
@@ -18,37 +132,88 @@ const char* plugin_get_name(void){
 }
 
 
+/**
+ * Get the plugin's properties
+ * @return PLUGIN_FLAG_PURE - the transform only builds a new string from its input,
+ *         PLUGIN_FLAG_INVOLUTION - flipping twice gives back the input
+ */
+__attribute__((visibility("default")))
+unsigned int plugin_get_flags(void){
+    return PLUGIN_FLAG_PURE | PLUGIN_FLAG_INVOLUTION;
+}
+
+
+/**
+ * Length-preserving transform into a caller-provided buffer (lets the host fuse stages without allocating)
+ * @param input The string to transform (len chars, need not be terminated)
+ * @param output Buffer of at least len chars, not overlapping input (not terminated by this function)
+ * @param len Number of chars
+ */
+__attribute__((visibility("default")))
+void plugin_transform_span(const char* input, char* output, size_t len){
+    // reverse while copying
+    flipper_reverse(input, output, len);
+}
+
+
+/**
+ * Flip several times in a single pass (every two flips cancel out)
+ * @param input The string to transform (len chars, need not be terminated)
+ * @param output Buffer of at least len chars, not overlapping input (not terminated by this function)
+ * @param len Number of chars
+ * @param times How many times to flip
+ */
+__attribute__((visibility("default")))
+void plugin_transform_span_repeat(const char* input, char* output, size_t len, unsigned long times){
+    if(times % 2 == 0){
+        memcpy(output, input, len);
+        return;
+    }
+    plugin_transform_span(input, output, len);
+}
+
+
+/**
+ * Reverse a view instead of the chars (two flips cancel out in it, so a run of flips costs nothing)
+ * @param view The string so far
+ * @return 0 on success, -1 if the view can't take another layer
+ */
+__attribute__((visibility("default")))
+int plugin_transform_view(plugin_view_t* view){
+    return plugin_view_reverse(view);
+}
+
+
 // transformation function
 const char* plugin_transform(const char* input){    
     // allocate memory for the copy of input (so we can later on free the original input from memory)
     int len= strlen(input);
-    int start=0;
-    int end= len-1;
-    char tmp;
             
-    char* result= malloc(len+1);
+    char* result= plugin_buffer_alloc(len+1);
     // error allocating memory: return NULL
     if(result == NULL){
         return NULL;
     }
 
-    // copy
-    strcpy(result, input);
-
-    // reverse the copy
-    while(start<end){
-        tmp= result[start];
-        result[start]=result[end];
-        result[end]=tmp;
-
-        start++;
-        end--;
-    }
+    // reverse into the copy
+    plugin_transform_span(input, result, len);
+    result[len]= '\0';
            
     return result;
 }
 
 
+/**
+ * In-place transform: reverse the string in the buffer it came in (the instance owns it, so no copy is made)
+ * @param buf The string (len chars)
+ * @param len Number of chars
+ */
+__attribute__((visibility("default")))
+void plugin_transform_inplace(char* buf, size_t len){
+    flipper_reverse_inplace(buf, len);
+}
+
+
 /**
  * Initialize the plugin with the specified queue size - calls common_plugin_init
  * This function should be implemented by each plugin
@@ -59,3 +224,16 @@ __attribute__((visibility("default")))
 const char* plugin_init(int queue_size){
     return common_plugin_init(plugin_transform, "flipper", queue_size);
 }
+
+
+/**
+ * Create a new, independent instance of the plugin - calls common_plugin_instance_init
+ * This function should be implemented by each plugin
+ * @param config Plugin configuration
+ * @param instance Output - the new instance on success
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_init(const plugin_config_t* config, plugin_instance_t** instance){
+    return common_plugin_instance_init_inplace(plugin_transform, plugin_transform_inplace, NULL, "flipper", config, instance);
+}
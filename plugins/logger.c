@@ -20,22 +20,83 @@ const char* plugin_get_name(void){
 }
 
 
-// transformation function
-const char* plugin_transform(const char* input){
-    fprintf(stdout, "[logger] %s\n", input);
+/**
+ * Get the plugin's properties
+ * @return 0 - the transform writes to stdout, so calls must stay on one thread and in input order
+ */
+__attribute__((visibility("default")))
+unsigned int plugin_get_flags(void){
+    return 0;
+}
+
+
+/**
+ * Print a line of len chars and copy it for the next stage
+ * @param input The line (null-terminated)
+ * @param len Number of chars
+ * @return The copy, or NULL on allocation failure
+ */
+static char* logger_log(const char* input, size_t len){
+    // the whole line is one record - the host's writer thread batches many of them into one write
+    struct iovec line[]= { { "[logger] ", 9 }, { (char*)input, len }, { "\n", 1 } };
+    plugin_output(line, 3);
     
     // allocate memory for the copy of input (so we can later on free the original input from memory)
-    char* result= malloc(strlen(input)+1);
+    char* result= plugin_buffer_alloc(len+1);
     // error allocating memory: return NULL
     if(result == NULL){
         return NULL;
     }
     // copy
-    strcpy(result, input);
+    memcpy(result, input, len+1);
     return result;
 }
 
 
+// transformation function
+const char* plugin_transform(const char* input){
+    return logger_log(input, strlen(input));
+}
+
+
+/**
+ * v2 transform: the envelope brings the line's length, so it is printed and copied without counting it
+ * @param input The line
+ * @param output Gets the copy
+ * @return 0 on success, -1 on failure
+ */
+__attribute__((visibility("default")))
+int plugin_transform_message(const plugin_message_t* input, plugin_message_t* output){
+    output->payload= logger_log(input->payload, input->len);
+    output->len= input->len;
+    return output->payload != NULL ? 0 : -1;
+}
+
+
+
+/**
+ * Rope transform: print a very long line straight from its segments, as one record (the rope goes on unchanged)
+ * @param rope The string
+ * @return 0 on success, -1 on failure
+ */
+__attribute__((visibility("default")))
+int plugin_transform_rope(plugin_rope_t* rope){
+    int count= plugin_rope_parts(rope, NULL, 0);
+    struct iovec* line= malloc((count+2) * sizeof(struct iovec));
+    // error allocating memory: return -1
+    if(line == NULL){
+        return -1;
+    }
+
+    line[0]= (struct iovec){ "[logger] ", 9 };
+    plugin_rope_parts(rope, line+1, count);
+    line[count+1]= (struct iovec){ "\n", 1 };
+    plugin_output(line, count+2);
+    free(line);
+    return 0;
+}
+
+
 /**
  * Initialize the plugin with the specified queue size - calls common_plugin_init
  * This function should be implemented by each plugin
@@ -47,3 +108,16 @@ const char* plugin_init(int queue_size){
     return common_plugin_init(plugin_transform, "logger", queue_size);
 }
 
+
+/**
+ * Create a new, independent instance of the plugin - calls common_plugin_instance_init_message
+ * This function should be implemented by each plugin
+ * @param config Plugin configuration
+ * @param instance Output - the new instance on success
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_init(const plugin_config_t* config, plugin_instance_t** instance){
+    return common_plugin_instance_init_message(plugin_transform, plugin_transform_message, plugin_transform_rope, "logger", config, instance);
+}
+
@@ -0,0 +1,19 @@
+#include "byte_map_plugin.h"
+
+// lowercaser: Converts all alphabetic characters in the string to lowercase.
+// (ASCII A-Z, as a byte map like uppercaser - the table is all there is to it)
+
+
+/**
+ * The map: A-Z to a-z, every other byte stays
+ * @param table Output - byte -> byte
+ */
+static void lowercaser_table(unsigned char table[256]){
+    for(int c = 0; c < 256; c++){
+        table[c] = (c >= 'A' && c <= 'Z') ? (unsigned char)(c - 'A' + 'a') : (unsigned char)c;
+    }
+}
+
+
+// PLUGIN_FLAG_IDEMPOTENT - lowercasing twice changes nothing more
+BYTE_MAP_PLUGIN("lowercaser", PLUGIN_FLAG_PURE | PLUGIN_FLAG_IDEMPOTENT, lowercaser_table)
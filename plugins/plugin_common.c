@@ -2,17 +2,754 @@
 #include <stdlib.h>  // malloc, free
 #include <string.h>  // strcpy, strlen
 #include <pthread.h> // threads
+#include <sched.h>   // sched_yield
+#include <limits.h>  // INT_MAX
+#include <time.h>    // clock_gettime
 #include "sync/consumer_producer.h"
+#include "sync/reorder_buffer.h"
+#include "sync/monitor.h"
 #include "plugin_sdk.h"
 
 #include "plugin_common.h"
 
+// how far (in sequence numbers) each replica may run ahead of the slowest one before it waits
+#define REORDER_WINDOW_PER_REPLICA 16
+
 // mutex for init function
 static pthread_mutex_t init_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 // static global to hold the plugin state
 static plugin_context_t* g_plugin_context = NULL;
 
+// output service of the instance whose transform runs on this thread (NULL: stdio) - plugin_output has no context argument
+static __thread const plugin_output_t* plugin_current_output = NULL;
+
+// buffer allocator of the instance whose transform runs on this thread (NULL: malloc) - same for plugin_buffer_alloc
+static __thread const plugin_buffers_t* plugin_current_buffers = NULL;
+
+/**
+ * Allocate a message buffer from the instance's allocator
+ * @param context Plugin context
+ * @param size Bytes needed
+ * @return The buffer, or NULL on allocation failure
+ */
+static char* plugin_alloc(plugin_context_t* context, size_t size){
+    if(context->buffers.alloc != NULL){
+        return context->buffers.alloc(context->buffers.pool, size);
+    }
+    return malloc(size);
+}
+
+/**
+ * Free a heap string through the instance's allocator (which takes malloc'd strings too)
+ * @param context Plugin context
+ * @param buffer Heap-allocated string (NULL is ignored)
+ */
+static void plugin_release(plugin_context_t* context, char* buffer){
+    if(context->buffers.release != NULL){
+        context->buffers.release(context->buffers.pool, buffer);
+        return;
+    }
+    free(buffer);
+}
+
+/**
+ * Free an owned item, whether it is a string or a rope
+ * @param context Plugin context
+ * @param item Heap-allocated string or tagged rope
+ */
+static void plugin_free_item(plugin_context_t* context, char* item){
+    plugin_rope_t* rope = plugin_rope_from_item(item);
+    if(rope != NULL){
+        plugin_rope_free(rope);
+        return;
+    }
+    plugin_release(context, item);
+}
+
+/**
+ * The queue's allocator: copies come from the instance's buffers - unless its inputs are lent, since the host's
+ * release_input then gets the copies too, and it passes what it didn't lend to free()
+ * @param arg Pointer to plugin_context_t
+ * @param size Bytes needed
+ * @return The buffer, or NULL on allocation failure
+ */
+static char* plugin_queue_alloc(void* arg, size_t size){
+    plugin_context_t* context = (plugin_context_t*)arg;
+    if(context->release_input != NULL){
+        return malloc(size);
+    }
+    return plugin_alloc(context, size);
+}
+
+/**
+ * The queue's release function: items left in it at destroy may be ropes too, and a record ring gives back the
+ * items it copied in right away - lent ones among them, which go back to the host
+ * @param arg Pointer to plugin_context_t
+ * @param item Owned item
+ */
+static void plugin_queue_release(void* arg, char* item){
+    plugin_context_t* context = (plugin_context_t*)arg;
+    if(context->release_input != NULL){
+        context->release_input(context->release_arg, item);
+        return;
+    }
+    plugin_free_item(context, item);
+}
+
+/**
+ * Current time for ingest timestamps
+ * @return CLOCK_MONOTONIC in nanoseconds
+ */
+static unsigned long long plugin_now_ns(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+/**
+ * Put an item just taken from the queue into an envelope
+ * @param message Output - the envelope
+ * @param item Queue item (string or tagged rope)
+ * @param header What it was put with (len PLUGIN_MESSAGE_LEN_UNKNOWN if nobody counted it yet)
+ */
+static void plugin_message_wrap(plugin_message_t* message, char* item, const plugin_header_t* header){
+    message->payload = item;
+    message->len = header->len;
+    message->seq = header->seq;
+    message->ingest_ns = header->ingest_ns;
+    message->flags = PLUGIN_MESSAGE_DATA;
+    message->control = 0;
+}
+
+/**
+ * Header of a record taken from a record ring (the ring keeps it in the record's own header)
+ * @param view The record
+ * @return The header
+ */
+static plugin_header_t plugin_view_header(const record_ring_view_t* view){
+    plugin_header_t header = { view->len, view->seq, view->ingest_ns };
+    return header;
+}
+
+/**
+ * Header a message's result goes downstream with: the input's seq and ingest time, and the result's length
+ * @param message The message (its len is the result's once plugin_process returned)
+ * @return The header
+ */
+static plugin_header_t plugin_message_header(const plugin_message_t* message){
+    plugin_header_t header = { message->len, message->seq, message->ingest_ns };
+    return header;
+}
+
+/**
+ * Header of an item placed without one: it is new input here - the next seq of the instance's own count, read now
+ * @param context Plugin context
+ * @return The header (len not counted)
+ */
+static plugin_header_t plugin_ingest_header(plugin_context_t* context){
+    plugin_header_t header = { PLUGIN_MESSAGE_LEN_UNKNOWN, atomic_fetch_add(&context->ingested, 1), plugin_now_ns() };
+    return header;
+}
+
+/**
+ * Take the control message the queue has due into an envelope - after a take came back empty-handed
+ * @param context Plugin context
+ * @param message Output - the control message (NULL payload, seq is its position in the queue)
+ * @return 1 if one was taken, 0 if there is none after all (another replica took it first)
+ */
+static int plugin_take_control(plugin_context_t* context, plugin_message_t* message){
+    consumer_producer_signal_t signal;
+    if(consumer_producer_take_control(context->queue, &signal) != 1){
+        return 0;
+    }
+    message->payload = NULL;
+    message->len = 0;
+    message->seq = signal.position;
+    message->ingest_ns = plugin_now_ns();
+    message->flags = PLUGIN_MESSAGE_CONTROL;
+    // the lane's types have the SDK's values
+    message->control = (int)signal.type;
+    return 1;
+}
+
+/**
+ * Length of a message's payload, counted on first use and kept in the envelope (free when the queue knew it)
+ * @param message The message (a string)
+ * @return Number of chars
+ */
+static size_t plugin_message_len(plugin_message_t* message){
+    if(message->len == PLUGIN_MESSAGE_LEN_UNKNOWN){
+        message->len = strlen(message->payload);
+    }
+    return message->len;
+}
+
+int plugin_message_transform_legacy(const char* (*transform)(const char*), const plugin_message_t* input, plugin_message_t* output){
+    *output = *input;
+    output->payload = (char*)transform(input->payload);
+    output->len = PLUGIN_MESSAGE_LEN_UNKNOWN;
+    return output->payload != NULL ? 0 : -1;
+}
+
+/**
+ * Forward one result downstream, handing over ownership when the next stage accepts it
+ * @param context Plugin context
+ * @param result Heap-allocated transformed string (always consumed by this call)
+ * @param header What it goes on with (plugin_message_header)
+ */
+static void plugin_forward(plugin_context_t* context, char* result, const plugin_header_t* header){
+    if(context->next.instance){
+        // zero-copy: the next queue stores our pointer as-is, its header next to it (we keep it only if the put failed)
+        const char* error = context->next.place_messages_owned != NULL
+                            ? context->next.place_messages_owned(context->next.instance, &result, header, 1)
+                            : context->next.place_work_owned(context->next.instance, result);
+        if(error != NULL){
+            plugin_free_item(context, result);
+        }
+        return;
+    }
+
+    // single-instance link (or last plugin): the next queue copies what it receives, so the result is ours to free
+    // For logger/typewriter, output happens in plugin_transform, so just free
+    if(context->next_place_work){
+        context->next_place_work(result);
+    }
+    plugin_free_item(context, result);
+}
+
+/**
+ * Forward a batch of results downstream (always consumes every result)
+ * @param context Plugin context
+ * @param results Heap-allocated transformed strings
+ * @param headers What each of them goes on with
+ * @param count Number of results
+ */
+static void plugin_forward_batch(plugin_context_t* context, char** results, const plugin_header_t* headers, int count){
+    if(count == 0){
+        return;
+    }
+
+    if(context->next.instance && context->next.place_messages_owned){
+        // one lock acquisition and one wakeup downstream for the whole batch, no copies
+        if(context->next.place_messages_owned(context->next.instance, results, headers, count) != NULL){
+            for(int i = 0; i < count; i++){
+                plugin_free_item(context, results[i]);
+            }
+        }
+        return;
+    }
+
+    if(context->next.instance && context->next.place_work_many_owned){
+        // one lock acquisition and one wakeup downstream for the whole batch, no copies
+        if(context->next.place_work_many_owned(context->next.instance, results, count) != NULL){
+            for(int i = 0; i < count; i++){
+                plugin_free_item(context, results[i]);
+            }
+        }
+        return;
+    }
+
+    for(int i = 0; i < count; i++){
+        plugin_forward(context, results[i], &headers[i]);
+    }
+}
+
+/**
+ * Wait until everything the instance printed through the host's output service has been written (no-op for stdio)
+ * @param context Plugin context
+ */
+static void plugin_flush_output(plugin_context_t* context){
+    if(context->output.write != NULL && context->output.flush != NULL){
+        context->output.flush(context->output.writer);
+    }
+}
+
+/**
+ * Pass a control message on to the next stage (if there is one) - the instance's output is flushed first
+ * A failure is logged and kept for plugin_instance_wait_finished: the next stage may never see its END.
+ * @param context Plugin context
+ * @param control PLUGIN_CONTROL_END, PLUGIN_CONTROL_FLUSH or PLUGIN_CONTROL_BARRIER
+ * @return NULL on success, error message on failure
+ */
+static const char* plugin_forward_control(plugin_context_t* context, int control){
+    plugin_flush_output(context);
+    const char* error = NULL;
+    if(context->next.instance){
+        if(context->next.signal != NULL){
+            error = context->next.signal(context->next.instance, control);
+        }
+    }
+    else if(context->next_signal != NULL){
+        error = context->next_signal(control);
+    }
+    if(error != NULL){
+        log_error(context, error);
+        atomic_store(&context->control_failed, 1);
+    }
+    return error;
+}
+
+/**
+ * Is the instance's input only lent to it - by the host, or by its own record ring (it can't keep or write into it)
+ * @param context Plugin context
+ * @return 1 if so, 0 if input items are the instance's own
+ */
+static int plugin_input_lent(plugin_context_t* context){
+    return context->release_input != NULL || context->records;
+}
+
+/**
+ * Give an input item back once the instance is done with it (free it, unless the host or the record ring lent it)
+ * @param context Plugin context
+ * @param item Input item
+ */
+static void plugin_release_input(plugin_context_t* context, char* item){
+    // views into the record ring go back from the loop that took them (plugin_release_views), a batch at a time
+    if(context->records){
+        return;
+    }
+    if(context->release_input != NULL){
+        context->release_input(context->release_arg, item);
+        return;
+    }
+    plugin_free_item(context, item);
+}
+
+/**
+ * Give the oldest views taken from the record ring back, once their items are through (nothing to do for other queues)
+ * @param context Plugin context
+ * @param count Number of items taken and done with
+ */
+static void plugin_release_views(plugin_context_t* context, int count){
+    if(context->records){
+        consumer_producer_release_views(context->queue, count);
+    }
+}
+
+/**
+ * Make sure the thread's scratch buffer holds at least size chars
+ * @param scratch The calling thread's scratch buffer
+ * @param size Chars needed
+ * @return 0 on success, -1 if it couldn't grow
+ */
+static int plugin_scratch_reserve(plugin_scratch_t* scratch, size_t size){
+    if(scratch->size >= size){
+        return 0;
+    }
+    char* grown = realloc(scratch->buffer, size);
+    if(grown == NULL){
+        return -1;
+    }
+    scratch->buffer = grown;
+    scratch->size = size;
+    return 0;
+}
+
+/**
+ * Build the string a view over current stands for, into the buffer fused stages would write next
+ * (a new heap buffer when interleaving made it longer - it replaces owned)
+ * @param context Plugin context
+ * @param view The view (its base is *current)
+ * @param owned The heap buffer that becomes the result (freed on failure)
+ * @param current Where the latest output is - updated to the built string
+ * @param len Its length - updated
+ * @param scratch The calling thread's scratch buffer
+ * @return 0 on success, -1 on failure
+ */
+static int plugin_build_view(plugin_context_t* context, const plugin_view_t* view, char** owned, char** current, size_t* len, plugin_scratch_t* scratch){
+    // nothing left to remap (e.g. two flips) - the chars already are the string
+    if(view->num_layers == 0){
+        return 0;
+    }
+
+    size_t built_len = plugin_view_length(view);
+    char* target;
+    if(built_len > *len){
+        target = plugin_alloc(context, built_len + 1);
+        if(target == NULL){
+            plugin_release(context, *owned);
+            return -1;
+        }
+        plugin_view_materialize(view, target);
+        plugin_release(context, *owned);
+        *owned = target;
+    }
+    else{
+        if(*current == *owned && plugin_scratch_reserve(scratch, *len + 1) != 0){
+            plugin_release(context, *owned);
+            return -1;
+        }
+        target = *current == *owned ? scratch->buffer : *owned;
+        plugin_view_materialize(view, target);
+    }
+    target[built_len] = '\0';
+    *current = target;
+    *len = built_len;
+    return 0;
+}
+
+/**
+ * Run the instance's rope transform and decide what the result travels as
+ * @param context Plugin context
+ * @param rope The item (always consumed)
+ * @return The rope as a tagged item if the next stage takes ropes (or there is none), else the string built from it,
+ *         or NULL if the transform failed
+ */
+static char* plugin_process_rope(plugin_context_t* context, plugin_rope_t* rope){
+    if(context->rope_function(rope) != 0){
+        plugin_rope_free(rope);
+        return NULL;
+    }
+    int passed_on = context->next.instance != NULL ? context->next.ropes : context->next_place_work == NULL;
+    return passed_on ? plugin_rope_to_item(rope) : plugin_rope_flatten(rope);
+}
+
+/**
+ * Should this string be transformed as a rope: it is long, and the result can stay a rope downstream
+ * (turning it into one just to build it back right after would only add a copy)
+ * @param context Plugin context
+ * @param message Input message (a string)
+ * @return 1 if so, 0 otherwise
+ */
+static int plugin_wants_rope(plugin_context_t* context, const plugin_message_t* message){
+    if(context->rope_function == NULL || context->num_fused > 0){
+        return 0;
+    }
+    if(context->next.instance != NULL ? !context->next.ropes : context->next_place_work != NULL){
+        return 0;
+    }
+    if(message->len != PLUGIN_MESSAGE_LEN_UNKNOWN){
+        return message->len >= PLUGIN_ROPE_MIN_LENGTH;
+    }
+    // stops at the limit, so a short line is only looked at once more
+    return strnlen(message->payload, PLUGIN_ROPE_MIN_LENGTH) == PLUGIN_ROPE_MIN_LENGTH;
+}
+
+/**
+ * Run the instance's transform(s) on one item
+ * Fused length-preserving stages ping-pong between the item itself and the thread's scratch buffer, so a run of them
+ * allocates nothing per line. A run of fused stages that only remap indices (rotator, flipper, expander) just stacks
+ * them on a view, which is built in one pass when a stage needs the chars or the run ends the instance.
+ * @param context Plugin context
+ * @param message Input message (its payload is always consumed - unless the host lent it, it may become the result
+ *                buffer; its len becomes the result's, PLUGIN_MESSAGE_LEN_UNKNOWN when the transform didn't say)
+ * @param scratch The calling thread's scratch buffer
+ * @return Heap-allocated result, or NULL if a transform failed
+ */
+static char* plugin_process(plugin_context_t* context, plugin_message_t* message, plugin_scratch_t* scratch){
+    char* item = message->payload;
+
+    // pool workers and replicas run many instances' transforms, so this is set per item rather than per thread
+    plugin_current_output = context->output.write != NULL ? &context->output : NULL;
+    plugin_current_buffers = context->buffers.alloc != NULL ? &context->buffers : NULL;
+
+    // a rope from the stage before (lent items are always strings): transformed as it is, or built for the rest
+    plugin_rope_t* rope = !plugin_input_lent(context) ? plugin_rope_from_item(item) : NULL;
+    if(rope != NULL){
+        if(context->rope_function != NULL && context->num_fused == 0){
+            message->len = PLUGIN_MESSAGE_LEN_UNKNOWN;
+            return plugin_process_rope(context, rope);
+        }
+        item = plugin_rope_flatten(rope);
+        if(item == NULL){
+            return NULL;
+        }
+        message->payload = item;
+    }
+    else if(plugin_wants_rope(context, message)){
+        // a very long string: copied into chunks once, and from here on never held in one piece again
+        rope = plugin_rope_new();
+        if(rope == NULL || plugin_rope_append(rope, item, plugin_message_len(message)) != 0){
+            plugin_rope_free(rope);
+            plugin_release_input(context, item);
+            return NULL;
+        }
+        plugin_release_input(context, item);
+        message->len = PLUGIN_MESSAGE_LEN_UNKNOWN;
+        return plugin_process_rope(context, rope);
+    }
+
+    // async: start the transform, then wait for whichever thread finishes it (pool mode never gets here)
+    if(context->async_function != NULL){
+        monitor_reset(&context->async_done);
+        context->async_function(context, item);
+        plugin_release_input(context, item);
+        monitor_wait(&context->async_done);
+        message->len = PLUGIN_MESSAGE_LEN_UNKNOWN;
+        return context->async_result;
+    }
+
+    // in place: the item is ours, so it becomes the result - no allocation, no copy (a lent item is only read)
+    if(context->num_fused == 0 && context->inplace_function != NULL && !plugin_input_lent(context)){
+        context->inplace_function(item, plugin_message_len(message));
+        return item;
+    }
+
+    // one envelope in, one out - a legacy transform gets the payload, and the result's length is left uncounted
+    if(context->num_fused == 0){
+        int failed;
+        plugin_message_t result = *message;
+        result.payload = NULL;
+        result.len = PLUGIN_MESSAGE_LEN_UNKNOWN;
+        if(context->message_function != NULL){
+            // what the v2 transform gets is always counted (once, here, unless the queue knew it)
+            plugin_message_len(message);
+            failed = context->message_function(message, &result);
+        }
+        else{
+            failed = plugin_message_transform_legacy(context->process_function, message, &result);
+        }
+        plugin_release_input(context, item);
+        message->len = result.len;
+        return failed ? NULL : result.payload;
+    }
+
+    // spans write into the item, which isn't ours to write into or pass on when it was lent
+    size_t len = plugin_message_len(message);
+    if(plugin_input_lent(context)){
+        char* copy = plugin_alloc(context, len + 1);
+        if(copy != NULL){
+            memcpy(copy, item, len + 1);
+        }
+        plugin_release_input(context, item);
+        if(copy == NULL){
+            return NULL;
+        }
+        item = copy;
+    }
+
+    // owned: the heap buffer that becomes the result, current: where the latest output is (owned or scratch)
+    char* owned = item;
+    char* current = item;
+    // remappings stacked on current since the last stage that needed the chars
+    plugin_view_t view;
+    int viewing = 0;
+
+    for(int i = 0; i < context->num_fused; i++){
+        const plugin_fused_stage_t* stage = &context->fused[i];
+        // a stage repeated by the planner runs once if it can compose the repeats itself, else once per repeat
+        int composed = stage->transform_view == NULL && stage->transform_span_repeat != NULL && stage->transform_span != NULL;
+        unsigned long passes = (stage->repeat > 1 && !composed) ? stage->repeat : 1;
+
+        if(stage->transform_view != NULL){
+            for(unsigned long pass = 0; pass < passes; pass++){
+                if(!viewing){
+                    plugin_view_init(&view, current, len);
+                    viewing = 1;
+                }
+                if(stage->transform_view(&view) == 0){
+                    continue;
+                }
+                // the view can't take it (a second interleave) - build it, and the stage starts a new one on the result
+                if(plugin_build_view(context, &view, &owned, &current, &len, scratch) != 0){
+                    return NULL;
+                }
+                plugin_view_init(&view, current, len);
+                if(stage->transform_view(&view) != 0){
+                    plugin_release(context, owned);
+                    return NULL;
+                }
+            }
+            continue;
+        }
+
+        // this stage reads the chars
+        if(viewing){
+            viewing = 0;
+            if(plugin_build_view(context, &view, &owned, &current, &len, scratch) != 0){
+                return NULL;
+            }
+        }
+
+        if(stage->transform_span == NULL){
+            // changes the length - it allocates its own result, which becomes the new owned buffer
+            for(unsigned long pass = 0; pass < passes; pass++){
+                const char* result = stage->transform(current);
+                plugin_release(context, owned);
+                if(result == NULL){
+                    return NULL;
+                }
+                owned = current = (char*)result;
+            }
+            len = strlen(owned);
+            continue;
+        }
+
+        // spans keep the length, so scratch only grows when a length-changing stage made the line longer
+        if(plugin_scratch_reserve(scratch, len + 1) != 0){
+            plugin_release(context, owned);
+            return NULL;
+        }
+
+        // write into whichever of the two buffers doesn't hold the input
+        for(unsigned long pass = 0; pass < passes; pass++){
+            char* target = current == owned ? scratch->buffer : owned;
+            if(composed){
+                stage->transform_span_repeat(current, target, len, stage->repeat > 1 ? stage->repeat : 1);
+            }
+            else{
+                stage->transform_span(current, target, len);
+            }
+            target[len] = '\0';
+            current = target;
+        }
+    }
+
+    // the run ended the instance - its chars are written now, once
+    if(viewing && plugin_build_view(context, &view, &owned, &current, &len, scratch) != 0){
+        return NULL;
+    }
+
+    // the last span landed in scratch - the result needs a buffer of its own
+    if(current != owned){
+        memcpy(owned, current, len + 1);
+    }
+    message->len = len;
+    return owned;
+}
+
+/**
+ * Take the next input item or control message, blocking while there is none (a record ring's item is read where it
+ * is stored)
+ * @param context Plugin context
+ * @param message Output - the item or control message in its envelope
+ * @return 0 on success, -1 if there was nothing to take after all (or on error)
+ */
+static int plugin_take(plugin_context_t* context, plugin_message_t* message){
+    plugin_header_t header;
+    char* item = NULL;
+    if(!context->records){
+        item = consumer_producer_get_meta(context->queue, NULL, &header);
+    }
+    else{
+        record_ring_view_t view;
+        if(consumer_producer_get_view(context->queue, &view) == 0){
+            item = view.data;
+            header = plugin_view_header(&view);
+        }
+    }
+    if(item == NULL){
+        return plugin_take_control(context, message) ? 0 : -1;
+    }
+    plugin_message_wrap(message, item, &header);
+    return 0;
+}
+
+/**
+ * Take the next input item or control message without blocking
+ * @param context Plugin context
+ * @param message Output - the item or control message in its envelope
+ * @return 1 if one was taken, 0 if there is none
+ */
+static int plugin_try_take(plugin_context_t* context, plugin_message_t* message){
+    plugin_header_t header;
+    char* item = NULL;
+    if(!context->records){
+        item = consumer_producer_try_get_meta(context->queue, &header);
+    }
+    else{
+        record_ring_view_t view;
+        if(consumer_producer_try_get_view(context->queue, &view) == 1){
+            item = view.data;
+            header = plugin_view_header(&view);
+        }
+    }
+    if(item == NULL){
+        return plugin_take_control(context, message);
+    }
+    plugin_message_wrap(message, item, &header);
+    return 1;
+}
+
+/**
+ * Take between 1 and max input items, blocking while there is none - or the control message that is due, on its own
+ * @param context Plugin context
+ * @param messages Output array of at least max entries - the items in their envelopes
+ * @param items Room for max items
+ * @param headers Room for max headers
+ * @param views Room for max views (record ring only, may be NULL otherwise)
+ * @param max Maximum number of items
+ * @return Number of items taken (1 for a control message), 0 if there was nothing after all, or -1 on error
+ */
+static int plugin_take_many(plugin_context_t* context, plugin_message_t* messages, char** items, plugin_header_t* headers,
+                            record_ring_view_t* views, int max){
+    int count = context->records ? consumer_producer_get_many_views(context->queue, views, max)
+                                 : consumer_producer_get_many_meta(context->queue, items, headers, max);
+    if(count == 0){
+        return plugin_take_control(context, &messages[0]);
+    }
+    for(int i = 0; i < count; i++){
+        if(context->records){
+            headers[i] = plugin_view_header(&views[i]);
+            items[i] = views[i].data;
+        }
+        plugin_message_wrap(&messages[i], items[i], &headers[i]);
+    }
+    return count;
+}
+
+/**
+ * Batch consumer loop: drain everything available (up to batch_size), process it, forward it as one batch
+ * @param context Plugin context
+ */
+static void plugin_consumer_batch_loop(plugin_context_t* context){
+    char** items = malloc(context->batch_size * sizeof(char*));
+    char** results = malloc(context->batch_size * sizeof(char*));
+    plugin_header_t* headers = malloc(context->batch_size * sizeof(plugin_header_t));
+    plugin_message_t* messages = malloc(context->batch_size * sizeof(plugin_message_t));
+    record_ring_view_t* views = context->records ? malloc(context->batch_size * sizeof(record_ring_view_t)) : NULL;
+    plugin_scratch_t scratch = { NULL, 0 };
+    if(items == NULL || results == NULL || headers == NULL || messages == NULL || (context->records && views == NULL)){
+        // can't batch without the arrays - fall back to one item per get
+        free(items);
+        free(results);
+        free(headers);
+        free(messages);
+        free(views);
+        context->batch_size = 1;
+        return;
+    }
+
+    int done = 0;
+    while(!done){
+        int count = plugin_take_many(context, messages, items, headers, views, context->batch_size);
+        int num_results = 0;
+        int num_items = 0;
+
+        for(int i = 0; i < count; i++){
+            // a control message comes on its own, after everything taken before it went downstream
+            if(messages[i].flags & PLUGIN_MESSAGE_CONTROL){
+                plugin_forward_control(context, messages[i].control);
+                done = messages[i].control == PLUGIN_CONTROL_END;
+                continue;
+            }
+
+            num_items++;
+            char* result = plugin_process(context, &messages[i], &scratch);
+            if(result != NULL){
+                // the input headers before this one are all wrapped already, so the array is reused for the results'
+                headers[num_results] = plugin_message_header(&messages[i]);
+                results[num_results++] = result;
+            }
+        }
+        // the results are copies of their own - the ring can have the whole batch's bytes back in one go
+        plugin_release_views(context, num_items);
+
+        plugin_forward_batch(context, results, headers, num_results);
+    }
+
+    // Signal that THIS plugin is finished processing
+    consumer_producer_signal_finished(context->queue);
+
+    free(items);
+    free(results);
+    free(headers);
+    free(messages);
+    free(views);
+    free(scratch.buffer);
+}
+
 /**
  * Generic consumer thread function
  * This function runs in a separate thread and processes items from the queue
@@ -23,55 +760,263 @@ void *plugin_consumer_thread(void *arg){
     // we set the global plugin state variable with the input *arg (typecasting into a pointer to a plugin_contex_t structure)
     plugin_context_t* context = (plugin_context_t*)arg;
 
+    // batch mode: the loop returns after END (or drops back to single items if it couldn't allocate)
+    if(context->batch_size > 1){
+        plugin_consumer_batch_loop(context);
+        if(context->batch_size > 1){
+            context->finished = 1;
+            return NULL;
+        }
+    }
+
+    plugin_scratch_t scratch = { NULL, 0 };
+
     // run forever until we get the shutdown signal
     while (1){
         // get next item from the queue
-        char* item = consumer_producer_get(context->queue);
+        plugin_message_t message;
+        if(plugin_take(context, &message) != 0){
+            continue;
+        }
+
+        // a control message: flush, and pass it on to the next plugin in the chain (if there is one)
+        if(message.flags & PLUGIN_MESSAGE_CONTROL){
+            plugin_forward_control(context, message.control);
 
-        // if the string item is "<END>", meaning the shutdown signal, we shut down gracfully
-        if(strcmp(item, "<END>") == 0){
-            // foward shutdown signal to next plugin in the chain- to its function next_place_work (if there is one)
-            if(context->next_place_work){
-                context->next_place_work("<END>");
+            // END, meaning the shutdown signal - we shut down gracfully
+            if(message.control == PLUGIN_CONTROL_END){
+                // Signal that THIS plugin is finished processing
+                consumer_producer_signal_finished(context->queue);
+                break;
             }
+            continue;
+        }
 
-            // Signal that THIS plugin is finished processing
-            consumer_producer_signal_finished(context->queue);
+        // we get here in case the item isn't a control message
+        // we need to proccess the item using the plugins transofrmation function (this also frees the input item)
+        char* result = plugin_process(context, &message, &scratch);
+        plugin_release_views(context, 1);
 
-            // and free it too in case there is no next plugin
-            free(item);
-            break;
+        // if transformation failed (returned NULL), skip forwarding
+        if(result == NULL){
+            continue;
         }
 
-        // we get here in case the item isn't the shutdown signal
-        // we need to proccess the item using the plugins transofrmation function:
-        const char* result = context->process_function(item);
+        // forward the result to next plugin in the chain (if there is one), with the header the line came in with
+        plugin_header_t header = plugin_message_header(&message);
+        plugin_forward(context, result, &header);
+    }
 
-        // free the input item since we're done with it
-        free(item);
+    free(scratch.buffer);
 
-        // if transformation failed (returned NULL), skip forwarding
-        if(result == NULL){
+    // mark as finished when exiting the loop (update flag)
+    context->finished = 1;
+    return NULL;
+}
+
+// What an ordered replica hands the reorder buffer for a BARRIER - it is passed on in its place among the results
+static char plugin_barrier_marker[1];
+
+/**
+ * Reorder buffer callback: results come out in input order, one deliverer at a time
+ * @param arg Pointer to plugin_context_t
+ * @param result Heap-allocated transformed string, or plugin_barrier_marker
+ * @param header What the result goes on with
+ */
+static void plugin_deliver_in_order(void* arg, char* result, const plugin_header_t* header){
+    if(result == plugin_barrier_marker){
+        plugin_forward_control((plugin_context_t*)arg, PLUGIN_CONTROL_BARRIER);
+        return;
+    }
+    plugin_forward((plugin_context_t*)arg, result, header);
+}
+
+/**
+ * Replica consumer thread function - one of several threads sharing an instance's queue
+ * Numbers every item as it leaves the queue and hands results to the reorder buffer (or straight downstream when unordered)
+ * @param arg Pointer to plugin_context_t
+ * @return NULL
+ */
+void* plugin_replica_thread(void* arg){
+    plugin_context_t* context = (plugin_context_t*)arg;
+    plugin_scratch_t scratch = { NULL, 0 };
+
+    while(1){
+        // the queue's sequence orders the replicas' results - the header's seq is the line's, and goes on with it
+        unsigned long sequence;
+        plugin_header_t header;
+        char* item = consumer_producer_get_meta(context->queue, &sequence, &header);
+        plugin_message_t message;
+        if(item != NULL){
+            plugin_message_wrap(&message, item, &header);
+        }
+        // a control message is due - unless another replica took it first
+        else if(!plugin_take_control(context, &message)){
             continue;
         }
 
-        // forward the result to next plugin in the chain (if there is one)
-        if(context->next_place_work){
-            // Pass ownership to next plugin; do NOT free here
-            context->next_place_work(result);
+        if(message.flags & PLUGIN_MESSAGE_CONTROL && message.control == PLUGIN_CONTROL_END){
+            // END stays due, so every replica takes it
+            pthread_mutex_lock(&context->replica_mutex);
+            int last = --context->active_replicas == 0;
+            pthread_mutex_unlock(&context->replica_mutex);
+
+            // every earlier item was already handed in (and delivered) by the replicas that took it,
+            // so once the last replica is out nothing can still be on its way downstream
+            if(last){
+                plugin_forward_control(context, PLUGIN_CONTROL_END);
+                consumer_producer_signal_finished(context->queue);
+                context->finished = 1;
+            }
+            break;
         }
-        else{
-            // Last plugin: process and free result
-            // For logger/typewriter, output happens in plugin_transform, so just free
-            free((void *)result);
+
+        if(message.flags & PLUGIN_MESSAGE_CONTROL){
+            // a barrier waits for its turn like a result, so everything before it goes downstream first
+            if(message.control == PLUGIN_CONTROL_BARRIER && !context->unordered){
+                reorder_buffer_put(context->reorder, message.seq, plugin_barrier_marker, NULL, plugin_deliver_in_order, context);
+            }
+            else{
+                plugin_forward_control(context, message.control);
+            }
+            continue;
         }
+
+        char* result = plugin_process(context, &message, &scratch);
+        header = plugin_message_header(&message);
+
+        if(context->unordered){
+            if(result != NULL){
+                plugin_forward(context, result, &header);
+            }
+            continue;
+        }
+
+        // a failed transform still has to fill its sequence, or everything after it would wait forever
+        reorder_buffer_put(context->reorder, sequence, result, &header, plugin_deliver_in_order, context);
     }
 
-    // mark as finished when exiting the loop (update flag)
-    context->finished = 1;
+    free(scratch.buffer);
     return NULL;
 }
 
+/**
+ * Pool mode: make sure a task for the instance is queued (at most one is queued or running at any time)
+ * @param context Plugin context
+ */
+static void plugin_pool_schedule(plugin_context_t* context){
+    if(!atomic_exchange(&context->scheduled, 1)){
+        context->executor.submit(context->executor.pool, plugin_pool_run, context);
+    }
+}
+
+/**
+ * Pool mode: hand one result to the next stage without blocking the worker
+ * @param context Plugin context
+ * @param result Heap-allocated string
+ * @param header What it goes on with
+ * @return 1 if the result was consumed, 0 if the next stage is full (the caller keeps it)
+ */
+static int plugin_pool_offer(plugin_context_t* context, char* result, const plugin_header_t* header){
+    if(context->next.instance && (context->next.offer_message_owned || context->next.offer_owned)){
+        int accepted = context->next.offer_message_owned != NULL
+                       ? context->next.offer_message_owned(context->next.instance, result, header)
+                       : context->next.offer_owned(context->next.instance, result);
+        if(accepted < 0){
+            plugin_free_item(context, result);
+        }
+        return accepted != 0;
+    }
+
+    // last stage, or a link that can only block
+    plugin_forward(context, result, header);
+    return 1;
+}
+
+/**
+ * Pool mode: the instance took END and passed it on - nothing will run for it again
+ * @param context Plugin context
+ */
+static void plugin_pool_finish(plugin_context_t* context){
+    consumer_producer_signal_finished(context->queue);
+    context->finished = 1;
+
+    // scheduled stays set, so later puts never queue another task - this is the last access to the context
+    atomic_store(&context->done, 1);
+}
+
+/**
+ * Pool task for one instance - runs up to batch_size items through the plugin, then reschedules itself if there may be more
+ * @param arg Pointer to plugin_context_t
+ */
+void plugin_pool_run(void* arg){
+    plugin_context_t* context = (plugin_context_t*)arg;
+
+    // a result that didn't fit downstream last time goes first
+    if(context->pending != NULL){
+        if(!plugin_pool_offer(context, context->pending, &context->pending_header)){
+            // the next stage is queued (it has items) - let it drain before we try again
+            context->executor.defer(context->executor.pool, plugin_pool_run, context);
+            return;
+        }
+        context->pending = NULL;
+    }
+
+    int processed = 0;
+    while(processed < context->batch_size){
+        plugin_message_t message;
+        if(!plugin_try_take(context, &message)){
+            break;
+        }
+        char* item = message.payload;
+        processed++;
+
+        // every result before it is downstream already (a pending one is offered before anything is taken)
+        if(message.flags & PLUGIN_MESSAGE_CONTROL){
+            plugin_forward_control(context, message.control);
+            if(message.control == PLUGIN_CONTROL_END){
+                plugin_pool_finish(context);
+                return;
+            }
+            continue;
+        }
+
+        // async: give the worker back - scheduled stays set, so no other task runs until plugin_async_done submits one
+        // (with the header already where the result will wait for the next stage)
+        if(context->async_function != NULL){
+            message.len = PLUGIN_MESSAGE_LEN_UNKNOWN;
+            context->pending_header = plugin_message_header(&message);
+            context->async_function(context, item);
+            plugin_release_input(context, item);
+            plugin_release_views(context, 1);
+            return;
+        }
+
+        char* result = plugin_process(context, &message, &context->scratch);
+        plugin_release_views(context, 1);
+
+        plugin_header_t header = plugin_message_header(&message);
+        if(result != NULL && !plugin_pool_offer(context, result, &header)){
+            context->pending = result;
+            context->pending_header = header;
+            context->executor.defer(context->executor.pool, plugin_pool_run, context);
+            return;
+        }
+    }
+
+    // maybe more waiting: go behind the next stage's task we just queued, so our results move on while they're hot in cache
+    if(processed == context->batch_size){
+        context->executor.defer(context->executor.pool, plugin_pool_run, context);
+        return;
+    }
+
+    // idle: the next put (or control message) schedules us again - unless one slipped in before the flag was cleared
+    atomic_store(&context->scheduled, 0);
+    if(consumer_producer_ready(context->queue)){
+        plugin_pool_schedule(context);
+    }
+}
+
 /**
  * Print error message in the format [ERROR][Plugin Name] - message
  * @param context Plugin context
@@ -87,17 +1032,185 @@ void log_error(plugin_context_t *context, const char* message){
  * @param message Info message
  */
 void log_info(plugin_context_t* context, const char* message){
+    // same stream as the plugins' own output, so it keeps its place among their lines
+    if(context->output.write != NULL){
+        struct iovec parts[] = {
+            { "[INFO][", 7 },
+            { (char*)context->name, strlen(context->name) },
+            { "] - ", 4 },
+            { (char*)message, strlen(message) },
+            { "\n", 1 }
+        };
+        if(context->output.write(context->output.writer, parts, 5) == 0){
+            return;
+        }
+    }
     fprintf(stdout, "[INFO][%s] - %s\n", context->name, message);
 }
 
 /**
- * Initialize the common plugin infrastructure with the specified queue size
+ * Finish an async transform: pool mode hands the result to a new task, thread mode wakes the waiting consumer
+ * @param context Plugin context
+ * @param result Heap-allocated result, or NULL if the transform failed
+ */
+void plugin_async_done(plugin_context_t* context, char* result){
+    if(context->executor.submit != NULL){
+        // the task goes through the pending path, so a full next stage is waited out like for any other result
+        context->pending = result;
+        context->executor.submit(context->executor.pool, plugin_pool_run, context);
+        return;
+    }
+
+    context->async_result = result;
+    monitor_signal(&context->async_done);
+}
+
+/**
+ * Print one record through an output service, or to stdout in one locked stdio write
+ * @param output Output service (NULL: stdio)
+ * @param parts The record's pieces, printed back to back
+ * @param count Number of pieces
+ */
+static void plugin_write_output(const plugin_output_t* output, const struct iovec* parts, int count){
+    if(output != NULL && output->write(output->writer, parts, count) == 0){
+        return;
+    }
+
+    // no service (or it couldn't take the record): the pieces still come out together
+    flockfile(stdout);
+    for(int i = 0; i < count; i++){
+        fwrite(parts[i].iov_base, 1, parts[i].iov_len, stdout);
+    }
+    funlockfile(stdout);
+}
+
+/**
+ * Print one record (e.g. a line) for the instance whose transform is running on this thread
+ * Goes through the host's output service when the instance has one, else to stdout in one locked stdio write.
+ * @param parts The record's pieces, printed back to back
+ * @param count Number of pieces
+ */
+void plugin_output(const struct iovec* parts, int count){
+    plugin_write_output(plugin_current_output, parts, count);
+}
+
+/**
+ * Print one record for a given instance (for output that happens outside its transform, e.g. on a timer)
+ * @param context Plugin context
+ * @param parts The record's pieces, printed back to back
+ * @param count Number of pieces
+ */
+void plugin_instance_output(plugin_context_t* context, const struct iovec* parts, int count){
+    plugin_write_output(context->output.write != NULL ? &context->output : NULL, parts, count);
+}
+
+/**
+ * Allocate a message buffer (e.g. a transform's result) for the instance whose transform is running on this thread
+ * Comes from the host's buffer allocator when the instance has one, else from malloc - the SDK frees it either way.
+ * @param size Bytes needed
+ * @return The buffer, or NULL on allocation failure
+ */
+char* plugin_buffer_alloc(size_t size){
+    if(plugin_current_buffers != NULL){
+        return plugin_current_buffers->alloc(plugin_current_buffers->pool, size);
+    }
+    return malloc(size);
+}
+
+/**
+ * Allocate a message buffer for a given instance (for results finished outside its transform, e.g. on a timer)
+ * @param context Plugin context
+ * @param size Bytes needed
+ * @return The buffer, or NULL on allocation failure
+ */
+char* plugin_instance_buffer_alloc(plugin_context_t* context, size_t size){
+    return plugin_alloc(context, size);
+}
+
+/**
+ * Allocate what a replicated instance needs on top of a plain one (extra thread handles, reorder buffer, counters)
+ * @param context Plugin context (replicas > 1)
+ * @return NULL on success, error message on failure
+ */
+static const char* plugin_replicas_prepare(plugin_context_t* context){
+    context->replica_threads = malloc((context->replicas - 1) * sizeof(pthread_t));
+    if(context->replica_threads == NULL){
+        return "Failed to allocate replica threads";
+    }
+
+    if(pthread_mutex_init(&context->replica_mutex, NULL) != 0){
+        free(context->replica_threads);
+        context->replica_threads = NULL;
+        return "Failed to initialize replica mutex";
+    }
+
+    if(!context->unordered){
+        context->reorder = malloc(sizeof(reorder_buffer_t));
+        if(context->reorder == NULL || reorder_buffer_init(context->reorder, context->replicas * REORDER_WINDOW_PER_REPLICA) != NULL){
+            free(context->reorder);
+            context->reorder = NULL;
+            pthread_mutex_destroy(&context->replica_mutex);
+            free(context->replica_threads);
+            context->replica_threads = NULL;
+            return "Failed to create reorder buffer";
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Free what plugin_replicas_prepare allocated (no-op for a plain instance)
+ * @param context Plugin context
+ */
+static void plugin_replicas_release(plugin_context_t* context){
+    if(context->replica_threads == NULL){
+        return;
+    }
+
+    if(context->reorder != NULL){
+        reorder_buffer_destroy(context->reorder);
+        free(context->reorder);
+        context->reorder = NULL;
+    }
+    pthread_mutex_destroy(&context->replica_mutex);
+    free(context->replica_threads);
+    context->replica_threads = NULL;
+}
+
+/**
+ * Join every consumer thread of an instance (consumer_thread and, if replicated, the other replicas)
+ * @param context Plugin context
+ * @return 0 on success, -1 if a join failed
+ */
+static int plugin_replicas_join(plugin_context_t* context){
+    int result = pthread_join(context->consumer_thread, NULL) == 0 ? 0 : -1;
+    for(int i = 1; i < context->replicas; i++){
+        if(pthread_join(context->replica_threads[i - 1], NULL) != 0){
+            result = -1;
+        }
+    }
+    return result;
+}
+
+/**
+ * Create one plugin instance: its own context, queue and consumer thread
  * @param process_function Plugin-specific processing function
+ * @param message_function Transforms envelopes (NULL: process_function is called on their payloads)
+ * @param async_function Starts an async transform (NULL: process_function is the transform)
+ * @param inplace_function Transforms an owned item in its own buffer (NULL: process_function allocates the result)
+ * @param rope_function Transforms long items as ropes (NULL: every item is a string)
  * @param name Plugin name
- * @param queue_size Maximum number of items that can be queued
+ * @param config Plugin configuration (queue size, queue implementation, batch size)
+ * @param instance Output - the new instance on success
  * @return NULL on success, error message on failure
  */
-const char* common_plugin_init(const char* (*process_function)(const char*), const char* name, int queue_size){
+static const char* plugin_instance_create(const char* (*process_function)(const char*),
+                                          int (*message_function)(const plugin_message_t*, plugin_message_t*),
+                                          void (*async_function)(plugin_context_t*, const char*),
+                                          void (*inplace_function)(char*, size_t),
+                                          int (*rope_function)(plugin_rope_t*),
+                                          const char* name, const plugin_config_t* config, plugin_context_t** instance){
     // input validation checks
     if(process_function == NULL){
         return "Process function can't be NULL";
@@ -107,122 +1220,470 @@ const char* common_plugin_init(const char* (*process_function)(const char*), con
         return "Plugin name can't be NULL";
     }
 
-    if(queue_size<=0){
+    if(config == NULL || instance == NULL){
+        return "Plugin config can't be NULL";
+    }
+
+    if(config->queue_size<=0){
         return "Queue size must be positive";
     }
-    
-    pthread_mutex_lock(&init_mutex);
 
-    // if already initialized (error)
-    if(g_plugin_context != NULL){
-        pthread_mutex_unlock(&init_mutex);
-        return "Plugin already initialized";
+    consumer_producer_mode_t queue_mode;
+    switch(config->queue_mode){
+        case PLUGIN_QUEUE_LOCKED:
+            queue_mode = CONSUMER_PRODUCER_LOCKED;
+            break;
+        case PLUGIN_QUEUE_SPSC:
+            queue_mode = CONSUMER_PRODUCER_SPSC;
+            break;
+        case PLUGIN_QUEUE_RECORDS:
+            queue_mode = CONSUMER_PRODUCER_RECORDS;
+            break;
+        default:
+            return "Unknown queue mode";
     }
 
-    // allocate g_plugin_context with malloc()
-    g_plugin_context = malloc(sizeof(plugin_context_t));
-    if(g_plugin_context == NULL){
-        pthread_mutex_unlock(&init_mutex);
+    // a record ring's capacity is in bytes
+    size_t queue_bytes = config->queue_bytes > 0 ? config->queue_bytes : (size_t)config->queue_size * PLUGIN_RECORD_BYTES;
+    if(queue_mode == CONSUMER_PRODUCER_RECORDS && queue_bytes > INT_MAX){
+        return "Record ring is too large";
+    }
+    int capacity = queue_mode == CONSUMER_PRODUCER_RECORDS ? (int)queue_bytes : config->queue_size;
+
+    int replicas = config->replicas > 1 ? config->replicas : 1;
+    // several threads take from the queue, so it has to be the multi-consumer one
+    if(replicas > 1 && queue_mode != CONSUMER_PRODUCER_LOCKED){
+        return "Replicated plugins need a locked queue";
+    }
+
+    // a pool task must never block, and replicas are threads of their own
+    if(config->executor != NULL && (config->executor->submit == NULL || config->executor->defer == NULL)){
+        return "Executor is missing submit/defer";
+    }
+    if(config->executor != NULL && replicas > 1){
+        return "Replicated plugins can't run on an executor";
+    }
+
+    // an async instance finishes one item before it takes the next - there is nothing to replicate, batch or fuse
+    if(async_function != NULL && (replicas > 1 || config->num_fused > 0)){
+        return "Async plugins can't be replicated or fused";
+    }
+
+    // allocate the context with malloc()
+    plugin_context_t* context = malloc(sizeof(plugin_context_t));
+    if(context == NULL){
         return "Failed to allocate plugin context";
     }
 
     // initialize all fields
-    g_plugin_context->name = name;
-    g_plugin_context->next_place_work = NULL;
-    g_plugin_context->process_function = process_function;
-    g_plugin_context->initialized = 0;
-    g_plugin_context->finished = 0;
+    context->name = name;
+    context->next_place_work = NULL;
+    context->next_signal = NULL;
+    atomic_init(&context->control_failed, 0);
+    context->next.instance = NULL;
+    context->next.place_work = NULL;
+    context->next.place_work_owned = NULL;
+    context->next.place_work_many_owned = NULL;
+    context->next.offer_owned = NULL;
+    context->next.place_messages_owned = NULL;
+    context->next.offer_message_owned = NULL;
+    context->next.signal = NULL;
+    context->next.ropes = 0;
+    context->batch_size = (replicas > 1 || async_function != NULL) ? 1 : (config->batch_size > 1 ? config->batch_size : 1);
+    context->replicas = replicas;
+    context->unordered = config->unordered;
+    context->replica_threads = NULL;
+    context->reorder = NULL;
+    context->active_replicas = replicas;
+    context->executor.pool = NULL;
+    context->executor.submit = NULL;
+    context->executor.defer = NULL;
+    if(config->executor != NULL){
+        context->executor = *config->executor;
+    }
+    atomic_init(&context->scheduled, 0);
+    atomic_init(&context->done, 0);
+    context->pending = NULL;
+    context->pending_header = (plugin_header_t)ITEM_META_UNKNOWN;
+    context->scratch.buffer = NULL;
+    context->scratch.size = 0;
+    context->fused = NULL;
+    context->num_fused = 0;
+    if(config->num_fused > 0){
+        if(config->fused == NULL){
+            free(context);
+            return "Fused stages can't be NULL";
+        }
+        context->fused = malloc(config->num_fused * sizeof(plugin_fused_stage_t));
+        if(context->fused == NULL){
+            free(context);
+            return "Failed to allocate fused stages";
+        }
+        memcpy(context->fused, config->fused, config->num_fused * sizeof(plugin_fused_stage_t));
+        context->num_fused = config->num_fused;
+    }
+    context->release_input = config->release_input;
+    context->release_arg = config->release_arg;
+    context->records = queue_mode == CONSUMER_PRODUCER_RECORDS;
+    context->output.writer = NULL;
+    context->output.write = NULL;
+    context->output.flush = NULL;
+    if(config->output != NULL){
+        context->output = *config->output;
+    }
+    context->buffers.pool = NULL;
+    context->buffers.alloc = NULL;
+    context->buffers.release = NULL;
+    if(config->buffers != NULL){
+        context->buffers = *config->buffers;
+    }
+    context->process_function = process_function;
+    context->message_function = message_function;
+    atomic_init(&context->ingested, 0);
+    context->async_function = async_function;
+    context->inplace_function = inplace_function;
+    context->rope_function = rope_function;
+    context->async_result = NULL;
+    context->timer.timer = NULL;
+    context->timer.schedule = NULL;
+    if(config->timer != NULL){
+        context->timer = *config->timer;
+    }
+    context->char_delay_us = config->char_delay_us;
+    context->initialized = 0;
+    context->finished = 0;
 
     // allocate and initialize the queue
-    g_plugin_context->queue = malloc(sizeof(consumer_producer_t));
+    context->queue = malloc(sizeof(consumer_producer_t));
     // error allocating memory
-    if(g_plugin_context->queue == NULL){
-        free(g_plugin_context);
-        g_plugin_context = NULL;
-        pthread_mutex_unlock(&init_mutex);
+    if(context->queue == NULL){
+        free(context->fused);
+        free(context);
         return "Failed to allocate memory for consumer-producer queue";
     }
 
-    // initiallize the queue
-    if(consumer_producer_init(g_plugin_context->queue, queue_size)){
-        free(g_plugin_context->queue);
-        free(g_plugin_context);
-        g_plugin_context = NULL;
-        pthread_mutex_unlock(&init_mutex);
+    // initiallize the queue (a record ring is sized in bytes)
+    if(consumer_producer_init_mode(context->queue, capacity, queue_mode)){
+        free(context->queue);
+        free(context->fused);
+        free(context);
         return "Failed to create consumer-producer queue";
     }
+    // put's copies come from the instance's buffers, and whatever is left at destroy (ropes too) is freed like an item
+    consumer_producer_set_buffers(context->queue, context, plugin_queue_alloc, plugin_queue_release);
+
+    // pool mode: no thread - the first put schedules the first task
+    if(context->executor.submit != NULL){
+        context->initialized = 1;
+        *instance = context;
+        return NULL;
+    }
+
+    // replicated: the reorder buffer and the extra thread handles have to exist before any replica runs
+    if(replicas > 1){
+        const char* replica_error = plugin_replicas_prepare(context);
+        if(replica_error != NULL){
+            consumer_producer_destroy(context->queue);
+            free(context->queue);
+            free(context->fused);
+            free(context);
+            return replica_error;
+        }
+    }
+
+    // async in thread mode: the consumer thread waits on this for each transform to finish
+    if(async_function != NULL && monitor_init(&context->async_done) != 0){
+        consumer_producer_destroy(context->queue);
+        free(context->queue);
+        free(context->fused);
+        free(context);
+        return "Failed to initialize async monitor";
+    }
 
     // start the consumer thread with pthread_create()
-    int pthread_result = pthread_create(&g_plugin_context->consumer_thread, NULL, plugin_consumer_thread, g_plugin_context);
+    int pthread_result = pthread_create(&context->consumer_thread, NULL, replicas > 1 ? plugin_replica_thread : plugin_consumer_thread, context);
     if(pthread_result != 0){
-        consumer_producer_destroy(g_plugin_context->queue);
-        free(g_plugin_context->queue);
-        free(g_plugin_context);
-        g_plugin_context = NULL;
-        pthread_mutex_unlock(&init_mutex);
+        if(async_function != NULL){
+            monitor_destroy(&context->async_done);
+        }
+        plugin_replicas_release(context);
+        consumer_producer_destroy(context->queue);
+        free(context->queue);
+        free(context->fused);
+        free(context);
         return "Failed to create consumer thread";
     }
 
-    // update init flag
-    g_plugin_context->initialized = 1;
+    // the other replicas - if one can't start, the ones already running are told to stop like at shutdown
+    for(int i = 1; i < replicas; i++){
+        if(pthread_create(&context->replica_threads[i - 1], NULL, plugin_replica_thread, context) != 0){
+            pthread_mutex_lock(&context->replica_mutex);
+            context->active_replicas = i;
+            pthread_mutex_unlock(&context->replica_mutex);
+            context->replicas = i;
+            consumer_producer_put_control(context->queue, CONSUMER_PRODUCER_END);
+            plugin_replicas_join(context);
+            plugin_replicas_release(context);
+            consumer_producer_destroy(context->queue);
+            free(context->queue);
+            free(context->fused);
+            free(context);
+            return "Failed to create replica thread";
+        }
+    }
 
-    // final unlock
-    pthread_mutex_unlock(&init_mutex);
+    // update init flag
+    context->initialized = 1;
 
     // on success
+    *instance = context;
     return NULL;
 }
 
 /**
- * Finalize the plugin - drain queue and terminate thread gracefully (i.e. pthread_join)
+ * Create one plugin instance: its own context, queue and consumer thread
+ * @param process_function Plugin-specific processing function
+ * @param name Plugin name
+ * @param config Plugin configuration (queue size, queue implementation, batch size)
+ * @param instance Output - the new instance on success
+ * @return NULL on success, error message on failure
+ */
+const char* common_plugin_instance_init(const char* (*process_function)(const char*), const char* name, const plugin_config_t* config, plugin_context_t** instance){
+    return plugin_instance_create(process_function, NULL, NULL, NULL, NULL, name, config, instance);
+}
+
+/**
+ * Create one instance whose transform finishes later (see plugin_async_done)
+ * @param process_function Plugin-specific processing function (for hosts that call plugin_transform directly)
+ * @param async_function Starts the transform of one item
+ * @param name Plugin name
+ * @param config Plugin configuration
+ * @param instance Output - the new instance on success
+ * @return NULL on success, error message on failure
+ */
+const char* common_plugin_instance_init_async(const char* (*process_function)(const char*),
+                                              void (*async_function)(plugin_context_t*, const char*),
+                                              const char* name, const plugin_config_t* config, plugin_context_t** instance){
+    if(async_function == NULL){
+        return "Async function can't be NULL";
+    }
+    return plugin_instance_create(process_function, NULL, async_function, NULL, NULL, name, config, instance);
+}
+
+/**
+ * Create one instance of a length-preserving plugin that transforms items in the buffer they arrived in
+ * @param process_function Plugin-specific processing function (used for items the host lent)
+ * @param inplace_function Transforms len chars in place
+ * @param rope_function Transforms long items as ropes (NULL: none)
+ * @param name Plugin name
+ * @param config Plugin configuration
+ * @param instance Output - the new instance on success
+ * @return NULL on success, error message on failure
+ */
+const char* common_plugin_instance_init_inplace(const char* (*process_function)(const char*),
+                                                void (*inplace_function)(char*, size_t),
+                                                int (*rope_function)(plugin_rope_t*),
+                                                const char* name, const plugin_config_t* config, plugin_context_t** instance){
+    if(inplace_function == NULL){
+        return "In-place function can't be NULL";
+    }
+    return plugin_instance_create(process_function, NULL, NULL, inplace_function, rope_function, name, config, instance);
+}
+
+/**
+ * Create one instance of a plugin that transforms very long items as ropes
+ * @param process_function Plugin-specific processing function (every other item)
+ * @param rope_function Transforms a rope in place, 0 on success
+ * @param name Plugin name
+ * @param config Plugin configuration
+ * @param instance Output - the new instance on success
+ * @return NULL on success, error message on failure
+ */
+const char* common_plugin_instance_init_rope(const char* (*process_function)(const char*),
+                                             int (*rope_function)(plugin_rope_t*),
+                                             const char* name, const plugin_config_t* config, plugin_context_t** instance){
+    if(rope_function == NULL){
+        return "Rope function can't be NULL";
+    }
+    return plugin_instance_create(process_function, NULL, NULL, NULL, rope_function, name, config, instance);
+}
+
+/**
+ * Create one instance of a plugin whose transform takes and returns envelopes
+ * @param process_function Plugin-specific processing function (for hosts that call plugin_transform directly)
+ * @param message_function Transforms one envelope, 0 on success
+ * @param rope_function Transforms long items as ropes (NULL: none)
+ * @param name Plugin name
+ * @param config Plugin configuration
+ * @param instance Output - the new instance on success
+ * @return NULL on success, error message on failure
+ */
+const char* common_plugin_instance_init_message(const char* (*process_function)(const char*),
+                                                int (*message_function)(const plugin_message_t*, plugin_message_t*),
+                                                int (*rope_function)(plugin_rope_t*),
+                                                const char* name, const plugin_config_t* config, plugin_context_t** instance){
+    if(message_function == NULL){
+        return "Message function can't be NULL";
+    }
+    return plugin_instance_create(process_function, message_function, NULL, NULL, rope_function, name, config, instance);
+}
+
+/**
+ * Initialize the common plugin infrastructure with the specified queue size
+ * @param process_function Plugin-specific processing function
+ * @param name Plugin name
+ * @param queue_size Maximum number of items that can be queued
+ * @return NULL on success, error message on failure
+ */
+const char* common_plugin_init(const char* (*process_function)(const char*), const char* name, int queue_size){
+    plugin_config_t config = { .queue_size = queue_size, .queue_mode = PLUGIN_QUEUE_LOCKED, .batch_size = 1 };
+    
+    pthread_mutex_lock(&init_mutex);
+
+    // if already initialized (error)
+    if(g_plugin_context != NULL){
+        pthread_mutex_unlock(&init_mutex);
+        return "Plugin already initialized";
+    }
+
+    // the single-instance ABI simply owns one default instance
+    const char* error = common_plugin_instance_init(process_function, name, &config, &g_plugin_context);
+
+    // final unlock
+    pthread_mutex_unlock(&init_mutex);
+    return error;
+}
+
+/**
+ * Finalize one instance - drain queue and terminate thread gracefully (i.e. pthread_join), then free it
+ * @param instance Plugin instance
  * @return NULL on success, error message on failure
  */
 __attribute__((visibility("default")))
-const char* plugin_fini(void){
+const char* plugin_instance_fini(plugin_instance_t* instance){
+    plugin_context_t* context = (plugin_context_t*)instance;
+
     // check if initiallized
-    if(g_plugin_context == NULL || !g_plugin_context->initialized){
+    if(context == NULL || !context->initialized){
         return "Plugin isn't initiallized";
     }
 
-    // send shutdown signal
-    const char *place_result = plugin_place_work("<END>");
-    if(place_result != NULL){
-        return place_result;
+    // send shutdown signal (ignored if the host already sent it)
+    const char *signal_result = plugin_instance_signal(instance, PLUGIN_CONTROL_END);
+    if(signal_result != NULL){
+        return signal_result;
     }
 
     // wait for plugin to finish processing (this should wait for the finished flag)
-    const char *wait_result = plugin_wait_finished();
-    if(wait_result != NULL){
+    // (a control message it couldn't pass on is reported once the instance is gone - it finished all the same)
+    const char *wait_result = plugin_instance_wait_finished(instance);
+    const char *control_error = atomic_load(&context->control_failed) ? wait_result : NULL;
+    if(wait_result != NULL && control_error == NULL){
         return wait_result;
     }
 
-    // now join the thread since it should be finished
-    int join_result = pthread_join(g_plugin_context->consumer_thread, NULL);
-    if(join_result != 0){
+    // pool mode: the last task may still be returning - wait until it let go of the context
+    if(context->executor.submit != NULL){
+        while(!atomic_load(&context->done)){
+            sched_yield();
+        }
+    }
+    // now join the thread(s) since they should be finished
+    else if(plugin_replicas_join(context) != 0){
         return "Failed to join consumer thread";
     }
 
     // clean up resources
-    consumer_producer_destroy(g_plugin_context->queue);
-    free(g_plugin_context->queue);
-    free(g_plugin_context);
-    g_plugin_context= NULL;
+    if(context->async_function != NULL && context->executor.submit == NULL){
+        monitor_destroy(&context->async_done);
+    }
+    plugin_replicas_release(context);
+    consumer_producer_destroy(context->queue);
+    free(context->queue);
+    free(context->scratch.buffer);
+    free(context->fused);
+    free(context);
 
-    // on success
-    return NULL;
+    // NULL on success
+    return control_error;
+}
+
+/**
+ * Finalize the plugin - drain queue and terminate thread gracefully (i.e. pthread_join)
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_fini(void){
+    const char* error = plugin_instance_fini(g_plugin_context);
+    if(error == NULL){
+        g_plugin_context = NULL;
+    }
+    return error;
 }
 
 
 
+/**
+ * Place work (a string) into one instance's queue
+ * @param instance Plugin instance
+ * @param str The string to process (copied by the queue)
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_place_work(plugin_instance_t* instance, const char* str){
+    plugin_context_t* context = (plugin_context_t*)instance;
+
+    // check if initialized
+    if(context == NULL || !context->initialized){
+        return "Plugin not initialized";
+    }
+
+    // error message
+    if(str == NULL){
+        return "Input string is NULL";
+    }
+
+    // use the queue's put function - it handles copying and blocking (a string placed here is new input)
+    plugin_header_t header = plugin_ingest_header(context);
+    const char* error = consumer_producer_put_meta(context->queue, str, &header);
+    if(error == NULL && context->executor.submit != NULL){
+        plugin_pool_schedule(context);
+    }
+    return error;
+}
+
 /**
  * Place work (a string) into the plugin's queue
- * @param str The string to process (plugin takes ownership if it allocates new memory)
+ * @param str The string to process (plugin takes ownership if it allocates new memory) - "<END>" ends the stream
  * @return NULL on success, error message on failure
  */
 __attribute__((visibility("default")))
 const char* plugin_place_work(const char* str){
+    return plugin_instance_place_work(g_plugin_context, str);
+}
+
+/**
+ * Put a control message on the plugin's control lane
+ * @param control PLUGIN_CONTROL_END, PLUGIN_CONTROL_FLUSH, PLUGIN_CONTROL_BARRIER, PLUGIN_CONTROL_PAUSE or PLUGIN_CONTROL_RESUME
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_signal(int control){
+    return plugin_instance_signal(g_plugin_context, control);
+}
+
+/**
+ * Place work into one instance's queue without copying it
+ * @param instance Plugin instance
+ * @param str Heap-allocated string (the instance takes ownership on success, the caller keeps it on failure)
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_place_work_owned(plugin_instance_t* instance, char* str){
+    plugin_context_t* context = (plugin_context_t*)instance;
+
     // check if initialized
-    if(g_plugin_context == NULL || !g_plugin_context->initialized){
+    if(context == NULL || !context->initialized){
         return "Plugin not initialized";
     }
 
@@ -231,12 +1692,183 @@ const char* plugin_place_work(const char* str){
         return "Input string is NULL";
     }
 
-    // use the queue's put function - it handles copying and blocking
-    return consumer_producer_put(g_plugin_context->queue, str);
+    // the queue stores the pointer as-is (a string placed here is new input)
+    plugin_header_t header = plugin_ingest_header(context);
+    const char* error = consumer_producer_put_owned_meta(context->queue, str, &header);
+    if(error == NULL && context->executor.submit != NULL){
+        plugin_pool_schedule(context);
+    }
+    return error;
+}
+
+/**
+ * Place work into one instance's queue without copying it and without blocking
+ * @param instance Plugin instance
+ * @param str Heap-allocated string (the instance takes ownership only if it was accepted - a refused one still used up
+ *            its seq)
+ * @return 1 if accepted, 0 if the queue is full, -1 on error
+ */
+__attribute__((visibility("default")))
+int plugin_instance_offer_owned(plugin_instance_t* instance, char* str){
+    plugin_context_t* context = (plugin_context_t*)instance;
+
+    // check if initialized
+    if(context == NULL || !context->initialized || str == NULL){
+        return -1;
+    }
+
+    plugin_header_t header = plugin_ingest_header(context);
+    int accepted = consumer_producer_try_put_owned_meta(context->queue, str, &header);
+    if(accepted == 1 && context->executor.submit != NULL){
+        plugin_pool_schedule(context);
+    }
+    return accepted;
+}
+
+/**
+ * Place several heap-allocated strings into one instance's queue without copying them
+ * @param instance Plugin instance
+ * @param items The strings to process (the instance takes ownership of all of them on success)
+ * @param count Number of strings
+ * @return NULL on success, error message on failure (the caller keeps the strings on failure)
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_place_work_many_owned(plugin_instance_t* instance, char* const* items, int count){
+    plugin_context_t* context = (plugin_context_t*)instance;
+
+    // check if initialized
+    if(context == NULL || !context->initialized){
+        return "Plugin not initialized";
+    }
+
+    // error message
+    if(items == NULL){
+        return "Input items are NULL";
+    }
+
+    if(count <= 0){
+        // nothing to stamp - the queue has its own word on an empty or negative count
+        return consumer_producer_put_many_owned(context->queue, items, count);
+    }
+
+    // the strings placed here are new input - consecutive seqs, all read now
+    plugin_header_t* headers = malloc(count * sizeof(plugin_header_t));
+    if(headers == NULL){
+        return "Failed to allocate headers";
+    }
+    unsigned long seq = atomic_fetch_add(&context->ingested, (unsigned long)count);
+    unsigned long long now = plugin_now_ns();
+    for(int i = 0; i < count; i++){
+        headers[i] = (plugin_header_t){ PLUGIN_MESSAGE_LEN_UNKNOWN, seq + i, now };
+    }
+
+    const char* error = consumer_producer_put_many_owned_meta(context->queue, items, headers, count);
+    free(headers);
+    if(error == NULL && context->executor.submit != NULL){
+        plugin_pool_schedule(context);
+    }
+    return error;
+}
+
+/**
+ * Place heap-allocated strings into one instance's queue without copying them, each with the header it already has
+ * (the input's seq and ingest time, stamped where it was read - they stay the same from stage to stage)
+ * @param instance Plugin instance
+ * @param items The strings to process (the instance takes ownership of all of them on success)
+ * @param headers Header of each string
+ * @param count Number of strings
+ * @return NULL on success, error message on failure (the caller keeps the strings on failure)
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_place_messages_owned(plugin_instance_t* instance, char* const* items,
+                                                 const plugin_header_t* headers, int count){
+    plugin_context_t* context = (plugin_context_t*)instance;
+
+    // check if initialized
+    if(context == NULL || !context->initialized){
+        return "Plugin not initialized";
+    }
+
+    // error message
+    if(items == NULL || headers == NULL){
+        return "Input items are NULL";
+    }
+
+    const char* error = count == 1 ? consumer_producer_put_owned_meta(context->queue, items[0], &headers[0])
+                                   : consumer_producer_put_many_owned_meta(context->queue, items, headers, count);
+    if(error == NULL && context->executor.submit != NULL){
+        plugin_pool_schedule(context);
+    }
+    return error;
+}
+
+/**
+ * Place one heap-allocated string with its header into one instance's queue without copying it and without blocking
+ * @param instance Plugin instance
+ * @param str Heap-allocated string (the instance takes ownership only if it was accepted)
+ * @param header Its header
+ * @return 1 if accepted, 0 if the queue is full, -1 on error
+ */
+__attribute__((visibility("default")))
+int plugin_instance_offer_message_owned(plugin_instance_t* instance, char* str, const plugin_header_t* header){
+    plugin_context_t* context = (plugin_context_t*)instance;
+
+    // check if initialized
+    if(context == NULL || !context->initialized || str == NULL || header == NULL){
+        return -1;
+    }
+
+    int accepted = consumer_producer_try_put_owned_meta(context->queue, str, header);
+    if(accepted == 1 && context->executor.submit != NULL){
+        plugin_pool_schedule(context);
+    }
+    return accepted;
+}
+
+
+
+/**
+ * Put a control message on one instance's control lane (only a BARRIER may wait, for the lane to have room)
+ * @param instance Plugin instance
+ * @param control PLUGIN_CONTROL_END, PLUGIN_CONTROL_FLUSH, PLUGIN_CONTROL_BARRIER, PLUGIN_CONTROL_PAUSE or PLUGIN_CONTROL_RESUME
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_signal(plugin_instance_t* instance, int control){
+    plugin_context_t* context = (plugin_context_t*)instance;
+
+    // check if initialized
+    if(context == NULL || !context->initialized){
+        return "Plugin not initialized";
+    }
+
+    if(control < PLUGIN_CONTROL_END || control > PLUGIN_CONTROL_RESUME){
+        return "Unknown control message";
+    }
+
+    // the lane's types have the SDK's values
+    const char* error = consumer_producer_put_control(context->queue, (consumer_producer_control_t)control);
+    if(error == NULL && context->executor.submit != NULL){
+        plugin_pool_schedule(context);
+    }
+    return error;
 }
 
 
 
+/**
+ * Attach one instance to the next stage in the chain
+ * @param instance Plugin instance
+ * @param next The next stage (its instance and entry points) - copied
+ */
+__attribute__((visibility("default")))
+void plugin_instance_attach(plugin_instance_t* instance, const plugin_link_t* next){
+    plugin_context_t* context = (plugin_context_t*)instance;
+    if(context != NULL && next != NULL){
+        context->next = *next;
+    }
+}
+
 /**
  * Attach this plugin to the next plugin in the chain
  * @param next_place_work Function pointer to the next plugin's place_work function
@@ -248,25 +1880,53 @@ void plugin_attach(const char* (*next_place_work)(const char*)){
     }
 }
 
+/**
+ * Pass this plugin's control messages on to the next plugin in the chain
+ * @param next_signal Function pointer to the next plugin's plugin_signal (NULL: they stop here)
+ */
+__attribute__((visibility("default")))
+void plugin_attach_signal(const char* (*next_signal)(int)){
+    if(g_plugin_context != NULL){
+        g_plugin_context->next_signal = next_signal;
+    }
+}
+
 
 
 /**
- * Wait until the plugin has finished processing all work and is ready to shutdown
- * This is a blocking function used for graceful shutdown coordination
- * @return NULL on success, error message on failure
+ * Wait until one instance has finished processing all work
+ * @param instance Plugin instance
+ * @return NULL on success, error message on failure (also once finished, if a control message couldn't be passed on)
  */
 __attribute__((visibility("default")))
-const char* plugin_wait_finished(void){
+const char* plugin_instance_wait_finished(plugin_instance_t* instance){
+    plugin_context_t* context = (plugin_context_t*)instance;
+
     // check if initiallized
-    if(g_plugin_context == NULL || !g_plugin_context->initialized){
+    if(context == NULL || !context->initialized){
         return "Plugin not initialized";
     }
 
     // Use the queue's finished monitor - blocks until signaled
-    if(consumer_producer_wait_finished(g_plugin_context->queue) != 0){
+    if(consumer_producer_wait_finished(context->queue) != 0){
         return "Failed to wait for completion";
     }
 
+    // the next stage may be left waiting for what it didn't get
+    if(atomic_load(&context->control_failed)){
+        return "Failed to pass a control message on";
+    }
+
     // on success
     return NULL;
-}
\ No newline at end of file
+}
+
+/**
+ * Wait until the plugin has finished processing all work and is ready to shutdown
+ * This is a blocking function used for graceful shutdown coordination
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_wait_finished(void){
+    return plugin_instance_wait_finished(g_plugin_context);
+}
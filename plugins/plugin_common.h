@@ -2,21 +2,84 @@
 #define PLUGIN_COMMON_H
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include "sync/consumer_producer.h"
+#include "sync/reorder_buffer.h"
+#include "sync/monitor.h"
+#include "plugin_sdk.h"
+#include "plugin_view.h"
+#include "plugin_rope.h"
 
 /**
  * Common SDK structures and functions for plugin implementation
  */
-// Plugin context structure
+// Ping-pong buffer for fused length-preserving stages - one per thread that runs them, reused for every line
 typedef struct
+{
+    char* buffer;
+    size_t size;
+} plugin_scratch_t;
+
+// plugin_message_t.flags
+#define PLUGIN_MESSAGE_DATA 0x0 // A line for the transform
+#define PLUGIN_MESSAGE_CONTROL 0x1 // A control message from the queue's control lane (plugin_message_t.control) - never transformed
+
+// plugin_message_t.len of a payload nobody has counted yet
+#define PLUGIN_MESSAGE_LEN_UNKNOWN ITEM_META_LEN_UNKNOWN
+
+// Message envelope - built by the SDK for every item an instance takes from its queue (plugin_message_t in plugin_sdk.h)
+typedef struct plugin_message
+{
+    char* payload; // The chars, null-terminated
+    size_t len; // Number of chars (PLUGIN_MESSAGE_LEN_UNKNOWN: not counted yet - never so for a v2 transform's input)
+    unsigned long seq; // Position in the input: 0 for the first line the host read, 1 for the next, ... (a control message's: its position in the queue)
+    unsigned long long ingest_ns; // When the host read it (CLOCK_MONOTONIC, nanoseconds) - both come from its header, as stamped at ingest
+    unsigned int flags; // PLUGIN_MESSAGE_DATA or PLUGIN_MESSAGE_CONTROL
+    int control; // PLUGIN_MESSAGE_CONTROL: PLUGIN_CONTROL_END, PLUGIN_CONTROL_FLUSH or PLUGIN_CONTROL_BARRIER (payload is NULL)
+} plugin_message_t;
+
+// Plugin context structure - one per instance (plugin_instance_t in plugin_sdk.h is this struct, opaque to the host)
+typedef struct plugin_instance
 {
     const char* name; // Plugin name (for diagnosis)
     consumer_producer_t* queue; // Input queue
     pthread_t consumer_thread; // Consumer thread
-    const char* (*next_place_work)(const char*); // Next plugin's place_work function
+    const char* (*next_place_work)(const char*); // Next plugin's place_work function (single-instance ABI)
+    const char* (*next_signal)(int); // Next plugin's plugin_signal (single-instance ABI, may be NULL)
+    plugin_link_t next; // Next stage (instance ABI) - preferred when next.instance is set
     const char* (*process_function)(const char*); // Plugin-specific processing function
+    int (*message_function)(const plugin_message_t*, plugin_message_t*); // Transforms envelopes instead of process_function (NULL: process_function through plugin_message_transform_legacy)
+    atomic_ulong ingested; // Items placed without a header so far - the next one's seq (the host stamps its own lines)
+    int batch_size; // Items drained per wakeup (1 = one item at a time)
+    int replicas; // Worker threads pulling from the queue (1 = just consumer_thread)
+    int unordered; // Replicas forward results in completion order instead of input order
+    pthread_t* replica_threads; // The replicas beyond consumer_thread (replicas - 1 of them)
+    reorder_buffer_t* reorder; // Restores input order between the replicas and the next stage (ordered replicas only)
+    pthread_mutex_t replica_mutex; // Guards active_replicas
+    int active_replicas; // Replicas that haven't taken END yet (END stays due, so every replica takes it)
+    plugin_executor_t executor; // Pool the instance runs on (executor.submit == NULL: consumer_thread does the work)
+    atomic_int scheduled; // Pool mode: a task for this instance is queued or running (never more than one)
+    char* pending; // Pool mode: a result the next stage had no room for yet
+    plugin_header_t pending_header; // Pool mode: its header (set before an async transform starts, for the result it will bring)
+    atomic_int done; // Pool mode: the last task finished and won't touch the instance again
+    plugin_fused_stage_t* fused; // Stages run back to back instead of process_function (NULL: just process_function)
+    int num_fused; // Number of fused stages
+    plugin_scratch_t scratch; // Pool mode: scratch for fused stages (tasks of one instance never overlap)
+    void (*release_input)(void*, char*); // Gives input items back to the host instead of free() (NULL: free them)
+    void* release_arg; // release_input's first argument
+    int records; // The queue is a record ring: input items are views into it, given back to it in order (never owned)
+    plugin_output_t output; // Host's output service (output.write == NULL: stdio)
+    plugin_buffers_t buffers; // Host's message buffer allocator (buffers.alloc == NULL: malloc and free)
+    void (*inplace_function)(char*, size_t); // Transforms an owned item in its own buffer, which is then forwarded (NULL: process_function allocates)
+    int (*rope_function)(plugin_rope_t*); // Transforms long items as ropes (NULL: ropes that arrive are built into strings)
+    void (*async_function)(struct plugin_instance*, const char*); // Starts a transform that plugin_async_done finishes (NULL: process_function returns the result)
+    monitor_t async_done; // Thread mode: signaled by plugin_async_done (async instances only)
+    char* async_result; // Thread mode: the finished transform's result
+    plugin_timer_t timer; // Host's timer service (timer.schedule == NULL: none)
+    long char_delay_us; // Pacing plugins: delay per character (config's char_delay_us)
     int initialized; // Initialization flag
     int finished; // Finished processing flag
+    atomic_int control_failed; // A control message couldn't be passed on to the next stage (wait_finished reports it)
 } plugin_context_t;
 
 /**
@@ -27,6 +90,20 @@ typedef struct
  */
 void* plugin_consumer_thread(void* arg);
 
+/**
+ * Replica consumer thread function - one of several threads sharing an instance's queue
+ * Numbers every item as it leaves the queue and hands results to the reorder buffer (or straight downstream when unordered)
+ * @param arg Pointer to plugin_context_t
+ * @return NULL
+ */
+void* plugin_replica_thread(void* arg);
+
+/**
+ * Pool task for one instance - runs up to batch_size items through the plugin, then reschedules itself if there may be more
+ * @param arg Pointer to plugin_context_t
+ */
+void plugin_pool_run(void* arg);
+
 /**
  * Print error message in the format [ERROR][Plugin Name] - message
  * @param context Plugin context
@@ -41,6 +118,31 @@ void log_error(plugin_context_t* context, const char* message);
  */
 void log_info(plugin_context_t* context, const char* message);
 
+/**
+ * Print one record (e.g. a line) for the instance whose transform is running on this thread
+ * Goes through the host's output service when the instance has one, else to stdout in one locked stdio write.
+ * @param parts The record's pieces, printed back to back
+ * @param count Number of pieces
+ */
+void plugin_output(const struct iovec* parts, int count);
+
+/**
+ * Allocate a message buffer (e.g. a transform's result) for the instance whose transform is running on this thread
+ * Comes from the host's buffer allocator when the instance has one, else from malloc - the SDK frees it either way.
+ * @param size Bytes needed
+ * @return The buffer, or NULL on allocation failure
+ */
+char* plugin_buffer_alloc(size_t size);
+
+/**
+ * Run a legacy const char* transform on an envelope - how plugins without plugin_transform_message are called
+ * @param transform The plugin's plugin_transform
+ * @param input The message (payload not modified or freed)
+ * @param output Gets input's seq, ingest time and flags, the result as payload and PLUGIN_MESSAGE_LEN_UNKNOWN as len
+ * @return 0 on success, -1 if the transform failed
+ */
+int plugin_message_transform_legacy(const char* (*transform)(const char*), const plugin_message_t* input, plugin_message_t* output);
+
 /**
  * Get the plugin's name
  * @return The plugin's name (should not be modified or freed)
@@ -48,6 +150,55 @@ void log_info(plugin_context_t* context, const char* message);
 __attribute__((visibility("default")))
 const char* plugin_get_name(void);
 
+/**
+ * Get the plugin's properties
+ * @return Bitwise OR of PLUGIN_FLAG_* values
+ */
+__attribute__((visibility("default")))
+unsigned int plugin_get_flags(void);
+
+/**
+ * Length-preserving transform into a caller-provided buffer (only plugins that keep the length implement it)
+ * @param input The string to transform (len chars, need not be terminated)
+ * @param output Buffer of at least len chars, not overlapping input (not terminated by this function)
+ * @param len Number of chars
+ */
+__attribute__((visibility("default")))
+void plugin_transform_span(const char* input, char* output, size_t len);
+
+/**
+ * Length-preserving transform in the buffer the string came in (only plugins that keep the length implement it)
+ * @param buf The string (len chars)
+ * @param len Number of chars
+ */
+__attribute__((visibility("default")))
+void plugin_transform_inplace(char* buf, size_t len);
+
+/**
+ * Index-remapping transform that only updates a view (only plugins that just move chars around implement it)
+ * @param view The string so far
+ * @return 0 on success, -1 if the view can't take another layer (it is left unchanged)
+ */
+__attribute__((visibility("default")))
+int plugin_transform_view(plugin_view_t* view);
+
+/**
+ * Transform a very long record kept as a rope (only plugins that can work segment by segment implement it)
+ * @param rope The record (changed in place)
+ * @return 0 on success, -1 on failure
+ */
+__attribute__((visibility("default")))
+int plugin_transform_rope(plugin_rope_t* rope);
+
+/**
+ * Transform one message envelope (only plugins that use what the envelope carries implement it)
+ * @param input The message, its len always counted (payload not modified or freed)
+ * @param output Starts as a copy of input without its payload - gets the new heap-allocated payload and its length
+ * @return 0 on success, -1 on failure
+ */
+__attribute__((visibility("default")))
+int plugin_transform_message(const plugin_message_t* input, plugin_message_t* output);
+
 /**
  * Initialize the common plugin infrastructure with the specified queue size
  * @param process_function Plugin-specific processing function
@@ -57,6 +208,101 @@ const char* plugin_get_name(void);
  */
 const char* common_plugin_init(const char* (*process_function)(const char*), const char* name, int queue_size);
 
+/**
+ * Create one plugin instance: its own context, queue and consumer thread
+ * @param process_function Plugin-specific processing function
+ * @param name Plugin name
+ * @param config Plugin configuration (queue size, queue implementation, batch size, replicas)
+ * @param instance Output - the new instance on success
+ * @return NULL on success, error message on failure
+ */
+const char* common_plugin_instance_init(const char* (*process_function)(const char*), const char* name, const plugin_config_t* config, plugin_context_t** instance);
+
+/**
+ * Create one instance whose transform finishes later: async_function starts work on an item and returns at once,
+ * and whichever thread finishes it calls plugin_async_done. The instance takes its next item only after that,
+ * and on a pool it holds no worker in between. Not replicated, batched or fused.
+ * @param process_function Plugin-specific processing function (for hosts that call plugin_transform directly)
+ * @param async_function Starts the transform of one item (the item isn't kept - copy what's needed)
+ * @param name Plugin name
+ * @param config Plugin configuration
+ * @param instance Output - the new instance on success
+ * @return NULL on success, error message on failure
+ */
+const char* common_plugin_instance_init_async(const char* (*process_function)(const char*),
+                                              void (*async_function)(plugin_context_t*, const char*),
+                                              const char* name, const plugin_config_t* config, plugin_context_t** instance);
+
+/**
+ * Create one instance of a length-preserving plugin whose items are transformed in the buffer they arrived in,
+ * and that same buffer goes downstream (items the host lent go through process_function instead)
+ * @param process_function Plugin-specific processing function
+ * @param inplace_function Transforms len chars in place (the plugin's plugin_transform_inplace)
+ * @param rope_function Transforms long items as ropes, like common_plugin_instance_init_rope (NULL: none)
+ * @param name Plugin name
+ * @param config Plugin configuration
+ * @param instance Output - the new instance on success
+ * @return NULL on success, error message on failure
+ */
+const char* common_plugin_instance_init_inplace(const char* (*process_function)(const char*),
+                                                void (*inplace_function)(char*, size_t),
+                                                int (*rope_function)(plugin_rope_t*),
+                                                const char* name, const plugin_config_t* config, plugin_context_t** instance);
+
+/**
+ * Create one instance of a plugin that can transform very long items as ropes: strings of at least
+ * PLUGIN_ROPE_MIN_LENGTH chars (and ropes from the stage before) go through rope_function, and stay ropes
+ * when the next stage takes them (plugin_link_t.ropes)
+ * @param process_function Plugin-specific processing function (every other item)
+ * @param rope_function Transforms a rope in place, 0 on success
+ * @param name Plugin name
+ * @param config Plugin configuration
+ * @param instance Output - the new instance on success
+ * @return NULL on success, error message on failure
+ */
+const char* common_plugin_instance_init_rope(const char* (*process_function)(const char*),
+                                             int (*rope_function)(plugin_rope_t*),
+                                             const char* name, const plugin_config_t* config, plugin_context_t** instance);
+
+/**
+ * Create one instance of a plugin with a v2 transform: every data message goes through message_function as an
+ * envelope, so the plugin gets its length without counting it (and its seq and ingest time)
+ * @param process_function Plugin-specific processing function (for hosts that call plugin_transform directly)
+ * @param message_function Transforms one envelope, 0 on success
+ * @param rope_function Transforms long items as ropes, like common_plugin_instance_init_rope (NULL: none)
+ * @param name Plugin name
+ * @param config Plugin configuration
+ * @param instance Output - the new instance on success
+ * @return NULL on success, error message on failure
+ */
+const char* common_plugin_instance_init_message(const char* (*process_function)(const char*),
+                                                int (*message_function)(const plugin_message_t*, plugin_message_t*),
+                                                int (*rope_function)(plugin_rope_t*),
+                                                const char* name, const plugin_config_t* config, plugin_context_t** instance);
+
+/**
+ * Finish the transform an async instance started (exactly once per item, from any thread)
+ * @param context Plugin context
+ * @param result Heap-allocated result (the instance takes it), or NULL if the transform failed
+ */
+void plugin_async_done(plugin_context_t* context, char* result);
+
+/**
+ * Print one record for a given instance (for output that happens outside its transform, e.g. on a timer)
+ * @param context Plugin context
+ * @param parts The record's pieces, printed back to back
+ * @param count Number of pieces
+ */
+void plugin_instance_output(plugin_context_t* context, const struct iovec* parts, int count);
+
+/**
+ * Allocate a message buffer for a given instance (for results finished outside its transform, e.g. on a timer)
+ * @param context Plugin context
+ * @param size Bytes needed
+ * @return The buffer, or NULL on allocation failure
+ */
+char* plugin_instance_buffer_alloc(plugin_context_t* context, size_t size);
+
 /**
  * Initialize the plugin with the specified queue size - calls common_plugin_init
  * This function should be implemented by each plugin
@@ -66,6 +312,16 @@ const char* common_plugin_init(const char* (*process_function)(const char*), con
 __attribute__((visibility("default")))
 const char* plugin_init(int queue_size);
 
+/**
+ * Create a new, independent instance of the plugin - calls common_plugin_instance_init
+ * This function should be implemented by each plugin
+ * @param config Plugin configuration
+ * @param instance Output - the new instance on success
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_init(const plugin_config_t* config, plugin_instance_t** instance);
+
 /**
  * Finalize the plugin - drain queue and terminate thread gracefully (i.e. pthread_join)
  * @return NULL on success, error message on failure
@@ -74,13 +330,87 @@ __attribute__((visibility("default")))
 const char* plugin_fini(void);
 
 /**
- * Place work (a string) into the plugin's queue
+ * Finalize one instance - drain queue and terminate thread gracefully (i.e. pthread_join), then free it
+ * @param instance Plugin instance
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_fini(plugin_instance_t* instance);
+
+/**
+ * Place work (a string) into the plugin's queue - every string is data, plugin_signal ends the stream
  * @param str The string to process (plugin takes ownership if it allocates new memory)
  * @return NULL on success, error message on failure
  */
 __attribute__((visibility("default")))
 const char* plugin_place_work(const char* str);
 
+/**
+ * Put a control message on the plugin's control lane
+ * @param control PLUGIN_CONTROL_END, PLUGIN_CONTROL_FLUSH, PLUGIN_CONTROL_BARRIER, PLUGIN_CONTROL_PAUSE or PLUGIN_CONTROL_RESUME
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_signal(int control);
+
+/**
+ * Place work (a string) into one instance's queue
+ * @param instance Plugin instance
+ * @param str The string to process (copied by the queue)
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_place_work(plugin_instance_t* instance, const char* str);
+
+/**
+ * Place work into one instance's queue without copying it
+ * @param instance Plugin instance
+ * @param str Heap-allocated string (the instance takes ownership on success, the caller keeps it on failure)
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_place_work_owned(plugin_instance_t* instance, char* str);
+
+/**
+ * Place several heap-allocated strings into one instance's queue without copying them
+ * @param instance Plugin instance
+ * @param items The strings to process (the instance takes ownership of all of them on success)
+ * @param count Number of strings
+ * @return NULL on success, error message on failure (the caller keeps the strings on failure)
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_place_work_many_owned(plugin_instance_t* instance, char* const* items, int count);
+
+/**
+ * Place work into one instance's queue without copying it and without blocking
+ * @param instance Plugin instance
+ * @param str Heap-allocated string (the instance takes ownership only if it was accepted)
+ * @return 1 if accepted, 0 if the queue is full, -1 on error
+ */
+__attribute__((visibility("default")))
+int plugin_instance_offer_owned(plugin_instance_t* instance, char* str);
+
+/**
+ * Place heap-allocated strings into one instance's queue together with their headers, without copying them
+ * @param instance Plugin instance
+ * @param items The strings to process (the instance takes ownership of all of them on success)
+ * @param headers Each string's header (kept as it is)
+ * @param count Number of strings
+ * @return NULL on success, error message on failure (the caller keeps the strings on failure)
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_place_messages_owned(plugin_instance_t* instance, char* const* items, const plugin_header_t* headers, int count);
+
+/**
+ * Place one heap-allocated string and its header into one instance's queue without blocking
+ * @param instance Plugin instance
+ * @param str Heap-allocated string (the instance takes ownership only if it was accepted)
+ * @param header Its header (kept as it is)
+ * @return 1 if accepted, 0 if the queue is full, -1 on error
+ */
+__attribute__((visibility("default")))
+int plugin_instance_offer_message_owned(plugin_instance_t* instance, char* str, const plugin_header_t* header);
+
 /**
  * Attach this plugin to the next plugin in the chain
  * @param next_place_work Function pointer to the next plugin's place_work function
@@ -88,6 +418,21 @@ const char* plugin_place_work(const char* str);
 __attribute__((visibility("default")))
 void plugin_attach(const char* (*next_place_work)(const char*));
 
+/**
+ * Pass this plugin's control messages on to the next plugin in the chain
+ * @param next_signal Function pointer to the next plugin's plugin_signal (NULL: they stop here)
+ */
+__attribute__((visibility("default")))
+void plugin_attach_signal(const char* (*next_signal)(int));
+
+/**
+ * Attach one instance to the next stage in the chain
+ * @param instance Plugin instance
+ * @param next The next stage (its instance and entry points) - copied
+ */
+__attribute__((visibility("default")))
+void plugin_instance_attach(plugin_instance_t* instance, const plugin_link_t* next);
+
 /**
  * Wait until the plugin has finished processing all work and is ready to shutdown
  * This is a blocking function used for graceful shutdown coordination
@@ -96,4 +441,12 @@ void plugin_attach(const char* (*next_place_work)(const char*));
 __attribute__((visibility("default")))
 const char* plugin_wait_finished(void);
 
+/**
+ * Wait until one instance has finished processing all work
+ * @param instance Plugin instance
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_wait_finished(plugin_instance_t* instance);
+
 #endif
\ No newline at end of file
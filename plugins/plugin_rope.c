@@ -0,0 +1,342 @@
+#include <stdlib.h>   // malloc, realloc, free
+#include <string.h>   // memcpy, memmove
+#include <stdint.h>   // uintptr_t
+#include <pthread.h>  // the chunk cache's lock
+#include <sys/mman.h> // mmap, munmap
+
+#include "plugin_rope.h"
+#include "plugin_view.h"
+
+// free chunks kept for reuse - a chunk is usually freed on another stage's thread than the one that took it
+static plugin_rope_chunk_t* plugin_rope_cache[PLUGIN_ROPE_CACHE_CHUNKS];
+static int plugin_rope_cached = 0;
+static pthread_mutex_t plugin_rope_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/**
+ * Take a chunk, with one ref (from the cache, else mapped fresh - not malloc'd: a malloc'd chunk freed on another
+ * thread goes back to the arena of the thread that took it, so every stage would end up with its own pile of them)
+ * @return The chunk, or NULL on failure
+ */
+static plugin_rope_chunk_t* plugin_rope_chunk_new(void){
+    plugin_rope_chunk_t* chunk = NULL;
+    pthread_mutex_lock(&plugin_rope_cache_mutex);
+    if(plugin_rope_cached > 0){
+        chunk = plugin_rope_cache[--plugin_rope_cached];
+    }
+    pthread_mutex_unlock(&plugin_rope_cache_mutex);
+
+    if(chunk == NULL){
+        chunk = mmap(NULL, sizeof(plugin_rope_chunk_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(chunk == MAP_FAILED){
+            return NULL;
+        }
+    }
+    atomic_init(&chunk->refs, 1);
+    return chunk;
+}
+
+
+plugin_rope_t* plugin_rope_new(void){
+    return calloc(1, sizeof(plugin_rope_t));
+}
+
+
+/**
+ * Drop one ref on a chunk - the last one frees it
+ * @param chunk The chunk
+ */
+static void plugin_rope_chunk_release(plugin_rope_chunk_t* chunk){
+    if(atomic_fetch_sub(&chunk->refs, 1) != 1){
+        return;
+    }
+
+    pthread_mutex_lock(&plugin_rope_cache_mutex);
+    if(plugin_rope_cached < PLUGIN_ROPE_CACHE_CHUNKS){
+        plugin_rope_cache[plugin_rope_cached++] = chunk;
+        chunk = NULL;
+    }
+    pthread_mutex_unlock(&plugin_rope_cache_mutex);
+    // the cache is full - the memory goes straight back to the system
+    if(chunk != NULL){
+        munmap(chunk, sizeof(plugin_rope_chunk_t));
+    }
+}
+
+
+/**
+ * Drop every segment (the segment array is kept)
+ * @param rope The rope
+ */
+static void plugin_rope_clear(plugin_rope_t* rope){
+    for(int i = 0; i < rope->count; i++){
+        plugin_rope_chunk_release(rope->segments[i].chunk);
+    }
+    rope->count = 0;
+    rope->len = 0;
+}
+
+
+void plugin_rope_free(plugin_rope_t* rope){
+    if(rope == NULL){
+        return;
+    }
+    plugin_rope_clear(rope);
+    free(rope->segments);
+    free(rope);
+}
+
+
+/**
+ * Make sure the segment array has room for count segments
+ * @param rope The rope
+ * @param count Segments needed
+ * @return 0 on success, -1 on allocation failure
+ */
+static int plugin_rope_reserve(plugin_rope_t* rope, int count){
+    if(rope->capacity >= count){
+        return 0;
+    }
+    int capacity = rope->capacity > 0 ? rope->capacity : 8;
+    while(capacity < count){
+        capacity *= 2;
+    }
+    plugin_rope_segment_t* grown = realloc(rope->segments, capacity * sizeof(plugin_rope_segment_t));
+    if(grown == NULL){
+        return -1;
+    }
+    rope->segments = grown;
+    rope->capacity = capacity;
+    return 0;
+}
+
+
+/**
+ * Where the next chars at the end go: right after the last segment if its chunk has room and nothing else points
+ * into it, else at the start of a new chunk (plugin_rope_commit then counts what was written)
+ * @param rope The rope
+ * @param room Output - chars that fit there (> 0)
+ * @return Write position, or NULL on allocation failure
+ */
+static char* plugin_rope_tail(plugin_rope_t* rope, size_t* room){
+    plugin_rope_segment_t* last = rope->count > 0 ? &rope->segments[rope->count - 1] : NULL;
+    if(last != NULL && last->offset + last->len < PLUGIN_ROPE_CHUNK_CHARS && atomic_load(&last->chunk->refs) == 1){
+        *room = PLUGIN_ROPE_CHUNK_CHARS - (last->offset + last->len);
+        return last->chunk->data + last->offset + last->len;
+    }
+
+    if(plugin_rope_reserve(rope, rope->count + 1) != 0){
+        return NULL;
+    }
+    plugin_rope_chunk_t* chunk = plugin_rope_chunk_new();
+    if(chunk == NULL){
+        return NULL;
+    }
+    rope->segments[rope->count++] = (plugin_rope_segment_t){ .chunk = chunk, .offset = 0, .len = 0 };
+    *room = PLUGIN_ROPE_CHUNK_CHARS;
+    return chunk->data;
+}
+
+
+/**
+ * Count chars written at plugin_rope_tail's position
+ * @param rope The rope
+ * @param len Number of chars (no more than the room it gave)
+ */
+static void plugin_rope_commit(plugin_rope_t* rope, size_t len){
+    rope->segments[rope->count - 1].len += len;
+    rope->len += len;
+}
+
+
+int plugin_rope_append(plugin_rope_t* rope, const char* data, size_t len){
+    while(len > 0){
+        size_t room;
+        char* tail = plugin_rope_tail(rope, &room);
+        if(tail == NULL){
+            return -1;
+        }
+        size_t count = len < room ? len : room;
+        memcpy(tail, data, count);
+        plugin_rope_commit(rope, count);
+        data += count;
+        len -= count;
+    }
+    return 0;
+}
+
+
+char* plugin_rope_flatten(plugin_rope_t* rope){
+    char* result = malloc(rope->len + 1);
+    if(result == NULL){
+        plugin_rope_free(rope);
+        return NULL;
+    }
+
+    size_t at = 0;
+    for(int i = 0; i < rope->count; i++){
+        const plugin_rope_segment_t* segment = &rope->segments[i];
+        memcpy(result + at, segment->chunk->data + segment->offset, segment->len);
+        at += segment->len;
+        plugin_rope_chunk_release(segment->chunk);
+    }
+    result[at] = '\0';
+    rope->count = 0;
+    plugin_rope_free(rope);
+    return result;
+}
+
+
+int plugin_rope_map(plugin_rope_t* rope, void (*map)(char*, size_t)){
+    for(int i = 0; i < rope->count; i++){
+        plugin_rope_segment_t* segment = &rope->segments[i];
+        // another slice still reads this chunk - this one gets a chunk of its own first
+        if(atomic_load(&segment->chunk->refs) > 1){
+            plugin_rope_chunk_t* chunk = plugin_rope_chunk_new();
+            if(chunk == NULL){
+                plugin_rope_clear(rope);
+                return -1;
+            }
+            memcpy(chunk->data, segment->chunk->data + segment->offset, segment->len);
+            plugin_rope_chunk_release(segment->chunk);
+            segment->chunk = chunk;
+            segment->offset = 0;
+        }
+        map(segment->chunk->data + segment->offset, segment->len);
+    }
+    return 0;
+}
+
+
+int plugin_rope_interleave(plugin_rope_t* rope, char fill){
+    // no two chars to put anything between
+    if(rope->len <= 1){
+        return 0;
+    }
+
+    plugin_rope_t built = { 0 };
+    for(int i = 0; i < rope->count; i++){
+        const plugin_rope_segment_t* segment = &rope->segments[i];
+        const char* source = segment->chunk->data + segment->offset;
+        size_t left = segment->len;
+        while(left > 0){
+            size_t room;
+            char* tail = plugin_rope_tail(&built, &room);
+            if(tail == NULL){
+                // the segments from this one on haven't been let go yet
+                for(int j = i; j < rope->count; j++){
+                    plugin_rope_chunk_release(rope->segments[j].chunk);
+                }
+                rope->count = 0;
+                rope->len = 0;
+                plugin_rope_clear(&built);
+                free(built.segments);
+                return -1;
+            }
+            // every char comes with its fill, so new chunks fill up in pairs and always have room for one
+            size_t count = left < room / 2 ? left : room / 2;
+            plugin_view_t view;
+            plugin_view_init(&view, source, count);
+            plugin_view_interleave(&view, fill);
+            plugin_view_materialize(&view, tail);
+            tail[2 * count - 1] = fill;
+            plugin_rope_commit(&built, 2 * count);
+            source += count;
+            left -= count;
+        }
+        // read - the chunk can go now, not when the whole line is done
+        plugin_rope_chunk_release(segment->chunk);
+    }
+
+    // the last char gets no fill after it
+    built.segments[built.count - 1].len--;
+    built.len--;
+
+    free(rope->segments);
+    *rope = built;
+    return 0;
+}
+
+
+int plugin_rope_rotate(plugin_rope_t* rope, unsigned long times){
+    // nothing to move
+    if(rope->len <= 1 || times % rope->len == 0){
+        return 0;
+    }
+
+    // the chars from cut on go to the front - find the segment it falls in
+    size_t cut = rope->len - times % rope->len;
+    int at = 0;
+    size_t start = 0;
+    while(start + rope->segments[at].len <= cut){
+        start += rope->segments[at].len;
+        at++;
+    }
+    size_t head = cut - start;
+
+    // one more segment at most: the cut one becomes two
+    int capacity = rope->count + 1;
+    plugin_rope_segment_t* relinked = malloc(capacity * sizeof(plugin_rope_segment_t));
+    if(relinked == NULL){
+        return -1;
+    }
+
+    // the cut segment's tail, then everything after it ...
+    const plugin_rope_segment_t* cut_segment = &rope->segments[at];
+    int count = 0;
+    if(head > 0){
+        relinked[count++] = (plugin_rope_segment_t){ .chunk = cut_segment->chunk, .offset = cut_segment->offset + head, .len = cut_segment->len - head };
+        atomic_fetch_add(&cut_segment->chunk->refs, 1);
+    }
+    else{
+        relinked[count++] = *cut_segment;
+    }
+    memcpy(relinked + count, rope->segments + at + 1, (rope->count - at - 1) * sizeof(plugin_rope_segment_t));
+    count += rope->count - at - 1;
+    int moved = count;
+    // ... then everything before it, and the cut segment's head (its slice of the same chunk)
+    memcpy(relinked + count, rope->segments, at * sizeof(plugin_rope_segment_t));
+    count += at;
+    if(head > 0){
+        relinked[count++] = (plugin_rope_segment_t){ .chunk = cut_segment->chunk, .offset = cut_segment->offset, .len = head };
+    }
+
+    // rotating again and again cuts the same chunk next to the last cut - the two slices join up again
+    plugin_rope_segment_t* before = &relinked[moved - 1];
+    plugin_rope_segment_t* after = &relinked[moved];
+    if(before->chunk == after->chunk && before->offset + before->len == after->offset){
+        before->len += after->len;
+        plugin_rope_chunk_release(after->chunk);
+        memmove(after, after + 1, (count - moved - 1) * sizeof(plugin_rope_segment_t));
+        count--;
+    }
+
+    free(rope->segments);
+    rope->segments = relinked;
+    rope->count = count;
+    rope->capacity = capacity;
+    return 0;
+}
+
+
+int plugin_rope_parts(const plugin_rope_t* rope, struct iovec* parts, int max){
+    for(int i = 0; i < rope->count && i < max; i++){
+        parts[i].iov_base = rope->segments[i].chunk->data + rope->segments[i].offset;
+        parts[i].iov_len = rope->segments[i].len;
+    }
+    return rope->count;
+}
+
+
+char* plugin_rope_to_item(plugin_rope_t* rope){
+    return (char*)((uintptr_t)rope | 1);
+}
+
+
+plugin_rope_t* plugin_rope_from_item(char* item){
+    // malloc'd strings are at least 8-aligned, so an odd address can only be a tagged rope
+    if(((uintptr_t)item & 1) == 0){
+        return NULL;
+    }
+    return (plugin_rope_t*)((uintptr_t)item & ~(uintptr_t)1);
+}
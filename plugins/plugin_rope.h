@@ -0,0 +1,141 @@
+#ifndef PLUGIN_ROPE_H
+#define PLUGIN_ROPE_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
+
+/**
+ * plugin rope is a string kept as a list of segments, each a slice of a fixed-size, refcounted chunk.
+ * very long records move between stages that take ropes (plugin_link_t.ropes) this way instead of as one string:
+ * - per-char plugins (uppercaser, lowercaser, rot13) map the chunks where they are
+ * - expander streams the segments into new chunks, and lets each one go as soon as it is read
+ * - rotator only relinks segments - the chunk the cut falls in is shared by the two slices, nothing is copied
+ * - logger prints the segments as they are
+ * so a record never needs one contiguous buffer, and a stage holds at most its input and its output, chunk by chunk.
+ * chunks are mapped, not malloc'd, so one freed on any thread really is free (past a small cache of them).
+ *
+ * in a queue a rope is a tagged item (plugin_rope_to_item): its address with the low bit set, which no malloc'd
+ * string has. only items the instance owns are ever ropes - lent items (release_input) are always strings.
+ **/
+
+// bytes per chunk, its ref count included (every chunk is a mapping of its own)
+#define PLUGIN_ROPE_CHUNK_SIZE (64 * 1024)
+
+// chars per chunk - what is left after the ref count, rounded down to keep it even (expander fills chunks in pairs)
+#define PLUGIN_ROPE_CHUNK_CHARS (PLUGIN_ROPE_CHUNK_SIZE - 16)
+
+// free chunks kept for reuse (across all instances of a plugin) - more than that go back to the system
+#define PLUGIN_ROPE_CACHE_CHUNKS 64
+
+// a stage that takes ropes turns strings at least this long into one (shorter ones aren't worth the segments)
+#define PLUGIN_ROPE_MIN_LENGTH PLUGIN_ROPE_CHUNK_SIZE
+
+/**
+ * A fixed-size block of chars, shared by every segment that points into it
+ */
+typedef struct
+{
+ atomic_int refs; /* Segments pointing into the chunk (it is freed with the last one) */
+ char data[PLUGIN_ROPE_CHUNK_CHARS]; /* The chars */
+} plugin_rope_chunk_t;
+
+/**
+ * A slice of a chunk
+ */
+typedef struct
+{
+ plugin_rope_chunk_t* chunk; /* The chunk (one of its refs is this segment's) */
+ size_t offset; /* Where the slice starts in it */
+ size_t len; /* Number of chars */
+} plugin_rope_segment_t;
+
+/**
+ * Rope structure (plugin_rope_t in plugin_sdk.h is this struct)
+ */
+typedef struct plugin_rope
+{
+ plugin_rope_segment_t* segments; /* The string, front to back */
+ int count; /* Segments in use */
+ int capacity; /* Segments allocated */
+ size_t len; /* Number of chars in all segments */
+} plugin_rope_t;
+
+/**
+ * Create an empty rope
+ * @return Heap-allocated rope (plugin_rope_free frees it), or NULL on allocation failure
+ */
+plugin_rope_t* plugin_rope_new(void);
+
+/**
+ * Free a rope, dropping its refs on the chunks (NULL is ignored)
+ * @param rope The rope
+ */
+void plugin_rope_free(plugin_rope_t* rope);
+
+/**
+ * Append chars at the end (copied, into the last chunk while it has room and isn't shared)
+ * @param rope The rope
+ * @param data The chars
+ * @param len Number of chars
+ * @return 0 on success, -1 on allocation failure (what was appended so far stays)
+ */
+int plugin_rope_append(plugin_rope_t* rope, const char* data, size_t len);
+
+/**
+ * Build the contiguous string and free the rope (each chunk goes as soon as it is copied)
+ * @param rope The rope (always freed)
+ * @return Heap-allocated, null-terminated string, or NULL on allocation failure
+ */
+char* plugin_rope_flatten(plugin_rope_t* rope);
+
+/**
+ * Run a per-char transform over every segment, in the chunk itself (a shared chunk is copied first)
+ * @param rope The rope
+ * @param map Transforms len chars in place
+ * @return 0 on success, -1 on allocation failure (the rope is left empty)
+ */
+int plugin_rope_map(plugin_rope_t* rope, void (*map)(char*, size_t));
+
+/**
+ * Put fill between every two chars, none after the last (expander) - written into new chunks, segment by segment,
+ * each old chunk let go once it has been read
+ * @param rope The rope
+ * @param fill The char to put in
+ * @return 0 on success, -1 on allocation failure (the rope is left empty)
+ */
+int plugin_rope_interleave(plugin_rope_t* rope, char fill);
+
+/**
+ * Move every char times positions to the right, the last ones wrapping around to the front (rotator)
+ * Only the segments move: the one the cut falls in becomes two slices of its chunk.
+ * @param rope The rope
+ * @param times Positions to move
+ * @return 0 on success, -1 on allocation failure (the rope is left unchanged)
+ */
+int plugin_rope_rotate(plugin_rope_t* rope, unsigned long times);
+
+/**
+ * Describe the segments as iovecs (e.g. for plugin_output)
+ * @param rope The rope
+ * @param parts Output - one iovec per segment (may be NULL when max is 0)
+ * @param max Entries parts has room for
+ * @return Number of segments (only the first max are written)
+ */
+int plugin_rope_parts(const plugin_rope_t* rope, struct iovec* parts, int max);
+
+/**
+ * The queue item that stands for a rope (the rope moves with it)
+ * @param rope The rope
+ * @return The tagged item
+ */
+char* plugin_rope_to_item(plugin_rope_t* rope);
+
+/**
+ * The rope a queue item stands for
+ * @param item An owned queue item
+ * @return The rope, or NULL if the item is a string
+ */
+plugin_rope_t* plugin_rope_from_item(char* item);
+
+#endif
@@ -1,6 +1,184 @@
 #ifndef PLUGIN_SDK_H
 #define PLUGIN_SDK_H
 
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "sync/item_meta.h"
+
+/**
+ * Queue implementations a plugin's input link can use
+ * PLUGIN_QUEUE_LOCKED - mutex-protected queue, safe for any number of producers/consumers (default)
+ * PLUGIN_QUEUE_SPSC - lock-free ring, only valid when exactly one thread places work into the plugin
+ * PLUGIN_QUEUE_RECORDS - strings stored inline in one byte ring of queue_bytes, read where they are (any number of
+ *                        producers, not for replicated plugins; the link into it must not pass ropes)
+ */
+#define PLUGIN_QUEUE_LOCKED 0
+#define PLUGIN_QUEUE_SPSC 1
+#define PLUGIN_QUEUE_RECORDS 2
+
+// PLUGIN_QUEUE_RECORDS with queue_bytes 0: the ring gets this many bytes per queue_size
+#define PLUGIN_RECORD_BYTES 256
+
+/**
+ * Plugin properties returned by plugin_get_flags
+ * PLUGIN_FLAG_PURE - plugin_transform has no side effects and may be called from many threads at once
+ * PLUGIN_FLAG_IDEMPOTENT - running the transform twice gives the same result as running it once
+ * PLUGIN_FLAG_INVOLUTION - running the transform twice gives back the original input
+ */
+#define PLUGIN_FLAG_PURE 0x1
+#define PLUGIN_FLAG_IDEMPOTENT 0x2
+#define PLUGIN_FLAG_INVOLUTION 0x4
+
+/**
+ * Control messages (plugin_instance_signal) - they go on a lane of their own next to an instance's queue, so no input
+ * line is ever taken for one, and putting one never waits for room in a full queue. Only FLUSH, PAUSE and RESUME act
+ * ahead of the lines already queued; END and BARRIER are ordered after them, so they take effect once the queue drained.
+ * None is ever dropped: END always fits, a FLUSH still waiting stands for the ones after it, and barriers with no line
+ * between them share a slot - a BARRIER put waits only while the lane is full of barriers that have lines between them.
+ * PLUGIN_CONTROL_END - end of stream: taken once every line placed before it was (none is dropped - shutting down takes
+ *                      as long as the queued lines do), passed on, and the instance finishes
+ * PLUGIN_CONTROL_FLUSH - ahead of the lines already queued: the instance's output is flushed and the flush passed on
+ * PLUGIN_CONTROL_BARRIER - behind the lines placed before it: they are all through (output flushed) before any line
+ *                          placed after it starts, and it is passed on
+ * PLUGIN_CONTROL_PAUSE - the instance takes no more lines until PLUGIN_CONTROL_RESUME (controls still get through, and
+ *                        neither is passed on)
+ * PLUGIN_CONTROL_RESUME - it takes lines again
+ */
+#define PLUGIN_CONTROL_END 1
+#define PLUGIN_CONTROL_FLUSH 2
+#define PLUGIN_CONTROL_BARRIER 3
+#define PLUGIN_CONTROL_PAUSE 4
+#define PLUGIN_CONTROL_RESUME 5
+
+/**
+ * A shared worker pool owned by the host. Instances created with an executor get no thread of their own:
+ * every time work arrives they are scheduled as a task on the pool, and one task runs a few items through the plugin.
+ */
+typedef struct
+{
+    void* pool; // Host's pool (opaque to the plugin)
+    void (*submit)(void* pool, void (*run)(void*), void* arg); // Run a task soon - from a pool worker, right after its current task on that same worker
+    void (*defer)(void* pool, void (*run)(void*), void* arg); // Run a task after everything the calling worker already has queued (other workers steal it first)
+} plugin_executor_t;
+
+/**
+ * An output service owned by the host. Instances created with one print through it (plugin_output in plugin_common.h)
+ * instead of stdio: a line is appended without taking a lock, and the host's writer thread writes many lines per syscall.
+ */
+typedef struct
+{
+    void* writer; // Host's writer (opaque to the plugin)
+    int (*write)(void* writer, const struct iovec* parts, int count); // Queue one record made of parts (copied, kept in order per calling thread), 0 on success
+    void (*flush)(void* writer); // Return once everything queued so far has been written
+} plugin_output_t;
+
+/**
+ * A timer service owned by the host: one scheduler thread runs every instance's timers, so a plugin that paces its
+ * output (typewriter) waits on a timer instead of sleeping on its own thread.
+ */
+typedef struct
+{
+    void* timer; // Host's timer (opaque to the plugin)
+    int (*schedule)(void* timer, unsigned long delay_us, void (*run)(void*), void* arg); // Run a callback on the timer thread after delay_us (from a callback: after its own due time), 0 on success
+} plugin_timer_t;
+
+/**
+ * A message buffer allocator owned by the host: lines and results come from per-thread caches of size-classed buffers,
+ * so a buffer allocated on one stage's thread and freed on the next one's doesn't go through malloc at all.
+ */
+typedef struct
+{
+    void* pool; // Host's allocator (opaque to the plugin)
+    char* (*alloc)(void* pool, size_t size); // A buffer of at least size bytes (any thread), NULL on failure
+    void (*release)(void* pool, char* buffer); // Give a buffer back (any thread) - one of alloc's, or any malloc'd string
+} plugin_buffers_t;
+
+/**
+ * plugin_config_t.char_delay_us: no delay at all (0 leaves the plugin's own default)
+ */
+#define PLUGIN_DELAY_NONE (-1L)
+
+/**
+ * A string that hasn't been built yet: a base buffer plus index remappings (plugin_view.h) - opaque to the host
+ */
+typedef struct plugin_view plugin_view_t;
+
+/**
+ * A string kept as segments of refcounted chunks (plugin_rope.h) - how very long records move between stages that take it
+ */
+typedef struct plugin_rope plugin_rope_t;
+
+/**
+ * A message as a stage sees it: the chars, their length, where they are in the stream and when they arrived
+ * (plugin_common.h) - opaque to the host
+ */
+typedef struct plugin_message plugin_message_t;
+
+/**
+ * What a line carries from stage to stage besides its chars (the queues' item meta): len, seq - its position in the
+ * input, 0 for the first line - and ingest_ns - when it was read (CLOCK_MONOTONIC, nanoseconds). The host stamps it
+ * once, where it reads the line (plugin_instance_place_messages_owned), and every stage hands it on as it got it -
+ * only len follows the line, ITEM_META_LEN_UNKNOWN when a transform didn't say.
+ */
+typedef item_meta_t plugin_header_t;
+
+/**
+ * One stage folded into another stage's instance (see plugin_config_t.fused)
+ */
+typedef struct
+{
+    const char* (*transform)(const char*); // The stage's plugin_transform
+    void (*transform_span)(const char*, char*, size_t); // The stage's plugin_transform_span, NULL if it has none (changes the length)
+    void (*transform_span_repeat)(const char*, char*, size_t, unsigned long); // The stage's plugin_transform_span_repeat, NULL if it has none
+    unsigned long repeat; // > 1: the stage stands for this many copies of itself in a row (0 or 1: once)
+    int (*transform_view)(plugin_view_t*); // The stage's plugin_transform_view, NULL if it has none (needs the chars)
+} plugin_fused_stage_t;
+
+/**
+ * Plugin configuration passed to plugin_instance_init
+ */
+typedef struct
+{
+    int queue_size; // Maximum number of items that can be queued
+    int queue_mode; // PLUGIN_QUEUE_LOCKED, PLUGIN_QUEUE_SPSC or PLUGIN_QUEUE_RECORDS
+    int batch_size; // > 1: drain up to batch_size items per wakeup and forward them as one batch (0 or 1: one item at a time)
+    int replicas; // > 1: that many worker threads pull from the instance's queue (needs PLUGIN_QUEUE_LOCKED, ignores batch_size)
+    int unordered; // replicas > 1: forward results as soon as they're done instead of in input order (next link must be locked)
+    const plugin_executor_t* executor; // non-NULL: run on this pool instead of a dedicated thread (must outlive the instance, excludes replicas)
+    const plugin_fused_stage_t* fused; // num_fused > 0: run these stages back to back instead of the plugin's own transform (copied)
+    int num_fused; // Number of fused stages
+    void (*release_input)(void* arg, char* item); // non-NULL: called instead of free() on input items (the host lent them, e.g. mapped file slices)
+    void* release_arg; // release_input's first argument
+    const plugin_output_t* output; // non-NULL: what the transform prints goes through this, flushed on END, FLUSH and BARRIER (must outlive the instance)
+    const plugin_timer_t* timer; // non-NULL: pacing plugins wait on this instead of sleeping (must outlive the instance)
+    long char_delay_us; // Pacing plugins: delay per character in microseconds (0: the plugin's default, PLUGIN_DELAY_NONE: no delay)
+    const plugin_buffers_t* buffers; // non-NULL: queue copies and results are allocated from this, and input items given back to it (the same for every instance of a chain, must outlive them)
+    size_t queue_bytes; // PLUGIN_QUEUE_RECORDS: size of the ring in bytes (0: queue_size * PLUGIN_RECORD_BYTES)
+} plugin_config_t;
+
+/**
+ * One running copy of a plugin (its own queue and consumer thread) - opaque to the host.
+ * A plugin .so can be instantiated any number of times, e.g. "rotator rotator logger".
+ */
+typedef struct plugin_instance plugin_instance_t;
+
+/**
+ * The next stage an instance forwards its results to
+ */
+typedef struct
+{
+    plugin_instance_t* instance; // Next stage's instance
+    const char* (*place_work)(plugin_instance_t*, const char*); // Next stage's plugin_instance_place_work
+    const char* (*place_work_owned)(plugin_instance_t*, char*); // Next stage's plugin_instance_place_work_owned
+    const char* (*place_work_many_owned)(plugin_instance_t*, char* const*, int); // Next stage's plugin_instance_place_work_many_owned (may be NULL)
+    int (*offer_owned)(plugin_instance_t*, char*); // Next stage's plugin_instance_offer_owned (may be NULL - pool workers use it so they never block)
+    const char* (*place_messages_owned)(plugin_instance_t*, char* const*, const plugin_header_t*, int); // Next stage's plugin_instance_place_messages_owned (may be NULL - the next stage then stamps what it gets as new input)
+    int (*offer_message_owned)(plugin_instance_t*, char*, const plugin_header_t*); // Next stage's plugin_instance_offer_message_owned (may be NULL, like offer_owned)
+    const char* (*signal)(plugin_instance_t*, int); // Next stage's plugin_instance_signal (END, FLUSH and BARRIER go on through it)
+    int ropes; // The next stage exports plugin_transform_rope, so long results may go to it as ropes instead of strings
+} plugin_link_t;
+
 /**
  * Get the plugin's name
  * @return The plugin's name (should not be modified or freed)
@@ -8,6 +186,82 @@
 const char* plugin_get_name(void);
 
 
+/**
+ * Get the plugin's properties (optional export - a plugin without it is treated as 0)
+ * @return Bitwise OR of PLUGIN_FLAG_* values
+ */
+unsigned int plugin_get_flags(void);
+
+
+/**
+ * Transform one string - the function the plugin's consumer thread runs on every item
+ * Hosts may also call it directly (e.g. to run a whole chain on one thread).
+ * @param input The string to transform (not modified or freed)
+ * @return A new heap-allocated string (caller frees), or NULL on failure
+ */
+const char* plugin_transform(const char* input);
+
+
+/**
+ * Length-preserving transform into a caller-provided buffer (optional export)
+ * @param input The string to transform (len chars, need not be terminated)
+ * @param output Buffer of at least len chars, not overlapping input (not terminated by this function)
+ * @param len Number of chars
+ */
+void plugin_transform_span(const char* input, char* output, size_t len);
+
+
+/**
+ * Length-preserving transform applied several times in a single pass (optional export, needs plugin_transform_span)
+ * @param input The string to transform (len chars, need not be terminated)
+ * @param output Buffer of at least len chars, not overlapping input (not terminated by this function)
+ * @param len Number of chars
+ * @param times How many times to apply the transform (0 copies the input)
+ */
+void plugin_transform_span_repeat(const char* input, char* output, size_t len, unsigned long times);
+
+
+/**
+ * Length-preserving transform in the buffer the string came in (optional export)
+ * An instance of a plugin that has it runs it on every item it owns instead of plugin_transform, and forwards that
+ * same buffer - no allocation, no copy. Items the host lent still go through plugin_transform.
+ * @param buf The string (len chars, its terminator stays where it is)
+ * @param len Number of chars
+ */
+void plugin_transform_inplace(char* buf, size_t len);
+
+
+/**
+ * Index-remapping transform that only updates a view (optional export, for plugins that just move chars around)
+ * Runs of such stages in one instance compose into one view, and the chars are written once, when a stage
+ * needs them or the result leaves the instance.
+ * @param view The string so far
+ * @return 0 on success, -1 if the view can't take another layer (it is left unchanged - build it and start a new one)
+ */
+int plugin_transform_view(plugin_view_t* view);
+
+
+/**
+ * Transform a very long record kept as a rope, without building it into one string (optional export)
+ * An instance of a plugin that has it turns long strings into ropes, and hands its results on as ropes when the
+ * next stage has it too (plugin_link_t.ropes) - otherwise they are built into strings first.
+ * @param rope The record (changed in place)
+ * @return 0 on success, -1 on failure (the rope is dropped)
+ */
+int plugin_transform_rope(plugin_rope_t* rope);
+
+
+/**
+ * Transform one message envelope (optional export, the v2 transform - plugin_transform stays for hosts that call it)
+ * An instance of a plugin that has it runs it on every data message instead of plugin_transform, so the length the
+ * SDK already knows (e.g. from a record ring) isn't counted again. Control messages never get here.
+ * @param input The message, its len always counted (payload not modified or freed)
+ * @param output Starts as a copy of input without its payload - gets the new heap-allocated payload and its length
+ * @return 0 on success, -1 on failure
+ */
+int plugin_transform_message(const plugin_message_t* input, plugin_message_t* output);
+
+
 /**
  * Initialize the plugin with the specified queue size
  * @param queue_size Maximum number of items that can be queued
@@ -24,13 +278,21 @@ const char* plugin_fini(void);
 
 
 /**
- * Place work (a string) into the plugin's queue
+ * Place work (a string) into the plugin's queue - every string is data, plugin_signal ends the stream
  * @param str The string to process (plugin takes ownership if it allocates new memory)
  * @return NULL on success, error message on failure
  */
 const char* plugin_place_work(const char* str);
 
 
+/**
+ * Put a control message on the plugin's control lane (plugin_instance_signal for the single instance)
+ * @param control PLUGIN_CONTROL_END, PLUGIN_CONTROL_FLUSH, PLUGIN_CONTROL_BARRIER, PLUGIN_CONTROL_PAUSE or PLUGIN_CONTROL_RESUME
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_signal(int control);
+
+
 /**
  * Attach this plugin to the next plugin in the chain
  * @param next_place_work Function pointer to the next plugin's place_work function
@@ -38,6 +300,13 @@ const char* plugin_place_work(const char* str);
 void plugin_attach(const char* (*next_place_work)(const char*));
 
 
+/**
+ * Pass this plugin's control messages (END, FLUSH, BARRIER) on to the next plugin in the chain
+ * @param next_signal Function pointer to the next plugin's plugin_signal (NULL: they stop here)
+ */
+void plugin_attach_signal(const char* (*next_signal)(int));
+
+
 /**
  * Wait until the plugin has finished processing all work and is ready to shutdown
  * This is a blocking function used for graceful shutdown coordination
@@ -45,4 +314,112 @@ void plugin_attach(const char* (*next_place_work)(const char*));
  */
 const char* plugin_wait_finished(void);
 
-#endif
\ No newline at end of file
+
+/**
+ * Instance ABI - same lifecycle as above, but every call names the instance it acts on,
+ * so the host can create as many independent instances of one .so as it needs.
+ */
+
+/**
+ * Create a new, independent instance of the plugin
+ * @param config Plugin configuration
+ * @param instance Output - the new instance on success
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_instance_init(const plugin_config_t* config, plugin_instance_t** instance);
+
+
+/**
+ * Finalize one instance - terminate its thread gracefully and free it
+ * @param instance Plugin instance
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_instance_fini(plugin_instance_t* instance);
+
+
+/**
+ * Place work (a string) into one instance's queue
+ * @param instance Plugin instance
+ * @param str The string to process (copied by the queue)
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_instance_place_work(plugin_instance_t* instance, const char* str);
+
+
+/**
+ * Place work into one instance's queue without copying it
+ * @param instance Plugin instance
+ * @param str Heap-allocated string (the instance takes ownership on success, the caller keeps it on failure)
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_instance_place_work_owned(plugin_instance_t* instance, char* str);
+
+
+/**
+ * Place several heap-allocated strings into one instance's queue without copying them
+ * @param instance Plugin instance
+ * @param items The strings to process (the instance takes ownership of all of them on success)
+ * @param count Number of strings
+ * @return NULL on success, error message on failure (the caller keeps the strings on failure)
+ */
+const char* plugin_instance_place_work_many_owned(plugin_instance_t* instance, char* const* items, int count);
+
+
+/**
+ * Place work into one instance's queue without copying it and without blocking
+ * @param instance Plugin instance
+ * @param str Heap-allocated string (the instance takes ownership only if it was accepted)
+ * @return 1 if accepted, 0 if the queue is full, -1 on error
+ */
+int plugin_instance_offer_owned(plugin_instance_t* instance, char* str);
+
+
+/**
+ * Place heap-allocated strings into one instance's queue together with their headers, without copying them
+ * The place_work functions above stamp what they get as new input (the next seq, the time now); these keep the
+ * headers as they are - the host stamps its lines here, and every stage forwards its results with them.
+ * @param instance Plugin instance
+ * @param items The strings to process (the instance takes ownership of all of them on success)
+ * @param headers Each string's header
+ * @param count Number of strings
+ * @return NULL on success, error message on failure (the caller keeps the strings on failure)
+ */
+const char* plugin_instance_place_messages_owned(plugin_instance_t* instance, char* const* items, const plugin_header_t* headers, int count);
+
+
+/**
+ * Place one heap-allocated string and its header into one instance's queue without blocking
+ * @param instance Plugin instance
+ * @param str Heap-allocated string (the instance takes ownership only if it was accepted)
+ * @param header Its header
+ * @return 1 if accepted, 0 if the queue is full, -1 on error
+ */
+int plugin_instance_offer_message_owned(plugin_instance_t* instance, char* str, const plugin_header_t* header);
+
+
+/**
+ * Put a control message on one instance's control lane (a BARRIER may wait for the lane to have room, nothing else
+ * blocks - END and BARRIER still wait behind the queued lines)
+ * @param instance Plugin instance
+ * @param control PLUGIN_CONTROL_END, PLUGIN_CONTROL_FLUSH, PLUGIN_CONTROL_BARRIER, PLUGIN_CONTROL_PAUSE or PLUGIN_CONTROL_RESUME
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_instance_signal(plugin_instance_t* instance, int control);
+
+
+/**
+ * Attach one instance to the next stage in the chain
+ * @param instance Plugin instance
+ * @param next The next stage (its instance and entry points) - copied
+ */
+void plugin_instance_attach(plugin_instance_t* instance, const plugin_link_t* next);
+
+
+/**
+ * Wait until one instance has finished processing all work
+ * @param instance Plugin instance
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_instance_wait_finished(plugin_instance_t* instance);
+
+#endif
@@ -0,0 +1,259 @@
+#include <string.h> // memcpy, memset
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PLUGIN_VIEW_X86 1
+#include "byte_reverse.h"
+#endif
+
+#include "plugin_view.h"
+
+
+void plugin_view_init(plugin_view_t* view, const char* base, size_t len){
+    view->base = base;
+    view->base_len = len;
+    view->num_layers = 0;
+}
+
+
+size_t plugin_view_length(const plugin_view_t* view){
+    return view->num_layers > 0 ? view->layers[view->num_layers - 1].len : view->base_len;
+}
+
+
+/**
+ * Stack a permutation (char i comes from offset +/- i below) - merged into the permutation on top if there is one
+ * (p1 after p2 is again i -> offset +/- i: the directions multiply, and p2's offset moves p1's one way or the other)
+ * @param view Pointer to view structure
+ * @param reversed Chars come from offset - i instead of offset + i
+ * @param offset Where char 0 comes from (< the view's length)
+ * @return 0 on success, -1 if the view has no room for another layer
+ */
+static int plugin_view_permute(plugin_view_t* view, int reversed, size_t offset){
+    size_t len = plugin_view_length(view);
+    plugin_view_layer_t* top = view->num_layers > 0 ? &view->layers[view->num_layers - 1] : NULL;
+
+    if(top != NULL && top->kind == PLUGIN_VIEW_PERMUTE){
+        offset = top->reversed ? (top->offset + len - offset) % len : (top->offset + offset) % len;
+        reversed = top->reversed != reversed;
+        // the two undid each other (e.g. two flips) - the layer below is the string again
+        if(!reversed && offset == 0){
+            view->num_layers--;
+            return 0;
+        }
+        top->offset = offset;
+        top->reversed = reversed;
+        return 0;
+    }
+
+    if(!reversed && offset == 0){
+        return 0;
+    }
+    if(view->num_layers == PLUGIN_VIEW_MAX_LAYERS){
+        return -1;
+    }
+    view->layers[view->num_layers++] = (plugin_view_layer_t){ .kind = PLUGIN_VIEW_PERMUTE, .len = len, .offset = offset, .reversed = reversed };
+    return 0;
+}
+
+
+int plugin_view_rotate(plugin_view_t* view, unsigned long times){
+    size_t len = plugin_view_length(view);
+    // nothing to move
+    if(len <= 1){
+        return 0;
+    }
+    // char i comes from i - times
+    return plugin_view_permute(view, 0, (len - times % len) % len);
+}
+
+
+int plugin_view_reverse(plugin_view_t* view){
+    size_t len = plugin_view_length(view);
+    if(len <= 1){
+        return 0;
+    }
+    // char i comes from len - 1 - i
+    return plugin_view_permute(view, 1, len - 1);
+}
+
+
+int plugin_view_interleave(plugin_view_t* view, char fill){
+    size_t len = plugin_view_length(view);
+    // no two chars to put anything between
+    if(len <= 1){
+        return 0;
+    }
+    // a second one would spread the chars out to every 4th place, which only a byte loop can write - building the
+    // string up to here and interleaving that is faster
+    for(int i = 0; i < view->num_layers; i++){
+        if(view->layers[i].kind == PLUGIN_VIEW_INTERLEAVE){
+            return -1;
+        }
+    }
+    view->layers[view->num_layers++] = (plugin_view_layer_t){ .kind = PLUGIN_VIEW_INTERLEAVE, .len = 2 * len - 1, .fill = fill };
+    return 0;
+}
+
+
+/**
+ * Copy count base chars from source on, walking forwards (dir 1) or backwards (dir -1)
+ * @param fill >= 0: every char is followed by this one in output (written too), < 0: output is contiguous
+ */
+static void plugin_view_copy_scalar(const char* source, size_t count, int dir, char* output, int fill){
+    for(size_t k = 0; k < count; k++){
+        if(fill >= 0){
+            output[2 * k] = *source;
+            output[2 * k + 1] = (char)fill;
+        }
+        else{
+            output[k] = *source;
+        }
+        source += dir;
+    }
+}
+
+
+#ifdef PLUGIN_VIEW_X86
+
+/**
+ * Copy base chars 16 at a time: backwards into contiguous output (fill < 0), or either way as char/fill pairs
+ * @return Chars copied (the rest is left to the scalar loop)
+ */
+static size_t plugin_view_copy_sse2(const char* source, size_t count, int dir, char* output, int fill){
+    size_t k = 0;
+    if(fill < 0){
+        for(; k + 16 <= count; k += 16){
+            __m128i block = _mm_loadu_si128((const __m128i*)(source - k - 15));
+            _mm_storeu_si128((__m128i*)(output + k), byte_reverse_sse2(block));
+        }
+        return k;
+    }
+
+    const __m128i fills = _mm_set1_epi8((char)fill);
+    for(; k + 16 <= count; k += 16){
+        __m128i block = dir > 0 ? _mm_loadu_si128((const __m128i*)(source + k))
+                                : byte_reverse_sse2(_mm_loadu_si128((const __m128i*)(source - k - 15)));
+        _mm_storeu_si128((__m128i*)(output + 2 * k), _mm_unpacklo_epi8(block, fills));
+        _mm_storeu_si128((__m128i*)(output + 2 * k + 16), _mm_unpackhi_epi8(block, fills));
+    }
+    return k;
+}
+
+
+/**
+ * Same as the SSE2 kernel, 32 chars per step - a reversed block is mirrored within its lanes, then the lanes swapped,
+ * and since the unpacks work within lanes too, pairs need the quarters in order 0, 2, 1, 3 first
+ */
+__attribute__((target("avx2")))
+static size_t plugin_view_copy_avx2(const char* source, size_t count, int dir, char* output, int fill){
+    const __m256i mirror = byte_reverse_mirror_avx2();
+    size_t k = 0;
+    if(fill < 0){
+        for(; k + 32 <= count; k += 32){
+            __m256i block = _mm256_loadu_si256((const __m256i*)(source - k - 31));
+            _mm256_storeu_si256((__m256i*)(output + k), byte_reverse_avx2(block, mirror));
+        }
+        return k + plugin_view_copy_sse2(source - k, count - k, dir, output + k, fill);
+    }
+
+    const __m256i fills = _mm256_set1_epi8((char)fill);
+    for(; k + 32 <= count; k += 32){
+        __m256i block;
+        if(dir > 0){
+            block = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i*)(source + k)), _MM_SHUFFLE(3, 1, 2, 0));
+        }
+        else{
+            // mirrored lanes come in order 1, 0 - and 0, 2, 1, 3 of that
+            block = byte_reverse_lanes_avx2(_mm256_loadu_si256((const __m256i*)(source - k - 31)), mirror);
+            block = _mm256_permute4x64_epi64(block, _MM_SHUFFLE(1, 3, 0, 2));
+        }
+        _mm256_storeu_si256((__m256i*)(output + 2 * k), _mm256_unpacklo_epi8(block, fills));
+        _mm256_storeu_si256((__m256i*)(output + 2 * k + 32), _mm256_unpackhi_epi8(block, fills));
+    }
+    return k + plugin_view_copy_sse2(dir > 0 ? source + k : source - k, count - k, dir, output + 2 * k, fill);
+}
+
+#endif
+
+
+// the kernel this CPU runs for reversed copies and pairs (NULL: scalar only) - picked when the plugin is loaded
+static size_t (*plugin_view_copy_kernel)(const char*, size_t, int, char*, int) = NULL;
+
+/**
+ * Pick the kernel when the plugin is loaded (before any view can be built)
+ */
+__attribute__((constructor))
+static void plugin_view_setup(void){
+#ifdef PLUGIN_VIEW_X86
+    __builtin_cpu_init();
+    plugin_view_copy_kernel = __builtin_cpu_supports("avx2") ? plugin_view_copy_avx2 : plugin_view_copy_sse2;
+#endif
+}
+
+
+/**
+ * Copy count base chars from index start on
+ * @param fill >= 0: every char is followed by this one in output (written too), < 0: output is contiguous
+ */
+static void plugin_view_copy(const plugin_view_t* view, size_t start, size_t count, int dir, char* output, int fill){
+    const char* source = view->base + start;
+    if(dir > 0 && fill < 0){
+        memcpy(output, source, count);
+        return;
+    }
+
+    size_t done = plugin_view_copy_kernel != NULL ? plugin_view_copy_kernel(source, count, dir, output, fill) : 0;
+    plugin_view_copy_scalar(dir > 0 ? source + done : source - done, count - done, dir, output + (fill >= 0 ? 2 * done : done), fill);
+}
+
+
+/**
+ * Write count chars of one layer's output, from index start on, walking forwards (dir 1) or backwards (dir -1)
+ * Every layer turns its range into at most two ranges of the layer below, so the chars are only ever read from the base.
+ * @param view Pointer to view structure
+ * @param level Layers to go through (0: read the base)
+ * @param start First index to write (< the layer's length)
+ * @param count Number of chars (start + dir * (count - 1) must be inside the layer too)
+ * @param dir 1 or -1
+ * @param output Where the first char goes
+ * @param fill >= 0: below the interleave - every char is followed by this one, so the copy writes char/fill pairs
+ *             (the last char's fill lands just past the range, where the next range or the terminator goes after it)
+ */
+static void plugin_view_emit(const plugin_view_t* view, int level, size_t start, size_t count, int dir, char* output, int fill){
+    if(count == 0){
+        return;
+    }
+
+    if(level == 0){
+        plugin_view_copy(view, start, count, dir, output, fill);
+        return;
+    }
+
+    const plugin_view_layer_t* layer = &view->layers[level - 1];
+
+    if(layer->kind == PLUGIN_VIEW_PERMUTE){
+        size_t len = layer->len;
+        size_t from = layer->reversed ? (layer->offset + len - start) % len : (layer->offset + start) % len;
+        int from_dir = layer->reversed ? -dir : dir;
+        // the chars below run contiguously until they wrap around the end (or the start) of the layer below
+        size_t run = from_dir > 0 ? len - from : from + 1;
+        size_t first = count < run ? count : run;
+        plugin_view_emit(view, level - 1, from, first, from_dir, output, fill);
+        plugin_view_emit(view, level - 1, from_dir > 0 ? 0 : len - 1, count - first, from_dir, output + (fill >= 0 ? 2 * first : first), fill);
+        return;
+    }
+
+    // interleave: even indices are chars of the layer below (index / 2), odd ones are fill - each char brings its own
+    size_t first_char = start % 2;
+    size_t num_chars = count > first_char ? (count - first_char + 1) / 2 : 0;
+    size_t below = dir > 0 ? (start + first_char) / 2 : (start - first_char) / 2;
+    if(first_char){
+        output[0] = layer->fill;
+    }
+    plugin_view_emit(view, level - 1, below, num_chars, dir, output + first_char, (unsigned char)layer->fill);
+}
+
+
+void plugin_view_materialize(const plugin_view_t* view, char* output){
+    plugin_view_emit(view, view->num_layers, 0, plugin_view_length(view), 1, output, -1);
+}
@@ -0,0 +1,91 @@
+#ifndef PLUGIN_VIEW_H
+#define PLUGIN_VIEW_H
+
+#include <stddef.h>
+
+/**
+ * plugin view is a string that hasn't been built yet: a base buffer plus the index remappings stacked on top of it.
+ * geometric plugins (rotator, flipper, expander) only move chars around, so instead of copying they add a layer:
+ * - a permutation: char i comes from char (offset + i) or (offset - i) of the layer below, mod its length -
+ *   rotations and flips compose into a single one of these, however many follow each other
+ * - an interleave: the layer below with a fill char between every two of its chars (expander)
+ * plugin_view_materialize then writes the final string in one pass, reading every char straight from the base.
+ * a view holds one interleave at most - a second one is the caller's cue to build the string and start a new view.
+ **/
+
+// layers a view can stack: a permutation, the interleave, a permutation (neighbouring permutations merge)
+#define PLUGIN_VIEW_MAX_LAYERS 3
+
+#define PLUGIN_VIEW_PERMUTE 0
+#define PLUGIN_VIEW_INTERLEAVE 1
+
+/**
+ * One index remapping
+ */
+typedef struct
+{
+ int kind; /* PLUGIN_VIEW_PERMUTE or PLUGIN_VIEW_INTERLEAVE */
+ size_t len; /* Length of the layer's output */
+ size_t offset; /* Permutation: where char 0 comes from (< len) */
+ int reversed; /* Permutation: chars come from offset - i instead of offset + i */
+ char fill; /* Interleave: the char put between every two chars */
+} plugin_view_layer_t;
+
+/**
+ * View structure (plugin_view_t in plugin_sdk.h is this struct)
+ */
+typedef struct plugin_view
+{
+ const char* base; /* The chars every layer is built on (not owned, not modified) */
+ size_t base_len; /* Number of chars in base */
+ plugin_view_layer_t layers[PLUGIN_VIEW_MAX_LAYERS]; /* Bottom (applied to base first) to top */
+ int num_layers; /* Layers in use (0: the view is just base) */
+} plugin_view_t;
+
+/**
+ * Start a view over a buffer
+ * @param view Pointer to view structure
+ * @param base The chars (must stay valid and unchanged while the view is used)
+ * @param len Number of chars
+ */
+void plugin_view_init(plugin_view_t* view, const char* base, size_t len);
+
+/**
+ * Length of the string the view stands for
+ * @param view Pointer to view structure
+ * @return Number of chars
+ */
+size_t plugin_view_length(const plugin_view_t* view);
+
+/**
+ * Move every char times positions to the right, the last ones wrapping around to the front (rotator)
+ * @param view Pointer to view structure
+ * @param times Positions to move
+ * @return 0 on success, -1 if the view has no room for another layer (it is left unchanged)
+ */
+int plugin_view_rotate(plugin_view_t* view, unsigned long times);
+
+/**
+ * Reverse the order of the chars (flipper)
+ * @param view Pointer to view structure
+ * @return 0 on success, -1 if the view has no room for another layer (it is left unchanged)
+ */
+int plugin_view_reverse(plugin_view_t* view);
+
+/**
+ * Put fill between every two chars, none after the last (expander)
+ * @param view Pointer to view structure
+ * @param fill The char to put in
+ * @return 0 on success, -1 if the view already interleaves (it is left unchanged)
+ */
+int plugin_view_interleave(plugin_view_t* view, char fill);
+
+/**
+ * Write the string the view stands for (one pass, every char read from the base)
+ * @param view Pointer to view structure
+ * @param output Buffer of at least plugin_view_length + 1 chars, not overlapping the base (the last one is for the
+ *               terminator, which isn't written by this function - it may be overwritten though)
+ */
+void plugin_view_materialize(const plugin_view_t* view, char* output);
+
+#endif
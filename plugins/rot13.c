@@ -0,0 +1,27 @@
+#include "byte_map_plugin.h"
+
+// rot13: Moves every letter 13 places along the alphabet, wrapping around (a <-> n, B <-> O), keeping its case.
+// (a byte map like uppercaser - four shifted runs: a-m, n-z, A-M, N-Z)
+
+
+/**
+ * The map: every letter 13 places on, every other byte stays
+ * @param table Output - byte -> byte
+ */
+static void rot13_table(unsigned char table[256]){
+    for(int c = 0; c < 256; c++){
+        if(c >= 'a' && c <= 'z'){
+            table[c] = (unsigned char)('a' + (c - 'a' + 13) % 26);
+        }
+        else if(c >= 'A' && c <= 'Z'){
+            table[c] = (unsigned char)('A' + (c - 'A' + 13) % 26);
+        }
+        else{
+            table[c] = (unsigned char)c;
+        }
+    }
+}
+
+
+// PLUGIN_FLAG_INVOLUTION - rotating by 13 twice goes all the way around
+BYTE_MAP_PLUGIN("rot13", PLUGIN_FLAG_PURE | PLUGIN_FLAG_INVOLUTION, rot13_table)
@@ -20,22 +20,104 @@ const char* plugin_get_name(void){
 }
 
 
+/**
+ * Get the plugin's properties
+ * @return PLUGIN_FLAG_PURE - the transform only builds a new string from its input
+ */
+__attribute__((visibility("default")))
+unsigned int plugin_get_flags(void){
+    return PLUGIN_FLAG_PURE;
+}
+
+
+/**
+ * Rotate by several positions in a single pass (instead of one shift per rotation)
+ * @param input The string to transform (len chars, need not be terminated)
+ * @param output Buffer of at least len chars, not overlapping input (not terminated by this function)
+ * @param len Number of chars
+ * @param times How many positions to move every char to the right
+ */
+__attribute__((visibility("default")))
+void plugin_transform_span_repeat(const char* input, char* output, size_t len, unsigned long times){
+    // nothing to move (and no last char to read)
+    if(len == 0){
+        return;
+    }
+
+    // the last k chars wrap around to the front, the rest shift right by k
+    size_t k = times % len;
+    memcpy(output, input + len - k, k);
+    memcpy(output + k, input, len - k);
+}
+
+
+/**
+ * Length-preserving transform into a caller-provided buffer (lets the host fuse stages without allocating)
+ * @param input The string to transform (len chars, need not be terminated)
+ * @param output Buffer of at least len chars, not overlapping input (not terminated by this function)
+ * @param len Number of chars
+ */
+__attribute__((visibility("default")))
+void plugin_transform_span(const char* input, char* output, size_t len){
+    // move last char to front, shift others right
+    plugin_transform_span_repeat(input, output, len, 1);
+}
+
+
+/**
+ * Index-remapping transform: rotate by one (lets the host compose a run of stages and write the chars once)
+ * @param view The string so far
+ * @return 0 on success, -1 if the view can't take another layer
+ */
+__attribute__((visibility("default")))
+int plugin_transform_view(plugin_view_t* view){
+    return plugin_view_rotate(view, 1);
+}
+
+
+/**
+ * In-place transform: rotate by one in the buffer the string came in (the instance owns it, so no copy is made)
+ * @param buf The string (len chars)
+ * @param len Number of chars
+ */
+__attribute__((visibility("default")))
+void plugin_transform_inplace(char* buf, size_t len){
+    // nothing to move (and no last char to read)
+    if(len == 0){
+        return;
+    }
+
+    // the last char goes to the front once the rest moved right over it
+    char last = buf[len - 1];
+    memmove(buf + 1, buf, len - 1);
+    buf[0] = last;
+}
+
+
+/**
+ * Rope transform: rotate by one by relinking segments - the last char becomes a slice of its chunk at the front
+ * @param rope The string
+ * @return 0 on success, -1 on failure
+ */
+__attribute__((visibility("default")))
+int plugin_transform_rope(plugin_rope_t* rope){
+    return plugin_rope_rotate(rope, 1);
+}
+
+
 // transformation function
 const char* plugin_transform(const char* input){
     int len= strlen(input);
     
     // allocate the memory for the copy of input (so we can later on free the original input from memory)
-    char* result= malloc(len+1);
+    char* result= plugin_buffer_alloc(len+1);
     // error allocating memory: return NULL
     if(result == NULL){
         return NULL;
     }
 
     // Always rotate: move last char to front, shift others right
-    result[0] = input[len - 1];
-    for (int i = 0; i < len - 1; i++) {
-        result[i + 1] = input[i];
-    }
+    plugin_transform_span(input, result, len);
     result[len] = '\0';
     return result;
 }
@@ -51,3 +133,16 @@ __attribute__((visibility("default")))
 const char* plugin_init(int queue_size){
     return common_plugin_init(plugin_transform, "rotator", queue_size);
 }
+
+
+/**
+ * Create a new, independent instance of the plugin - calls common_plugin_instance_init
+ * This function should be implemented by each plugin
+ * @param config Plugin configuration
+ * @param instance Output - the new instance on success
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_init(const plugin_config_t* config, plugin_instance_t** instance){
+    return common_plugin_instance_init_inplace(plugin_transform, plugin_transform_inplace, plugin_transform_rope, "rotator", config, instance);
+}
@@ -0,0 +1,283 @@
+#include <stdlib.h>   // malloc, calloc, free, aligned_alloc
+#include <string.h>   // memset
+#include <stdint.h>   // uintptr_t
+#include <sys/mman.h> // mmap, mprotect, madvise, munmap
+#include <pthread.h>
+
+#include "buffer_pool.h"
+
+
+/**
+ * The class a size falls in
+ * @param size Bytes needed
+ * @return Index of the smallest class that holds size bytes, or -1 if none does
+ */
+static int buffer_pool_class(size_t size){
+    if(size > ((size_t)1 << BUFFER_POOL_MAX_SHIFT)){
+        return -1;
+    }
+    int shift = BUFFER_POOL_MIN_SHIFT;
+    while(((size_t)1 << shift) < size){
+        shift++;
+    }
+    return shift - BUFFER_POOL_MIN_SHIFT;
+}
+
+
+/**
+ * Bytes per buffer of a class
+ * @param size_class Index of the class
+ * @return The size
+ */
+static size_t buffer_pool_class_size(int size_class){
+    return (size_t)1 << (size_class + BUFFER_POOL_MIN_SHIFT);
+}
+
+
+/**
+ * Thread exit: leave the thread's cache for the next thread (buffers it handed out still come back to it)
+ * @param arg The cache
+ */
+static void buffer_pool_abandon(void* arg){
+    buffer_pool_cache_t* cache = (buffer_pool_cache_t*)arg;
+    buffer_pool_t* pool = cache->pool;
+    pthread_mutex_lock(&pool->mutex);
+    cache->next_idle = pool->idle;
+    pool->idle = cache;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+
+const char* buffer_pool_init(buffer_pool_t* pool, int huge_pages){
+    // a huge page more than needed, so the range can start on a huge page boundary
+    size_t size = BUFFER_POOL_RESERVE_SIZE;
+    char* reserved = MAP_FAILED;
+    while(size >= 64 * BUFFER_POOL_COMMIT_SIZE){
+        reserved = mmap(NULL, size + BUFFER_POOL_COMMIT_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(reserved != MAP_FAILED){
+            break;
+        }
+        size /= 2;
+    }
+    if(reserved == MAP_FAILED){
+        return "failed to reserve buffer pool range";
+    }
+
+    // trim to an aligned range of exactly size bytes
+    size_t lead = (BUFFER_POOL_COMMIT_SIZE - (uintptr_t)reserved % BUFFER_POOL_COMMIT_SIZE) % BUFFER_POOL_COMMIT_SIZE;
+    if(lead > 0){
+        munmap(reserved, lead);
+    }
+    munmap(reserved + lead + size, BUFFER_POOL_COMMIT_SIZE - lead);
+    pool->base = reserved + lead;
+    pool->size = size;
+
+    if(huge_pages && madvise(pool->base, pool->size, MADV_HUGEPAGE) != 0){
+        munmap(pool->base, pool->size);
+        return "huge pages are not available";
+    }
+
+    // one entry per slab - only the pages of the slabs carved so far are ever touched
+    pool->slabs = calloc(size / BUFFER_POOL_SLAB_SIZE, sizeof(buffer_pool_slab_t));
+    if(pool->slabs == NULL){
+        munmap(pool->base, pool->size);
+        return "failed to allocate slab table";
+    }
+
+    if(pthread_key_create(&pool->key, buffer_pool_abandon) != 0){
+        free(pool->slabs);
+        munmap(pool->base, pool->size);
+        return "failed to create buffer pool key";
+    }
+
+    if(pthread_mutex_init(&pool->mutex, NULL) != 0){
+        pthread_key_delete(pool->key);
+        free(pool->slabs);
+        munmap(pool->base, pool->size);
+        return "failed initializing buffer pool mutex";
+    }
+
+    pool->committed = 0;
+    pool->carved = 0;
+    pool->caches = NULL;
+    pool->idle = NULL;
+    return NULL;
+}
+
+
+void buffer_pool_destroy(buffer_pool_t* pool){
+    if(pool == NULL){
+        return;
+    }
+
+    // the calling thread's cache is freed below - its key must not point at it when the thread exits
+    pthread_key_delete(pool->key);
+    buffer_pool_cache_t* cache = pool->caches;
+    while(cache != NULL){
+        buffer_pool_cache_t* next = cache->next;
+        free(cache);
+        cache = next;
+    }
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->slabs);
+    munmap(pool->base, pool->size);
+}
+
+
+/**
+ * The calling thread's cache - one left behind by an exited thread, else a new one
+ * @param pool Pointer to pool structure
+ * @return The cache, or NULL on allocation failure
+ */
+static buffer_pool_cache_t* buffer_pool_cache(buffer_pool_t* pool){
+    buffer_pool_cache_t* cache = pthread_getspecific(pool->key);
+    if(cache != NULL){
+        return cache;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    cache = pool->idle;
+    if(cache != NULL){
+        pool->idle = cache->next_idle;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    if(cache == NULL){
+        // aligned, so the line other threads push to is its own
+        cache = aligned_alloc(64, (sizeof(buffer_pool_cache_t) + 63) / 64 * 64);
+        if(cache == NULL){
+            return NULL;
+        }
+        memset(cache, 0, sizeof(buffer_pool_cache_t));
+        for(int i = 0; i < BUFFER_POOL_CLASSES; i++){
+            atomic_init(&cache->returned[i], NULL);
+        }
+        atomic_init(&cache->in_flight, 0);
+        atomic_init(&cache->hits, 0);
+        atomic_init(&cache->misses, 0);
+        cache->pool = pool;
+
+        pthread_mutex_lock(&pool->mutex);
+        cache->next = pool->caches;
+        pool->caches = cache;
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    if(pthread_setspecific(pool->key, cache) != 0){
+        buffer_pool_abandon(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+
+/**
+ * Give a cache a new slab for one class
+ * @param pool Pointer to pool structure
+ * @param cache The calling thread's cache
+ * @param size_class Index of the class
+ * @return 0 on success, -1 if the range is used up (or can't be made usable)
+ */
+static int buffer_pool_new_slab(buffer_pool_t* pool, buffer_pool_cache_t* cache, int size_class){
+    pthread_mutex_lock(&pool->mutex);
+    if(pool->carved + BUFFER_POOL_SLAB_SIZE > pool->size){
+        pthread_mutex_unlock(&pool->mutex);
+        return -1;
+    }
+    if(pool->carved + BUFFER_POOL_SLAB_SIZE > pool->committed){
+        if(mprotect(pool->base + pool->committed, BUFFER_POOL_COMMIT_SIZE, PROT_READ | PROT_WRITE) != 0){
+            pthread_mutex_unlock(&pool->mutex);
+            return -1;
+        }
+        pool->committed += BUFFER_POOL_COMMIT_SIZE;
+    }
+    char* slab = pool->base + pool->carved;
+    pool->carved += BUFFER_POOL_SLAB_SIZE;
+    pthread_mutex_unlock(&pool->mutex);
+
+    // before any of its buffers leaves this thread, so whoever frees one sees this too
+    buffer_pool_slab_t* entry = &pool->slabs[(slab - pool->base) / BUFFER_POOL_SLAB_SIZE];
+    entry->owner = cache;
+    entry->size_class = size_class;
+    cache->carve[size_class] = slab;
+    cache->carve_end[size_class] = slab + BUFFER_POOL_SLAB_SIZE;
+    return 0;
+}
+
+
+char* buffer_pool_alloc(buffer_pool_t* pool, size_t size){
+    int size_class = buffer_pool_class(size);
+    buffer_pool_cache_t* cache = buffer_pool_cache(pool);
+    if(cache == NULL){
+        return malloc(size);
+    }
+    // bigger than any class
+    if(size_class < 0){
+        atomic_store_explicit(&cache->misses, atomic_load_explicit(&cache->misses, memory_order_relaxed) + 1, memory_order_relaxed);
+        return malloc(size);
+    }
+
+    // our own free list, else everything other threads gave back since we last looked
+    buffer_pool_block_t* block = cache->free[size_class];
+    if(block == NULL){
+        block = atomic_exchange_explicit(&cache->returned[size_class], NULL, memory_order_acquire);
+    }
+    if(block != NULL){
+        cache->free[size_class] = block->next;
+        atomic_store_explicit(&cache->hits, atomic_load_explicit(&cache->hits, memory_order_relaxed) + 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&cache->in_flight, (long)buffer_pool_class_size(size_class), memory_order_relaxed);
+        return (char*)block;
+    }
+
+    atomic_store_explicit(&cache->misses, atomic_load_explicit(&cache->misses, memory_order_relaxed) + 1, memory_order_relaxed);
+    if(cache->carve[size_class] == cache->carve_end[size_class] && buffer_pool_new_slab(pool, cache, size_class) != 0){
+        return malloc(size);
+    }
+    char* buffer = cache->carve[size_class];
+    cache->carve[size_class] += buffer_pool_class_size(size_class);
+    atomic_fetch_add_explicit(&cache->in_flight, (long)buffer_pool_class_size(size_class), memory_order_relaxed);
+    return buffer;
+}
+
+
+void buffer_pool_free(buffer_pool_t* pool, char* buffer){
+    if(buffer == NULL){
+        return;
+    }
+    // not from a slab - malloc'd (by us above the largest class, or by whoever made it)
+    if(buffer < pool->base || buffer >= pool->base + pool->size){
+        free(buffer);
+        return;
+    }
+
+    const buffer_pool_slab_t* slab = &pool->slabs[(buffer - pool->base) / BUFFER_POOL_SLAB_SIZE];
+    buffer_pool_cache_t* owner = slab->owner;
+    buffer_pool_block_t* block = (buffer_pool_block_t*)buffer;
+    atomic_fetch_sub_explicit(&owner->in_flight, (long)buffer_pool_class_size(slab->size_class), memory_order_relaxed);
+
+    if(owner == pthread_getspecific(pool->key)){
+        block->next = owner->free[slab->size_class];
+        owner->free[slab->size_class] = block;
+        return;
+    }
+
+    // another thread's buffer: onto its return list (the owner only ever takes the whole list, so no ABA)
+    block->next = atomic_load_explicit(&owner->returned[slab->size_class], memory_order_relaxed);
+    while(!atomic_compare_exchange_weak_explicit(&owner->returned[slab->size_class], &block->next, block,
+                                                 memory_order_release, memory_order_relaxed)){
+    }
+}
+
+
+void buffer_pool_stats(buffer_pool_t* pool, buffer_pool_stats_t* stats){
+    stats->hits = 0;
+    stats->misses = 0;
+    stats->in_flight = 0;
+    pthread_mutex_lock(&pool->mutex);
+    for(buffer_pool_cache_t* cache = pool->caches; cache != NULL; cache = cache->next){
+        stats->hits += atomic_load_explicit(&cache->hits, memory_order_relaxed);
+        stats->misses += atomic_load_explicit(&cache->misses, memory_order_relaxed);
+        stats->in_flight += atomic_load_explicit(&cache->in_flight, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
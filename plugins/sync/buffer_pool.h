@@ -0,0 +1,132 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+/**
+ * buffer pool hands out message buffers (lines and stage results) in power-of-two size classes, so a line allocated
+ * on one stage's thread and freed on the next one's never goes through malloc's arenas and their locks.
+ * - every thread has a cache of its own: a free list per class, taken from and given back to without any atomics
+ * - a buffer freed on another thread goes back to the cache that handed it out, pushed onto that cache's return list
+ *   for its class without a lock - the owner takes the whole list over in one exchange once its own list runs dry
+ * - buffers are carved out of slabs, which come from one address range reserved up front (and made usable a huge page
+ *   at a time), so whether a pointer is one of ours is a range check - anything else is passed to free()
+ * - the range can be backed by transparent huge pages, which saves TLB misses on long runs that touch a lot of buffers
+ * a thread that exits leaves its cache behind for the next thread that starts allocating, free lists and all, so
+ * buffers still in flight always have a cache to go back to. sizes above the largest class come from malloc.
+ **/
+
+// smallest and largest class (log2 of the size in bytes)
+#define BUFFER_POOL_MIN_SHIFT 4
+#define BUFFER_POOL_MAX_SHIFT 16
+#define BUFFER_POOL_CLASSES (BUFFER_POOL_MAX_SHIFT - BUFFER_POOL_MIN_SHIFT + 1)
+
+// bytes per slab - every buffer in a slab has the same class and the same owning cache
+#define BUFFER_POOL_SLAB_SIZE (256 * 1024)
+
+// the reserved range is made usable this many bytes at a time (one huge page)
+#define BUFFER_POOL_COMMIT_SIZE (2 * 1024 * 1024)
+
+// address space reserved for slabs (nothing is used until it is committed) - halved until the system gives it
+#define BUFFER_POOL_RESERVE_SIZE (16UL * 1024 * 1024 * 1024)
+
+/**
+ * A free buffer (the link lives in the buffer itself)
+ */
+typedef struct buffer_pool_block
+{
+ struct buffer_pool_block* next; /* Next free buffer of the same class */
+} buffer_pool_block_t;
+
+/**
+ * One thread's cache (an exited thread's one waits for the next thread)
+ */
+typedef struct buffer_pool_cache
+{
+ _Atomic(buffer_pool_block_t*) returned[BUFFER_POOL_CLASSES]; /* Freed by other threads, pushed without a lock */
+ atomic_long in_flight; /* Bytes handed out and not freed yet (other threads subtract too) */
+ char padding[64]; /* Keeps the owner's fields below off the line other threads write to */
+ buffer_pool_block_t* free[BUFFER_POOL_CLASSES]; /* Free buffers, only the owner touches these */
+ char* carve[BUFFER_POOL_CLASSES]; /* Next never-used buffer in the class's current slab */
+ char* carve_end[BUFFER_POOL_CLASSES]; /* End of that slab */
+ atomic_ulong hits; /* Allocations served from a free list */
+ atomic_ulong misses; /* Allocations that needed a new buffer (carved, or from malloc) */
+ struct buffer_pool* pool; /* The pool it belongs to */
+ struct buffer_pool_cache* next; /* Every cache of the pool */
+ struct buffer_pool_cache* next_idle; /* Caches left behind by exited threads */
+} buffer_pool_cache_t;
+
+/**
+ * What a slab is for
+ */
+typedef struct
+{
+ buffer_pool_cache_t* owner; /* Cache its buffers go back to */
+ int size_class; /* Index of their class */
+} buffer_pool_slab_t;
+
+/**
+ * Pool counters, summed over every cache
+ */
+typedef struct
+{
+ unsigned long hits; /* Allocations served from a free list */
+ unsigned long misses; /* Allocations that needed a new buffer */
+ long in_flight; /* Bytes of pool buffers handed out and not freed yet */
+} buffer_pool_stats_t;
+
+/**
+ * Buffer pool structure
+ */
+typedef struct buffer_pool
+{
+ char* base; /* Start of the reserved range */
+ size_t size; /* Its length */
+ buffer_pool_slab_t* slabs; /* One per slab of the range (set before any of its buffers is handed out) */
+ pthread_key_t key; /* The calling thread's cache */
+ pthread_mutex_t mutex; /* Guards the fields below */
+ size_t committed; /* Bytes from base on that are usable */
+ size_t carved; /* Bytes from base on that are slabs already */
+ buffer_pool_cache_t* caches; /* Every cache */
+ buffer_pool_cache_t* idle; /* Caches no thread uses */
+} buffer_pool_t;
+
+/**
+ * Initialize a buffer pool (reserves its address range)
+ * @param pool Pointer to pool structure
+ * @param huge_pages Back the range with transparent huge pages
+ * @return NULL on success, error message on failure
+ */
+const char* buffer_pool_init(buffer_pool_t* pool, int huge_pages);
+
+/**
+ * Free the pool and every buffer in it (no thread may use it any more, and no buffer of it may be in use)
+ * @param pool Pointer to pool structure
+ */
+void buffer_pool_destroy(buffer_pool_t* pool);
+
+/**
+ * Take a buffer (any thread)
+ * @param pool Pointer to pool structure
+ * @param size Bytes needed
+ * @return A buffer of at least size bytes, or NULL on allocation failure
+ */
+char* buffer_pool_alloc(buffer_pool_t* pool, size_t size);
+
+/**
+ * Give a buffer back (any thread, not necessarily the one that took it)
+ * @param pool Pointer to pool structure
+ * @param buffer One of the pool's buffers, or any malloc'd one (freed), or NULL (ignored)
+ */
+void buffer_pool_free(buffer_pool_t* pool, char* buffer);
+
+/**
+ * Read the counters (a snapshot - other threads may be allocating)
+ * @param pool Pointer to pool structure
+ * @param stats Output - the counters
+ */
+void buffer_pool_stats(buffer_pool_t* pool, buffer_pool_stats_t* stats);
+
+#endif
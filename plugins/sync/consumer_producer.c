@@ -13,6 +13,266 @@
  * @return NULL on success, error message on failure
  */
 const char* consumer_producer_init(consumer_producer_t* queue, int capacity){
+    return consumer_producer_init_mode(queue, capacity, CONSUMER_PRODUCER_LOCKED);
+}
+
+
+/**
+ * Free an item the queue owns
+ * @param queue Pointer to queue structure
+ * @param item Heap-allocated string
+ */
+static void consumer_producer_release(consumer_producer_t* queue, char* item){
+    if(queue->buffer_release){
+        queue->buffer_release(queue->buffers, item);
+        return;
+    }
+    free(item);
+}
+
+
+/**
+ * Copy an item the caller keeps
+ * @param queue Pointer to queue structure
+ * @param item String to copy
+ * @param len Its length (ITEM_META_LEN_UNKNOWN: counted here)
+ * @return Heap-allocated copy, or NULL on allocation failure
+ */
+static char* consumer_producer_copy(consumer_producer_t* queue, const char* item, size_t len){
+    if(len == ITEM_META_LEN_UNKNOWN){
+        len= strlen(item);
+    }
+    char* copy= queue->buffer_alloc ? queue->buffer_alloc(queue->buffers, len + 1) : malloc(len + 1);
+    if(copy){
+        memcpy(copy, item, len + 1);
+    }
+    return copy;
+}
+
+
+/**
+ * Copy a record out of the ring and give it back (RECORDS mode, for the getters that hand out owned items)
+ * @param queue Pointer to queue structure
+ * @param view The record
+ * @param meta Output - the record's meta (may be NULL)
+ * @return Heap-allocated copy, or NULL on allocation failure (the record is given back either way)
+ */
+static char* consumer_producer_copy_view(consumer_producer_t* queue, const record_ring_view_t* view, item_meta_t* meta){
+    if(meta){
+        meta->len= view->len;
+        meta->seq= view->seq;
+        meta->ingest_ns= view->ingest_ns;
+    }
+    char* item= consumer_producer_copy(queue, view->data, view->len);
+    record_ring_release(queue->records, view->data);
+    return item;
+}
+
+
+/**
+ * Count items that can be taken now - what END and BARRIER are placed after
+ * @param queue Pointer to queue structure
+ * @param count Number of items just added
+ */
+static void consumer_producer_count_puts(consumer_producer_t* queue, int count){
+    // the record ring's producers are the only ones that get here without a lock (SPSC has one producer)
+    if(queue->mode == CONSUMER_PRODUCER_RECORDS){
+        atomic_fetch_add_explicit(&queue->puts, (unsigned long)count, memory_order_relaxed);
+        return;
+    }
+    atomic_store_explicit(&queue->puts, atomic_load_explicit(&queue->puts, memory_order_relaxed) + count, memory_order_relaxed);
+}
+
+
+/**
+ * The eventcount the consumer parks on while it has nothing to take (control messages notify it too)
+ * @param queue Pointer to queue structure
+ * @return The eventcount
+ */
+static eventcount_t* consumer_producer_consumer_event(consumer_producer_t* queue){
+    if(queue->mode == CONSUMER_PRODUCER_SPSC){
+        return &queue->ring->event;
+    }
+    if(queue->mode == CONSUMER_PRODUCER_RECORDS){
+        return &queue->records->not_empty_event;
+    }
+    return &queue->not_empty_event;
+}
+
+
+/**
+ * How many items the consumer may take before the next control message
+ * @param queue Pointer to queue structure (LOCKED: mutex held, it guards sequence)
+ * @param max Items the caller wants
+ * @return Up to max (fewer if an END or BARRIER comes first, 0 while paused), or -1 if a control message is due
+ */
+static int consumer_producer_limit(consumer_producer_t* queue, int max){
+    if(atomic_load(&queue->controls_pending) != 0){
+        pthread_mutex_lock(&queue->control_mutex);
+        for(int i=0; i<queue->num_controls; i++){
+            const consumer_producer_signal_t* signal = &queue->controls[i];
+            if(signal->type == CONSUMER_PRODUCER_FLUSH || signal->position <= queue->sequence){
+                pthread_mutex_unlock(&queue->control_mutex);
+                return -1;
+            }
+            if(signal->position - queue->sequence < (unsigned long)max){
+                max = (int)(signal->position - queue->sequence);
+            }
+        }
+        if(queue->ended){
+            if(queue->end_position <= queue->sequence){
+                pthread_mutex_unlock(&queue->control_mutex);
+                return -1;
+            }
+            if(queue->end_position - queue->sequence < (unsigned long)max){
+                max = (int)(queue->end_position - queue->sequence);
+            }
+        }
+        pthread_mutex_unlock(&queue->control_mutex);
+    }
+    return atomic_load(&queue->paused) ? 0 : max;
+}
+
+
+/**
+ * Take up to max items (SPSC) or records (RECORDS) without blocking, stopping short of the next control message
+ * @param queue Pointer to queue structure
+ * @param items Output array of at least max entries (SPSC)
+ * @param metas Output array of at least max entries (SPSC, may be NULL)
+ * @param views Output array of at least max entries (RECORDS)
+ * @param max Maximum number to take
+ * @return Number taken, 0 if there is nothing to take (or the queue is paused), -1 if a control message is due
+ */
+static int consumer_producer_try_take(consumer_producer_t* queue, char** items, item_meta_t* metas, record_ring_view_t* views, int max){
+    int limit = consumer_producer_limit(queue, max);
+    if(limit <= 0){
+        return limit;
+    }
+
+    int n;
+    if(queue->mode == CONSUMER_PRODUCER_SPSC){
+        n = spsc_ring_try_pop_many(queue->ring, items, metas, limit);
+        // a producer may be parked on the full ring
+        if(n > 0){
+            eventcount_notify(&queue->ring->event);
+        }
+    }
+    else{
+        n = record_ring_try_get_many(queue->records, views, limit);
+    }
+    queue->sequence += n;
+    return n;
+}
+
+
+/**
+ * Take between 1 and max items (SPSC) or records (RECORDS), blocking while there is none - single consumer, so the
+ * sequence needs no lock
+ * @param queue Pointer to queue structure
+ * @param items Output array of at least max entries (SPSC)
+ * @param metas Output array of at least max entries (SPSC, may be NULL)
+ * @param views Output array of at least max entries (RECORDS)
+ * @param max Maximum number to take
+ * @return Number taken, 0 when a control message is due instead
+ */
+static int consumer_producer_take(consumer_producer_t* queue, char** items, item_meta_t* metas, record_ring_view_t* views, int max){
+    // fast path: a short spin covers the common case of a producer that is just about to publish (the record ring
+    // takes its lock on every try, so it goes straight to parking)
+    int spins = queue->mode == CONSUMER_PRODUCER_SPSC ? SPSC_SPIN_LIMIT : 1;
+    int n = 0;
+    for(int i=0; i<spins && n == 0; i++){
+        n = consumer_producer_try_take(queue, items, metas, views, max);
+    }
+
+    // slow path: park until an item is published or a control message is put
+    eventcount_t* event = consumer_producer_consumer_event(queue);
+    while(n == 0){
+        unsigned int key = eventcount_prepare_wait(event);
+        if((n = consumer_producer_try_take(queue, items, metas, views, max)) != 0){
+            eventcount_cancel_wait(event);
+            break;
+        }
+        eventcount_wait(event, key);
+    }
+    return n < 0 ? 0 : n;
+}
+
+
+/**
+ * Wait until the consumer may take items or a control message is due (LOCKED)
+ * @param queue Pointer to queue structure (mutex held - released while parked)
+ * @param max Items the caller wants
+ * @return Items that may be taken (at least 1, and the queue has some), or -1 if a control message is due
+ */
+static int consumer_producer_locked_wait(consumer_producer_t* queue, int max){
+    while(1){
+        int limit = consumer_producer_limit(queue, max);
+        if(limit < 0 || (limit > 0 && queue->count > 0)){
+            return limit;
+        }
+        // register as a waiter while still holding the lock, so a put after we unlock can't be missed - and look at
+        // the lane once more, since a control message is put without the lock
+        unsigned int key = eventcount_prepare_wait(&queue->not_empty_event);
+        limit = consumer_producer_limit(queue, max);
+        if(limit < 0 || (limit > 0 && queue->count > 0)){
+            eventcount_cancel_wait(&queue->not_empty_event);
+            continue;
+        }
+        // unlock before wait, and lock back after
+        pthread_mutex_unlock(&queue->mutex);
+        eventcount_wait(&queue->not_empty_event, key);
+        pthread_mutex_lock(&queue->mutex);
+    }
+}
+
+
+/**
+ * Free the item storage of a queue (items array, SPSC ring or record ring)
+ * @param queue Pointer to queue structure
+ */
+static void consumer_producer_free_storage(consumer_producer_t* queue){
+    if(queue->records){
+        record_ring_destroy(queue->records);
+        free(queue->records);
+        queue->records= NULL;
+    }
+
+    if(queue->ring){
+        // the ring frees with free() - what is left goes back through the queue's allocator first
+        char* item;
+        while((item= spsc_ring_try_pop(queue->ring, NULL))){
+            consumer_producer_release(queue, item);
+        }
+        spsc_ring_destroy(queue->ring);
+        free(queue->ring);
+        queue->ring= NULL;
+    }
+
+    if(queue->items){
+        // capacity and not count beacuse of the circular buffer
+        for(int i=0; i<queue->capacity; i++){
+            // free the item in this index (if there is one)
+            if(queue->items[i]){
+                consumer_producer_release(queue, queue->items[i]);
+                queue->items[i]= NULL;
+            }
+        }
+        free(queue->items);
+        queue->items= NULL;
+    }
+    free(queue->metas);
+    queue->metas= NULL;
+}
+
+
+/**
+ * Initialize a consumer-producer queue with an explicit implementation
+ * @param queue Pointer to queue structure
+ * @param capacity Maximum number of items (RECORDS: size of the ring in bytes)
+ * @param mode CONSUMER_PRODUCER_LOCKED, CONSUMER_PRODUCER_SPSC or CONSUMER_PRODUCER_RECORDS
+ * @return NULL on success, error message on failure
+ */
+const char* consumer_producer_init_mode(consumer_producer_t* queue, int capacity, consumer_producer_mode_t mode){
     // error: can't be NULL
     if(!queue){
         return "Queue pointer is NULL";
@@ -23,55 +283,153 @@ const char* consumer_producer_init(consumer_producer_t* queue, int capacity){
         return "capacity must be positive";
     }
 
+    // error: unknown implementation
+    if(mode != CONSUMER_PRODUCER_LOCKED && mode != CONSUMER_PRODUCER_SPSC && mode != CONSUMER_PRODUCER_RECORDS){
+        return "unknown queue mode";
+    }
+
     queue->capacity= capacity;
     queue->count= 0;
     queue->head= 0;
     queue->tail= 0;
+    queue->mode= mode;
+    queue->items= NULL;
+    queue->metas= NULL;
+    queue->ring= NULL;
+    queue->records= NULL;
+    queue->sequence= 0;
+    atomic_init(&queue->puts, 0);
+    queue->num_controls= 0;
+    queue->ended= 0;
+    queue->end_position= 0;
+    queue->barriers= 0;
+    atomic_init(&queue->controls_pending, 0);
+    atomic_init(&queue->paused, 0);
+    queue->buffers= NULL;
+    queue->buffer_alloc= NULL;
+    queue->buffer_release= NULL;
 
-    // allocate items array + handle error: memory allocation fail
-    if(!(queue->items= malloc(capacity* sizeof(char*)))){
-        return "failed to allocate memory for items array";
+    if(mode == CONSUMER_PRODUCER_SPSC){
+        // the ring keeps head and tail on separate cache lines, so it needs cache line alignment
+        if(posix_memalign((void**)&queue->ring, SPSC_CACHE_LINE, sizeof(spsc_ring_t)) != 0){
+            queue->ring= NULL;
+            return "failed to allocate memory for spsc ring";
+        }
+
+        const char* ring_error= spsc_ring_init(queue->ring, capacity);
+        if(ring_error){
+            free(queue->ring);
+            queue->ring= NULL;
+            return ring_error;
+        }
     }
+    else if(mode == CONSUMER_PRODUCER_RECORDS){
+        // the records live in the ring itself - there is no item array
+        if(!(queue->records= malloc(sizeof(record_ring_t)))){
+            return "failed to allocate memory for record ring";
+        }
 
-    //initializing all pointers to null
-    for(int i=0; i<capacity; i++){
-        queue->items[i]= NULL;
+        const char* ring_error= record_ring_init(queue->records, capacity);
+        if(ring_error){
+            free(queue->records);
+            queue->records= NULL;
+            return ring_error;
+        }
     }
+    else{
+        // allocate items array + handle error: memory allocation fail
+        if(!(queue->items= malloc(capacity* sizeof(char*)))){
+            return "failed to allocate memory for items array";
+        }
 
-    // initialize 3 monitors + handle any errors with *proper cleanup*
-    if(monitor_init(&queue->not_full_monitor)!=0){
-        free(queue->items);
-        return "failed initializing not_full_monitor";
+        // the metas live next to it, slot for slot
+        if(!(queue->metas= malloc(capacity* sizeof(item_meta_t)))){
+            free(queue->items);
+            queue->items= NULL;
+            return "failed to allocate memory for metas array";
+        }
+
+        //initializing all pointers to null
+        for(int i=0; i<capacity; i++){
+            queue->items[i]= NULL;
+        }
     }
 
-    if(monitor_init(&queue->not_empty_monitor)!=0){
-        monitor_destroy(&queue->not_full_monitor);
-        free(queue->items);
-        return "failed initializing not_empty_monitor";
+    // initialize 2 eventcounts and the finished monitor + handle any errors with *proper cleanup*
+    if(eventcount_init(&queue->not_full_event)!=0){
+        consumer_producer_free_storage(queue);
+        return "failed initializing not_full_event";
+    }
+
+    if(eventcount_init(&queue->not_empty_event)!=0){
+        eventcount_destroy(&queue->not_full_event);
+        consumer_producer_free_storage(queue);
+        return "failed initializing not_empty_event";
+    }
+
+    if(eventcount_init(&queue->control_room_event)!=0){
+        eventcount_destroy(&queue->not_full_event);
+        eventcount_destroy(&queue->not_empty_event);
+        consumer_producer_free_storage(queue);
+        return "failed initializing control_room_event";
     }
 
     if(monitor_init(&queue->finished_monitor)!=0){
-        monitor_destroy(&queue->not_full_monitor);
-        monitor_destroy(&queue->not_empty_monitor);
-        free(queue->items);
+        eventcount_destroy(&queue->not_full_event);
+        eventcount_destroy(&queue->not_empty_event);
+        eventcount_destroy(&queue->control_room_event);
+        consumer_producer_free_storage(queue);
         return "failed initializing finished_monitor";
     }
 
     // to prevent race conditions
     // clean up all monitors and memory if mutex init failed
     if(pthread_mutex_init(&queue->mutex, NULL) != 0){
-        monitor_destroy(&queue->not_full_monitor);
-        monitor_destroy(&queue->not_empty_monitor);
+        eventcount_destroy(&queue->not_full_event);
+        eventcount_destroy(&queue->not_empty_event);
+        eventcount_destroy(&queue->control_room_event);
         monitor_destroy(&queue->finished_monitor);
-        free(queue->items);
+        consumer_producer_free_storage(queue);
         return "failed initializing mutex";
     }
 
+    if(pthread_mutex_init(&queue->control_mutex, NULL) != 0){
+        pthread_mutex_destroy(&queue->mutex);
+        eventcount_destroy(&queue->not_full_event);
+        eventcount_destroy(&queue->not_empty_event);
+        eventcount_destroy(&queue->control_room_event);
+        monitor_destroy(&queue->finished_monitor);
+        consumer_producer_free_storage(queue);
+        return "failed initializing control mutex";
+    }
+
     // on success
     return NULL;
 }
 
 
+/**
+ * Make the queue's copies come from an allocator (and free what is left in it at destroy through it)
+ * @param queue Pointer to queue structure (initialized, not used yet)
+ * @param buffers The allocator, passed to both functions
+ * @param alloc Returns a buffer of at least size bytes, NULL on failure
+ * @param release Gives back an item - one of alloc's or any malloc'd string
+ */
+void consumer_producer_set_buffers(consumer_producer_t* queue, void* buffers,
+                                   char* (*alloc)(void* buffers, size_t size), void (*release)(void* buffers, char* item)){
+    if(!queue){
+        return;
+    }
+    queue->buffers= buffers;
+    queue->buffer_alloc= alloc;
+    queue->buffer_release= release;
+    // long records are kept out of line, and owned items copied in are given back - both through the same allocator
+    if(queue->records){
+        record_ring_set_buffers(queue->records, buffers, alloc, release);
+    }
+}
+
+
 /**
  * Destroy a consumer-producer queue and free its resources
  * @param queue Pointer to queue structure
@@ -83,23 +441,15 @@ void consumer_producer_destroy(consumer_producer_t* queue){
     }
 
     // free all items with error checks
-    if(queue->items){
-        // capacity and not count beacuse of the circular buffer
-        for(int i=0; i<queue->capacity; i++){
-            // free the item in this index (if there is one)
-            if(queue->items[i]){
-                free(queue->items[i]);
-                queue->items[i]= NULL;
-            }
-        }
-        free(queue->items);
-    }
+    consumer_producer_free_storage(queue);
     
     //clean up the mutex (to prevent race conditions)
     pthread_mutex_destroy(&queue->mutex);
+    pthread_mutex_destroy(&queue->control_mutex);
 
-    monitor_destroy(&queue->not_full_monitor);
-    monitor_destroy(&queue->not_empty_monitor);
+    eventcount_destroy(&queue->not_full_event);
+    eventcount_destroy(&queue->not_empty_event);
+    eventcount_destroy(&queue->control_room_event);
     monitor_destroy(&queue->finished_monitor);
 }
 
@@ -108,10 +458,22 @@ void consumer_producer_destroy(consumer_producer_t* queue){
  * Add an item to the queue (producer).
  * Blocks if queue is full.
  * @param queue Pointer to queue structure
- * @param item String to add (queue takes ownership)
+ * @param item String to add (the queue stores its own copy - the caller keeps item)
  * @return NULL on success, error message on failure
  */
 const char* consumer_producer_put(consumer_producer_t* queue, const char* item){
+    return consumer_producer_put_meta(queue, item, NULL);
+}
+
+/**
+ * Add an item to the queue (producer) together with its meta.
+ * Blocks if queue is full.
+ * @param queue Pointer to queue structure
+ * @param item String to add (the queue stores its own copy - the caller keeps item)
+ * @param meta What it carries (NULL: nothing known)
+ * @return NULL on success, error message on failure
+ */
+const char* consumer_producer_put_meta(consumer_producer_t* queue, const char* item, const item_meta_t* meta){
     // error: queue is NULL
     if(!queue){
         return "queue is NULL";
@@ -122,37 +484,94 @@ const char* consumer_producer_put(consumer_producer_t* queue, const char* item){
         return "item is NULL";
     }
 
+    // the ring copies it in itself (and only allocates for a long one)
+    if(queue->mode == CONSUMER_PRODUCER_RECORDS){
+        if(record_ring_put(queue->records, item, meta) != 0){
+            return "failed adding item to the queue";
+        }
+        consumer_producer_count_puts(queue, 1);
+        return NULL;
+    }
+
+    // copy outside of the critical section, then hand the copy over
+    char* copy = consumer_producer_copy(queue, item, meta ? meta->len : ITEM_META_LEN_UNKNOWN);
+    if(!copy){
+        return "failed adding item to the queue";
+    }
+
+    return consumer_producer_put_owned_meta(queue, copy, meta);
+}
+
+/**
+ * Add an item to the queue (producer) without copying it.
+ * Blocks if queue is full.
+ * @param queue Pointer to queue structure
+ * @param item Heap-allocated string to add (queue takes ownership - stored as-is and freed by whoever gets it)
+ * @return NULL on success, error message on failure (the caller keeps ownership on failure)
+ */
+const char* consumer_producer_put_owned(consumer_producer_t* queue, char* item){
+    return consumer_producer_put_owned_meta(queue, item, NULL);
+}
+
+/**
+ * Add an item to the queue (producer) without copying it, together with its meta.
+ * Blocks if queue is full.
+ * @param queue Pointer to queue structure
+ * @param item Heap-allocated string to add (queue takes ownership - stored as-is and freed by whoever gets it)
+ * @param meta What it carries (NULL: nothing known)
+ * @return NULL on success, error message on failure (the caller keeps ownership on failure)
+ */
+const char* consumer_producer_put_owned_meta(consumer_producer_t* queue, char* item, const item_meta_t* meta){
+    // error: queue is NULL
+    if(!queue){
+        return "queue is NULL";
+    }
+
+    // error: item is NULL
+    if(!item){
+        return "item is NULL";
+    }
+
+    // lock-free link: hand the pointer to the ring
+    if(queue->mode == CONSUMER_PRODUCER_SPSC){
+        spsc_ring_push(queue->ring, item, meta);
+        consumer_producer_count_puts(queue, 1);
+        return NULL;
+    }
+
+    if(queue->mode == CONSUMER_PRODUCER_RECORDS){
+        record_ring_put_owned(queue->records, item, meta);
+        consumer_producer_count_puts(queue, 1);
+        return NULL;
+    }
+
     // critical section ahead 
     pthread_mutex_lock(&queue->mutex);
     // Wait until queue is not full - keep waiting until space available
     while(queue->count >= queue->capacity){
+        // register as a waiter while still holding the lock, so a get that frees a slot after we unlock can't be missed
+        unsigned int key = eventcount_prepare_wait(&queue->not_full_event);
         // unlock before wait
         pthread_mutex_unlock(&queue->mutex);
-        monitor_wait(&queue->not_full_monitor);    
+        eventcount_wait(&queue->not_full_event, key);
         // and lock back after
         pthread_mutex_lock(&queue->mutex);
     }
 
-
-
     // add item at tail (entry point- next available index)
-    queue->items[queue->tail] = strdup(item);
-
-    // error: couldn't add item to queue
-    if(!(queue->items[queue->tail])){
-        pthread_mutex_unlock(&queue->mutex);
-        return "failed adding item to the queue";
-    }
+    queue->items[queue->tail] = item;
+    queue->metas[queue->tail] = meta ? *meta : ITEM_META_UNKNOWN;
 
     //update other queue properties
     queue->count++;
     queue->tail = (queue->tail + 1) % queue->capacity; // circular buffer causes this calculation method
-    
-    // Signal that queue is not empty (someone might be waiting)
-    monitor_signal(&queue->not_empty_monitor);
+    consumer_producer_count_puts(queue, 1);
 
     // final unlock
     pthread_mutex_unlock(&queue->mutex);
+
+    // Signal that queue is not empty (no syscall unless a consumer is parked)
+    eventcount_notify(&queue->not_empty_event);
     
     // on success
     return NULL;
@@ -162,44 +581,721 @@ const char* consumer_producer_put(consumer_producer_t* queue, const char* item){
  * Remove an item from the queue (consumer) and returns it.
  * Blocks if queue is empty.
  * @param queue Pointer to queue structure
- * @return String item or NULL if error (never NULL for empty queue - blocks instead)
+ * @return String item, or NULL if a control message is due (consumer_producer_take_control) or on error (never NULL
+ *         for empty queue - blocks instead)
  */
 char* consumer_producer_get(consumer_producer_t* queue){
+    return consumer_producer_get_meta(queue, NULL, NULL);
+}
+
+/**
+ * Remove an item from the queue (consumer) together with its position in the stream.
+ * Blocks if queue is empty. With several consumers the sequence numbers still follow insertion order exactly,
+ * so a reorder buffer downstream can restore it.
+ * @param queue Pointer to queue structure
+ * @param sequence Output - 0 for the first item ever removed, 1 for the second, ... (may be NULL; a BARRIER takes a
+ *                 number of its own)
+ * @return String item, or NULL if a control message is due or on error
+ */
+char* consumer_producer_get_sequenced(consumer_producer_t* queue, unsigned long* sequence){
+    return consumer_producer_get_meta(queue, sequence, NULL);
+}
+
+/**
+ * Remove an item from the queue (consumer) together with its position in the stream and its meta.
+ * Blocks if queue is empty.
+ * @param queue Pointer to queue structure
+ * @param sequence Output - like consumer_producer_get_sequenced (may be NULL)
+ * @param meta Output - what the item was put with (may be NULL)
+ * @return String item, or NULL if a control message is due or on error
+ */
+char* consumer_producer_get_meta(consumer_producer_t* queue, unsigned long* sequence, item_meta_t* meta){
     // error: queue is NULL
     if(!queue){
         return NULL; // Only return NULL on error, not empty queue
     }
 
 
+    // lock-free link: blocks only while the ring is empty (single consumer, so the counter needs no lock)
+    if(queue->mode == CONSUMER_PRODUCER_SPSC){
+        char* item;
+        if(consumer_producer_take(queue, &item, meta, NULL, 1) == 0){
+            return NULL;
+        }
+        if(sequence){
+            *sequence = queue->sequence - 1;
+        }
+        return item;
+    }
+
+    // single consumer too - the record is copied out for a caller that wants an item of its own
+    if(queue->mode == CONSUMER_PRODUCER_RECORDS){
+        record_ring_view_t view;
+        if(consumer_producer_take(queue, NULL, NULL, &view, 1) == 0){
+            return NULL;
+        }
+        if(sequence){
+            *sequence = queue->sequence - 1;
+        }
+        return consumer_producer_copy_view(queue, &view, meta);
+    }
+
     // critical section ahead
     pthread_mutex_lock(&queue->mutex);
-    // Wait until queue is not empty (blocks until item available)
-    while(queue->count == 0){
-        // unlock before wait
+    // Wait until queue is not empty (blocks until item available) or a control message is due
+    if(consumer_producer_locked_wait(queue, 1) < 0){
         pthread_mutex_unlock(&queue->mutex);
-        monitor_wait(&queue->not_empty_monitor);   
-        // and lock back
-        pthread_mutex_lock(&queue->mutex); 
+        return NULL;
     }
 
     // remove an item from the head (where we extract next item)
     char* item = queue->items[queue->head];
     queue->items[queue->head] = NULL;
+    if(meta){
+        *meta = queue->metas[queue->head];
+    }
+
+    // numbered under the same lock as the removal, so numbers match queue order
+    if(sequence){
+        *sequence = queue->sequence;
+    }
+    queue->sequence++;
 
     //update other queue properties
     queue->count--;
     queue->head = (queue->head + 1) % queue->capacity; //circular buffer
 
-    // Signal that queue is not full (producer might be waiting)
-    monitor_signal(&queue->not_full_monitor);
-
     // final unlock
     pthread_mutex_unlock(&queue->mutex);
+
+    // Signal that queue is not full (no syscall unless a producer is parked)
+    eventcount_notify(&queue->not_full_event);
+    // that may have made an END due for the other consumers
+    if(atomic_load(&queue->controls_pending) != 0){
+        eventcount_notify(&queue->not_empty_event);
+    }
     
     // on success - return the item (never NULL for empty queue)
     return item;
 }
 
+/**
+ * Add several items to the queue (producer) with one lock acquisition and one wakeup per chunk that fits.
+ * Blocks while the queue is full; returns once every item was added.
+ * @param queue Pointer to queue structure
+ * @param items Strings to add (copied, like consumer_producer_put)
+ * @param count Number of items
+ * @return NULL on success, error message on failure
+ */
+const char* consumer_producer_put_many(consumer_producer_t* queue, const char* const* items, int count){
+    // error: queue is NULL
+    if(!queue){
+        return "queue is NULL";
+    }
+
+    // error: items is NULL
+    if(!items || count<0){
+        return "items is NULL";
+    }
+
+    if(count == 0){
+        return NULL;
+    }
+
+    if(queue->mode == CONSUMER_PRODUCER_RECORDS){
+        for(int i=0; i<count; i++){
+            if(!items[i]){
+                return "item is NULL";
+            }
+            if(record_ring_put(queue->records, items[i], NULL) != 0){
+                return "failed adding items to the queue";
+            }
+            consumer_producer_count_puts(queue, 1);
+        }
+        return NULL;
+    }
+
+    // copy everything before touching the queue so the critical section only moves pointers
+    char** copies = malloc(count * sizeof(char*));
+    if(!copies){
+        return "failed adding items to the queue";
+    }
+    for(int i=0; i<count; i++){
+        if(!items[i] || !(copies[i] = consumer_producer_copy(queue, items[i], ITEM_META_LEN_UNKNOWN))){
+            for(int j=0; j<i; j++){
+                consumer_producer_release(queue, copies[j]);
+            }
+            free(copies);
+            return items[i] ? "failed adding items to the queue" : "item is NULL";
+        }
+    }
+
+    consumer_producer_put_many_owned(queue, copies, count);
+    free(copies);
+    return NULL;
+}
+
+/**
+ * Add several items to the queue (producer) without copying them.
+ * Blocks while the queue is full; returns once every item was added.
+ * @param queue Pointer to queue structure
+ * @param items Heap-allocated strings to add (queue takes ownership of every item)
+ * @param count Number of items
+ * @return NULL on success, error message on failure (the caller keeps ownership on failure)
+ */
+const char* consumer_producer_put_many_owned(consumer_producer_t* queue, char* const* items, int count){
+    return consumer_producer_put_many_owned_meta(queue, items, NULL, count);
+}
+
+/**
+ * Add several items to the queue (producer) without copying them, together with their metas.
+ * Blocks while the queue is full; returns once every item was added.
+ * @param queue Pointer to queue structure
+ * @param items Heap-allocated strings to add (queue takes ownership of every item)
+ * @param metas What each item carries (NULL: nothing known)
+ * @param count Number of items
+ * @return NULL on success, error message on failure (the caller keeps ownership on failure)
+ */
+const char* consumer_producer_put_many_owned_meta(consumer_producer_t* queue, char* const* items, const item_meta_t* metas, int count){
+    // error: queue is NULL
+    if(!queue){
+        return "queue is NULL";
+    }
+
+    // error: items is NULL
+    if(!items || count<0){
+        return "items is NULL";
+    }
+
+    if(count == 0){
+        return NULL;
+    }
+
+    if(queue->mode == CONSUMER_PRODUCER_SPSC){
+        spsc_ring_push_many(queue->ring, items, metas, count);
+        consumer_producer_count_puts(queue, count);
+        return NULL;
+    }
+
+    if(queue->mode == CONSUMER_PRODUCER_RECORDS){
+        record_ring_put_many_owned(queue->records, items, metas, count);
+        consumer_producer_count_puts(queue, count);
+        return NULL;
+    }
+
+    int added = 0;
+    pthread_mutex_lock(&queue->mutex);
+    while(added < count){
+        // Wait until queue is not full
+        while(queue->count >= queue->capacity){
+            unsigned int key = eventcount_prepare_wait(&queue->not_full_event);
+            pthread_mutex_unlock(&queue->mutex);
+            eventcount_wait(&queue->not_full_event, key);
+            pthread_mutex_lock(&queue->mutex);
+        }
+
+        // move as many as fit in one go
+        int moved = 0;
+        while(added < count && queue->count < queue->capacity){
+            queue->metas[queue->tail] = metas ? metas[added] : ITEM_META_UNKNOWN;
+            queue->items[queue->tail] = items[added++];
+            queue->count++;
+            queue->tail = (queue->tail + 1) % queue->capacity;
+            moved++;
+        }
+        consumer_producer_count_puts(queue, moved);
+
+        // one wakeup for the whole chunk (drop the lock around it so the consumer can run right away)
+        pthread_mutex_unlock(&queue->mutex);
+        eventcount_notify(&queue->not_empty_event);
+        if(added < count){
+            pthread_mutex_lock(&queue->mutex);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Remove up to max items from the queue (consumer) with one lock acquisition and one wakeup.
+ * Blocks while the queue is empty, then takes everything available (up to max) - short of an END or BARRIER.
+ * @param queue Pointer to queue structure
+ * @param items Output array of at least max entries (caller frees each item)
+ * @param max Maximum number of items to remove
+ * @return Number of items removed, 0 if a control message is due, or -1 on error
+ */
+int consumer_producer_get_many(consumer_producer_t* queue, char** items, int max){
+    return consumer_producer_get_many_meta(queue, items, NULL, max);
+}
+
+/**
+ * Remove up to max items from the queue (consumer) together with their metas, like consumer_producer_get_many.
+ * @param queue Pointer to queue structure
+ * @param items Output array of at least max entries (caller frees each item)
+ * @param metas Output array of at least max entries - what each item was put with (may be NULL)
+ * @param max Maximum number of items to remove
+ * @return Number of items removed, 0 if a control message is due, or -1 on error
+ */
+int consumer_producer_get_many_meta(consumer_producer_t* queue, char** items, item_meta_t* metas, int max){
+    // error: bad arguments
+    if(!queue || !items || max<=0){
+        return -1;
+    }
+
+    if(queue->mode == CONSUMER_PRODUCER_SPSC){
+        return consumer_producer_take(queue, items, metas, NULL, max);
+    }
+
+    if(queue->mode == CONSUMER_PRODUCER_RECORDS){
+        // the first one blocks, the rest are whatever is there already
+        record_ring_view_t view;
+        if(consumer_producer_take(queue, NULL, NULL, &view, 1) == 0){
+            return 0;
+        }
+        int n = 0;
+        do{
+            items[n] = consumer_producer_copy_view(queue, &view, metas ? &metas[n] : NULL);
+            n++;
+        } while(n < max && consumer_producer_try_take(queue, NULL, NULL, &view, 1) == 1);
+        return n;
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+    // Wait until queue is not empty or a control message is due
+    int limit = consumer_producer_locked_wait(queue, max);
+    if(limit < 0){
+        pthread_mutex_unlock(&queue->mutex);
+        return 0;
+    }
+
+    // drain everything available, up to max (and up to the next END or BARRIER)
+    int n = 0;
+    while(n < limit && queue->count > 0){
+        if(metas){
+            metas[n] = queue->metas[queue->head];
+        }
+        items[n++] = queue->items[queue->head];
+        queue->items[queue->head] = NULL;
+        queue->count--;
+        queue->head = (queue->head + 1) % queue->capacity;
+    }
+    queue->sequence += n;
+
+    pthread_mutex_unlock(&queue->mutex);
+
+    // one wakeup for all the freed slots
+    eventcount_notify(&queue->not_full_event);
+    // that may have made an END due for the other consumers
+    if(atomic_load(&queue->controls_pending) != 0){
+        eventcount_notify(&queue->not_empty_event);
+    }
+    return n;
+}
+
+/**
+ * Add an item to the queue (producer) without copying it and without blocking.
+ * @param queue Pointer to queue structure
+ * @param item Heap-allocated string to add (queue takes ownership only if it was added)
+ * @return 1 if the item was added, 0 if the queue is full, -1 on error
+ */
+int consumer_producer_try_put_owned(consumer_producer_t* queue, char* item){
+    return consumer_producer_try_put_owned_meta(queue, item, NULL);
+}
+
+/**
+ * Add an item to the queue (producer) without copying it and without blocking, together with its meta.
+ * @param queue Pointer to queue structure
+ * @param item Heap-allocated string to add (queue takes ownership only if it was added)
+ * @param meta What it carries (NULL: nothing known)
+ * @return 1 if the item was added, 0 if the queue is full, -1 on error
+ */
+int consumer_producer_try_put_owned_meta(consumer_producer_t* queue, char* item, const item_meta_t* meta){
+    // error: bad arguments
+    if(!queue || !item){
+        return -1;
+    }
+
+    if(queue->mode == CONSUMER_PRODUCER_SPSC){
+        if(!spsc_ring_try_push(queue->ring, item, meta)){
+            return 0;
+        }
+        consumer_producer_count_puts(queue, 1);
+        eventcount_notify(&queue->ring->event);
+        return 1;
+    }
+
+    if(queue->mode == CONSUMER_PRODUCER_RECORDS){
+        if(!record_ring_try_put_owned(queue->records, item, meta)){
+            return 0;
+        }
+        consumer_producer_count_puts(queue, 1);
+        return 1;
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+    if(queue->count >= queue->capacity){
+        pthread_mutex_unlock(&queue->mutex);
+        return 0;
+    }
+
+    queue->items[queue->tail] = item;
+    queue->metas[queue->tail] = meta ? *meta : ITEM_META_UNKNOWN;
+    queue->count++;
+    queue->tail = (queue->tail + 1) % queue->capacity;
+    consumer_producer_count_puts(queue, 1);
+    pthread_mutex_unlock(&queue->mutex);
+
+    eventcount_notify(&queue->not_empty_event);
+    return 1;
+}
+
+/**
+ * Remove an item from the queue (consumer) without blocking.
+ * @param queue Pointer to queue structure
+ * @return String item, or NULL if the queue is empty, paused, or a control message is due
+ */
+char* consumer_producer_try_get(consumer_producer_t* queue){
+    return consumer_producer_try_get_meta(queue, NULL);
+}
+
+/**
+ * Remove an item from the queue (consumer) without blocking, together with its meta.
+ * @param queue Pointer to queue structure
+ * @param meta Output - what the item was put with (may be NULL)
+ * @return String item, or NULL if the queue is empty, paused, or a control message is due
+ */
+char* consumer_producer_try_get_meta(consumer_producer_t* queue, item_meta_t* meta){
+    // error: queue is NULL
+    if(!queue){
+        return NULL;
+    }
+
+    if(queue->mode == CONSUMER_PRODUCER_SPSC){
+        char* item;
+        return consumer_producer_try_take(queue, &item, meta, NULL, 1) == 1 ? item : NULL;
+    }
+
+    if(queue->mode == CONSUMER_PRODUCER_RECORDS){
+        record_ring_view_t view;
+        if(consumer_producer_try_take(queue, NULL, NULL, &view, 1) != 1){
+            return NULL;
+        }
+        return consumer_producer_copy_view(queue, &view, meta);
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+    if(queue->count == 0 || consumer_producer_limit(queue, 1) <= 0){
+        pthread_mutex_unlock(&queue->mutex);
+        return NULL;
+    }
+
+    char* item = queue->items[queue->head];
+    queue->items[queue->head] = NULL;
+    if(meta){
+        *meta = queue->metas[queue->head];
+    }
+    queue->sequence++;
+    queue->count--;
+    queue->head = (queue->head + 1) % queue->capacity;
+    pthread_mutex_unlock(&queue->mutex);
+
+    eventcount_notify(&queue->not_full_event);
+    return item;
+}
+
+/**
+ * Take the next record where it is stored, without copying it (RECORDS consumer only).
+ * Blocks if queue is empty.
+ * @param queue Pointer to queue structure
+ * @param view Output - pointer and length of the record, valid until consumer_producer_release_view
+ * @return 0 on success, 1 if a control message is due instead, -1 on error
+ */
+int consumer_producer_get_view(consumer_producer_t* queue, record_ring_view_t* view){
+    // error: bad arguments, or no ring to look into
+    if(!queue || !view || queue->mode != CONSUMER_PRODUCER_RECORDS){
+        return -1;
+    }
+
+    return consumer_producer_take(queue, NULL, NULL, view, 1) == 1 ? 0 : 1;
+}
+
+/**
+ * Take the next record where it is stored without blocking (RECORDS consumer only)
+ * @param queue Pointer to queue structure
+ * @param view Output - the record
+ * @return 1 if a record was taken, 0 if the queue is empty, paused, or a control message is due, -1 on error
+ */
+int consumer_producer_try_get_view(consumer_producer_t* queue, record_ring_view_t* view){
+    // error: bad arguments, or no ring to look into
+    if(!queue || !view || queue->mode != CONSUMER_PRODUCER_RECORDS){
+        return -1;
+    }
+
+    return consumer_producer_try_take(queue, NULL, NULL, view, 1) == 1;
+}
+
+/**
+ * Take up to max records where they are stored, with one lock acquisition (RECORDS consumer only).
+ * Blocks while the queue is empty, then takes everything available (up to max) - short of an END or BARRIER.
+ * @param queue Pointer to queue structure
+ * @param views Output array of at least max entries
+ * @param max Maximum number of records to take
+ * @return Number of records taken, 0 if a control message is due, or -1 on error
+ */
+int consumer_producer_get_many_views(consumer_producer_t* queue, record_ring_view_t* views, int max){
+    // error: bad arguments, or no ring to look into
+    if(!queue || !views || max<=0 || queue->mode != CONSUMER_PRODUCER_RECORDS){
+        return -1;
+    }
+
+    return consumer_producer_take(queue, NULL, NULL, views, max);
+}
+
+/**
+ * Give a record back once it has been processed, which frees its bytes for producers (RECORDS consumer only)
+ * @param queue Pointer to queue structure
+ * @param data The record's data - views are given back in the order they were taken
+ * @return 0 on success, -1 on error
+ */
+int consumer_producer_release_view(consumer_producer_t* queue, const char* data){
+    // error: bad arguments, or no ring to give it back to
+    if(!queue || !data || queue->mode != CONSUMER_PRODUCER_RECORDS){
+        return -1;
+    }
+
+    return record_ring_release(queue->records, data);
+}
+
+/**
+ * Give the count oldest records taken back at once (RECORDS consumer only, e.g. after a batch from get_many_views)
+ * @param queue Pointer to queue structure
+ * @param count Number of records
+ * @return 0 on success, -1 on error
+ */
+int consumer_producer_release_views(consumer_producer_t* queue, int count){
+    // error: bad arguments, or no ring to give them back to
+    if(!queue || count<0 || queue->mode != CONSUMER_PRODUCER_RECORDS){
+        return -1;
+    }
+
+    return record_ring_release_many(queue->records, count);
+}
+
+/**
+ * Append an entry to the control lane (control_mutex held, the lane has room)
+ * @param queue Pointer to queue structure
+ * @param control FLUSH or BARRIER
+ * @param position Where it is due (BARRIER)
+ */
+static void consumer_producer_add_control(consumer_producer_t* queue, consumer_producer_control_t control, unsigned long position){
+    consumer_producer_signal_t* signal = &queue->controls[queue->num_controls++];
+    signal->type = control;
+    signal->position = position;
+    signal->count = 1;
+    atomic_store(&queue->controls_pending, queue->num_controls + queue->ended);
+}
+
+/**
+ * Put a control message on the queue's control lane (any thread, never blocks - not even on a full queue)
+ * @param queue Pointer to queue structure
+ * @param control The control message (a second END is ignored)
+ * @return NULL on success, error message on failure
+ */
+const char* consumer_producer_put_control(consumer_producer_t* queue, consumer_producer_control_t control){
+    // error: queue is NULL
+    if(!queue){
+        return "queue is NULL";
+    }
+
+    switch(control){
+    case CONSUMER_PRODUCER_PAUSE:
+    case CONSUMER_PRODUCER_RESUME:
+        // applied by the queue itself - nothing to take
+        atomic_store(&queue->paused, control == CONSUMER_PRODUCER_PAUSE);
+        break;
+
+    case CONSUMER_PRODUCER_END:
+        // not on the lane: it can't be crowded out, and a second one changes nothing
+        pthread_mutex_lock(&queue->control_mutex);
+        if(!queue->ended){
+            // after every item put so far, and after every barrier before it (each takes a sequence number too)
+            queue->ended = 1;
+            queue->end_position = atomic_load(&queue->puts) + queue->barriers;
+            atomic_store(&queue->controls_pending, queue->num_controls + 1);
+        }
+        pthread_mutex_unlock(&queue->control_mutex);
+        break;
+
+    case CONSUMER_PRODUCER_FLUSH:
+        pthread_mutex_lock(&queue->control_mutex);
+        // a FLUSH still waiting flushes everything this one would (and the lane always has room for one)
+        for(int i=0; i<queue->num_controls; i++){
+            if(queue->controls[i].type == CONSUMER_PRODUCER_FLUSH){
+                pthread_mutex_unlock(&queue->control_mutex);
+                return NULL;
+            }
+        }
+        consumer_producer_add_control(queue, CONSUMER_PRODUCER_FLUSH, 0);
+        pthread_mutex_unlock(&queue->control_mutex);
+        break;
+
+    case CONSUMER_PRODUCER_BARRIER:
+        pthread_mutex_lock(&queue->control_mutex);
+        for(;;){
+            // nothing takes a barrier behind END - it would wait forever
+            if(queue->ended){
+                pthread_mutex_unlock(&queue->control_mutex);
+                return "barrier after end of stream";
+            }
+            // after every item put so far, and after every barrier before it (each takes a sequence number too)
+            unsigned long position = atomic_load(&queue->puts) + queue->barriers;
+            consumer_producer_signal_t* last = queue->num_controls > 0 ? &queue->controls[queue->num_controls - 1] : NULL;
+            if(last && last->type == CONSUMER_PRODUCER_BARRIER && last->position + last->count == position){
+                // no item since the last one - the same entry holds both
+                last->count++;
+                break;
+            }
+            // the flush slot is kept free, so a FLUSH never waits
+            if(queue->num_controls < CONSUMER_PRODUCER_CONTROLS - 1){
+                consumer_producer_add_control(queue, CONSUMER_PRODUCER_BARRIER, position);
+                break;
+            }
+            // a full lane only waits for the consumer to take what is on it
+            unsigned int key = eventcount_prepare_wait(&queue->control_room_event);
+            pthread_mutex_unlock(&queue->control_mutex);
+            eventcount_wait(&queue->control_room_event, key);
+            pthread_mutex_lock(&queue->control_mutex);
+        }
+        queue->barriers++;
+        pthread_mutex_unlock(&queue->control_mutex);
+        break;
+
+    default:
+        return "unknown control message";
+    }
+
+    // a consumer parked on an empty (or paused) queue has to look again
+    eventcount_notify(consumer_producer_consumer_event(queue));
+    return NULL;
+}
+
+/**
+ * Take the control message that is due, if any (consumer)
+ * @param queue Pointer to queue structure
+ * @param signal Output - the control message and its position (a barrier's is its sequence number)
+ * @return 1 if a control message was taken, 0 if none is due, -1 on error
+ */
+int consumer_producer_take_control(consumer_producer_t* queue, consumer_producer_signal_t* signal){
+    // error: bad arguments
+    if(!queue || !signal){
+        return -1;
+    }
+
+    if(atomic_load(&queue->controls_pending) == 0){
+        return 0;
+    }
+
+    // the sequence is the consumers' (several of them in LOCKED mode)
+    if(queue->mode == CONSUMER_PRODUCER_LOCKED){
+        pthread_mutex_lock(&queue->mutex);
+    }
+    pthread_mutex_lock(&queue->control_mutex);
+    int taken = 0;
+    int room = 0;
+    for(int i=0; i<queue->num_controls; i++){
+        const consumer_producer_signal_t* control = &queue->controls[i];
+        if(control->type != CONSUMER_PRODUCER_FLUSH && control->position > queue->sequence){
+            continue;
+        }
+        *signal = *control;
+        signal->count = 1;
+        taken = 1;
+        if(control->type == CONSUMER_PRODUCER_BARRIER){
+            queue->sequence++;
+            // the next barrier of a run stays, one sequence number on
+            if(queue->controls[i].count > 1){
+                queue->controls[i].position++;
+                queue->controls[i].count--;
+                break;
+            }
+        }
+        memmove(&queue->controls[i], &queue->controls[i + 1], (queue->num_controls - i - 1) * sizeof(consumer_producer_signal_t));
+        queue->num_controls--;
+        atomic_store(&queue->controls_pending, queue->num_controls + queue->ended);
+        room = 1;
+        break;
+    }
+    // END stays, so every consumer sees it - once the lane before it is empty
+    if(!taken && queue->ended && queue->end_position <= queue->sequence){
+        signal->type = CONSUMER_PRODUCER_END;
+        signal->position = queue->end_position;
+        signal->count = 1;
+        taken = 1;
+    }
+    pthread_mutex_unlock(&queue->control_mutex);
+    if(room){
+        eventcount_notify(&queue->control_room_event);
+    }
+    if(queue->mode == CONSUMER_PRODUCER_LOCKED){
+        pthread_mutex_unlock(&queue->mutex);
+    }
+
+    // the items behind a barrier are free to go - to whichever consumer is parked
+    if(taken && signal->type == CONSUMER_PRODUCER_BARRIER){
+        eventcount_notify(consumer_producer_consumer_event(queue));
+    }
+    return taken;
+}
+
+/**
+ * Would a get return right away - an item may be taken, or a control message is due (a snapshot)
+ * @param queue Pointer to queue structure
+ * @return 1 if so, 0 otherwise (empty, or paused with no control due)
+ */
+int consumer_producer_ready(consumer_producer_t* queue){
+    // error: queue is NULL
+    if(!queue){
+        return 0;
+    }
+
+    if(queue->mode == CONSUMER_PRODUCER_LOCKED){
+        pthread_mutex_lock(&queue->mutex);
+    }
+    int limit = consumer_producer_limit(queue, 1);
+    if(queue->mode == CONSUMER_PRODUCER_LOCKED){
+        pthread_mutex_unlock(&queue->mutex);
+    }
+    if(limit < 0){
+        return 1;
+    }
+    return limit > 0 && consumer_producer_count(queue) > 0;
+}
+
+/**
+ * Number of items currently in the queue (a snapshot - may be stale as soon as it returns)
+ * @param queue Pointer to queue structure
+ * @return Number of items, or -1 on error
+ */
+int consumer_producer_count(consumer_producer_t* queue){
+    // error: queue is NULL
+    if(!queue){
+        return -1;
+    }
+
+    if(queue->mode == CONSUMER_PRODUCER_SPSC){
+        return spsc_ring_count(queue->ring);
+    }
+
+    if(queue->mode == CONSUMER_PRODUCER_RECORDS){
+        return record_ring_count(queue->records);
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+    int count = queue->count;
+    pthread_mutex_unlock(&queue->mutex);
+    return count;
+}
+
 /**
  * Signal that processing is finished
  * @param queue Pointer to queue structure
@@ -2,22 +2,92 @@
 #define CONSUMER_PRODUCER_H
 
 #include "monitor.h"
+#include "eventcount.h"
+#include "spsc_ring.h"
+#include "record_ring.h"
+#include "item_meta.h"
+
+/**
+ * Which implementation a queue uses (chosen per link at init time)
+ * LOCKED - mutex-protected circular buffer, any number of producers and consumers
+ * SPSC - lock-free ring, exactly one producer thread and one consumer thread
+ * RECORDS - strings stored inline in one byte ring (capacity in bytes), read in place through views, one consumer thread
+ */
+typedef enum
+{
+CONSUMER_PRODUCER_LOCKED = 0,
+CONSUMER_PRODUCER_SPSC = 1,
+CONSUMER_PRODUCER_RECORDS = 2
+} consumer_producer_mode_t;
+
+/**
+ * Control messages - they travel on a lane of their own next to the items, so putting one never waits for room in a
+ * full queue and no item is ever mistaken for one (only FLUSH, PAUSE and RESUME overtake the items already queued)
+ * END - end of stream: due once every item and barrier put before it was taken, and stays due (every consumer sees
+ *       it) - kept as a flag and its position, never on the lane, so it always gets through
+ * FLUSH - due right away, ahead of the items already queued (one waiting FLUSH stands for any put after it)
+ * BARRIER - due once every item put before it was taken; no item put after it is handed out before it is taken
+ *           (barriers in a row share one lane entry - a put only waits while the lane is full of separate ones)
+ * PAUSE - stop handing out items (controls still get through) until RESUME - applied by the queue itself, never taken
+ * RESUME - hand out items again
+ */
+typedef enum
+{
+CONSUMER_PRODUCER_NO_CONTROL = 0,
+CONSUMER_PRODUCER_END = 1,
+CONSUMER_PRODUCER_FLUSH = 2,
+CONSUMER_PRODUCER_BARRIER = 3,
+CONSUMER_PRODUCER_PAUSE = 4,
+CONSUMER_PRODUCER_RESUME = 5
+} consumer_producer_control_t;
+
+// lane entries that can wait at once (a FLUSH, or a run of barriers with no item between them)
+#define CONSUMER_PRODUCER_CONTROLS 16
+
+/**
+ * A control message on the lane
+ */
+typedef struct
+{
+consumer_producer_control_t type; /* END, FLUSH or BARRIER */
+unsigned long position; /* END and BARRIER: due once this many items (and barriers) were taken - a taken barrier's sequence number */
+unsigned long count; /* On the lane: barriers in a row, at position, position + 1, ... (1 once taken) */
+} consumer_producer_signal_t;
 
 /**
  * Consumer-Producer queue structure for thread-safe producer-consumer pattern
- * Now using monitors for simpler implementation
+ * Uses eventcounts for the not-full/not-empty waits (waiters truly park, notifiers skip the syscall when nobody waits)
+ * and a monitor for the sticky finished signal
  */
 typedef struct
 {
 char** items; /* Array of string pointers */
+item_meta_t* metas; /* Each item's meta, next to it (LOCKED only - the rings keep their own) */
 int capacity; /* Maximum number of items */
 int count; /* Current number of items */
 int head; /* Index of first item */
 int tail; /* Index of next insertion point */
 pthread_mutex_t mutex; /* Mutex for thread-safe access */
-monitor_t not_full_monitor; /* Monitor for "not full" state */
-monitor_t not_empty_monitor; /* Monitor for "not empty" state */
+eventcount_t not_full_event; /* Eventcount for "not full" state */
+eventcount_t not_empty_event; /* Eventcount for "not empty" state */
 monitor_t finished_monitor; /* Monitor for finished signal */
+consumer_producer_mode_t mode; /* LOCKED or SPSC */
+spsc_ring_t* ring; /* Lock-free ring (SPSC mode only - items/count/head/tail are unused then) */
+record_ring_t* records; /* Byte ring (RECORDS mode only - items/count/head/tail are unused then) */
+unsigned long sequence; /* Number of items removed so far - the next get hands out this sequence number (taken barriers count too) */
+atomic_ulong puts; /* Number of items added so far (counted once they can be taken) */
+pthread_mutex_t control_mutex; /* Guards the control lane (taken after mutex when both are needed) */
+consumer_producer_signal_t controls[CONSUMER_PRODUCER_CONTROLS]; /* FLUSHes and barriers not taken yet, oldest first */
+int num_controls; /* Number of them */
+eventcount_t control_room_event; /* Eventcount for "the lane has room" (a BARRIER put waits on it) */
+int ended; /* END was put */
+unsigned long end_position; /* END is due once this many items (and barriers) were taken */
+unsigned long barriers; /* Barriers put so far - each one takes a sequence number of its own */
+atomic_int controls_pending; /* num_controls + ended, read without the lock - 0 lets consumers skip the lane entirely */
+atomic_int paused; /* PAUSE came and RESUME didn't yet */
+void* buffers; /* Allocator the copies come from and items left at destroy go back to (NULL: strdup and free) */
+char* (*buffer_alloc)(void* buffers, size_t size); /* Its allocation function */
+void (*buffer_release)(void* buffers, char* item); /* Its release function (takes any heap string) */
 } consumer_producer_t;
 
 
@@ -29,6 +99,25 @@ monitor_t finished_monitor; /* Monitor for finished signal */
  */
 const char* consumer_producer_init(consumer_producer_t* queue, int capacity);
 
+/**
+ * Initialize a consumer-producer queue with an explicit implementation
+ * @param queue Pointer to queue structure
+ * @param capacity Maximum number of items (RECORDS: size of the ring in bytes)
+ * @param mode CONSUMER_PRODUCER_LOCKED, CONSUMER_PRODUCER_SPSC or CONSUMER_PRODUCER_RECORDS
+ * @return NULL on success, error message on failure
+ */
+const char* consumer_producer_init_mode(consumer_producer_t* queue, int capacity, consumer_producer_mode_t mode);
+
+
+/**
+ * Make the queue's copies come from an allocator (and free what is left in it at destroy through it)
+ * @param queue Pointer to queue structure (initialized, not used yet)
+ * @param buffers The allocator, passed to both functions
+ * @param alloc Returns a buffer of at least size bytes, NULL on failure
+ * @param release Gives back an item - one of alloc's or any malloc'd string
+ */
+void consumer_producer_set_buffers(consumer_producer_t* queue, void* buffers,
+                                   char* (*alloc)(void* buffers, size_t size), void (*release)(void* buffers, char* item));
 
 /**
  * Destroy a consumer-producer queue and free its resources
@@ -39,20 +128,231 @@ void consumer_producer_destroy(consumer_producer_t* queue);
 /**
  * Add an item to the queue (producer).
  * Blocks if queue is full.
- * @param item String to add (queue takes ownership)
+ * @param item String to add (the queue stores its own copy - the caller keeps item)
  * @return NULL on success, error message on failure
  */
 const char* consumer_producer_put(consumer_producer_t* queue, const char* item);
 
 
+/**
+ * Add an item to the queue (producer) without copying it.
+ * Blocks if queue is full.
+ * @param queue Pointer to queue structure
+ * @param item Heap-allocated string to add (queue takes ownership - stored as-is and freed by whoever gets it;
+ *             RECORDS copies a short one into the ring and releases it right away)
+ * @return NULL on success, error message on failure (the caller keeps ownership on failure)
+ */
+const char* consumer_producer_put_owned(consumer_producer_t* queue, char* item);
+
+/**
+ * Add an item to the queue (producer) together with its meta - it comes out of the queue with the item.
+ * Blocks if queue is full. consumer_producer_put and consumer_producer_put_owned add items without meta (the
+ * getters then hand out ITEM_META_UNKNOWN).
+ * @param queue Pointer to queue structure
+ * @param item String to add (copied, like consumer_producer_put)
+ * @param meta What it carries (NULL: nothing known - a known len saves counting it for the copy)
+ * @return NULL on success, error message on failure
+ */
+const char* consumer_producer_put_meta(consumer_producer_t* queue, const char* item, const item_meta_t* meta);
+
+/**
+ * Add an item to the queue (producer) without copying it, together with its meta.
+ * Blocks if queue is full.
+ * @param queue Pointer to queue structure
+ * @param item Heap-allocated string to add (queue takes ownership, like consumer_producer_put_owned)
+ * @param meta What it carries (NULL: nothing known)
+ * @return NULL on success, error message on failure (the caller keeps ownership on failure)
+ */
+const char* consumer_producer_put_owned_meta(consumer_producer_t* queue, char* item, const item_meta_t* meta);
+
+
 /**
  * Remove an item from the queue (consumer) and returns it.
  * Blocks if queue is empty.
  * @param queue Pointer to queue structure
- * @return String item or NULL if queue is empty
+ * @return String item (RECORDS: a heap copy - consumer_producer_get_view avoids it), NULL on error or when a control message is due
  */
 char* consumer_producer_get(consumer_producer_t* queue);
 
+/**
+ * Remove an item from the queue (consumer) together with its position in the stream.
+ * Blocks if queue is empty. With several consumers the sequence numbers still follow insertion order exactly,
+ * so a reorder buffer downstream can restore it.
+ * @param queue Pointer to queue structure
+ * @param sequence Output - 0 for the first item ever removed, 1 for the second, ... (may be NULL)
+ * @return String item, NULL on error or when a control message is due
+ */
+char* consumer_producer_get_sequenced(consumer_producer_t* queue, unsigned long* sequence);
+
+/**
+ * Remove an item from the queue (consumer) together with its position in the stream and its meta.
+ * Blocks if queue is empty.
+ * @param queue Pointer to queue structure
+ * @param sequence Output - like consumer_producer_get_sequenced (may be NULL)
+ * @param meta Output - what the item was put with (may be NULL)
+ * @return String item, NULL on error or when a control message is due
+ */
+char* consumer_producer_get_meta(consumer_producer_t* queue, unsigned long* sequence, item_meta_t* meta);
+
+/**
+ * Add several items to the queue (producer) with one lock acquisition and one wakeup per chunk that fits.
+ * Blocks while the queue is full; returns once every item was added.
+ * @param queue Pointer to queue structure
+ * @param items Strings to add (copied, like consumer_producer_put)
+ * @param count Number of items
+ * @return NULL on success, error message on failure
+ */
+const char* consumer_producer_put_many(consumer_producer_t* queue, const char* const* items, int count);
+
+/**
+ * Add several items to the queue (producer) without copying them.
+ * Blocks while the queue is full; returns once every item was added.
+ * @param queue Pointer to queue structure
+ * @param items Heap-allocated strings to add (queue takes ownership of every item)
+ * @param count Number of items
+ * @return NULL on success, error message on failure (the caller keeps ownership on failure)
+ */
+const char* consumer_producer_put_many_owned(consumer_producer_t* queue, char* const* items, int count);
+
+/**
+ * Add several items to the queue (producer) without copying them, together with their metas.
+ * Blocks while the queue is full; returns once every item was added.
+ * @param queue Pointer to queue structure
+ * @param items Heap-allocated strings to add (queue takes ownership of every item)
+ * @param metas What each item carries (NULL: nothing known)
+ * @param count Number of items
+ * @return NULL on success, error message on failure (the caller keeps ownership on failure)
+ */
+const char* consumer_producer_put_many_owned_meta(consumer_producer_t* queue, char* const* items, const item_meta_t* metas, int count);
+
+/**
+ * Remove up to max items from the queue (consumer) with one lock acquisition and one wakeup.
+ * Blocks while the queue is empty, then takes everything available (up to max).
+ * @param queue Pointer to queue structure
+ * @param items Output array of at least max entries (caller frees each item)
+ * @param max Maximum number of items to remove (fewer if a barrier or END comes first)
+ * @return Number of items removed, 0 when a control message is due, or -1 on error
+ */
+int consumer_producer_get_many(consumer_producer_t* queue, char** items, int max);
+
+/**
+ * Remove up to max items from the queue (consumer) together with their metas, like consumer_producer_get_many.
+ * @param queue Pointer to queue structure
+ * @param items Output array of at least max entries (caller frees each item)
+ * @param metas Output array of at least max entries - what each item was put with
+ * @param max Maximum number of items to remove (fewer if a barrier or END comes first)
+ * @return Number of items removed, 0 when a control message is due, or -1 on error
+ */
+int consumer_producer_get_many_meta(consumer_producer_t* queue, char** items, item_meta_t* metas, int max);
+
+/**
+ * Add an item to the queue (producer) without copying it and without blocking.
+ * @param queue Pointer to queue structure
+ * @param item Heap-allocated string to add (queue takes ownership only if it was added)
+ * @return 1 if the item was added, 0 if the queue is full, -1 on error
+ */
+int consumer_producer_try_put_owned(consumer_producer_t* queue, char* item);
+
+/**
+ * Add an item to the queue (producer) without copying it and without blocking, together with its meta.
+ * @param queue Pointer to queue structure
+ * @param item Heap-allocated string to add (queue takes ownership only if it was added)
+ * @param meta What it carries (NULL: nothing known)
+ * @return 1 if the item was added, 0 if the queue is full, -1 on error
+ */
+int consumer_producer_try_put_owned_meta(consumer_producer_t* queue, char* item, const item_meta_t* meta);
+
+/**
+ * Remove an item from the queue (consumer) without blocking.
+ * @param queue Pointer to queue structure
+ * @return String item, or NULL if the queue is empty, paused or a control message is due
+ */
+char* consumer_producer_try_get(consumer_producer_t* queue);
+
+/**
+ * Remove an item from the queue (consumer) without blocking, together with its meta.
+ * @param queue Pointer to queue structure
+ * @param meta Output - what the item was put with (may be NULL)
+ * @return String item, or NULL if the queue is empty, paused or a control message is due
+ */
+char* consumer_producer_try_get_meta(consumer_producer_t* queue, item_meta_t* meta);
+
+/**
+ * Take the next record where it is stored, without copying it (RECORDS consumer only).
+ * Blocks if queue is empty.
+ * @param queue Pointer to queue structure
+ * @param view Output - pointer, length and meta of the record, valid until consumer_producer_release_view
+ * @return 0 on success, 1 when a control message is due instead, -1 on error
+ */
+int consumer_producer_get_view(consumer_producer_t* queue, record_ring_view_t* view);
+
+/**
+ * Take the next record where it is stored without blocking (RECORDS consumer only)
+ * @param queue Pointer to queue structure
+ * @param view Output - the record
+ * @return 1 if a record was taken, 0 if the queue is empty, paused or a control message is due, -1 on error
+ */
+int consumer_producer_try_get_view(consumer_producer_t* queue, record_ring_view_t* view);
+
+/**
+ * Take up to max records where they are stored, with one lock acquisition (RECORDS consumer only).
+ * Blocks while the queue is empty, then takes everything available (up to max).
+ * @param queue Pointer to queue structure
+ * @param views Output array of at least max entries
+ * @param max Maximum number of records to take (fewer if a barrier or END comes first)
+ * @return Number of records taken, 0 when a control message is due, or -1 on error
+ */
+int consumer_producer_get_many_views(consumer_producer_t* queue, record_ring_view_t* views, int max);
+
+/**
+ * Give a record back once it has been processed, which frees its bytes for producers (RECORDS consumer only)
+ * @param queue Pointer to queue structure
+ * @param data The record's data - views are given back in the order they were taken
+ * @return 0 on success, -1 on error
+ */
+int consumer_producer_release_view(consumer_producer_t* queue, const char* data);
+
+/**
+ * Give the count oldest records taken back at once (RECORDS consumer only, e.g. after a batch from get_many_views)
+ * @param queue Pointer to queue structure
+ * @param count Number of records
+ * @return 0 on success, -1 on error
+ */
+int consumer_producer_release_views(consumer_producer_t* queue, int count);
+
+/**
+ * Put a control message on the queue's control lane (any thread, never waits for room in a full queue - a BARRIER
+ * waits only while the lane itself is full)
+ * END and BARRIER come after every item put so far, FLUSH comes before them, PAUSE/RESUME apply right away.
+ * A blocking get the consumer is parked in returns empty-handed once a control is due (consumer_producer_take_control).
+ * @param queue Pointer to queue structure
+ * @param control The control message (a second END is ignored, a BARRIER after END is refused)
+ * @return NULL on success, error message on failure
+ */
+const char* consumer_producer_put_control(consumer_producer_t* queue, consumer_producer_control_t control);
+
+/**
+ * Take the control message that is due, if any (consumer)
+ * @param queue Pointer to queue structure
+ * @param signal Output - the control message and its position (a barrier's is its sequence number)
+ * @return 1 if a control message was taken, 0 if none is due, -1 on error
+ */
+int consumer_producer_take_control(consumer_producer_t* queue, consumer_producer_signal_t* signal);
+
+/**
+ * Would a get return right away - an item may be taken, or a control message is due (a snapshot)
+ * @param queue Pointer to queue structure
+ * @return 1 if so, 0 otherwise (empty, or paused with no control due)
+ */
+int consumer_producer_ready(consumer_producer_t* queue);
+
+/**
+ * Number of items currently in the queue (a snapshot - may be stale as soon as it returns)
+ * @param queue Pointer to queue structure
+ * @return Number of items, or -1 on error
+ */
+int consumer_producer_count(consumer_producer_t* queue);
+
 /**
  * Signal that processing is finished
  * @param queue Pointer to queue structure
@@ -0,0 +1,79 @@
+#include <limits.h>        // INT_MAX
+#include <stdatomic.h>
+#include <unistd.h>        // syscall
+#include <sys/syscall.h>   // SYS_futex
+#include <linux/futex.h>   // FUTEX_WAIT_PRIVATE, FUTEX_WAKE_PRIVATE
+
+#include "eventcount.h"
+
+
+// glibc has no futex wrapper, so we go through syscall(2)
+static long futex(atomic_uint* word, int op, unsigned int value){
+    return syscall(SYS_futex, (unsigned int*)word, op, value, NULL, NULL, 0);
+}
+
+int eventcount_init(eventcount_t* ec){
+    // it's NULL
+    if(!ec){
+        return -1;
+    }
+
+    atomic_init(&ec->sequence, 0);
+    atomic_init(&ec->waiters, 0);
+    return 0;
+}
+
+void eventcount_destroy(eventcount_t* ec){
+    (void)ec;
+}
+
+unsigned int eventcount_prepare_wait(eventcount_t* ec){
+    // announce ourselves before reading the key: a notifier that misses the increment
+    // is ordered before it, so the caller's condition check will see the notifier's change
+    atomic_fetch_add(&ec->waiters, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    return atomic_load_explicit(&ec->sequence, memory_order_acquire);
+}
+
+void eventcount_cancel_wait(eventcount_t* ec){
+    atomic_fetch_sub_explicit(&ec->waiters, 1, memory_order_relaxed);
+}
+
+void eventcount_wait(eventcount_t* ec, unsigned int key){
+    // the kernel only puts us to sleep if the sequence still equals key,
+    // so a notify between prepare_wait and here is never lost
+    while(atomic_load_explicit(&ec->sequence, memory_order_acquire) == key){
+        futex(&ec->sequence, FUTEX_WAIT_PRIVATE, key);
+    }
+    atomic_fetch_sub_explicit(&ec->waiters, 1, memory_order_relaxed);
+}
+
+/**
+ * Bump the sequence and wake up to count waiters - only if somebody waits
+ * @param ec Pointer to eventcount structure
+ * @param count Maximum number of threads to wake
+ */
+static void eventcount_wake(eventcount_t* ec, int count){
+    // pairs with the fence in eventcount_prepare_wait: orders the caller's condition change before the waiters load
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load_explicit(&ec->waiters, memory_order_relaxed) == 0){
+        return;
+    }
+
+    atomic_fetch_add_explicit(&ec->sequence, 1, memory_order_release);
+    futex(&ec->sequence, FUTEX_WAKE_PRIVATE, (unsigned int)count);
+}
+
+void eventcount_notify(eventcount_t* ec){
+    if(!ec){
+        return;
+    }
+    eventcount_wake(ec, INT_MAX);
+}
+
+void eventcount_notify_one(eventcount_t* ec){
+    if(!ec){
+        return;
+    }
+    eventcount_wake(ec, 1);
+}
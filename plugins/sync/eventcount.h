@@ -0,0 +1,76 @@
+#ifndef EVENTCOUNT_H
+#define EVENTCOUNT_H
+
+#include <stdatomic.h>
+
+/**
+ * eventcount is a wait/notify primitive built directly on a futex.
+ * unlike monitor_t it doesn't remember a signal - a waiter re-checks its own condition, so it never spins on a stale "signaled" flag.
+ *
+ * waiter protocol:
+ *     key = eventcount_prepare_wait(ec);
+ *     if(condition is already true) eventcount_cancel_wait(ec);
+ *     else eventcount_wait(ec, key);   // then re-check the condition
+ *
+ * notifier protocol: make the condition true, then eventcount_notify(ec).
+ * notify only bumps the futex word and enters the kernel when somebody is actually between prepare_wait and wait,
+ * so producers skip the syscall while consumers are busy.
+ **/
+
+/**
+ * Eventcount structure
+ */
+typedef struct
+{
+ atomic_uint sequence; /* Futex word - bumped by every notify that has waiters */
+ atomic_int waiters; /* Threads between prepare_wait and the end of wait/cancel_wait */
+} eventcount_t;
+
+/**
+ * Initialize an eventcount
+ * @param ec Pointer to eventcount structure
+ * @return 0 on success, -1 on failure
+ */
+int eventcount_init(eventcount_t* ec);
+
+/**
+ * Destroy an eventcount (nothing to free - kept for symmetry with monitor_destroy)
+ * @param ec Pointer to eventcount structure
+ */
+void eventcount_destroy(eventcount_t* ec);
+
+/**
+ * Register as a waiter and return the key to pass to eventcount_wait
+ * Must be followed by exactly one eventcount_wait or eventcount_cancel_wait
+ * @param ec Pointer to eventcount structure
+ * @return The current sequence (wait key)
+ */
+unsigned int eventcount_prepare_wait(eventcount_t* ec);
+
+/**
+ * Unregister a waiter whose condition became true before it slept
+ * @param ec Pointer to eventcount structure
+ */
+void eventcount_cancel_wait(eventcount_t* ec);
+
+/**
+ * Sleep until a notify happened after the matching prepare_wait (returns at once if one already did)
+ * Spurious wakeups are possible - the caller re-checks its condition
+ * @param ec Pointer to eventcount structure
+ * @param key Value returned by eventcount_prepare_wait
+ */
+void eventcount_wait(eventcount_t* ec, unsigned int key);
+
+/**
+ * Wake every waiter (no syscall when nobody waits)
+ * @param ec Pointer to eventcount structure
+ */
+void eventcount_notify(eventcount_t* ec);
+
+/**
+ * Wake at most one waiter (no syscall when nobody waits)
+ * @param ec Pointer to eventcount structure
+ */
+void eventcount_notify_one(eventcount_t* ec);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef ITEM_META_H
+#define ITEM_META_H
+
+#include <stddef.h>
+
+/**
+ * item meta is what an item carries through the queues besides its chars: stamped once, where the input was read,
+ * and handed on unchanged from queue to queue - only len follows the item as the stages change it.
+ * every queue keeps it next to the item (beside its pointer, or in its record's header), so nobody counts or stamps
+ * an item again on the way.
+ **/
+
+// item_meta_t.len of an item nobody has counted
+#define ITEM_META_LEN_UNKNOWN ((size_t)-1)
+
+/**
+ * What an item carries besides its chars
+ */
+typedef struct
+{
+ size_t len; /* Number of chars, ITEM_META_LEN_UNKNOWN if not counted */
+ unsigned long seq; /* Position in the input: 0 for the first item read, 1 for the next, ... */
+ unsigned long long ingest_ns; /* When it was read (CLOCK_MONOTONIC, nanoseconds) */
+} item_meta_t;
+
+// What an item put without meta carries
+#define ITEM_META_UNKNOWN ((item_meta_t){ ITEM_META_LEN_UNKNOWN, 0, 0 })
+
+#endif
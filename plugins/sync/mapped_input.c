@@ -0,0 +1,568 @@
+#include <stdio.h>     // fopen, fwrite, rename, snprintf
+#include <stdlib.h>    // malloc, realloc, calloc, free
+#include <string.h>    // memchr, memcpy, memcmp
+#include <fcntl.h>     // open
+#include <unistd.h>    // close, sysconf
+#include <sys/mman.h>  // mmap, munmap, madvise
+#include <sys/stat.h>  // fstat
+#include <pthread.h>
+
+#include "mapped_input.h"
+
+
+/**
+ * Make the heap copy of a chunk's unterminated last line (if it has one)
+ * @param chunk The chunk
+ */
+static void mapped_input_copy_tail(mapped_chunk_t* chunk){
+    if(chunk->tail_start == NULL){
+        return;
+    }
+    size_t len= chunk->owned_end - chunk->tail_start;
+    chunk->tail= malloc(len + 1);
+    if(chunk->tail == NULL){
+        chunk->failed= 1;
+        return;
+    }
+    memcpy(chunk->tail, chunk->tail_start, len);
+    chunk->tail[len]= '\0';
+}
+
+
+/**
+ * List one chunk's lines, terminating each in place
+ * @param input Pointer to input structure
+ * @param index Chunk index
+ */
+static void mapped_input_split(mapped_input_t* input, size_t index){
+    mapped_chunk_t* chunk= &input->chunks[index];
+    char* nominal_start= input->base + index * MAPPED_INPUT_CHUNK_SIZE;
+
+    // indexed: every terminator's place is known - unless a line turns out not to end there (then scan after all)
+    if(input->index_map != NULL && !chunk->lines_owned){
+        char* line_end= chunk->tail_start ? chunk->tail_start : chunk->owned_end;
+        int matches= 1;
+        for(size_t i= 0; i < chunk->num_lines && matches; i++){
+            char* terminator= (i + 1 < chunk->num_lines ? nominal_start + chunk->lines[i + 1] : line_end) - 1;
+            matches= *terminator == input->delimiter;
+        }
+        if(matches){
+            for(size_t i= 0; i < chunk->num_lines; i++){
+                char* terminator= (i + 1 < chunk->num_lines ? nominal_start + chunk->lines[i + 1] : line_end) - 1;
+                *terminator= '\0';
+            }
+            mapped_input_copy_tail(chunk);
+            atomic_store(&chunk->refs, chunk->num_lines + 1);
+            return;
+        }
+        chunk->lines= NULL;
+        chunk->num_lines= 0;
+        chunk->tail_start= NULL;
+    }
+
+    size_t capacity= 0;
+    char* p= chunk->owned_start;
+    chunk->lines_owned= 1;
+
+    while(p < chunk->owned_end){
+        char* found= memchr(p, input->delimiter, chunk->owned_end - p);
+        if(found == NULL){
+            // only the file's last line can miss its delimiter - and there is no byte left to terminate it in
+            chunk->tail_start= p;
+            mapped_input_copy_tail(chunk);
+            break;
+        }
+
+        if(chunk->num_lines == capacity){
+            size_t grown_capacity= capacity ? 2 * capacity : 1024;
+            uint32_t* grown= realloc(chunk->lines, grown_capacity * sizeof(uint32_t));
+            if(grown == NULL){
+                chunk->failed= 1;
+                break;
+            }
+            chunk->lines= grown;
+            capacity= grown_capacity;
+        }
+
+        *found= '\0';
+        chunk->lines[chunk->num_lines++]= (uint32_t)(p - nominal_start);
+        p= found + 1;
+    }
+
+    atomic_store(&chunk->refs, chunk->num_lines + 1);
+}
+
+
+/**
+ * Splitter thread: split chunks in order, staying at most window chunks ahead of the consumer
+ * @param arg Pointer to input structure
+ * @return NULL
+ */
+static void* mapped_input_splitter(void* arg){
+    mapped_input_t* input= (mapped_input_t*)arg;
+
+    pthread_mutex_lock(&input->mutex);
+    while(!input->stopping && input->next_split < input->num_chunks){
+        if(input->next_split >= input->take_chunk + input->window){
+            pthread_cond_wait(&input->changed, &input->mutex);
+            continue;
+        }
+
+        size_t index= input->next_split++;
+        input->chunks[index].state= MAPPED_CHUNK_SPLITTING;
+        pthread_mutex_unlock(&input->mutex);
+
+        mapped_input_split(input, index);
+
+        pthread_mutex_lock(&input->mutex);
+        input->chunks[index].state= MAPPED_CHUNK_READY;
+        pthread_cond_broadcast(&input->changed);
+    }
+    pthread_mutex_unlock(&input->mutex);
+    return NULL;
+}
+
+
+/**
+ * Drop one reference on a chunk - the last one gives the chunk's pages back (the file still has their contents)
+ * @param chunk The chunk
+ */
+static void mapped_chunk_put(mapped_chunk_t* chunk){
+    if(atomic_fetch_sub(&chunk->refs, 1) != 1){
+        return;
+    }
+
+    // only whole pages inside the chunk's own bytes - the pages at its edges are shared with the neighbouring chunks
+    uintptr_t page= (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start= ((uintptr_t)chunk->owned_start + page - 1) & ~(page - 1);
+    uintptr_t end= (uintptr_t)chunk->owned_end & ~(page - 1);
+    if(end > start){
+        madvise((void*)start, end - start, MADV_DONTNEED);
+    }
+}
+
+
+/**
+ * FNV-1a over a few samples of the file (its first and last 64 KiB and the start of every chunk) - cheap enough to run
+ * on every start, and catches the edits a same-size, same-mtime rewrite would still make
+ * @param input Pointer to input structure (mapped, chunks counted)
+ * @return The hash
+ */
+static uint64_t mapped_input_sample_hash(mapped_input_t* input){
+    uint64_t hash= 14695981039346656037ULL;
+    const size_t edge= 64 * 1024;
+    const size_t sample= 256;
+
+    size_t head= input->size < edge ? input->size : edge;
+    for(size_t i= 0; i < head; i++){
+        hash= (hash ^ (unsigned char)input->base[i]) * 1099511628211ULL;
+    }
+    for(size_t c= 1; c < input->num_chunks; c++){
+        size_t from= c * MAPPED_INPUT_CHUNK_SIZE;
+        size_t to= from + sample < input->size ? from + sample : input->size;
+        for(size_t i= from; i < to; i++){
+            hash= (hash ^ (unsigned char)input->base[i]) * 1099511628211ULL;
+        }
+    }
+    for(size_t i= input->size - head; i < input->size; i++){
+        hash= (hash ^ (unsigned char)input->base[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+/**
+ * Take chunk boundaries and line offsets from the sidecar index, if it is there and matches the file
+ * @param input Pointer to input structure (mapped, chunks allocated, hash and mtime set)
+ * @return 1 if the index was loaded, 0 if the chunks still have to be found by scanning
+ */
+static int mapped_input_load_index(mapped_input_t* input){
+    int fd= open(input->index_path, O_RDONLY);
+    if(fd < 0){
+        return 0;
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(mapped_index_header_t)){
+        close(fd);
+        return 0;
+    }
+    void* map= mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED){
+        return 0;
+    }
+
+    const mapped_index_header_t* header= map;
+    const mapped_index_chunk_t* table= (const mapped_index_chunk_t*)(header + 1);
+    uint32_t* offsets= (uint32_t*)(table + input->num_chunks);
+    int valid= memcmp(header->magic, MAPPED_INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+               header->file_size == input->size && header->mtime_sec == input->mtime_sec &&
+               header->mtime_nsec == input->mtime_nsec && header->sample_hash == input->sample_hash &&
+               header->chunk_size == MAPPED_INPUT_CHUNK_SIZE && header->delimiter == (unsigned char)input->delimiter &&
+               header->num_chunks == input->num_chunks &&
+               (size_t)info.st_size == sizeof(*header) + input->num_chunks * sizeof(*table) + header->num_offsets * sizeof(uint32_t);
+
+    // the entries have to describe this file's chunks, or a bad index could send us outside the mapping
+    uint64_t listed= 0;
+    for(size_t i= 0; valid && i < input->num_chunks; i++){
+        uint64_t nominal= (uint64_t)i * MAPPED_INPUT_CHUNK_SIZE;
+        uint64_t owned_end= i + 1 < input->num_chunks ? table[i + 1].owned_start : input->size;
+        valid= table[i].owned_start <= owned_end && owned_end <= input->size &&
+               listed + table[i].num_lines <= header->num_offsets &&
+               (table[i].tail == UINT32_MAX || nominal + table[i].tail < owned_end);
+        for(uint32_t k= 0; valid && k < table[i].num_lines; k++){
+            uint64_t line= nominal + offsets[listed + k];
+            valid= line >= table[i].owned_start && line < owned_end;
+        }
+        listed += valid ? table[i].num_lines : 0;
+    }
+    if(!valid || listed != header->num_offsets){
+        munmap(map, info.st_size);
+        return 0;
+    }
+
+    listed= 0;
+    for(size_t i= 0; i < input->num_chunks; i++){
+        mapped_chunk_t* chunk= &input->chunks[i];
+        chunk->owned_start= input->base + table[i].owned_start;
+        chunk->owned_end= i + 1 < input->num_chunks ? input->base + table[i + 1].owned_start : input->base + input->size;
+        chunk->lines= table[i].num_lines > 0 ? offsets + listed : NULL;
+        chunk->lines_owned= 0;
+        chunk->num_lines= table[i].num_lines;
+        chunk->first_line= table[i].first_line;
+        chunk->tail_start= table[i].tail == UINT32_MAX ? NULL : input->base + i * MAPPED_INPUT_CHUNK_SIZE + table[i].tail;
+        listed += table[i].num_lines;
+    }
+    input->index_map= map;
+    input->index_size= info.st_size;
+    return 1;
+}
+
+
+/**
+ * Find chunk boundaries by scanning (no index): a chunk starts at the first line that starts at or after its nominal start
+ * @param input Pointer to input structure (mapped, chunks allocated)
+ */
+static void mapped_input_find_chunks(mapped_input_t* input){
+    // chunk boundaries come from the untouched file, before any splitter writes a terminator
+    char* end= input->base + input->size;
+    for(size_t i= 0; i < input->num_chunks; i++){
+        char* nominal_start= input->base + i * MAPPED_INPUT_CHUNK_SIZE;
+        char* start= input->base;
+        if(i > 0 && input->chunks[i - 1].owned_start >= nominal_start){
+            // the line before is longer than a chunk - no need to scan it again
+            start= input->chunks[i - 1].owned_start;
+        }
+        else if(i > 0){
+            char* found= memchr(nominal_start - 1, input->delimiter, end - (nominal_start - 1));
+            start= found ? found + 1 : end;
+        }
+        input->chunks[i].owned_start= start;
+        if(i > 0){
+            input->chunks[i - 1].owned_end= start;
+        }
+    }
+    if(input->num_chunks > 0){
+        input->chunks[input->num_chunks - 1].owned_end= end;
+    }
+}
+
+
+/**
+ * Start handing lines out at first_line: with an index, jump straight to its chunk; without, drop the lines before it
+ * @param input Pointer to input structure (chunks set up, splitters not started)
+ * @param first_line Line number (0-based)
+ */
+static void mapped_input_seek(mapped_input_t* input, size_t first_line){
+    if(input->index_map == NULL){
+        input->skip= first_line;
+        return;
+    }
+
+    // the first chunk whose lines (counting its tail) reach past first_line
+    size_t low= 0;
+    size_t high= input->num_chunks;
+    while(low < high){
+        size_t middle= low + (high - low) / 2;
+        mapped_chunk_t* chunk= &input->chunks[middle];
+        if(chunk->first_line + chunk->num_lines + (chunk->tail_start != NULL) <= first_line){
+            low= middle + 1;
+        }
+        else{
+            high= middle;
+        }
+    }
+    input->next_split= low;
+    input->take_chunk= low;
+    input->take_line= low < input->num_chunks ? first_line - input->chunks[low].first_line : 0;
+}
+
+
+const char* mapped_input_open(mapped_input_t* input, const char* path, char delimiter, int num_splitters,
+                              const char* index_path, size_t first_line){
+    if(!input || !path || num_splitters < 1){
+        return "Invalid input arguments";
+    }
+
+    int fd= open(path, O_RDONLY);
+    if(fd < 0){
+        return "Failed to open input file";
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)){
+        close(fd);
+        return "Input is not a regular file";
+    }
+
+    input->size= (size_t)info.st_size;
+    input->base= NULL;
+    input->delimiter= delimiter;
+    input->num_chunks= (input->size + MAPPED_INPUT_CHUNK_SIZE - 1) / MAPPED_INPUT_CHUNK_SIZE;
+    input->next_split= 0;
+    input->window= 2 * (size_t)num_splitters + 2;
+    input->stopping= 0;
+    input->take_chunk= 0;
+    input->take_line= 0;
+    input->take_ready= 0;
+    input->skip= 0;
+    input->index_path= index_path;
+    input->index_map= NULL;
+    input->index_size= 0;
+    input->mtime_sec= info.st_mtim.tv_sec;
+    input->mtime_nsec= info.st_mtim.tv_nsec;
+    input->sample_hash= 0;
+
+    // private and writable: terminators go into our copy of a page, never into the file
+    if(input->size > 0){
+        input->base= mmap(NULL, input->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if(input->base == MAP_FAILED){
+            close(fd);
+            return "Failed to map input file";
+        }
+        madvise(input->base, input->size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    input->chunks= calloc(input->num_chunks ? input->num_chunks : 1, sizeof(mapped_chunk_t));
+    input->splitters= malloc(num_splitters * sizeof(pthread_t));
+    if(!input->chunks || !input->splitters){
+        free(input->chunks);
+        free(input->splitters);
+        if(input->base){
+            munmap(input->base, input->size);
+        }
+        return "Failed to allocate chunks";
+    }
+    for(size_t i= 0; i < input->num_chunks; i++){
+        atomic_init(&input->chunks[i].refs, 0);
+    }
+
+    if(index_path != NULL){
+        input->sample_hash= mapped_input_sample_hash(input);
+    }
+    if(index_path == NULL || !mapped_input_load_index(input)){
+        mapped_input_find_chunks(input);
+    }
+    mapped_input_seek(input, first_line);
+
+    pthread_mutex_init(&input->mutex, NULL);
+    pthread_cond_init(&input->changed, NULL);
+
+    input->num_splitters= 0;
+    for(int i= 0; i < num_splitters; i++){
+        if(pthread_create(&input->splitters[i], NULL, mapped_input_splitter, input) != 0){
+            break;
+        }
+        input->num_splitters++;
+    }
+    if(input->num_splitters == 0){
+        pthread_cond_destroy(&input->changed);
+        pthread_mutex_destroy(&input->mutex);
+        free(input->chunks);
+        free(input->splitters);
+        if(input->index_map){
+            munmap(input->index_map, input->index_size);
+        }
+        if(input->base){
+            munmap(input->base, input->size);
+        }
+        return "Failed to create splitter threads";
+    }
+
+    return NULL;
+}
+
+
+void mapped_input_close(mapped_input_t* input){
+    if(!input){
+        return;
+    }
+
+    pthread_mutex_lock(&input->mutex);
+    input->stopping= 1;
+    pthread_cond_broadcast(&input->changed);
+    pthread_mutex_unlock(&input->mutex);
+
+    for(int i= 0; i < input->num_splitters; i++){
+        pthread_join(input->splitters[i], NULL);
+    }
+
+    // chunks the consumer never got to (it stopped at <END>), and the line lists kept for the index
+    for(size_t i= 0; i < input->num_chunks; i++){
+        if(input->chunks[i].lines_owned){
+            free(input->chunks[i].lines);
+        }
+        free(input->chunks[i].tail);
+    }
+
+    pthread_cond_destroy(&input->changed);
+    pthread_mutex_destroy(&input->mutex);
+    free(input->chunks);
+    free(input->splitters);
+    if(input->index_map){
+        munmap(input->index_map, input->index_size);
+    }
+    if(input->base){
+        munmap(input->base, input->size);
+    }
+}
+
+
+const char* mapped_input_save_index(mapped_input_t* input){
+    if(input->index_path == NULL || input->index_map != NULL){
+        return NULL;
+    }
+    if(input->take_chunk < input->num_chunks){
+        return "Input was not read to the end";
+    }
+
+    mapped_index_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAPPED_INDEX_MAGIC, sizeof(header.magic));
+    header.file_size= input->size;
+    header.mtime_sec= input->mtime_sec;
+    header.mtime_nsec= input->mtime_nsec;
+    header.sample_hash= input->sample_hash;
+    header.chunk_size= MAPPED_INPUT_CHUNK_SIZE;
+    header.delimiter= (unsigned char)input->delimiter;
+    header.num_chunks= input->num_chunks;
+    for(size_t i= 0; i < input->num_chunks; i++){
+        if(input->chunks[i].failed){
+            return "Some lines could not be listed";
+        }
+        header.num_offsets += input->chunks[i].num_lines;
+    }
+
+    // write a temporary file and rename it over the old index, so a reader never sees half an index
+    char temp_path[4096];
+    if(snprintf(temp_path, sizeof(temp_path), "%s.tmp", input->index_path) >= (int)sizeof(temp_path)){
+        return "Index path too long";
+    }
+    FILE* file= fopen(temp_path, "wb");
+    if(file == NULL){
+        return "Failed to create index file";
+    }
+
+    int written= fwrite(&header, sizeof(header), 1, file) == 1;
+    uint64_t first_line= 0;
+    for(size_t i= 0; written && i < input->num_chunks; i++){
+        mapped_chunk_t* chunk= &input->chunks[i];
+        mapped_index_chunk_t entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.owned_start= chunk->owned_start - input->base;
+        entry.first_line= first_line;
+        entry.num_lines= (uint32_t)chunk->num_lines;
+        entry.tail= chunk->tail_start ? (uint32_t)(chunk->tail_start - (input->base + i * MAPPED_INPUT_CHUNK_SIZE)) : UINT32_MAX;
+        written= fwrite(&entry, sizeof(entry), 1, file) == 1;
+        first_line += chunk->num_lines + (chunk->tail_start != NULL);
+    }
+    for(size_t i= 0; written && i < input->num_chunks; i++){
+        mapped_chunk_t* chunk= &input->chunks[i];
+        written= chunk->num_lines == 0 || fwrite(chunk->lines, sizeof(uint32_t), chunk->num_lines, file) == chunk->num_lines;
+    }
+
+    if(fclose(file) != 0 || !written){
+        remove(temp_path);
+        return "Failed to write index file";
+    }
+    if(rename(temp_path, input->index_path) != 0){
+        remove(temp_path);
+        return "Failed to replace index file";
+    }
+    return NULL;
+}
+
+
+int mapped_input_next(mapped_input_t* input, char** line){
+    while(input->take_chunk < input->num_chunks){
+        mapped_chunk_t* chunk= &input->chunks[input->take_chunk];
+
+        // first visit to the chunk: wait for its splitter
+        if(!input->take_ready){
+            pthread_mutex_lock(&input->mutex);
+            while(chunk->state != MAPPED_CHUNK_READY){
+                pthread_cond_wait(&input->changed, &input->mutex);
+            }
+            pthread_mutex_unlock(&input->mutex);
+            input->take_ready= 1;
+
+            // seeking with an index starts part-way into the chunk - the lines before are never handed out
+            size_t skipped= input->take_line < chunk->num_lines ? input->take_line : chunk->num_lines;
+            if(skipped > 0){
+                atomic_fetch_sub(&chunk->refs, skipped);
+            }
+        }
+
+        char* next= NULL;
+        if(input->take_line < chunk->num_lines){
+            next= input->base + input->take_chunk * MAPPED_INPUT_CHUNK_SIZE + chunk->lines[input->take_line++];
+        }
+        else if(chunk->tail != NULL){
+            // a heap copy - mapped_input_release passes it to free()
+            next= chunk->tail;
+            chunk->tail= NULL;
+        }
+        if(next != NULL){
+            // seeking without an index: the lines before the first one are dropped here
+            if(input->skip > 0){
+                input->skip--;
+                mapped_input_release(input, next);
+                continue;
+            }
+            *line= next;
+            return 1;
+        }
+
+        // every line is out: move on, and drop the reference that kept the chunk alive while we handed them out
+        // (a run that builds the index keeps the line list until it is written)
+        int failed= chunk->failed;
+        if(chunk->lines_owned && (input->index_path == NULL || input->index_map != NULL)){
+            free(chunk->lines);
+            chunk->lines= NULL;
+            chunk->lines_owned= 0;
+        }
+        pthread_mutex_lock(&input->mutex);
+        input->take_chunk++;
+        pthread_cond_broadcast(&input->changed);
+        pthread_mutex_unlock(&input->mutex);
+        input->take_line= 0;
+        input->take_ready= 0;
+        mapped_chunk_put(chunk);
+        if(failed){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+void mapped_input_release(void* arg, char* line){
+    mapped_input_t* input= (mapped_input_t*)arg;
+    if(line < input->base || line >= input->base + input->size){
+        free(line);
+        return;
+    }
+
+    // a line belongs to the chunk it starts in
+    mapped_chunk_put(&input->chunks[(line - input->base) / MAPPED_INPUT_CHUNK_SIZE]);
+}
@@ -0,0 +1,153 @@
+#ifndef MAPPED_INPUT_H
+#define MAPPED_INPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+/**
+ * mapped input serves the lines of a file straight out of a private mmap(2) of it - no read(2), no copy, no malloc per line.
+ * the file is cut into fixed-size chunks; a line belongs to the chunk it starts in. splitter threads each take a chunk,
+ * turn its delimiters into null terminators (the mapping is private, the file itself is never written) and list its lines,
+ * a few chunks ahead of the consumer that hands the lines out in file order.
+ *
+ * every line handed out holds a reference on its chunk; when the last one is released the chunk's pages are dropped,
+ * so memory use stays at a few chunks however big the file is.
+ *
+ * optionally the line offsets are kept in a sidecar index file. a later run over the unchanged file (same size, mtime and
+ * sampled hash) takes chunk boundaries and line offsets from the index instead of scanning for delimiters, and can start
+ * at any line without reading the lines before it.
+ **/
+
+// bytes per chunk (a line is at most this far from its chunk's start, so 32-bit offsets are enough)
+#define MAPPED_INPUT_CHUNK_SIZE (4 * 1024 * 1024)
+
+// life cycle of a chunk
+#define MAPPED_CHUNK_WAITING 0 // no splitter has taken it yet
+#define MAPPED_CHUNK_SPLITTING 1 // a splitter is working on it
+#define MAPPED_CHUNK_READY 2 // lines listed, waiting for the consumer
+
+// sidecar index: first bytes of the file (the version is part of it)
+#define MAPPED_INDEX_MAGIC "LNINDEX1"
+
+/**
+ * Sidecar index header - followed by num_chunks mapped_index_chunk_t, then every chunk's line offsets (uint32_t)
+ */
+typedef struct
+{
+ char magic[8]; /* MAPPED_INDEX_MAGIC */
+ uint64_t file_size; /* Indexed file's size */
+ int64_t mtime_sec; /* Indexed file's modification time */
+ int64_t mtime_nsec;
+ uint64_t sample_hash; /* FNV-1a of the file's first and last 64 KiB and the start of every chunk */
+ uint32_t chunk_size; /* MAPPED_INPUT_CHUNK_SIZE of the build that wrote it */
+ uint32_t delimiter; /* Line terminator the lines were split at */
+ uint64_t num_chunks; /* Number of chunks */
+ uint64_t num_offsets; /* Number of line offsets after the chunk table */
+} mapped_index_header_t;
+
+/**
+ * Sidecar index entry for one chunk
+ */
+typedef struct
+{
+ uint64_t owned_start; /* File offset of the chunk's first line */
+ uint64_t first_line; /* Number of the chunk's first line in the file (0-based) */
+ uint32_t num_lines; /* Terminated lines (their offsets follow the table) */
+ uint32_t tail; /* Offset of an unterminated last line from the chunk's nominal start, UINT32_MAX if none */
+} mapped_index_chunk_t;
+
+/**
+ * One chunk of the mapping
+ */
+typedef struct
+{
+ int state; /* MAPPED_CHUNK_* (guarded by the input's mutex) */
+ uint32_t* lines; /* Offsets of the chunk's lines from the chunk's nominal start */
+ int lines_owned; /* lines was allocated by the splitter (else it points into the index) */
+ size_t num_lines; /* Number of lines */
+ uint64_t first_line; /* Number of the chunk's first line in the file (known up front only with an index) */
+ char* tail_start; /* A last line with no delimiter after it (no room for its terminator in the mapping), NULL if none */
+ char* tail; /* Heap copy of it */
+ char* owned_start; /* First byte of the chunk's first line */
+ char* owned_end; /* One past the last line's terminator - [owned_start, owned_end) belongs to this chunk alone */
+ int failed; /* Listing the lines ran out of memory - the lines after the listed ones are skipped */
+ atomic_size_t refs; /* Lines not released yet, plus one while the consumer still hands lines out */
+} mapped_chunk_t;
+
+/**
+ * Mapped input structure
+ */
+typedef struct
+{
+ char* base; /* The mapping */
+ size_t size; /* File size */
+ char delimiter; /* Line terminator */
+ mapped_chunk_t* chunks; /* size / MAPPED_INPUT_CHUNK_SIZE chunks, rounded up */
+ size_t num_chunks; /* Number of chunks */
+ pthread_t* splitters; /* Splitter threads */
+ int num_splitters; /* Number of splitter threads */
+ pthread_mutex_t mutex; /* Guards chunk states and the fields below */
+ pthread_cond_t changed; /* Signaled when a chunk is ready or the consumer moves on */
+ size_t next_split; /* Next chunk a splitter takes */
+ size_t window; /* Splitters stay at most this many chunks ahead of the consumer */
+ int stopping; /* Set by mapped_input_close */
+ size_t take_chunk; /* Chunk the consumer hands lines out of */
+ /* consumer's own state (not guarded) */
+ size_t take_line; /* Next line of that chunk */
+ int take_ready; /* The consumer already waited for take_chunk to be split */
+ size_t skip; /* Lines the consumer still drops before handing any out (seeking without an index) */
+ /* sidecar index */
+ const char* index_path; /* NULL: no index */
+ void* index_map; /* The loaded index (NULL: none was valid - it is built during the run) */
+ size_t index_size; /* Its size */
+ int64_t mtime_sec; /* The file's modification time and sampled hash, for the index header */
+ int64_t mtime_nsec;
+ uint64_t sample_hash;
+} mapped_input_t;
+
+/**
+ * Map a file and start splitting it
+ * @param input Pointer to input structure
+ * @param path File to read
+ * @param delimiter Line terminator
+ * @param num_splitters Number of splitter threads (at least 1)
+ * @param index_path Sidecar index to use if it matches the file (and to build otherwise), NULL for none (not copied)
+ * @param first_line Number of the first line to hand out (0-based) - with a valid index no earlier chunk is touched
+ * @return NULL on success, error message on failure
+ */
+const char* mapped_input_open(mapped_input_t* input, const char* path, char delimiter, int num_splitters,
+                              const char* index_path, size_t first_line);
+
+/**
+ * Write the sidecar index (after mapped_input_next returned 0 - every chunk has been split by then).
+ * Does nothing if the index was loaded, or no index was asked for.
+ * @param input Pointer to input structure
+ * @return NULL on success, error message on failure
+ */
+const char* mapped_input_save_index(mapped_input_t* input);
+
+/**
+ * Stop the splitters and unmap the file (every line must have been released)
+ * @param input Pointer to input structure
+ */
+void mapped_input_close(mapped_input_t* input);
+
+/**
+ * Take the next line, in file order (blocks until its chunk is split)
+ * @param input Pointer to input structure
+ * @param line Output - null-terminated line without its delimiter, give it back with mapped_input_release
+ * @return 1 if a line was returned, 0 at end of file, -1 once for a chunk whose lines couldn't all be listed (they are skipped)
+ */
+int mapped_input_next(mapped_input_t* input, char** line);
+
+/**
+ * Give a line back (any thread, any order). Anything that isn't a line of the mapping is passed to free(),
+ * so this fits plugin_config_t.release_input as is.
+ * @param arg Pointer to input structure
+ * @param line The line
+ */
+void mapped_input_release(void* arg, char* line);
+
+#endif
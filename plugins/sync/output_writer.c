@@ -0,0 +1,389 @@
+#include <stdlib.h>    // malloc, calloc, free
+#include <string.h>    // memcpy, memset
+#include <errno.h>     // EINTR
+#include <sched.h>     // sched_yield
+#include <time.h>      // clock_gettime
+#include <unistd.h>
+#include <pthread.h>
+
+#include "output_writer.h"
+
+// ring offsets of positions
+#define OUTPUT_WRITER_MASK ((unsigned long)OUTPUT_WRITER_RING_SIZE - 1)
+// records are 8-byte aligned, so a header never straddles the end of the ring
+#define OUTPUT_WRITER_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+
+/**
+ * Bytes a record takes in the ring, header included
+ * @param record The record's header
+ * @param state Its state (not EMPTY)
+ * @return Bytes from this header to the next one
+ */
+static size_t output_writer_record_size(const output_record_t* record, unsigned int state){
+    if(state == OUTPUT_RECORD_PAD){
+        return record->len;
+    }
+    return sizeof(output_record_t) + (state == OUTPUT_RECORD_HEAP ? sizeof(char*) : OUTPUT_WRITER_ALIGN(record->len));
+}
+
+
+/**
+ * Wake the writer thread after a record was committed, if it is parked for it
+ * @param writer Pointer to writer structure
+ * @param end Ring position just past the record
+ */
+static void output_writer_notify(output_writer_t* writer, unsigned long end){
+    // only the first record after the writer went idle, and the ones that fill a batch, make a syscall
+    int parked = atomic_load(&writer->parked);
+    if(parked == OUTPUT_WRITER_IDLE ||
+       (parked == OUTPUT_WRITER_TIMED && end - atomic_load(&writer->released) >= OUTPUT_WRITER_FLUSH_BYTES)){
+        pthread_mutex_lock(&writer->mutex);
+        pthread_cond_signal(&writer->wake);
+        pthread_mutex_unlock(&writer->mutex);
+    }
+}
+
+
+/**
+ * Reserve space for one record (waits while the ring is full)
+ * A record that doesn't fit before the end of the ring goes to its start, behind a padding record.
+ * @param writer Pointer to writer structure
+ * @param size Bytes the record takes, header included
+ * @return Ring position of the record
+ */
+static unsigned long output_writer_reserve(output_writer_t* writer, size_t size){
+    unsigned long position = atomic_load(&writer->reserved);
+    for(;;){
+        size_t to_end = OUTPUT_WRITER_RING_SIZE - (position & OUTPUT_WRITER_MASK);
+        size_t pad = to_end < size ? to_end : 0;
+        unsigned long end = position + pad + size;
+
+        if(end - atomic_load(&writer->released) > OUTPUT_WRITER_RING_SIZE){
+            // the output can't keep up - wait until the writer gave enough space back
+            pthread_mutex_lock(&writer->mutex);
+            while(end - atomic_load(&writer->released) > OUTPUT_WRITER_RING_SIZE){
+                pthread_cond_signal(&writer->wake);
+                pthread_cond_wait(&writer->progress, &writer->mutex);
+            }
+            pthread_mutex_unlock(&writer->mutex);
+            position = atomic_load(&writer->reserved);
+            continue;
+        }
+
+        if(atomic_compare_exchange_weak(&writer->reserved, &position, end)){
+            if(pad > 0){
+                output_record_t* padding = (output_record_t*)(writer->ring + (position & OUTPUT_WRITER_MASK));
+                padding->len = (uint32_t)pad;
+                atomic_store_explicit(&padding->state, OUTPUT_RECORD_PAD, memory_order_release);
+            }
+            return position + pad;
+        }
+    }
+}
+
+
+/**
+ * Write a batch with as few writev(2) calls as it takes (writer thread only)
+ * @param writer Pointer to writer structure
+ * @param iov One entry per record (modified)
+ * @param count Number of records
+ * @return 0 on success, -1 if the write failed
+ */
+static int output_writer_write_batch(output_writer_t* writer, struct iovec* iov, int count){
+    struct iovec* pending = iov;
+    int remaining = count;
+    while(remaining > 0){
+        ssize_t n = writev(writer->fd, pending, remaining);
+        if(n < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            return -1;
+        }
+        // partial write: skip what went out and go on from the middle of the record it stopped in
+        while(remaining > 0 && (size_t)n >= pending->iov_len){
+            n -= pending->iov_len;
+            pending++;
+            remaining--;
+        }
+        if(remaining > 0){
+            pending->iov_base = (char*)pending->iov_base + n;
+            pending->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Give the space of written records back to the producers (writer thread only)
+ * The space is zeroed first: any 8-byte slot may hold a future header, which must read EMPTY until it is committed.
+ * @param writer Pointer to writer structure
+ * @param to Ring position up to which everything was written
+ * @param failed The write failed
+ */
+static void output_writer_release(output_writer_t* writer, unsigned long to, int failed){
+    unsigned long from = atomic_load(&writer->released);
+    for(unsigned long position = from; position < to; ){
+        output_record_t* record = (output_record_t*)(writer->ring + (position & OUTPUT_WRITER_MASK));
+        unsigned int state = atomic_load_explicit(&record->state, memory_order_relaxed);
+        size_t size = output_writer_record_size(record, state);
+        if(state == OUTPUT_RECORD_HEAP){
+            char* heap;
+            memcpy(&heap, record + 1, sizeof(char*));
+            free(heap);
+        }
+        memset(record, 0, size);
+        position += size;
+    }
+    atomic_store(&writer->released, to);
+
+    pthread_mutex_lock(&writer->mutex);
+    writer->failed |= failed;
+    pthread_cond_broadcast(&writer->progress);
+    pthread_mutex_unlock(&writer->mutex);
+}
+
+
+/**
+ * Microseconds from one monotonic time to another
+ * @param from Earlier time
+ * @param to Later time
+ * @return Elapsed microseconds
+ */
+static long output_writer_elapsed(const struct timespec* from, const struct timespec* to){
+    return (to->tv_sec - from->tv_sec) * 1000000L + (to->tv_nsec - from->tv_nsec) / 1000;
+}
+
+
+/**
+ * Writer thread: gather committed records into a batch and write it once it is full, old enough, or flushed
+ * @param arg Pointer to writer structure
+ * @return NULL
+ */
+static void* output_writer_thread(void* arg){
+    output_writer_t* writer = (output_writer_t*)arg;
+    struct iovec iov[OUTPUT_WRITER_MAX_IOV];
+    unsigned long gathered = 0; // ring position up to which records are in the batch
+    int count = 0;
+    size_t bytes = 0;
+    int stopping = 0;
+    int failed = 0;
+    struct timespec first;
+    struct timespec now;
+
+    for(;;){
+        // take committed records in ring order - the first one still being copied in ends the batch for now
+        unsigned long limit = atomic_load(&writer->reserved);
+        unsigned long start = gathered;
+        while(gathered < limit && count < OUTPUT_WRITER_MAX_IOV){
+            output_record_t* record = (output_record_t*)(writer->ring + (gathered & OUTPUT_WRITER_MASK));
+            unsigned int state = atomic_load_explicit(&record->state, memory_order_acquire);
+            if(state == OUTPUT_RECORD_EMPTY){
+                break;
+            }
+            if(state != OUTPUT_RECORD_PAD){
+                if(count == 0){
+                    clock_gettime(CLOCK_MONOTONIC, &first);
+                }
+                char* data = (char*)(record + 1);
+                if(state == OUTPUT_RECORD_HEAP){
+                    memcpy(&data, record + 1, sizeof(char*));
+                }
+                iov[count].iov_base = data;
+                iov[count].iov_len = record->len;
+                count++;
+                bytes += record->len;
+            }
+            gathered += output_writer_record_size(record, state);
+        }
+
+        int flushing = atomic_load(&writer->flush_target) > atomic_load(&writer->released);
+        if(count > 0){
+            clock_gettime(CLOCK_MONOTONIC, &now);
+        }
+        if(count > 0 && (flushing || stopping || count == OUTPUT_WRITER_MAX_IOV || bytes >= OUTPUT_WRITER_FLUSH_BYTES ||
+                         output_writer_elapsed(&first, &now) >= OUTPUT_WRITER_FLUSH_USEC)){
+            // after a failed write the output is gone - records are still taken (and flushes released), just not written
+            failed = failed || output_writer_write_batch(writer, iov, count) != 0;
+            output_writer_release(writer, gathered, failed);
+            count = 0;
+            bytes = 0;
+            continue;
+        }
+        if(count == 0 && gathered != atomic_load(&writer->released)){
+            // only padding went by
+            output_writer_release(writer, gathered, failed);
+        }
+
+        pthread_mutex_lock(&writer->mutex);
+        stopping = writer->stopping;
+        // destroy runs once no producer is left, so nothing can be reserved after this
+        if(stopping && count == 0 && atomic_load(&writer->reserved) == gathered){
+            pthread_mutex_unlock(&writer->mutex);
+            break;
+        }
+
+        // park - then look again, a producer that checked parked before we set it didn't wake us
+        atomic_store(&writer->parked, count > 0 ? OUTPUT_WRITER_TIMED : OUTPUT_WRITER_IDLE);
+        int more = atomic_load(&writer->reserved) != gathered;
+        flushing = atomic_load(&writer->flush_target) > atomic_load(&writer->released);
+        if(!stopping && !more && !flushing){
+            if(count > 0){
+                struct timespec deadline = first;
+                deadline.tv_nsec += OUTPUT_WRITER_FLUSH_USEC * 1000L;
+                deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+                deadline.tv_nsec %= 1000000000L;
+                pthread_cond_timedwait(&writer->wake, &writer->mutex, &deadline);
+            }
+            else{
+                pthread_cond_wait(&writer->wake, &writer->mutex);
+            }
+        }
+        atomic_store(&writer->parked, OUTPUT_WRITER_RUNNING);
+        stopping = writer->stopping;
+        pthread_mutex_unlock(&writer->mutex);
+
+        // the next record is reserved but still being copied in - its producer is a few instructions from done
+        if(more && gathered == start){
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+
+const char* output_writer_init(output_writer_t* writer, int fd){
+    if(!writer){
+        return "Invalid writer pointer";
+    }
+
+    writer->fd = fd;
+    atomic_init(&writer->reserved, 0);
+    atomic_init(&writer->released, 0);
+    atomic_init(&writer->flush_target, 0);
+    atomic_init(&writer->parked, OUTPUT_WRITER_RUNNING);
+    writer->stopping = 0;
+    writer->failed = 0;
+
+    // zeroed: every header reads EMPTY until its record is committed
+    writer->ring = calloc(1, OUTPUT_WRITER_RING_SIZE);
+    if(!writer->ring){
+        return "Failed to allocate output ring";
+    }
+
+    if(pthread_mutex_init(&writer->mutex, NULL) != 0){
+        free(writer->ring);
+        return "Failed to initialize mutex";
+    }
+
+    // the batch deadline is on the monotonic clock
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int initialized = pthread_cond_init(&writer->wake, &attr) == 0;
+    pthread_condattr_destroy(&attr);
+    if(!initialized){
+        pthread_mutex_destroy(&writer->mutex);
+        free(writer->ring);
+        return "Failed to initialize condition variable";
+    }
+    if(pthread_cond_init(&writer->progress, NULL) != 0){
+        pthread_cond_destroy(&writer->wake);
+        pthread_mutex_destroy(&writer->mutex);
+        free(writer->ring);
+        return "Failed to initialize condition variable";
+    }
+
+    if(pthread_create(&writer->thread, NULL, output_writer_thread, writer) != 0){
+        pthread_cond_destroy(&writer->progress);
+        pthread_cond_destroy(&writer->wake);
+        pthread_mutex_destroy(&writer->mutex);
+        free(writer->ring);
+        return "Failed to create writer thread";
+    }
+
+    return NULL;
+}
+
+
+int output_writer_destroy(output_writer_t* writer){
+    if(!writer){
+        return -1;
+    }
+
+    pthread_mutex_lock(&writer->mutex);
+    writer->stopping = 1;
+    pthread_cond_signal(&writer->wake);
+    pthread_mutex_unlock(&writer->mutex);
+    pthread_join(writer->thread, NULL);
+
+    pthread_cond_destroy(&writer->progress);
+    pthread_cond_destroy(&writer->wake);
+    pthread_mutex_destroy(&writer->mutex);
+    free(writer->ring);
+    return writer->failed ? -1 : 0;
+}
+
+
+int output_writer_append(output_writer_t* writer, const struct iovec* parts, int count){
+    size_t len = 0;
+    for(int i = 0; i < count; i++){
+        len += parts[i].iov_len;
+    }
+    if(len == 0){
+        return 0;
+    }
+    if(len > UINT32_MAX){
+        return -1;
+    }
+
+    // too big for the ring: the bytes go to the heap first, the ring only keeps the record's place
+    char* heap = NULL;
+    if(len > OUTPUT_WRITER_MAX_INLINE){
+        heap = malloc(len);
+        if(!heap){
+            return -1;
+        }
+    }
+
+    size_t size = sizeof(output_record_t) + (heap ? sizeof(char*) : OUTPUT_WRITER_ALIGN(len));
+    unsigned long position = output_writer_reserve(writer, size);
+    output_record_t* record = (output_record_t*)(writer->ring + (position & OUTPUT_WRITER_MASK));
+
+    char* cursor = heap ? heap : (char*)(record + 1);
+    for(int i = 0; i < count; i++){
+        memcpy(cursor, parts[i].iov_base, parts[i].iov_len);
+        cursor += parts[i].iov_len;
+    }
+    if(heap){
+        memcpy(record + 1, &heap, sizeof(char*));
+    }
+    record->len = (uint32_t)len;
+    atomic_store_explicit(&record->state, heap ? OUTPUT_RECORD_HEAP : OUTPUT_RECORD_INLINE, memory_order_release);
+
+    output_writer_notify(writer, position + size);
+    return 0;
+}
+
+
+void output_writer_flush(output_writer_t* writer){
+    // everything appended before this call is before this position (records still being copied in get waited for)
+    unsigned long target = atomic_load(&writer->reserved);
+    if(atomic_load(&writer->released) >= target){
+        return;
+    }
+
+    unsigned long current = atomic_load(&writer->flush_target);
+    while(current < target && !atomic_compare_exchange_weak(&writer->flush_target, &current, target)){
+    }
+
+    pthread_mutex_lock(&writer->mutex);
+    pthread_cond_signal(&writer->wake);
+    while(atomic_load(&writer->released) < target){
+        pthread_cond_wait(&writer->progress, &writer->mutex);
+    }
+    pthread_mutex_unlock(&writer->mutex);
+}
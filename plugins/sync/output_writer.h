@@ -0,0 +1,103 @@
+#ifndef OUTPUT_WRITER_H
+#define OUTPUT_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+/**
+ * output writer takes over a file descriptor for the sinks of the pipeline (logger, typewriter, log_info).
+ * sinks copy their records into one shared byte ring without taking a lock: a compare-and-swap reserves the space,
+ * the bytes are copied in, and the record's header is marked committed. a writer thread gathers committed records,
+ * in ring order, straight out of the ring into one writev(2): once a batch holds OUTPUT_WRITER_FLUSH_BYTES,
+ * once its oldest record waited OUTPUT_WRITER_FLUSH_USEC, or when someone asks for a flush.
+ *
+ * a thread's records are reserved one after the other, so they come out in the order it appended them,
+ * and a record is never split or interleaved. the writer is only woken when it sleeps with nothing queued
+ * or a threshold is crossed, so a busy sink makes no syscalls. records too big for the ring are copied to the heap,
+ * and the ring only holds a pointer to them.
+ **/
+
+// bytes in the ring (a power of two)
+#define OUTPUT_WRITER_RING_SIZE (4 * 1024 * 1024)
+// records longer than this go to the heap (the ring keeps their place)
+#define OUTPUT_WRITER_MAX_INLINE (OUTPUT_WRITER_RING_SIZE / 8)
+// a batch is written once it holds this many bytes ...
+#define OUTPUT_WRITER_FLUSH_BYTES (64 * 1024)
+// ... or its oldest record waited this long (microseconds)
+#define OUTPUT_WRITER_FLUSH_USEC 2000
+// records per writev(2) (IOV_MAX is at least 1024 on Linux)
+#define OUTPUT_WRITER_MAX_IOV 1024
+
+// what the writer thread is parked on
+#define OUTPUT_WRITER_RUNNING 0 // not parked
+#define OUTPUT_WRITER_IDLE 1 // nothing queued - the next record wakes it
+#define OUTPUT_WRITER_TIMED 2 // a batch is waiting for its time - only a full batch or a flush wakes it
+
+// state of a record's header in the ring
+#define OUTPUT_RECORD_EMPTY 0 // reserved, still being copied in (or free space)
+#define OUTPUT_RECORD_INLINE 1 // the bytes follow the header
+#define OUTPUT_RECORD_HEAP 2 // a pointer to a heap copy follows the header (the writer frees it)
+#define OUTPUT_RECORD_PAD 3 // skip to the end of the ring (a record didn't fit before it)
+
+/**
+ * Header in front of every record in the ring (records are 8-byte aligned)
+ */
+typedef struct
+{
+ uint32_t len; /* Bytes of the record (OUTPUT_RECORD_PAD: bytes to skip, header included) */
+ atomic_uint state; /* OUTPUT_RECORD_* - set last, when the record is complete */
+} output_record_t;
+
+/**
+ * Output writer structure
+ */
+typedef struct
+{
+ int fd; /* Output (not closed by the writer) */
+ pthread_t thread; /* Writer thread */
+ char* ring; /* OUTPUT_WRITER_RING_SIZE bytes */
+ atomic_ulong reserved; /* Ring position up to which producers reserved space (never wraps - taken modulo the size) */
+ atomic_ulong released; /* Ring position up to which records were written and their space given back */
+ atomic_ulong flush_target; /* Write everything before this position without waiting for a threshold */
+ atomic_int parked; /* OUTPUT_WRITER_* - what would wake the writer thread */
+ pthread_mutex_t mutex; /* Guards the fields below, and the writer's sleep */
+ pthread_cond_t wake; /* Wakes the writer thread */
+ pthread_cond_t progress; /* Broadcast after every write, for flush and for producers waiting for ring space */
+ int stopping; /* Set by output_writer_destroy */
+ int failed; /* A write failed - later records are dropped */
+} output_writer_t;
+
+/**
+ * Initialize an output writer and start its thread
+ * @param writer Pointer to writer structure
+ * @param fd File descriptor to write to
+ * @return NULL on success, error message on failure
+ */
+const char* output_writer_init(output_writer_t* writer, int fd);
+
+/**
+ * Write everything still queued, stop the writer thread and free its resources
+ * @param writer Pointer to writer structure
+ * @return 0 if everything was written, -1 if a write failed
+ */
+int output_writer_destroy(output_writer_t* writer);
+
+/**
+ * Append one record made of several parts (copied - any thread, only blocks while the ring is full)
+ * @param writer Pointer to writer structure
+ * @param parts The record's pieces, written back to back
+ * @param count Number of pieces
+ * @return 0 on success, -1 on allocation failure (only records too big for the ring allocate)
+ */
+int output_writer_append(output_writer_t* writer, const struct iovec* parts, int count);
+
+/**
+ * Return once every record appended before the call (by any thread) has been written
+ * @param writer Pointer to writer structure
+ */
+void output_writer_flush(output_writer_t* writer);
+
+#endif
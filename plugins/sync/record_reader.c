@@ -0,0 +1,275 @@
+#include <stdlib.h>    // malloc, realloc, free
+#include <string.h>    // memchr, memcpy
+#include <errno.h>     // EINTR
+#include <poll.h>      // poll
+#include <unistd.h>    // read, write, pipe, close
+#include <pthread.h>
+
+#include "record_reader.h"
+
+
+/**
+ * Reader thread: fill whichever block the consumer isn't holding, until end of input or destroy
+ * @param arg Pointer to reader structure
+ * @return NULL
+ */
+static void* record_reader_thread(void* arg){
+    record_reader_t* reader= (record_reader_t*)arg;
+
+    pthread_mutex_lock(&reader->mutex);
+    while(!reader->stopping){
+        int index= reader->fill_index;
+        while(reader->filled[index] && !reader->stopping){
+            pthread_cond_wait(&reader->changed, &reader->mutex);
+        }
+        if(reader->stopping){
+            break;
+        }
+        pthread_mutex_unlock(&reader->mutex);
+
+        // wait for input without blocking in read(2), so destroy can always wake us
+        struct pollfd fds[2]= { { reader->fd, POLLIN, 0 }, { reader->wake[0], POLLIN, 0 } };
+        ssize_t n= -1;
+        int polled= poll(fds, 2, -1);
+        if(polled < 0 && errno == EINTR){
+            pthread_mutex_lock(&reader->mutex);
+            continue;
+        }
+        if(polled > 0 && !(fds[1].revents & POLLIN)){
+            do{
+                n= read(reader->fd, reader->blocks[index], RECORD_READER_BLOCK_SIZE);
+            } while(n < 0 && errno == EINTR);
+        }
+
+        pthread_mutex_lock(&reader->mutex);
+        if(fds[1].revents & POLLIN){
+            break;
+        }
+        if(n <= 0){
+            reader->failed= n < 0;
+            break;
+        }
+        reader->lengths[index]= (size_t)n;
+        reader->filled[index]= 1;
+        reader->fill_index= 1 - index;
+        pthread_cond_broadcast(&reader->changed);
+    }
+
+    reader->eof= 1;
+    pthread_cond_broadcast(&reader->changed);
+    pthread_mutex_unlock(&reader->mutex);
+    return NULL;
+}
+
+
+const char* record_reader_init(record_reader_t* reader, int fd, char delimiter){
+    if(!reader){
+        return "Invalid reader pointer";
+    }
+
+    reader->fd= fd;
+    reader->delimiter= delimiter;
+    reader->lengths[0]= reader->lengths[1]= 0;
+    reader->filled[0]= reader->filled[1]= 0;
+    reader->fill_index= 0;
+    reader->eof= 0;
+    reader->failed= 0;
+    reader->stopping= 0;
+    reader->take_index= 0;
+    reader->holding= 0;
+    reader->cursor= reader->end= NULL;
+    reader->partial= NULL;
+    reader->partial_len= 0;
+    reader->partial_size= 0;
+    reader->buffers= NULL;
+    reader->buffer_alloc= NULL;
+
+    reader->blocks[0]= malloc(RECORD_READER_BLOCK_SIZE);
+    reader->blocks[1]= malloc(RECORD_READER_BLOCK_SIZE);
+    if(!reader->blocks[0] || !reader->blocks[1]){
+        free(reader->blocks[0]);
+        free(reader->blocks[1]);
+        return "Failed to allocate input blocks";
+    }
+
+    if(pipe(reader->wake) != 0){
+        free(reader->blocks[0]);
+        free(reader->blocks[1]);
+        return "Failed to create wake-up pipe";
+    }
+
+    if(pthread_mutex_init(&reader->mutex, NULL) != 0){
+        close(reader->wake[0]);
+        close(reader->wake[1]);
+        free(reader->blocks[0]);
+        free(reader->blocks[1]);
+        return "Failed to initialize mutex";
+    }
+    if(pthread_cond_init(&reader->changed, NULL) != 0){
+        pthread_mutex_destroy(&reader->mutex);
+        close(reader->wake[0]);
+        close(reader->wake[1]);
+        free(reader->blocks[0]);
+        free(reader->blocks[1]);
+        return "Failed to initialize condition variable";
+    }
+
+    if(pthread_create(&reader->thread, NULL, record_reader_thread, reader) != 0){
+        pthread_cond_destroy(&reader->changed);
+        pthread_mutex_destroy(&reader->mutex);
+        close(reader->wake[0]);
+        close(reader->wake[1]);
+        free(reader->blocks[0]);
+        free(reader->blocks[1]);
+        return "Failed to create reader thread";
+    }
+
+    return NULL;
+}
+
+
+void record_reader_set_buffers(record_reader_t* reader, void* buffers, char* (*alloc)(void* buffers, size_t size)){
+    reader->buffers= buffers;
+    reader->buffer_alloc= alloc;
+}
+
+
+void record_reader_destroy(record_reader_t* reader){
+    if(!reader){
+        return;
+    }
+
+    pthread_mutex_lock(&reader->mutex);
+    reader->stopping= 1;
+    pthread_cond_broadcast(&reader->changed);
+    pthread_mutex_unlock(&reader->mutex);
+
+    // the thread may be parked in poll(2) rather than on the condition
+    char wake= 1;
+    while(write(reader->wake[1], &wake, 1) < 0 && errno == EINTR){
+    }
+    pthread_join(reader->thread, NULL);
+
+    pthread_cond_destroy(&reader->changed);
+    pthread_mutex_destroy(&reader->mutex);
+    close(reader->wake[0]);
+    close(reader->wake[1]);
+    free(reader->blocks[0]);
+    free(reader->blocks[1]);
+    free(reader->partial);
+}
+
+
+/**
+ * Append bytes to the carried-over partial record
+ * @param reader Pointer to reader structure
+ * @param data Bytes to append
+ * @param len Number of bytes
+ * @return 0 on success, -1 on allocation failure
+ */
+static int record_reader_carry(record_reader_t* reader, const char* data, size_t len){
+    if(reader->partial_len + len + 1 > reader->partial_size){
+        size_t size= reader->partial_size ? reader->partial_size : 256;
+        while(size < reader->partial_len + len + 1){
+            size *= 2;
+        }
+        char* grown= realloc(reader->partial, size);
+        if(!grown){
+            return -1;
+        }
+        reader->partial= grown;
+        reader->partial_size= size;
+    }
+    memcpy(reader->partial + reader->partial_len, data, len);
+    reader->partial_len += len;
+    reader->partial[reader->partial_len]= '\0';
+    return 0;
+}
+
+
+/**
+ * Turn the carried-over bytes plus data into one record
+ * @param reader Pointer to reader structure
+ * @param data The record's last bytes
+ * @param len Number of bytes
+ * @return Heap-allocated record, or NULL on allocation failure (the carried-over bytes are dropped either way)
+ */
+static char* record_reader_finish(record_reader_t* reader, const char* data, size_t len){
+    // common case: the whole record is in this block - one exact allocation
+    if(reader->partial_len == 0){
+        char* record= reader->buffer_alloc ? reader->buffer_alloc(reader->buffers, len + 1) : malloc(len + 1);
+        if(record){
+            memcpy(record, data, len);
+            record[len]= '\0';
+        }
+        return record;
+    }
+
+    // the carry buffer itself becomes the record
+    char* record= NULL;
+    if(record_reader_carry(reader, data, len) == 0){
+        record= reader->partial;
+        reader->partial= NULL;
+        reader->partial_size= 0;
+    }
+    reader->partial_len= 0;
+    return record;
+}
+
+
+int record_reader_next(record_reader_t* reader, char** record, size_t* len){
+    for(;;){
+        if(reader->holding){
+            const char* found= memchr(reader->cursor, reader->delimiter, reader->end - reader->cursor);
+            if(found){
+                if(len){
+                    *len= reader->partial_len + (found - reader->cursor);
+                }
+                *record= record_reader_finish(reader, reader->cursor, found - reader->cursor);
+                reader->cursor= found + 1;
+                return *record ? 1 : -1;
+            }
+
+            // the record goes on in the next block - keep its start and give this block back to the reader thread
+            int carried= record_reader_carry(reader, reader->cursor, reader->end - reader->cursor);
+            pthread_mutex_lock(&reader->mutex);
+            reader->filled[reader->take_index]= 0;
+            reader->take_index= 1 - reader->take_index;
+            pthread_cond_broadcast(&reader->changed);
+            pthread_mutex_unlock(&reader->mutex);
+            reader->holding= 0;
+            if(carried != 0){
+                reader->partial_len= 0;
+                return -1;
+            }
+        }
+
+        pthread_mutex_lock(&reader->mutex);
+        while(!reader->filled[reader->take_index] && !reader->eof){
+            pthread_cond_wait(&reader->changed, &reader->mutex);
+        }
+        int filled= reader->filled[reader->take_index];
+        // a read failure is reported once, after the last record
+        int failed= !filled && reader->partial_len == 0 && reader->failed;
+        if(failed){
+            reader->failed= 0;
+        }
+        pthread_mutex_unlock(&reader->mutex);
+
+        if(!filled){
+            // end of input: whatever was carried over is the last record
+            if(reader->partial_len > 0){
+                if(len){
+                    *len= reader->partial_len;
+                }
+                *record= record_reader_finish(reader, "", 0);
+                return *record ? 1 : -1;
+            }
+            return failed ? -1 : 0;
+        }
+
+        reader->cursor= reader->blocks[reader->take_index];
+        reader->end= reader->cursor + reader->lengths[reader->take_index];
+        reader->holding= 1;
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef RECORD_READER_H
+#define RECORD_READER_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/**
+ * record reader splits a file descriptor into delimiter-terminated records of any length.
+ * a reader thread read(2)s the input in large blocks into two buffers, so the next block is already being read
+ * while the caller splits the current one (memchr finds the delimiters, a whole block at a time).
+ * a record that runs past the end of a block is carried over, so records have no length limit.
+ *
+ * the thread waits on poll(2) together with a wake-up pipe, so destroy doesn't hang on an input that is still open.
+ **/
+
+// bytes per read(2)
+#define RECORD_READER_BLOCK_SIZE (256 * 1024)
+
+/**
+ * Record reader structure
+ */
+typedef struct
+{
+ int fd; /* Input */
+ char delimiter; /* Record terminator (not part of the record) */
+ pthread_t thread; /* Reader thread */
+ int wake[2]; /* Pipe that wakes the reader thread out of poll(2) */
+ pthread_mutex_t mutex; /* Guards the fields below, up to the consumer's own state */
+ pthread_cond_t changed; /* Signaled when a block is filled or released, or on end of input */
+ char* blocks[2]; /* Double buffer: one is read into while the consumer splits the other */
+ size_t lengths[2]; /* Bytes held by each block */
+ int filled[2]; /* Block holds input the consumer hasn't taken yet */
+ int fill_index; /* Block the reader thread fills next */
+ int eof; /* No more blocks will be filled (end of input, read error, or stopping) */
+ int failed; /* read(2) failed */
+ int stopping; /* Set by record_reader_destroy */
+ /* consumer's own state (not guarded) */
+ int take_index; /* Block the consumer splits next */
+ int holding; /* Consumer is splitting blocks[take_index] */
+ const char* cursor; /* Start of the unsplit part of the held block */
+ const char* end; /* End of the held block */
+ char* partial; /* Start of a record carried over from earlier blocks */
+ size_t partial_len; /* Its length */
+ size_t partial_size; /* Its buffer's size */
+ void* buffers; /* Allocator records come from (NULL: malloc) */
+ char* (*buffer_alloc)(void* buffers, size_t size); /* Its allocation function */
+} record_reader_t;
+
+/**
+ * Initialize a record reader and start its reader thread
+ * @param reader Pointer to reader structure
+ * @param fd File descriptor to read (not closed by the reader)
+ * @param delimiter Record terminator
+ * @return NULL on success, error message on failure
+ */
+const char* record_reader_init(record_reader_t* reader, int fd, char delimiter);
+
+/**
+ * Allocate records from an allocator instead of malloc (a record carried over from earlier blocks stays malloc'd -
+ * whatever frees records has to take both)
+ * @param reader Pointer to reader structure
+ * @param buffers The allocator, passed to alloc
+ * @param alloc Returns a buffer of at least size bytes, NULL on failure
+ */
+void record_reader_set_buffers(record_reader_t* reader, void* buffers, char* (*alloc)(void* buffers, size_t size));
+
+/**
+ * Stop the reader thread and free the reader's resources (input not read yet stays unread)
+ * @param reader Pointer to reader structure
+ */
+void record_reader_destroy(record_reader_t* reader);
+
+/**
+ * Take the next record (blocks until it is complete or the input ends)
+ * The last record may be missing its delimiter, like the last line of a file.
+ * @param reader Pointer to reader structure
+ * @param record Output - heap-allocated, null-terminated record without its delimiter (caller frees)
+ * @param len Output - number of chars in the record (may be NULL)
+ * @return 1 if a record was returned, 0 at end of input, -1 on a read or allocation failure
+ */
+int record_reader_next(record_reader_t* reader, char** record, size_t* len);
+
+#endif
@@ -0,0 +1,480 @@
+#include <stdlib.h>   // malloc, free
+#include <string.h>   // memcpy, strlen
+
+#include "record_ring.h"
+
+// what follows a header
+#define RECORD_RING_INLINE 0 // the chars themselves
+#define RECORD_RING_OUT_OF_LINE 1 // a pointer to a heap string and its length
+#define RECORD_RING_SKIP 2 // nothing - the record after it is at the start of the buffer
+
+
+/**
+ * Bytes a record takes up in the ring
+ * @param kind RECORD_RING_INLINE or RECORD_RING_OUT_OF_LINE
+ * @param len Number of chars
+ * @return Header and payload, rounded up to RECORD_RING_ALIGN
+ */
+static size_t record_ring_span(uint32_t kind, size_t len){
+    size_t payload = kind == RECORD_RING_INLINE ? len + 1 : sizeof(char*) + sizeof(size_t);
+    return sizeof(record_ring_header_t) + (payload + RECORD_RING_ALIGN - 1) / RECORD_RING_ALIGN * RECORD_RING_ALIGN;
+}
+
+
+/**
+ * Is a string short enough to be stored inline
+ * @param ring Pointer to ring structure
+ * @param len Number of chars
+ * @return 1 if so, 0 if it has to be kept out of line
+ */
+static int record_ring_fits_inline(const record_ring_t* ring, size_t len){
+    return len < UINT32_MAX && record_ring_span(RECORD_RING_INLINE, len) <= ring->capacity / 4;
+}
+
+
+const char* record_ring_init(record_ring_t* ring, size_t capacity){
+    if(capacity < RECORD_RING_MIN_CAPACITY){
+        return "record ring capacity is too small";
+    }
+
+    ring->capacity = (capacity + RECORD_RING_ALIGN - 1) / RECORD_RING_ALIGN * RECORD_RING_ALIGN;
+    ring->bytes = malloc(ring->capacity);
+    if(ring->bytes == NULL){
+        return "failed to allocate memory for record ring";
+    }
+    ring->head = 0;
+    ring->read = 0;
+    ring->tail = 0;
+    ring->used = 0;
+    ring->count = 0;
+    ring->taken = 0;
+    ring->buffers = NULL;
+    ring->buffer_alloc = NULL;
+    ring->buffer_release = NULL;
+
+    if(eventcount_init(&ring->not_full_event) != 0){
+        free(ring->bytes);
+        return "failed initializing not_full_event";
+    }
+    if(eventcount_init(&ring->not_empty_event) != 0){
+        eventcount_destroy(&ring->not_full_event);
+        free(ring->bytes);
+        return "failed initializing not_empty_event";
+    }
+    if(pthread_mutex_init(&ring->mutex, NULL) != 0){
+        eventcount_destroy(&ring->not_full_event);
+        eventcount_destroy(&ring->not_empty_event);
+        free(ring->bytes);
+        return "failed initializing mutex";
+    }
+    return NULL;
+}
+
+
+void record_ring_set_buffers(record_ring_t* ring, void* buffers,
+                             char* (*alloc)(void* buffers, size_t size), void (*release)(void* buffers, char* item)){
+    ring->buffers = buffers;
+    ring->buffer_alloc = alloc;
+    ring->buffer_release = release;
+}
+
+
+/**
+ * Give back a string the ring owns
+ * @param ring Pointer to ring structure
+ * @param item Heap-allocated string
+ */
+static void record_ring_free(record_ring_t* ring, char* item){
+    if(ring->buffer_release != NULL){
+        ring->buffer_release(ring->buffers, item);
+        return;
+    }
+    free(item);
+}
+
+
+void record_ring_destroy(record_ring_t* ring){
+    if(ring == NULL || ring->bytes == NULL){
+        return;
+    }
+
+    // every record from the oldest one not released on, taken or not - only the out-of-line ones hold anything
+    size_t at = ring->head;
+    size_t left = ring->used;
+    while(left > 0){
+        const record_ring_header_t* header = (const record_ring_header_t*)(ring->bytes + at);
+        if(header->kind == RECORD_RING_SKIP){
+            left -= ring->capacity - at;
+            at = 0;
+            continue;
+        }
+        if(header->kind == RECORD_RING_OUT_OF_LINE){
+            char* item;
+            memcpy(&item, header + 1, sizeof(char*));
+            record_ring_free(ring, item);
+        }
+        size_t span = record_ring_span(header->kind, header->len);
+        at = (at + span) % ring->capacity;
+        left -= span;
+    }
+
+    pthread_mutex_destroy(&ring->mutex);
+    eventcount_destroy(&ring->not_full_event);
+    eventcount_destroy(&ring->not_empty_event);
+    free(ring->bytes);
+    ring->bytes = NULL;
+}
+
+
+/**
+ * Length of a string to put - counted only when its meta doesn't know it
+ * @param item The string
+ * @param meta What it carries (may be NULL)
+ * @return Number of chars
+ */
+static size_t record_ring_len(const char* item, const item_meta_t* meta){
+    if(meta != NULL && meta->len != ITEM_META_LEN_UNKNOWN){
+        return meta->len;
+    }
+    return strlen(item);
+}
+
+
+/**
+ * Claim room for a record at the tail (lock held) - a skip marker takes what is left before the end if it doesn't fit there
+ * @param ring Pointer to ring structure
+ * @param span Bytes the record takes up
+ * @return Where to write it, or NULL if there is no room right now
+ */
+static char* record_ring_reserve(record_ring_t* ring, size_t span){
+    size_t to_end = ring->capacity - ring->tail;
+    size_t needed = span <= to_end ? span : to_end + span;
+    if(ring->used + needed > ring->capacity){
+        return NULL;
+    }
+
+    if(span > to_end){
+        // tail is aligned and short of the end, so there is always room for the marker's header
+        record_ring_header_t* marker = (record_ring_header_t*)(ring->bytes + ring->tail);
+        marker->len = 0;
+        marker->kind = RECORD_RING_SKIP;
+        ring->used += to_end;
+        ring->tail = 0;
+    }
+
+    char* at = ring->bytes + ring->tail;
+    ring->tail = (ring->tail + span) % ring->capacity;
+    ring->used += span;
+    return at;
+}
+
+
+/**
+ * Claim room for a record at the tail, waiting for the consumer to release enough (lock held, dropped while waiting)
+ * @param ring Pointer to ring structure
+ * @param span Bytes the record takes up
+ * @return Where to write it
+ */
+static char* record_ring_wait_reserve(record_ring_t* ring, size_t span){
+    char* at;
+    while((at = record_ring_reserve(ring, span)) == NULL){
+        // register while still holding the lock, so a release after we unlock can't be missed
+        unsigned int key = eventcount_prepare_wait(&ring->not_full_event);
+        pthread_mutex_unlock(&ring->mutex);
+        eventcount_wait(&ring->not_full_event, key);
+        pthread_mutex_lock(&ring->mutex);
+    }
+    return at;
+}
+
+
+/**
+ * Write a record into room claimed for it
+ * @param at Where (from record_ring_reserve)
+ * @param kind RECORD_RING_INLINE or RECORD_RING_OUT_OF_LINE
+ * @param item The string (copied when inline, else its pointer is kept)
+ * @param len Number of chars
+ * @param meta What it carries (NULL: nothing known)
+ */
+static void record_ring_write(char* at, uint32_t kind, const char* item, size_t len, const item_meta_t* meta){
+    record_ring_header_t* header = (record_ring_header_t*)at;
+    header->kind = kind;
+    header->seq = meta != NULL ? meta->seq : 0;
+    header->ingest_ns = meta != NULL ? meta->ingest_ns : 0;
+    if(kind == RECORD_RING_INLINE){
+        header->len = (uint32_t)len;
+        memcpy(header + 1, item, len + 1);
+        return;
+    }
+    header->len = 0;
+    memcpy(header + 1, &item, sizeof(char*));
+    memcpy((char*)(header + 1) + sizeof(char*), &len, sizeof(size_t));
+}
+
+
+/**
+ * Add a record, blocking while there is no room
+ * @param ring Pointer to ring structure
+ * @param kind RECORD_RING_INLINE or RECORD_RING_OUT_OF_LINE
+ * @param item The string
+ * @param len Number of chars
+ * @param meta What it carries (NULL: nothing known)
+ */
+static void record_ring_add(record_ring_t* ring, uint32_t kind, const char* item, size_t len, const item_meta_t* meta){
+    pthread_mutex_lock(&ring->mutex);
+    // the copy is made under the lock - inline records are short, and it saves a second pass to publish them
+    record_ring_write(record_ring_wait_reserve(ring, record_ring_span(kind, len)), kind, item, len, meta);
+    ring->count++;
+    pthread_mutex_unlock(&ring->mutex);
+    eventcount_notify(&ring->not_empty_event);
+}
+
+
+int record_ring_put(record_ring_t* ring, const char* item, const item_meta_t* meta){
+    size_t len = record_ring_len(item, meta);
+    if(record_ring_fits_inline(ring, len)){
+        record_ring_add(ring, RECORD_RING_INLINE, item, len, meta);
+        return 0;
+    }
+
+    char* copy = ring->buffer_alloc != NULL ? ring->buffer_alloc(ring->buffers, len + 1) : malloc(len + 1);
+    if(copy == NULL){
+        return -1;
+    }
+    memcpy(copy, item, len + 1);
+    record_ring_add(ring, RECORD_RING_OUT_OF_LINE, copy, len, meta);
+    return 0;
+}
+
+
+void record_ring_put_owned(record_ring_t* ring, char* item, const item_meta_t* meta){
+    size_t len = record_ring_len(item, meta);
+    if(record_ring_fits_inline(ring, len)){
+        record_ring_add(ring, RECORD_RING_INLINE, item, len, meta);
+        record_ring_free(ring, item);
+        return;
+    }
+    record_ring_add(ring, RECORD_RING_OUT_OF_LINE, item, len, meta);
+}
+
+
+void record_ring_put_many_owned(record_ring_t* ring, char* const* items, const item_meta_t* metas, int count){
+    int added = 0;
+    while(added < count){
+        pthread_mutex_lock(&ring->mutex);
+        // the first one of a run waits for room, the rest go in while there is some
+        int first = added;
+        do{
+            const item_meta_t* meta = metas != NULL ? &metas[added] : NULL;
+            size_t len = record_ring_len(items[added], meta);
+            uint32_t kind = record_ring_fits_inline(ring, len) ? RECORD_RING_INLINE : RECORD_RING_OUT_OF_LINE;
+            size_t span = record_ring_span(kind, len);
+            char* at = added == first ? record_ring_wait_reserve(ring, span) : record_ring_reserve(ring, span);
+            if(at == NULL){
+                break;
+            }
+            record_ring_write(at, kind, items[added], len, meta);
+            ring->count++;
+            // copied, so not needed any more (once the lock is dropped an out-of-line one may be gone already)
+            if(kind == RECORD_RING_INLINE){
+                record_ring_free(ring, items[added]);
+            }
+            added++;
+        } while(added < count);
+        pthread_mutex_unlock(&ring->mutex);
+        eventcount_notify(&ring->not_empty_event);
+    }
+}
+
+
+int record_ring_try_put_owned(record_ring_t* ring, char* item, const item_meta_t* meta){
+    size_t len = record_ring_len(item, meta);
+    uint32_t kind = record_ring_fits_inline(ring, len) ? RECORD_RING_INLINE : RECORD_RING_OUT_OF_LINE;
+
+    pthread_mutex_lock(&ring->mutex);
+    char* at = record_ring_reserve(ring, record_ring_span(kind, len));
+    if(at == NULL){
+        pthread_mutex_unlock(&ring->mutex);
+        return 0;
+    }
+    record_ring_write(at, kind, item, len, meta);
+    ring->count++;
+    pthread_mutex_unlock(&ring->mutex);
+    eventcount_notify(&ring->not_empty_event);
+
+    if(kind == RECORD_RING_INLINE){
+        record_ring_free(ring, item);
+    }
+    return 1;
+}
+
+
+/**
+ * Hand out the next record (lock held, count > 0)
+ * @param ring Pointer to ring structure
+ * @param view Output - the record
+ */
+static void record_ring_take(record_ring_t* ring, record_ring_view_t* view){
+    record_ring_header_t* header = (record_ring_header_t*)(ring->bytes + ring->read);
+    if(header->kind == RECORD_RING_SKIP){
+        ring->read = 0;
+        header = (record_ring_header_t*)ring->bytes;
+    }
+
+    if(header->kind == RECORD_RING_INLINE){
+        view->data = (char*)(header + 1);
+        view->len = header->len;
+    }
+    else{
+        memcpy(&view->data, header + 1, sizeof(char*));
+        memcpy(&view->len, (char*)(header + 1) + sizeof(char*), sizeof(size_t));
+    }
+    view->seq = header->seq;
+    view->ingest_ns = header->ingest_ns;
+    ring->read = (ring->read + record_ring_span(header->kind, header->len)) % ring->capacity;
+    ring->count--;
+    ring->taken++;
+}
+
+
+void record_ring_get(record_ring_t* ring, record_ring_view_t* view){
+    record_ring_get_many(ring, view, 1);
+}
+
+
+int record_ring_try_get(record_ring_t* ring, record_ring_view_t* view){
+    return record_ring_try_get_many(ring, view, 1);
+}
+
+
+int record_ring_try_get_many(record_ring_t* ring, record_ring_view_t* views, int max){
+    pthread_mutex_lock(&ring->mutex);
+    int n = 0;
+    while(n < max && ring->count > 0){
+        record_ring_take(ring, &views[n++]);
+    }
+    pthread_mutex_unlock(&ring->mutex);
+    return n;
+}
+
+
+int record_ring_get_many(record_ring_t* ring, record_ring_view_t* views, int max){
+    pthread_mutex_lock(&ring->mutex);
+    while(ring->count == 0){
+        unsigned int key = eventcount_prepare_wait(&ring->not_empty_event);
+        pthread_mutex_unlock(&ring->mutex);
+        eventcount_wait(&ring->not_empty_event, key);
+        pthread_mutex_lock(&ring->mutex);
+    }
+
+    int n = 0;
+    while(n < max && ring->count > 0){
+        record_ring_take(ring, &views[n++]);
+    }
+    pthread_mutex_unlock(&ring->mutex);
+    return n;
+}
+
+
+/**
+ * Is data the oldest record taken and not given back yet (lock held)
+ * @param ring Pointer to ring structure
+ * @param data A view's data
+ * @return 1 if so, 0 otherwise
+ */
+static int record_ring_is_oldest(record_ring_t* ring, const char* data){
+    if(ring->taken == 0){
+        return 0;
+    }
+    size_t at = ring->head;
+    const record_ring_header_t* header = (const record_ring_header_t*)(ring->bytes + at);
+    if(header->kind == RECORD_RING_SKIP){
+        header = (const record_ring_header_t*)ring->bytes;
+    }
+    if(header->kind == RECORD_RING_INLINE){
+        return data == (const char*)(header + 1);
+    }
+    const char* item;
+    memcpy(&item, header + 1, sizeof(char*));
+    return data == item;
+}
+
+
+/**
+ * Give back the count oldest records taken (lock held, count <= taken)
+ * @param ring Pointer to ring structure
+ * @param count Number of records
+ */
+static void record_ring_drop(record_ring_t* ring, int count){
+    for(int i = 0; i < count; i++){
+        const record_ring_header_t* header = (const record_ring_header_t*)(ring->bytes + ring->head);
+        if(header->kind == RECORD_RING_SKIP){
+            ring->used -= ring->capacity - ring->head;
+            ring->head = 0;
+            header = (const record_ring_header_t*)ring->bytes;
+        }
+        if(header->kind == RECORD_RING_OUT_OF_LINE){
+            char* item;
+            memcpy(&item, header + 1, sizeof(char*));
+            record_ring_free(ring, item);
+        }
+        size_t span = record_ring_span(header->kind, header->len);
+        ring->head = (ring->head + span) % ring->capacity;
+        ring->used -= span;
+    }
+    ring->taken -= count;
+
+    // empty: start over at the front, so the next records don't wrap for nothing
+    if(ring->used == 0){
+        ring->head = 0;
+        ring->read = 0;
+        ring->tail = 0;
+    }
+}
+
+
+/**
+ * Wake producers once the ring is no more than half full (lock held - dropped here)
+ * A producer only waits while it is fuller than that: with half of it free any record fits (inline ones take at most
+ * a quarter, even after a skip marker), so producers are woken once then instead of once per record given back.
+ * @param ring Pointer to ring structure
+ */
+static void record_ring_unlock_released(record_ring_t* ring){
+    int wake = ring->used <= ring->capacity / 2;
+    pthread_mutex_unlock(&ring->mutex);
+    if(wake){
+        eventcount_notify(&ring->not_full_event);
+    }
+}
+
+
+int record_ring_release(record_ring_t* ring, const char* data){
+    pthread_mutex_lock(&ring->mutex);
+    if(!record_ring_is_oldest(ring, data)){
+        pthread_mutex_unlock(&ring->mutex);
+        return -1;
+    }
+    record_ring_drop(ring, 1);
+    record_ring_unlock_released(ring);
+    return 0;
+}
+
+
+int record_ring_release_many(record_ring_t* ring, int count){
+    pthread_mutex_lock(&ring->mutex);
+    if(count < 0 || count > ring->taken){
+        pthread_mutex_unlock(&ring->mutex);
+        return -1;
+    }
+    record_ring_drop(ring, count);
+    record_ring_unlock_released(ring);
+    return 0;
+}
+
+
+int record_ring_count(record_ring_t* ring){
+    pthread_mutex_lock(&ring->mutex);
+    int count = ring->count;
+    pthread_mutex_unlock(&ring->mutex);
+    return count;
+}
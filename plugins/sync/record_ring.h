@@ -0,0 +1,192 @@
+#ifndef RECORD_RING_H
+#define RECORD_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "eventcount.h"
+#include "item_meta.h"
+
+/**
+ * record ring is a bounded queue of strings stored inline: each record is a small header (its length and the rest of
+ * its item meta) followed by its chars
+ * (null-terminated), back to back in one byte buffer whose capacity is given in bytes. a producer copies a string in,
+ * the consumer gets a view - a pointer and a length into the ring itself - and releases it once it is done with it.
+ * - short records cost no allocation at all, and consecutive records sit next to each other in memory, so the
+ *   consumer walks the ring the way the prefetcher expects instead of chasing one pointer per item
+ * - a record never wraps: when it doesn't fit before the end of the buffer, a skip marker fills the rest and the
+ *   record goes to the start
+ * - a record longer than a quarter of the ring would block everything behind it - it is kept out of line instead
+ *   (a heap string, the ring only holds the pointer), so the view looks the same either way
+ *
+ * any number of producers, ONE consumer: views are released in the order they were taken, which frees their bytes.
+ **/
+
+// every record starts on this boundary (the header and the out-of-line pointer are read in place)
+#define RECORD_RING_ALIGN 8
+
+// smallest ring accepted
+#define RECORD_RING_MIN_CAPACITY 256
+
+/**
+ * A record as the consumer sees it (valid until it is released)
+ */
+typedef struct
+{
+ char* data; /* The chars, null-terminated */
+ size_t len; /* Number of chars */
+ unsigned long seq; /* The record's item meta, as it was put */
+ unsigned long long ingest_ns;
+} record_ring_view_t;
+
+/**
+ * What comes before every record's chars
+ */
+typedef struct
+{
+ uint32_t len; /* Number of chars (inline records only) */
+ uint32_t kind; /* Inline, out of line or skip marker */
+ unsigned long seq; /* The record's item meta (its len is the one above, or the out-of-line one) */
+ unsigned long long ingest_ns;
+} record_ring_header_t;
+
+/**
+ * Record ring structure
+ */
+typedef struct
+{
+ char* bytes; /* The records */
+ size_t capacity; /* Size of bytes */
+ size_t head; /* Oldest record not released yet */
+ size_t read; /* Next record to hand out */
+ size_t tail; /* Where the next record is written */
+ size_t used; /* Bytes between head and tail, skip markers included */
+ int count; /* Records not handed out yet */
+ int taken; /* Records handed out and not released yet */
+ pthread_mutex_t mutex; /* Guards the fields above */
+ eventcount_t not_full_event; /* Parks producers waiting for room */
+ eventcount_t not_empty_event; /* Parks the consumer waiting for a record */
+ void* buffers; /* Allocator out-of-line records come from (NULL: malloc and free) */
+ char* (*buffer_alloc)(void* buffers, size_t size); /* Its allocation function */
+ void (*buffer_release)(void* buffers, char* item); /* Its release function - also gets the owned strings put copied */
+} record_ring_t;
+
+/**
+ * Initialize a ring
+ * @param ring Pointer to ring structure
+ * @param capacity Size of the ring in bytes, headers included (rounded up to RECORD_RING_ALIGN)
+ * @return NULL on success, error message on failure
+ */
+const char* record_ring_init(record_ring_t* ring, size_t capacity);
+
+/**
+ * Make out-of-line records come from an allocator, and owned strings go back through it
+ * @param ring Pointer to ring structure (initialized, not used yet)
+ * @param buffers The allocator, passed to both functions
+ * @param alloc Returns a buffer of at least size bytes, NULL on failure
+ * @param release Gives back a string - one of alloc's or any owned string handed to the ring
+ */
+void record_ring_set_buffers(record_ring_t* ring, void* buffers,
+                             char* (*alloc)(void* buffers, size_t size), void (*release)(void* buffers, char* item));
+
+/**
+ * Destroy a ring (out-of-line records still inside are released)
+ * @param ring Pointer to ring structure
+ */
+void record_ring_destroy(record_ring_t* ring);
+
+/**
+ * Copy a string in, blocking while there is no room (any producer)
+ * @param ring Pointer to ring structure
+ * @param item The string (the caller keeps it)
+ * @param meta What it carries (NULL: nothing known - a known len saves counting it)
+ * @return 0 on success, -1 on allocation failure
+ */
+int record_ring_put(record_ring_t* ring, const char* item, const item_meta_t* meta);
+
+/**
+ * Hand a heap string over, blocking while there is no room (any producer)
+ * Short strings are copied in and released at once, long ones are kept as they are.
+ * @param ring Pointer to ring structure
+ * @param item Heap-allocated string (the ring takes ownership)
+ * @param meta What it carries (NULL: nothing known - a known len saves counting it)
+ */
+void record_ring_put_owned(record_ring_t* ring, char* item, const item_meta_t* meta);
+
+/**
+ * Hand several heap strings over, with one lock acquisition and one wakeup per run that fits (any producer)
+ * Blocks while there is no room; returns once every string was added.
+ * @param ring Pointer to ring structure
+ * @param items Heap-allocated strings (the ring takes ownership of every one)
+ * @param metas What each one carries (NULL: nothing known)
+ * @param count Number of strings
+ */
+void record_ring_put_many_owned(record_ring_t* ring, char* const* items, const item_meta_t* metas, int count);
+
+/**
+ * Hand a heap string over without blocking (any producer)
+ * @param ring Pointer to ring structure
+ * @param item Heap-allocated string (the ring takes ownership only if it was added)
+ * @param meta What it carries (NULL: nothing known)
+ * @return 1 if the string was added, 0 if there is no room
+ */
+int record_ring_try_put_owned(record_ring_t* ring, char* item, const item_meta_t* meta);
+
+/**
+ * Take the next record, blocking while there is none (consumer only)
+ * @param ring Pointer to ring structure
+ * @param view Output - the record
+ */
+void record_ring_get(record_ring_t* ring, record_ring_view_t* view);
+
+/**
+ * Take the next record without blocking (consumer only)
+ * @param ring Pointer to ring structure
+ * @param view Output - the record
+ * @return 1 if a record was taken, 0 if there is none
+ */
+int record_ring_try_get(record_ring_t* ring, record_ring_view_t* view);
+
+/**
+ * Take up to max records without blocking (consumer only)
+ * @param ring Pointer to ring structure
+ * @param views Output array of at least max entries
+ * @param max Maximum number of records to take
+ * @return Number of records taken, 0 if there is none
+ */
+int record_ring_try_get_many(record_ring_t* ring, record_ring_view_t* views, int max);
+
+/**
+ * Take between 1 and max records, blocking while there is none (consumer only)
+ * @param ring Pointer to ring structure
+ * @param views Output array of at least max entries
+ * @param max Maximum number of records to take
+ * @return Number of records taken (at least 1)
+ */
+int record_ring_get_many(record_ring_t* ring, record_ring_view_t* views, int max);
+
+/**
+ * Give back the oldest record taken and not given back yet - its bytes are free for producers again
+ * @param ring Pointer to ring structure
+ * @param data That record's data (checked - views must be released in the order they were taken)
+ * @return 0 on success, -1 if data isn't the oldest view
+ */
+int record_ring_release(record_ring_t* ring, const char* data);
+
+/**
+ * Give back the count oldest records taken and not given back yet, with one lock acquisition (e.g. a whole batch)
+ * @param ring Pointer to ring structure
+ * @param count Number of records
+ * @return 0 on success, -1 if fewer than count are taken
+ */
+int record_ring_release_many(record_ring_t* ring, int count);
+
+/**
+ * Number of records not taken yet (a snapshot - may be stale as soon as it returns)
+ * @param ring Pointer to ring structure
+ * @return Number of records
+ */
+int record_ring_count(record_ring_t* ring);
+
+#endif
@@ -0,0 +1,134 @@
+#include <stdlib.h>    // malloc, free
+#include <pthread.h>
+
+#include "reorder_buffer.h"
+
+
+/**
+ * Initialize a reorder buffer
+ * @param buffer Pointer to reorder buffer structure
+ * @param window Maximum number of sequences that can be buffered ahead of the next one
+ * @return NULL on success, error message on failure
+ */
+const char* reorder_buffer_init(reorder_buffer_t* buffer, int window){
+    // error: can't be NULL
+    if(!buffer){
+        return "Reorder buffer pointer is NULL";
+    }
+
+    // error: invalid window
+    if(window<=0){
+        return "window must be positive";
+    }
+
+    buffer->window= window;
+    buffer->next_sequence= 0;
+    buffer->delivering= 0;
+
+    buffer->slots= calloc(window, sizeof(char*));
+    buffer->metas= malloc(window * sizeof(item_meta_t));
+    buffer->ready= calloc(window, sizeof(unsigned char));
+    if(!buffer->slots || !buffer->metas || !buffer->ready){
+        free(buffer->slots);
+        free(buffer->metas);
+        free(buffer->ready);
+        return "failed to allocate memory for reorder slots";
+    }
+
+    if(pthread_mutex_init(&buffer->mutex, NULL)!=0){
+        free(buffer->slots);
+        free(buffer->metas);
+        free(buffer->ready);
+        return "failed initializing reorder mutex";
+    }
+
+    if(pthread_cond_init(&buffer->window_condition, NULL)!=0){
+        pthread_mutex_destroy(&buffer->mutex);
+        free(buffer->slots);
+        free(buffer->metas);
+        free(buffer->ready);
+        return "failed initializing reorder condition";
+    }
+
+    // on success
+    return NULL;
+}
+
+
+/**
+ * Destroy a reorder buffer and free any items still inside it
+ * @param buffer Pointer to reorder buffer structure
+ */
+void reorder_buffer_destroy(reorder_buffer_t* buffer){
+    if(!buffer){
+        return;
+    }
+
+    if(buffer->slots){
+        for(int i=0; i<buffer->window; i++){
+            free(buffer->slots[i]);
+        }
+        free(buffer->slots);
+        buffer->slots= NULL;
+    }
+    free(buffer->metas);
+    buffer->metas= NULL;
+    free(buffer->ready);
+    buffer->ready= NULL;
+
+    pthread_mutex_destroy(&buffer->mutex);
+    pthread_cond_destroy(&buffer->window_condition);
+}
+
+
+/**
+ * Hand in the result for one sequence and deliver everything that is now in order
+ * Blocks while sequence is window or more ahead of the next sequence to deliver.
+ * @param buffer Pointer to reorder buffer structure
+ * @param sequence Sequence number of the item (every sequence must be put exactly once)
+ * @param item Result (ownership passes to deliver), or NULL to just mark the sequence as done
+ * @param meta What the result carries, handed to deliver with it (NULL: nothing known)
+ * @param deliver Called in sequence order, outside the buffer's lock, with every non-NULL item
+ * @param arg Passed to deliver
+ */
+void reorder_buffer_put(reorder_buffer_t* buffer, unsigned long sequence, char* item, const item_meta_t* meta,
+                        void (*deliver)(void* arg, char* item, const item_meta_t* meta), void* arg){
+    pthread_mutex_lock(&buffer->mutex);
+
+    // too far ahead: wait for the slow worker that holds next_sequence (it never waits here itself)
+    while(sequence >= buffer->next_sequence + (unsigned long)buffer->window){
+        pthread_cond_wait(&buffer->window_condition, &buffer->mutex);
+    }
+
+    int slot= (int)(sequence % (unsigned long)buffer->window);
+    buffer->slots[slot]= item;
+    buffer->metas[slot]= meta ? *meta : ITEM_META_UNKNOWN;
+    buffer->ready[slot]= 1;
+
+    // somebody else is already releasing items - it will pick ours up if it's next
+    if(buffer->delivering){
+        pthread_mutex_unlock(&buffer->mutex);
+        return;
+    }
+
+    buffer->delivering= 1;
+    while(buffer->ready[buffer->next_sequence % (unsigned long)buffer->window]){
+        int next= (int)(buffer->next_sequence % (unsigned long)buffer->window);
+        char* next_item= buffer->slots[next];
+        item_meta_t next_meta= buffer->metas[next];
+        buffer->slots[next]= NULL;
+        buffer->ready[next]= 0;
+        buffer->next_sequence++;
+        pthread_cond_broadcast(&buffer->window_condition);
+
+        // deliver outside the lock (it may block on a full downstream queue)
+        if(next_item){
+            pthread_mutex_unlock(&buffer->mutex);
+            deliver(arg, next_item, &next_meta);
+            pthread_mutex_lock(&buffer->mutex);
+        }
+    }
+    buffer->delivering= 0;
+
+    pthread_mutex_unlock(&buffer->mutex);
+}
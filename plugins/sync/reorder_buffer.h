@@ -0,0 +1,59 @@
+#ifndef REORDER_BUFFER_H
+#define REORDER_BUFFER_H
+
+#include <pthread.h>
+
+#include "item_meta.h"
+
+/**
+ * reorder buffer restores input order after several workers processed a stream out of order.
+ * every item carries the sequence number it was dequeued with; items are released strictly in sequence order.
+ *
+ * whichever worker completes the next expected sequence becomes the "deliverer" and releases every consecutive ready item,
+ * so delivery is always done by one thread at a time (safe for a single-producer downstream queue).
+ * a worker that runs more than window sequences ahead waits, which bounds the memory held by the buffer.
+ **/
+
+/**
+ * Reorder buffer structure
+ */
+typedef struct
+{
+ char** slots; /* Items waiting for their turn, indexed by sequence % window */
+ item_meta_t* metas; /* What each of them carries */
+ unsigned char* ready; /* Whether the slot holds a completed sequence (its item may be NULL = dropped) */
+ int window; /* Maximum distance between the oldest undelivered sequence and any buffered one */
+ unsigned long next_sequence; /* Next sequence to deliver */
+ int delivering; /* Set while some worker is releasing items */
+ pthread_mutex_t mutex; /* Mutex for thread safety */
+ pthread_cond_t window_condition; /* Signaled whenever next_sequence moves forward */
+} reorder_buffer_t;
+
+/**
+ * Initialize a reorder buffer
+ * @param buffer Pointer to reorder buffer structure
+ * @param window Maximum number of sequences that can be buffered ahead of the next one
+ * @return NULL on success, error message on failure
+ */
+const char* reorder_buffer_init(reorder_buffer_t* buffer, int window);
+
+/**
+ * Destroy a reorder buffer and free any items still inside it
+ * @param buffer Pointer to reorder buffer structure
+ */
+void reorder_buffer_destroy(reorder_buffer_t* buffer);
+
+/**
+ * Hand in the result for one sequence and deliver everything that is now in order
+ * Blocks while sequence is window or more ahead of the next sequence to deliver.
+ * @param buffer Pointer to reorder buffer structure
+ * @param sequence Sequence number of the item (every sequence must be put exactly once)
+ * @param item Result (ownership passes to deliver), or NULL to just mark the sequence as done
+ * @param meta What the result carries, handed to deliver with it (NULL: nothing known)
+ * @param deliver Called in sequence order, outside the buffer's lock, with every non-NULL item
+ * @param arg Passed to deliver
+ */
+void reorder_buffer_put(reorder_buffer_t* buffer, unsigned long sequence, char* item, const item_meta_t* meta,
+                        void (*deliver)(void* arg, char* item, const item_meta_t* meta), void* arg);
+
+#endif
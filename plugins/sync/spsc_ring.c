@@ -0,0 +1,324 @@
+#include <stdlib.h>    // malloc, free
+#include <stdatomic.h>
+
+#include "spsc_ring.h"
+
+
+/**
+ * Initialize a ring
+ * @param ring Pointer to ring structure (must be SPSC_CACHE_LINE aligned)
+ * @param capacity Maximum number of items
+ * @return NULL on success, error message on failure
+ */
+const char* spsc_ring_init(spsc_ring_t* ring, int capacity){
+    // error: can't be NULL
+    if(!ring){
+        return "Ring pointer is NULL";
+    }
+
+    // error: invalid capacity
+    if(capacity<=0){
+        return "capacity must be positive";
+    }
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->cached_head= 0;
+    ring->cached_tail= 0;
+    ring->capacity= (size_t)capacity;
+
+    // allocate slots array + handle error: memory allocation fail
+    if(!(ring->slots= calloc(ring->capacity, sizeof(char*)))){
+        return "failed to allocate memory for ring slots";
+    }
+
+    if(!(ring->metas= malloc(ring->capacity * sizeof(item_meta_t)))){
+        free(ring->slots);
+        return "failed to allocate memory for ring metas";
+    }
+
+    if(eventcount_init(&ring->event)!=0){
+        free(ring->metas);
+        free(ring->slots);
+        return "failed initializing ring eventcount";
+    }
+
+    // on success
+    return NULL;
+}
+
+
+/**
+ * Destroy a ring and free the items still inside it
+ * @param ring Pointer to ring structure
+ */
+void spsc_ring_destroy(spsc_ring_t* ring){
+    if(!ring){
+        return;
+    }
+
+    if(ring->slots){
+        // head and tail are free-running counters, so everything in between is still owned by the ring
+        size_t head= atomic_load(&ring->head);
+        size_t tail= atomic_load(&ring->tail);
+        for(size_t i=head; i!=tail; i++){
+            free(ring->slots[i % ring->capacity]);
+        }
+        free(ring->slots);
+        ring->slots= NULL;
+    }
+    free(ring->metas);
+    ring->metas= NULL;
+
+    eventcount_destroy(&ring->event);
+}
+
+
+/**
+ * Try to add an item without blocking (producer side only)
+ * @param ring Pointer to ring structure
+ * @param item Item to add (ring takes ownership on success)
+ * @param meta What the item carries (NULL: nothing known)
+ * @return 1 if the item was added, 0 if the ring is full
+ */
+int spsc_ring_try_push(spsc_ring_t* ring, char* item, const item_meta_t* meta){
+    size_t tail= atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    // looks full from our snapshot - refresh it from the consumer's real head before giving up
+    if(tail - ring->cached_head >= ring->capacity){
+        ring->cached_head= atomic_load_explicit(&ring->head, memory_order_acquire);
+        if(tail - ring->cached_head >= ring->capacity){
+            return 0;
+        }
+    }
+
+    ring->slots[tail % ring->capacity]= item;
+    ring->metas[tail % ring->capacity]= meta ? *meta : ITEM_META_UNKNOWN;
+
+    // publish the slot to the consumer
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+
+/**
+ * Try to remove an item without blocking (consumer side only)
+ * @param ring Pointer to ring structure
+ * @param meta Output - what the item carries (may be NULL)
+ * @return The item, or NULL if the ring is empty
+ */
+char* spsc_ring_try_pop(spsc_ring_t* ring, item_meta_t* meta){
+    size_t head= atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    // looks empty from our snapshot - refresh it from the producer's real tail before giving up
+    if(head == ring->cached_tail){
+        ring->cached_tail= atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if(head == ring->cached_tail){
+            return NULL;
+        }
+    }
+
+    char* item= ring->slots[head % ring->capacity];
+    ring->slots[head % ring->capacity]= NULL;
+    if(meta){
+        *meta= ring->metas[head % ring->capacity];
+    }
+
+    // hand the slot back to the producer
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return item;
+}
+
+
+/**
+ * Add an item, blocking while the ring is full (producer side only)
+ * @param ring Pointer to ring structure
+ * @param item Item to add (ring takes ownership)
+ * @param meta What the item carries (NULL: nothing known)
+ */
+void spsc_ring_push(spsc_ring_t* ring, char* item, const item_meta_t* meta){
+    // fast path: a short spin covers the common case of a consumer that is just about to free a slot
+    int pushed= 0;
+    for(int i=0; i<SPSC_SPIN_LIMIT && !pushed; i++){
+        pushed= spsc_ring_try_push(ring, item, meta);
+    }
+
+    // slow path: park until the consumer frees a slot
+    while(!pushed){
+        unsigned int key= eventcount_prepare_wait(&ring->event);
+        if((pushed= spsc_ring_try_push(ring, item, meta))){
+            eventcount_cancel_wait(&ring->event);
+            break;
+        }
+        eventcount_wait(&ring->event, key);
+    }
+
+    // no syscall unless the consumer is parked
+    eventcount_notify(&ring->event);
+}
+
+
+/**
+ * Remove an item, blocking while the ring is empty (consumer side only)
+ * @param ring Pointer to ring structure
+ * @param meta Output - what the item carries (may be NULL)
+ * @return The item (never NULL)
+ */
+char* spsc_ring_pop(spsc_ring_t* ring, item_meta_t* meta){
+    // fast path: a short spin covers the common case of a producer that is just about to publish
+    char* item= NULL;
+    for(int i=0; i<SPSC_SPIN_LIMIT && !item; i++){
+        item= spsc_ring_try_pop(ring, meta);
+    }
+
+    // slow path: park until the producer publishes an item
+    while(!item){
+        unsigned int key= eventcount_prepare_wait(&ring->event);
+        if((item= spsc_ring_try_pop(ring, meta))){
+            eventcount_cancel_wait(&ring->event);
+            break;
+        }
+        eventcount_wait(&ring->event, key);
+    }
+
+    // no syscall unless the producer is parked
+    eventcount_notify(&ring->event);
+    return item;
+}
+
+
+/**
+ * Try to add up to count items without blocking, publishing them with a single tail update (producer side only)
+ * @param ring Pointer to ring structure
+ * @param items Items to add (ring takes ownership of the ones it accepts)
+ * @param metas What each item carries (NULL: nothing known)
+ * @param count Number of items
+ * @return Number of items added (a prefix of items), 0 if the ring is full
+ */
+int spsc_ring_try_push_many(spsc_ring_t* ring, char* const* items, const item_meta_t* metas, int count){
+    size_t tail= atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t free_slots= ring->capacity - (tail - ring->cached_head);
+
+    // not enough room according to our snapshot - refresh it once
+    if(free_slots < (size_t)count){
+        ring->cached_head= atomic_load_explicit(&ring->head, memory_order_acquire);
+        free_slots= ring->capacity - (tail - ring->cached_head);
+    }
+
+    size_t n= free_slots < (size_t)count ? free_slots : (size_t)count;
+    for(size_t i=0; i<n; i++){
+        ring->slots[(tail + i) % ring->capacity]= items[i];
+        ring->metas[(tail + i) % ring->capacity]= metas ? metas[i] : ITEM_META_UNKNOWN;
+    }
+
+    // publish the whole batch to the consumer at once
+    if(n > 0){
+        atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+    }
+    return (int)n;
+}
+
+
+/**
+ * Try to remove up to max items without blocking, releasing the slots with a single head update (consumer side only)
+ * @param ring Pointer to ring structure
+ * @param items Output array of at least max entries
+ * @param metas Output array of at least max entries - what each item carries (may be NULL)
+ * @param max Maximum number of items to remove
+ * @return Number of items removed, 0 if the ring is empty
+ */
+int spsc_ring_try_pop_many(spsc_ring_t* ring, char** items, item_meta_t* metas, int max){
+    size_t head= atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t available= ring->cached_tail - head;
+
+    // fewer items than requested according to our snapshot - refresh it once
+    if(available < (size_t)max){
+        ring->cached_tail= atomic_load_explicit(&ring->tail, memory_order_acquire);
+        available= ring->cached_tail - head;
+    }
+
+    size_t n= available < (size_t)max ? available : (size_t)max;
+    for(size_t i=0; i<n; i++){
+        items[i]= ring->slots[(head + i) % ring->capacity];
+        ring->slots[(head + i) % ring->capacity]= NULL;
+        if(metas){
+            metas[i]= ring->metas[(head + i) % ring->capacity];
+        }
+    }
+
+    // hand all the slots back to the producer at once
+    if(n > 0){
+        atomic_store_explicit(&ring->head, head + n, memory_order_release);
+    }
+    return (int)n;
+}
+
+
+/**
+ * Add count items, blocking while the ring is full (producer side only)
+ * @param ring Pointer to ring structure
+ * @param items Items to add (ring takes ownership)
+ * @param metas What each item carries (NULL: nothing known)
+ * @param count Number of items
+ */
+void spsc_ring_push_many(spsc_ring_t* ring, char* const* items, const item_meta_t* metas, int count){
+    int pushed= 0;
+    while(pushed < count){
+        int n= spsc_ring_try_push_many(ring, items + pushed, metas ? metas + pushed : NULL, count - pushed);
+        if(n > 0){
+            pushed+= n;
+            // one wakeup per published chunk, not per item
+            eventcount_notify(&ring->event);
+            continue;
+        }
+
+        // full: park until the consumer frees a slot
+        unsigned int key= eventcount_prepare_wait(&ring->event);
+        if(spsc_ring_count(ring) < (int)ring->capacity){
+            eventcount_cancel_wait(&ring->event);
+            continue;
+        }
+        eventcount_wait(&ring->event, key);
+    }
+}
+
+
+/**
+ * Remove between 1 and max items, blocking while the ring is empty (consumer side only)
+ * @param ring Pointer to ring structure
+ * @param items Output array of at least max entries
+ * @param metas Output array of at least max entries - what each item carries (may be NULL)
+ * @param max Maximum number of items to remove
+ * @return Number of items removed (at least 1)
+ */
+int spsc_ring_pop_many(spsc_ring_t* ring, char** items, item_meta_t* metas, int max){
+    int n= 0;
+    for(int i=0; i<SPSC_SPIN_LIMIT && n == 0; i++){
+        n= spsc_ring_try_pop_many(ring, items, metas, max);
+    }
+
+    // empty: park until the producer publishes something
+    while(n == 0){
+        unsigned int key= eventcount_prepare_wait(&ring->event);
+        if((n= spsc_ring_try_pop_many(ring, items, metas, max)) > 0){
+            eventcount_cancel_wait(&ring->event);
+            break;
+        }
+        eventcount_wait(&ring->event, key);
+    }
+
+    eventcount_notify(&ring->event);
+    return n;
+}
+
+
+/**
+ * Number of items currently in the ring (a snapshot - may be stale as soon as it returns)
+ * @param ring Pointer to ring structure
+ * @return Number of items
+ */
+int spsc_ring_count(spsc_ring_t* ring){
+    size_t tail= atomic_load(&ring->tail);
+    size_t head= atomic_load(&ring->head);
+    return (int)(tail - head);
+}
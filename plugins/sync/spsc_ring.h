@@ -0,0 +1,132 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "eventcount.h"
+#include "item_meta.h"
+
+/**
+ * spsc ring is a bounded queue of string pointers (each with its item meta) for links that have exactly ONE producer thread and ONE consumer thread.
+ * push and pop never take a lock: the producer only writes tail, the consumer only writes head,
+ * and each side keeps a private snapshot of the other side's index so it touches the shared cache line only when it has to.
+ *
+ * only when the ring is empty (consumer) or full (producer) the caller falls back to blocking.
+ **/
+
+#define SPSC_CACHE_LINE 64
+
+// how many times we retry a full/empty ring before parking the thread
+#define SPSC_SPIN_LIMIT 64
+
+/**
+ * Single-producer/single-consumer ring structure
+ * head and tail live on separate cache lines so the two threads don't bounce a line between cores on every item
+ */
+typedef struct
+{
+ _Alignas(SPSC_CACHE_LINE) atomic_size_t head; /* Next slot to read (written by the consumer only) */
+ size_t cached_tail; /* Consumer's last snapshot of tail */
+ _Alignas(SPSC_CACHE_LINE) atomic_size_t tail; /* Next slot to write (written by the producer only) */
+ size_t cached_head; /* Producer's last snapshot of head */
+ _Alignas(SPSC_CACHE_LINE) char** slots; /* Array of string pointers */
+ item_meta_t* metas; /* Each slot's item meta */
+ size_t capacity; /* Maximum number of items */
+ _Alignas(SPSC_CACHE_LINE) eventcount_t event; /* Parks a consumer on an empty ring or a producer on a full ring */
+} spsc_ring_t;
+
+/**
+ * Initialize a ring
+ * @param ring Pointer to ring structure (must be SPSC_CACHE_LINE aligned)
+ * @param capacity Maximum number of items
+ * @return NULL on success, error message on failure
+ */
+const char* spsc_ring_init(spsc_ring_t* ring, int capacity);
+
+/**
+ * Destroy a ring and free the items still inside it
+ * @param ring Pointer to ring structure
+ */
+void spsc_ring_destroy(spsc_ring_t* ring);
+
+/**
+ * Try to add an item without blocking (producer side only)
+ * @param ring Pointer to ring structure
+ * @param item Item to add (ring takes ownership on success)
+ * @param meta What the item carries (NULL: nothing known)
+ * @return 1 if the item was added, 0 if the ring is full
+ */
+int spsc_ring_try_push(spsc_ring_t* ring, char* item, const item_meta_t* meta);
+
+/**
+ * Try to remove an item without blocking (consumer side only)
+ * @param ring Pointer to ring structure
+ * @param meta Output - what the item carries (may be NULL)
+ * @return The item, or NULL if the ring is empty
+ */
+char* spsc_ring_try_pop(spsc_ring_t* ring, item_meta_t* meta);
+
+/**
+ * Add an item, blocking while the ring is full (producer side only)
+ * @param ring Pointer to ring structure
+ * @param item Item to add (ring takes ownership)
+ * @param meta What the item carries (NULL: nothing known)
+ */
+void spsc_ring_push(spsc_ring_t* ring, char* item, const item_meta_t* meta);
+
+/**
+ * Remove an item, blocking while the ring is empty (consumer side only)
+ * @param ring Pointer to ring structure
+ * @param meta Output - what the item carries (may be NULL)
+ * @return The item (never NULL)
+ */
+char* spsc_ring_pop(spsc_ring_t* ring, item_meta_t* meta);
+
+/**
+ * Try to add up to count items without blocking, publishing them with a single tail update (producer side only)
+ * @param ring Pointer to ring structure
+ * @param items Items to add (ring takes ownership of the ones it accepts)
+ * @param metas What each item carries (NULL: nothing known)
+ * @param count Number of items
+ * @return Number of items added (a prefix of items), 0 if the ring is full
+ */
+int spsc_ring_try_push_many(spsc_ring_t* ring, char* const* items, const item_meta_t* metas, int count);
+
+/**
+ * Try to remove up to max items without blocking, releasing the slots with a single head update (consumer side only)
+ * @param ring Pointer to ring structure
+ * @param items Output array of at least max entries
+ * @param metas Output array of at least max entries - what each item carries (may be NULL)
+ * @param max Maximum number of items to remove
+ * @return Number of items removed, 0 if the ring is empty
+ */
+int spsc_ring_try_pop_many(spsc_ring_t* ring, char** items, item_meta_t* metas, int max);
+
+/**
+ * Add count items, blocking while the ring is full (producer side only)
+ * @param ring Pointer to ring structure
+ * @param items Items to add (ring takes ownership)
+ * @param metas What each item carries (NULL: nothing known)
+ * @param count Number of items
+ */
+void spsc_ring_push_many(spsc_ring_t* ring, char* const* items, const item_meta_t* metas, int count);
+
+/**
+ * Remove between 1 and max items, blocking while the ring is empty (consumer side only)
+ * @param ring Pointer to ring structure
+ * @param items Output array of at least max entries
+ * @param metas Output array of at least max entries - what each item carries (may be NULL)
+ * @param max Maximum number of items to remove
+ * @return Number of items removed (at least 1)
+ */
+int spsc_ring_pop_many(spsc_ring_t* ring, char** items, item_meta_t* metas, int max);
+
+/**
+ * Number of items currently in the ring (a snapshot - may be stale as soon as it returns)
+ * @param ring Pointer to ring structure
+ * @return Number of items
+ */
+int spsc_ring_count(spsc_ring_t* ring);
+
+#endif
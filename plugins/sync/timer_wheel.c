@@ -0,0 +1,324 @@
+#include <stdlib.h>       // malloc, free
+#include <stdint.h>       // uint64_t
+#include <errno.h>        // EINTR
+#include <poll.h>         // poll
+#include <time.h>         // clock_gettime
+#include <unistd.h>       // read, write, close
+#include <sys/eventfd.h>  // eventfd
+#include <sys/timerfd.h>  // timerfd_create, timerfd_settime
+#include <pthread.h>
+
+#include "timer_wheel.h"
+
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+
+
+/**
+ * Microseconds on the monotonic clock
+ * @return Current time
+ */
+static long long timer_wheel_clock_us(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+
+/**
+ * The tick the wall clock is in (virtual clock: the tick the thread is at) - caller holds the mutex
+ * @param wheel Pointer to wheel structure
+ * @return Current tick
+ */
+static unsigned long timer_wheel_current(timer_wheel_t* wheel){
+    if(wheel->virtual_clock){
+        return wheel->now;
+    }
+    unsigned long tick = (unsigned long)((timer_wheel_clock_us() - wheel->start_us) / TIMER_WHEEL_TICK_US);
+    return tick > wheel->now ? tick : wheel->now;
+}
+
+
+/**
+ * Earliest due tick of all pending timers - caller holds the mutex
+ * @param wheel Pointer to wheel structure (at least one timer pending)
+ * @return The tick
+ */
+static unsigned long timer_wheel_earliest(timer_wheel_t* wheel){
+    unsigned long earliest = 0;
+    int found = 0;
+    for(int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++){
+        for(timer_entry_t* entry = wheel->heads[slot]; entry != NULL; entry = entry->next){
+            if(!found || entry->due < earliest){
+                earliest = entry->due;
+                found = 1;
+            }
+        }
+    }
+    return earliest;
+}
+
+
+/**
+ * Advance to a tick and run the timers due on it, in scheduling order - caller holds the mutex (dropped around callbacks)
+ * @param wheel Pointer to wheel structure
+ * @param tick The tick (later than wheel->now)
+ */
+static void timer_wheel_run_tick(timer_wheel_t* wheel, unsigned long tick){
+    int slot = (int)(tick & TIMER_WHEEL_MASK);
+    wheel->now = tick;
+
+    // unhook the due ones first - a callback may add to this very slot
+    timer_entry_t* due = NULL;
+    timer_entry_t** due_tail = &due;
+    timer_entry_t* kept_tail = NULL;
+    timer_entry_t** link = &wheel->heads[slot];
+    while(*link != NULL){
+        timer_entry_t* entry = *link;
+        if(entry->due > tick){
+            kept_tail = entry;
+            link = &entry->next;
+            continue;
+        }
+        *link = entry->next;
+        entry->next = NULL;
+        *due_tail = entry;
+        due_tail = &entry->next;
+        wheel->pending--;
+    }
+    wheel->tails[slot] = kept_tail;
+
+    while(due != NULL){
+        timer_entry_t* entry = due;
+        due = entry->next;
+        wheel->running = 1;
+        pthread_mutex_unlock(&wheel->mutex);
+        entry->run(entry->arg);
+        free(entry);
+        pthread_mutex_lock(&wheel->mutex);
+        wheel->running = 0;
+    }
+}
+
+
+/**
+ * Scheduler thread with a virtual clock: jump to the next due tick and run it
+ * @param wheel Pointer to wheel structure
+ */
+static void timer_wheel_run_virtual(timer_wheel_t* wheel){
+    pthread_mutex_lock(&wheel->mutex);
+    for(;;){
+        while(wheel->pending == 0 && !wheel->stopping){
+            pthread_cond_wait(&wheel->changed, &wheel->mutex);
+        }
+        if(wheel->stopping){
+            break;
+        }
+        timer_wheel_run_tick(wheel, timer_wheel_earliest(wheel));
+    }
+    pthread_mutex_unlock(&wheel->mutex);
+}
+
+
+/**
+ * Scheduler thread on the real clock: run every tick that passed, then sleep on the timerfd until the next due one
+ * @param wheel Pointer to wheel structure
+ */
+static void timer_wheel_run_real(timer_wheel_t* wheel){
+    pthread_mutex_lock(&wheel->mutex);
+    while(!wheel->stopping){
+        unsigned long current = timer_wheel_current(wheel);
+        while(wheel->now < current && wheel->pending > 0 && !wheel->stopping){
+            timer_wheel_run_tick(wheel, wheel->now + 1);
+        }
+        if(wheel->stopping){
+            break;
+        }
+        if(wheel->pending == 0 && wheel->now < current){
+            wheel->now = current;
+        }
+
+        // arm for the next due tick (disarm when there is none), so the sleep below ends right on it
+        struct itimerspec when = { { 0, 0 }, { 0, 0 } };
+        wheel->armed = 0;
+        if(wheel->pending > 0){
+            wheel->armed = timer_wheel_earliest(wheel);
+            long long at = wheel->start_us + (long long)wheel->armed * TIMER_WHEEL_TICK_US;
+            when.it_value.tv_sec = at / 1000000LL;
+            when.it_value.tv_nsec = (at % 1000000LL) * 1000;
+        }
+        timerfd_settime(wheel->timer_fd, TFD_TIMER_ABSTIME, &when, NULL);
+        pthread_mutex_unlock(&wheel->mutex);
+
+        struct pollfd fds[2] = { { wheel->timer_fd, POLLIN, 0 }, { wheel->wake_fd, POLLIN, 0 } };
+        if(poll(fds, 2, -1) > 0){
+            uint64_t count;
+            if(fds[0].revents & POLLIN){
+                while(read(wheel->timer_fd, &count, sizeof(count)) < 0 && errno == EINTR){
+                }
+            }
+            if(fds[1].revents & POLLIN){
+                while(read(wheel->wake_fd, &count, sizeof(count)) < 0 && errno == EINTR){
+                }
+            }
+        }
+        pthread_mutex_lock(&wheel->mutex);
+    }
+    pthread_mutex_unlock(&wheel->mutex);
+}
+
+
+/**
+ * Scheduler thread
+ * @param arg Pointer to wheel structure
+ * @return NULL
+ */
+static void* timer_wheel_thread(void* arg){
+    timer_wheel_t* wheel = (timer_wheel_t*)arg;
+    if(wheel->virtual_clock){
+        timer_wheel_run_virtual(wheel);
+    }
+    else{
+        timer_wheel_run_real(wheel);
+    }
+    return NULL;
+}
+
+
+/**
+ * Wake the scheduler thread out of its sleep
+ * @param wheel Pointer to wheel structure
+ */
+static void timer_wheel_wake(timer_wheel_t* wheel){
+    uint64_t one = 1;
+    while(write(wheel->wake_fd, &one, sizeof(one)) < 0 && errno == EINTR){
+    }
+}
+
+
+const char* timer_wheel_init(timer_wheel_t* wheel, int virtual_clock){
+    if(!wheel){
+        return "Invalid wheel pointer";
+    }
+
+    wheel->virtual_clock = virtual_clock;
+    for(int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++){
+        wheel->heads[slot] = NULL;
+        wheel->tails[slot] = NULL;
+    }
+    wheel->pending = 0;
+    wheel->now = 0;
+    wheel->armed = 0;
+    wheel->start_us = timer_wheel_clock_us();
+    wheel->running = 0;
+    wheel->stopping = 0;
+
+    wheel->timer_fd = -1;
+    if(!virtual_clock){
+        wheel->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if(wheel->timer_fd < 0){
+            return "Failed to create timerfd";
+        }
+    }
+    wheel->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if(wheel->wake_fd < 0){
+        if(wheel->timer_fd >= 0){
+            close(wheel->timer_fd);
+        }
+        return "Failed to create eventfd";
+    }
+
+    if(pthread_mutex_init(&wheel->mutex, NULL) != 0){
+        close(wheel->wake_fd);
+        if(wheel->timer_fd >= 0){
+            close(wheel->timer_fd);
+        }
+        return "Failed to initialize mutex";
+    }
+    if(pthread_cond_init(&wheel->changed, NULL) != 0){
+        pthread_mutex_destroy(&wheel->mutex);
+        close(wheel->wake_fd);
+        if(wheel->timer_fd >= 0){
+            close(wheel->timer_fd);
+        }
+        return "Failed to initialize condition variable";
+    }
+
+    if(pthread_create(&wheel->thread, NULL, timer_wheel_thread, wheel) != 0){
+        pthread_cond_destroy(&wheel->changed);
+        pthread_mutex_destroy(&wheel->mutex);
+        close(wheel->wake_fd);
+        if(wheel->timer_fd >= 0){
+            close(wheel->timer_fd);
+        }
+        return "Failed to create timer thread";
+    }
+
+    return NULL;
+}
+
+
+void timer_wheel_destroy(timer_wheel_t* wheel){
+    if(!wheel){
+        return;
+    }
+
+    pthread_mutex_lock(&wheel->mutex);
+    wheel->stopping = 1;
+    pthread_cond_signal(&wheel->changed);
+    pthread_mutex_unlock(&wheel->mutex);
+    timer_wheel_wake(wheel);
+    pthread_join(wheel->thread, NULL);
+
+    for(int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++){
+        while(wheel->heads[slot] != NULL){
+            timer_entry_t* entry = wheel->heads[slot];
+            wheel->heads[slot] = entry->next;
+            free(entry);
+        }
+    }
+    pthread_cond_destroy(&wheel->changed);
+    pthread_mutex_destroy(&wheel->mutex);
+    close(wheel->wake_fd);
+    if(wheel->timer_fd >= 0){
+        close(wheel->timer_fd);
+    }
+}
+
+
+int timer_wheel_schedule(timer_wheel_t* wheel, unsigned long delay_us, void (*run)(void*), void* arg){
+    timer_entry_t* entry = malloc(sizeof(timer_entry_t));
+    if(!entry){
+        return -1;
+    }
+    entry->next = NULL;
+    entry->run = run;
+    entry->arg = arg;
+
+    pthread_mutex_lock(&wheel->mutex);
+    // a callback chaining the next timer counts from its own tick, so the cadence doesn't drift with callback latency
+    int from_callback = wheel->running && pthread_equal(pthread_self(), wheel->thread);
+    unsigned long base = from_callback ? wheel->now : timer_wheel_current(wheel);
+    entry->due = base + (delay_us + TIMER_WHEEL_TICK_US - 1) / TIMER_WHEEL_TICK_US;
+    if(entry->due <= wheel->now){
+        entry->due = wheel->now + 1;
+    }
+
+    int slot = (int)(entry->due & TIMER_WHEEL_MASK);
+    if(wheel->tails[slot] != NULL){
+        wheel->tails[slot]->next = entry;
+    }
+    else{
+        wheel->heads[slot] = entry;
+    }
+    wheel->tails[slot] = entry;
+    wheel->pending++;
+
+    // the thread only needs waking if it would sleep past this timer (never from its own callbacks - it re-arms after them)
+    int wake = !wheel->virtual_clock && !from_callback && (wheel->armed == 0 || entry->due < wheel->armed);
+    pthread_cond_signal(&wheel->changed);
+    pthread_mutex_unlock(&wheel->mutex);
+    if(wake){
+        timer_wheel_wake(wheel);
+    }
+    return 0;
+}
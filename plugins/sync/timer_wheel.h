@@ -0,0 +1,82 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <pthread.h>
+
+/**
+ * timer wheel runs callbacks after a delay, all of them on one scheduler thread, so nothing has to sleep to wait.
+ * timers hang off a hashed wheel of TIMER_WHEEL_SLOTS slots, one tick (TIMER_WHEEL_TICK_US) each - a timer due in
+ * more ticks than there are slots just stays in its slot for as many turns as it takes.
+ * the thread sleeps on a timerfd armed for the next due tick, next to an eventfd that wakes it for an earlier timer or to stop.
+ *
+ * a callback that schedules the next timer measures the delay from its own due tick, not from the (slightly later)
+ * time it actually ran, so a chain of timers keeps its cadence without drifting. timers due on the same tick run in
+ * the order they were scheduled.
+ *
+ * with a virtual clock the thread doesn't sleep at all: time jumps straight to the next due tick. callbacks run in
+ * the same order and see the same times, just without the waiting (for tests).
+ **/
+
+// microseconds per tick
+#define TIMER_WHEEL_TICK_US 1000
+// slots in the wheel (a power of two)
+#define TIMER_WHEEL_SLOTS 512
+
+/**
+ * One scheduled callback
+ */
+typedef struct timer_entry
+{
+ struct timer_entry* next; /* Next timer in the same slot, in scheduling order */
+ unsigned long due; /* Tick it is due on */
+ void (*run)(void*); /* Callback */
+ void* arg; /* Its argument */
+} timer_entry_t;
+
+/**
+ * Timer wheel structure
+ */
+typedef struct
+{
+ int virtual_clock; /* Jump from due tick to due tick instead of sleeping */
+ int timer_fd; /* timerfd the thread sleeps on (-1 with a virtual clock) */
+ int wake_fd; /* eventfd that wakes the thread early */
+ pthread_t thread; /* Scheduler thread */
+ pthread_mutex_t mutex; /* Guards the fields below */
+ pthread_cond_t changed; /* Virtual clock: signaled when a timer is added or on stop */
+ timer_entry_t* heads[TIMER_WHEEL_SLOTS]; /* Oldest timer of every slot */
+ timer_entry_t* tails[TIMER_WHEEL_SLOTS]; /* Newest timer of every slot */
+ unsigned long pending; /* Timers not run yet */
+ unsigned long now; /* Tick the thread has run every timer up to */
+ unsigned long armed; /* Tick the timerfd is armed for (0: not armed) */
+ long long start_us; /* Monotonic time of tick 0 */
+ int running; /* The scheduler thread is inside a callback (so "now" is that callback's due tick) */
+ int stopping; /* Set by timer_wheel_destroy */
+} timer_wheel_t;
+
+/**
+ * Initialize a timer wheel and start its scheduler thread
+ * @param wheel Pointer to wheel structure
+ * @param virtual_clock Don't sleep - jump straight to the next due tick
+ * @return NULL on success, error message on failure
+ */
+const char* timer_wheel_init(timer_wheel_t* wheel, int virtual_clock);
+
+/**
+ * Stop the scheduler thread and free the wheel's resources (timers not run yet are dropped)
+ * @param wheel Pointer to wheel structure
+ */
+void timer_wheel_destroy(timer_wheel_t* wheel);
+
+/**
+ * Run a callback on the scheduler thread once a delay passed (any thread, callbacks included)
+ * From a callback the delay counts from that callback's due tick, from anywhere else from now.
+ * @param wheel Pointer to wheel structure
+ * @param delay_us Delay in microseconds (rounded up to whole ticks - 0 runs it on the next pass)
+ * @param run Callback
+ * @param arg Its argument
+ * @return 0 on success, -1 on allocation failure
+ */
+int timer_wheel_schedule(timer_wheel_t* wheel, unsigned long delay_us, void (*run)(void*), void* arg);
+
+#endif
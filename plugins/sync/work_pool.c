@@ -0,0 +1,345 @@
+#include <stdlib.h>    // malloc, free
+#include <stdint.h>    // intptr_t
+#include <sched.h>     // sched_yield
+#include <pthread.h>
+
+#include "work_pool.h"
+
+// initial number of slots in each deque (power of two)
+#define WORK_DEQUE_INITIAL_SIZE 64
+
+
+/**
+ * Double a deque's ring, keeping the tasks in order (caller holds the deque mutex)
+ * @param deque Pointer to deque structure
+ * @return 0 on success, -1 on allocation failure
+ */
+static int work_deque_grow(work_deque_t* deque){
+    size_t size= deque->mask + 1;
+    work_task_t* tasks= malloc(2 * size * sizeof(work_task_t));
+    if(!tasks){
+        return -1;
+    }
+
+    size_t count= deque->bottom - deque->top;
+    for(size_t i=0; i<count; i++){
+        tasks[i]= deque->tasks[(deque->top + i) & deque->mask];
+    }
+    free(deque->tasks);
+    deque->tasks= tasks;
+    deque->mask= 2 * size - 1;
+    deque->top= 0;
+    deque->bottom= count;
+    return 0;
+}
+
+
+/**
+ * Add a task to one end of a deque
+ * @param deque Pointer to deque structure
+ * @param task Task to add
+ * @param newest 1: the owner's end (runs next on the owner), 0: the oldest end (stolen first)
+ */
+static void work_deque_push(work_deque_t* deque, work_task_t task, int newest){
+    pthread_mutex_lock(&deque->mutex);
+
+    // a full ring we can't grow just keeps the task waiting for a free slot - an allocation failure is not worth losing a task
+    while(deque->bottom - deque->top > deque->mask && work_deque_grow(deque) != 0){
+        pthread_mutex_unlock(&deque->mutex);
+        sched_yield();
+        pthread_mutex_lock(&deque->mutex);
+    }
+
+    if(newest){
+        deque->tasks[deque->bottom & deque->mask]= task;
+        deque->bottom++;
+    }
+    else{
+        deque->top--;
+        deque->tasks[deque->top & deque->mask]= task;
+    }
+
+    pthread_mutex_unlock(&deque->mutex);
+}
+
+
+/**
+ * Take a task from one end of a deque
+ * @param deque Pointer to deque structure
+ * @param task Output - the task
+ * @param newest 1: the owner's end, 0: the oldest end (stealing)
+ * @return 1 if a task was taken, 0 if the deque is empty
+ */
+static int work_deque_pop(work_deque_t* deque, work_task_t* task, int newest){
+    pthread_mutex_lock(&deque->mutex);
+
+    if(deque->bottom == deque->top){
+        pthread_mutex_unlock(&deque->mutex);
+        return 0;
+    }
+
+    if(newest){
+        deque->bottom--;
+        *task= deque->tasks[deque->bottom & deque->mask];
+    }
+    else{
+        *task= deque->tasks[deque->top & deque->mask];
+        deque->top++;
+    }
+
+    pthread_mutex_unlock(&deque->mutex);
+    return 1;
+}
+
+
+/**
+ * Which worker the calling thread is
+ * @param pool Pointer to pool structure
+ * @return Worker index, or -1 for a thread outside the pool
+ */
+static int work_pool_self(work_pool_t* pool){
+    return (int)(intptr_t)pthread_getspecific(pool->worker_key) - 1;
+}
+
+
+/**
+ * Find a task for one worker: its own newest first, then the oldest of every other worker
+ * @param pool Pointer to pool structure
+ * @param self Worker index
+ * @param task Output - the task
+ * @return 1 if a task was found, 0 otherwise
+ */
+static int work_pool_find(work_pool_t* pool, int self, work_task_t* task){
+    if(work_deque_pop(&pool->deques[self], task, 1)){
+        return 1;
+    }
+
+    for(int i=1; i<pool->num_workers; i++){
+        if(work_deque_pop(&pool->deques[(self + i) % pool->num_workers], task, 0)){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Worker thread argument
+ */
+typedef struct
+{
+ work_pool_t* pool;
+ int index;
+} work_worker_arg_t;
+
+
+/**
+ * Worker thread: run tasks until the pool stops and nothing is left
+ * @param arg Pointer to a malloc'd work_worker_arg_t (freed here)
+ * @return NULL
+ */
+static void* work_pool_worker(void* arg){
+    work_worker_arg_t* worker= (work_worker_arg_t*)arg;
+    work_pool_t* pool= worker->pool;
+    int self= worker->index;
+    free(worker);
+
+    pthread_setspecific(pool->worker_key, (void*)(intptr_t)(self + 1));
+
+    while(1){
+        work_task_t task;
+        if(work_pool_find(pool, self, &task)){
+            atomic_fetch_sub(&pool->pending, 1);
+            task.run(task.arg);
+            continue;
+        }
+
+        // nothing to take: park, unless a task was submitted meanwhile (it may still be on its way into a deque)
+        unsigned int key= eventcount_prepare_wait(&pool->work_event);
+        if(atomic_load(&pool->pending) > 0){
+            eventcount_cancel_wait(&pool->work_event);
+            continue;
+        }
+        if(atomic_load(&pool->stopping)){
+            eventcount_cancel_wait(&pool->work_event);
+            break;
+        }
+        eventcount_wait(&pool->work_event, key);
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Tell the workers to leave once nothing is pending and join them
+ * @param pool Pointer to pool structure
+ * @param started Number of worker threads that were started
+ */
+static void work_pool_stop(work_pool_t* pool, int started){
+    atomic_store(&pool->stopping, 1);
+    eventcount_notify(&pool->work_event);
+
+    for(int i=0; i<started; i++){
+        pthread_join(pool->threads[i], NULL);
+    }
+}
+
+
+/**
+ * Free the deques, thread handles and eventcount of a pool whose workers are stopped
+ * @param pool Pointer to pool structure
+ */
+static void work_pool_free(work_pool_t* pool){
+    for(int i=0; i<pool->num_workers; i++){
+        pthread_mutex_destroy(&pool->deques[i].mutex);
+        free(pool->deques[i].tasks);
+    }
+    free(pool->threads);
+    free(pool->deques);
+    pool->threads= NULL;
+    pool->deques= NULL;
+
+    eventcount_destroy(&pool->work_event);
+}
+
+
+/**
+ * Initialize a pool and start its workers
+ * @param pool Pointer to pool structure
+ * @param num_workers Number of worker threads (at least 1)
+ * @return NULL on success, error message on failure
+ */
+const char* work_pool_init(work_pool_t* pool, int num_workers){
+    // error: can't be NULL
+    if(!pool){
+        return "Pool pointer is NULL";
+    }
+
+    // error: invalid size
+    if(num_workers<=0){
+        return "number of workers must be positive";
+    }
+
+    pool->num_workers= num_workers;
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->stopping, 0);
+    atomic_init(&pool->next_deque, 0);
+
+    pool->threads= calloc(num_workers, sizeof(pthread_t));
+    pool->deques= calloc(num_workers, sizeof(work_deque_t));
+    if(!pool->threads || !pool->deques){
+        free(pool->threads);
+        free(pool->deques);
+        return "failed to allocate memory for workers";
+    }
+
+    int ready= 0;
+    for(; ready<num_workers; ready++){
+        work_deque_t* deque= &pool->deques[ready];
+        deque->mask= WORK_DEQUE_INITIAL_SIZE - 1;
+        deque->top= 0;
+        deque->bottom= 0;
+        if(!(deque->tasks= malloc(WORK_DEQUE_INITIAL_SIZE * sizeof(work_task_t)))){
+            break;
+        }
+        if(pthread_mutex_init(&deque->mutex, NULL) != 0){
+            free(deque->tasks);
+            break;
+        }
+    }
+
+    if(ready < num_workers || eventcount_init(&pool->work_event) != 0){
+        for(int i=0; i<ready; i++){
+            pthread_mutex_destroy(&pool->deques[i].mutex);
+            free(pool->deques[i].tasks);
+        }
+        free(pool->threads);
+        free(pool->deques);
+        return "failed initializing worker deques";
+    }
+
+    if(pthread_key_create(&pool->worker_key, NULL) != 0){
+        work_pool_free(pool);
+        return "failed creating worker key";
+    }
+
+    for(int i=0; i<num_workers; i++){
+        work_worker_arg_t* worker= malloc(sizeof(work_worker_arg_t));
+        if(worker){
+            worker->pool= pool;
+            worker->index= i;
+        }
+        if(!worker || pthread_create(&pool->threads[i], NULL, work_pool_worker, worker) != 0){
+            free(worker);
+            // stop the workers that did start
+            work_pool_stop(pool, i);
+            pthread_key_delete(pool->worker_key);
+            work_pool_free(pool);
+            return "failed creating worker thread";
+        }
+    }
+
+    // on success
+    return NULL;
+}
+
+
+/**
+ * Run every task still queued, stop the workers and free the pool's resources
+ * @param pool Pointer to pool structure
+ */
+void work_pool_destroy(work_pool_t* pool){
+    if(!pool || !pool->deques){
+        return;
+    }
+
+    work_pool_stop(pool, pool->num_workers);
+    pthread_key_delete(pool->worker_key);
+    work_pool_free(pool);
+}
+
+
+/**
+ * Queue a task on the calling worker's deque (or a round-robin one from outside the pool) and wake an idle worker
+ * @param pool Pointer to pool structure
+ * @param run Task function
+ * @param arg Its argument
+ * @param newest Which end of the deque
+ */
+static void work_pool_push(work_pool_t* pool, work_pool_task_fn run, void* arg, int newest){
+    work_task_t task= { .run= run, .arg= arg };
+    int self= work_pool_self(pool);
+    if(self < 0){
+        self= (int)(atomic_fetch_add(&pool->next_deque, 1) % (unsigned int)pool->num_workers);
+    }
+
+    // counted before it's visible, so a worker that finds the deques empty doesn't park on it
+    atomic_fetch_add(&pool->pending, 1);
+    work_deque_push(&pool->deques[self], task, newest);
+
+    // no syscall unless a worker is parked
+    eventcount_notify_one(&pool->work_event);
+}
+
+
+/**
+ * Queue a task to run as soon as possible - on the calling worker right after its current task when called from the pool
+ * @param pool Pointer to pool structure
+ * @param run Task function
+ * @param arg Its argument
+ */
+void work_pool_submit(work_pool_t* pool, work_pool_task_fn run, void* arg){
+    work_pool_push(pool, run, arg, 1);
+}
+
+
+/**
+ * Queue a task behind everything already queued on the calling worker (the first thing another worker would steal)
+ * @param pool Pointer to pool structure
+ * @param run Task function
+ * @param arg Its argument
+ */
+void work_pool_defer(work_pool_t* pool, work_pool_task_fn run, void* arg){
+    work_pool_push(pool, run, arg, 0);
+}
@@ -0,0 +1,90 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "eventcount.h"
+
+/**
+ * work pool is a fixed set of worker threads that run small tasks (a function and its argument).
+ * every worker owns a deque: it pushes and pops its own tasks at the "newest" end, so a task submitted from a worker
+ * usually runs next on that same worker (its data is still in that core's cache).
+ * an idle worker steals from the "oldest" end of the other workers' deques, which spreads long-waiting work across cores.
+ *
+ * idle workers park on one eventcount, so a submit costs no syscall while every worker is busy.
+ **/
+
+/**
+ * Task function type
+ */
+typedef void (*work_pool_task_fn)(void* arg);
+
+/**
+ * One queued task
+ */
+typedef struct
+{
+ work_pool_task_fn run; /* Function to call */
+ void* arg; /* Its argument */
+} work_task_t;
+
+/**
+ * Per-worker deque (top = oldest, stolen by others; bottom = newest, popped by the owner)
+ */
+typedef struct
+{
+ pthread_mutex_t mutex; /* Guards the fields below (owner and thieves both take it - it's almost never contended) */
+ work_task_t* tasks; /* Ring of tasks (power of two size, grows when full) */
+ size_t mask; /* Ring size - 1 */
+ size_t top; /* Free-running index of the oldest task */
+ size_t bottom; /* Free-running index one past the newest task */
+} work_deque_t;
+
+/**
+ * Work pool structure
+ */
+typedef struct
+{
+ int num_workers; /* Number of worker threads */
+ pthread_t* threads; /* Worker threads */
+ work_deque_t* deques; /* One deque per worker */
+ pthread_key_t worker_key; /* Tells a thread which worker it is (unset for threads outside the pool) */
+ eventcount_t work_event; /* Idle workers park here */
+ atomic_int pending; /* Tasks submitted but not yet taken by a worker */
+ atomic_int stopping; /* Set by work_pool_destroy - workers leave once nothing is pending */
+ atomic_uint next_deque; /* Round-robin target for submits from outside the pool */
+} work_pool_t;
+
+/**
+ * Initialize a pool and start its workers
+ * @param pool Pointer to pool structure
+ * @param num_workers Number of worker threads (at least 1)
+ * @return NULL on success, error message on failure
+ */
+const char* work_pool_init(work_pool_t* pool, int num_workers);
+
+/**
+ * Run every task still queued, stop the workers and free the pool's resources
+ * @param pool Pointer to pool structure
+ */
+void work_pool_destroy(work_pool_t* pool);
+
+/**
+ * Queue a task to run as soon as possible - on the calling worker right after its current task when called from the pool
+ * @param pool Pointer to pool structure
+ * @param run Task function
+ * @param arg Its argument
+ */
+void work_pool_submit(work_pool_t* pool, work_pool_task_fn run, void* arg);
+
+/**
+ * Queue a task behind everything already queued on the calling worker (the first thing another worker would steal)
+ * @param pool Pointer to pool structure
+ * @param run Task function
+ * @param arg Its argument
+ */
+void work_pool_defer(work_pool_t* pool, work_pool_task_fn run, void* arg);
+
+#endif
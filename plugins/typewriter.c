@@ -9,6 +9,22 @@
 
 // typewriter: Simulates a typewriter effect by printing each character with a 100ms delay (you can use the usleep function). 
 // Note: No traffic jam due to threaded plugin architecture - each plugin runs independently
+// With a host timer the delays are timers instead of sleeps, so no thread sits in usleep while a line is typed.
+
+// default delay per character (microseconds)
+#define TYPEWRITER_DELAY_US 100000
+
+/**
+ * One line being typed on the host's timer
+ */
+typedef struct
+{
+    plugin_context_t* context; // Instance typing it
+    char* text; // "[typewriter] " + the input
+    size_t len; // Characters in text
+    size_t pos; // Next character to print
+    size_t input_len; // Characters of the input (the result is text + the prefix)
+} typewriter_job_t;
 
 
 /**
@@ -21,12 +37,22 @@ const char* plugin_get_name(void){
 }
 
 
+/**
+ * Get the plugin's properties
+ * @return 0 - the transform writes to stdout, so calls must stay on one thread and in input order
+ */
+__attribute__((visibility("default")))
+unsigned int plugin_get_flags(void){
+    return 0;
+}
+
+
 // transformation function
 const char* plugin_transform(const char* input){
     int len= strlen(input);
 
     // allocate memory for the copy of input (so we can later on free the original input from memory)
-    char* result= malloc(len+1);
+    char* result= plugin_buffer_alloc(len+1);
     // error allocating memory: return NULL
     if(result == NULL){
         return NULL;
@@ -38,18 +64,100 @@ const char* plugin_transform(const char* input){
     // printing the plugin name with 100ms delay too (before looping over the input)
     const char* prefix = "[typewriter] ";
     for(int i=0; i<strlen(prefix); i++){
-        fprintf(stdout,"%c", prefix[i]);
+        plugin_output(&(struct iovec){ (char*)&prefix[i], 1 }, 1);
         usleep(100000); //100 ms
     }
 
     // printing each character with a 100ms delay
+    // (through the host's writer thread - it writes a character within a couple of ms, well inside the delay)
     for(int i=0; i<len; i++){
-        fprintf(stdout,"%c", result[i]);
+        plugin_output(&(struct iovec){ &result[i], 1 }, 1);
         usleep(100000); //100 ms
     }
 
     // don't forget to enter a line at the end
-    fprintf(stdout,"\n");
+    plugin_output(&(struct iovec){ "\n", 1 }, 1);
+    return result;
+}
+
+
+/**
+ * Timer callback: print the next character and schedule the one after it, or end the line and finish the item
+ * @param arg Pointer to typewriter_job_t
+ */
+static void typewriter_step(void* arg){
+    typewriter_job_t* job = (typewriter_job_t*)arg;
+    plugin_context_t* context = job->context;
+    unsigned long delay = context->char_delay_us > 0 ? (unsigned long)context->char_delay_us : TYPEWRITER_DELAY_US;
+
+    // every character is followed by its delay, the newline comes after the last one
+    while(job->pos < job->len){
+        plugin_instance_output(context, &(struct iovec){ &job->text[job->pos], 1 }, 1);
+        job->pos++;
+        if(context->timer.schedule(context->timer.timer, delay, typewriter_step, job) == 0){
+            return;
+        }
+        // couldn't schedule: type the rest without the effect rather than lose the line
+    }
+
+    plugin_instance_output(context, &(struct iovec){ "\n", 1 }, 1);
+
+    // the result is the input itself, which sits right after the prefix
+    char* result = job->text;
+    memmove(result, result + (job->len - job->input_len), job->input_len + 1);
+    free(job);
+    plugin_async_done(context, result);
+}
+
+
+/**
+ * Start typing one line on the host's timer (the first character comes out right away)
+ * @param context Plugin context
+ * @param input Input string (copied)
+ */
+static void typewriter_start(plugin_context_t* context, const char* input){
+    const char* prefix = "[typewriter] ";
+    size_t prefix_len = strlen(prefix);
+    size_t input_len = strlen(input);
+
+    // the text becomes the result, so it is a message buffer of the instance
+    typewriter_job_t* job = malloc(sizeof(typewriter_job_t));
+    char* text = job != NULL ? plugin_instance_buffer_alloc(context, prefix_len + input_len + 1) : NULL;
+    if(text == NULL){
+        free(job);
+        plugin_async_done(context, NULL);
+        return;
+    }
+    memcpy(text, prefix, prefix_len);
+    memcpy(text + prefix_len, input, input_len + 1);
+
+    job->context = context;
+    job->text = text;
+    job->len = prefix_len + input_len;
+    job->pos = 0;
+    job->input_len = input_len;
+    typewriter_step(job);
+}
+
+
+/**
+ * Type a line without any delay (char delay PLUGIN_DELAY_NONE) - one record, so nothing else cuts into it
+ * @param input Input string
+ * @return Heap-allocated copy of the input, or NULL on allocation failure
+ */
+static const char* typewriter_transform_instant(const char* input){
+    size_t len = strlen(input);
+    char* result = plugin_buffer_alloc(len + 1);
+    if(result == NULL){
+        return NULL;
+    }
+    memcpy(result, input, len + 1);
+    struct iovec parts[] = {
+        { "[typewriter] ", 13 },
+        { result, len },
+        { "\n", 1 }
+    };
+    plugin_output(parts, 3);
     return result;
 }
 
@@ -64,3 +172,24 @@ __attribute__((visibility("default")))
 const char* plugin_init(int queue_size){
     return common_plugin_init(plugin_transform, "typewriter", queue_size);
 }
+
+
+/**
+ * Create a new, independent instance of the plugin - calls common_plugin_instance_init
+ * This function should be implemented by each plugin
+ * @param config Plugin configuration
+ * @param instance Output - the new instance on success
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default")))
+const char* plugin_instance_init(const plugin_config_t* config, plugin_instance_t** instance){
+    if(config != NULL && config->char_delay_us == PLUGIN_DELAY_NONE){
+        return common_plugin_instance_init(typewriter_transform_instant, "typewriter", config, instance);
+    }
+
+    // no timer to wait on (or replicated, which needs a plain transform): sleep between characters as before
+    if(config == NULL || config->timer == NULL || config->replicas > 1 || config->num_fused > 0){
+        return common_plugin_instance_init(plugin_transform, "typewriter", config, instance);
+    }
+    return common_plugin_instance_init_async(plugin_transform, typewriter_start, "typewriter", config, instance);
+}
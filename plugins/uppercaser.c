@@ -1,59 +1,19 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <pthread.h>
-
-// <ctype.h> is a standard library in C
-#include <ctype.h> // for uppercase
-
-
-#include "plugin_sdk.h"
-#include "plugin_common.h"
+#include "byte_map_plugin.h"
 
 // uppercaser: Converts all alphabetic characters in the string to uppercase. 
+// (ASCII a-z, like toupper in the "C" locale the analyzer runs in - as a byte map, so it runs 16-32 bytes at a time)
+
 
 /**
- * Get the plugin's name
- * @return The plugin's name (should not be modified or freed)
+ * The map: a-z to A-Z, every other byte stays
+ * @param table Output - byte -> byte
  */
-__attribute__((visibility("default")))
-const char* plugin_get_name(void){
-    return "uppercaser";
-}
-
-
-// transformation function
-const char* plugin_transform(const char* input){
-
-
-    // allocate memory for the copy of input (so we can later on free the original input from memory)
-    int len= strlen(input);
-
-    char* result= malloc(len+1);
-    // error allocating memory: return NULL
-    if(result == NULL){
-        return NULL;
-    }
-
-    // copy
-    strcpy(result, input);
-    
-    // uppercase each char
-    for(int i=0; i<len; i++){
-        result[i]=toupper(result[i]);
+static void uppercaser_table(unsigned char table[256]){
+    for(int c = 0; c < 256; c++){
+        table[c] = (c >= 'a' && c <= 'z') ? (unsigned char)(c - 'a' + 'A') : (unsigned char)c;
     }
-    
-    return result;
 }
 
 
-/**
- * Initialize the plugin with the specified queue size - calls common_plugin_init
- * This function should be implemented by each plugin
- * @param queue_size Maximum number of items that can be queued
- * @return NULL on success, error message on failure
- */
-__attribute__((visibility("default")))
-const char* plugin_init(int queue_size){
-    return common_plugin_init(plugin_transform, "uppercaser", queue_size);
-}
+// PLUGIN_FLAG_IDEMPOTENT - uppercasing twice changes nothing more
+BYTE_MAP_PLUGIN("uppercaser", PLUGIN_FLAG_PURE | PLUGIN_FLAG_IDEMPOTENT, uppercaser_table)
@@ -156,6 +156,11 @@ test_argument_validation() {
         "echo -e 'test\n<END>' | $ANALYZER 10 fakeplugin" \
         "Unknown plugin: fakeplugin" \
         "true"
+
+    run_test "Replicated stage rejected with --pool" \
+        "echo -e 'test\n<END>' | $ANALYZER 10 'rotator*2' logger --pool=2" \
+        "can't run with --pool" \
+        "true"
 }
 
 # ================================================================================
@@ -184,6 +189,18 @@ test_individual_plugins() {
     run_test "Expander adds spaces between chars" \
         "echo -e 'abc\n<END>' | $ANALYZER 10 expander logger" \
         "\\[logger\\] a b c"
+
+    run_test "Expander leaves an empty line empty" \
+        "printf '\\nab\\n<END>\\n' | $ANALYZER 10 expander logger | grep -c '^\\[logger\\] \$'" \
+        "^1$"
+
+    run_test "Lowercaser converts to lowercase" \
+        "echo -e 'Hello World123\n<END>' | $ANALYZER 10 lowercaser logger" \
+        "\\[logger\\] hello world123"
+
+    run_test "Rot13 rotates letters and keeps the rest" \
+        "echo -e 'Hello, World zZ!\n<END>' | $ANALYZER 10 rot13 logger" \
+        "\\[logger\\] Uryyb, Jbeyq mM!"
         
     # Test typewriter with timing
     echo -e "\n${PASTEL_CYAN}🧪 TEST $((total + 1)): ${PASTEL_YELLOW}Typewriter timing behavior${NC}"
@@ -197,6 +214,19 @@ test_individual_plugins() {
         echo -e "   ${PASTEL_RED}❌ FAILED ${DIM}(｡•́︿•̀｡)${NC} ${DIM}- Too fast: ${duration}ms${NC}"
         failed=$((failed + 1))
     fi
+
+    run_test "Typewriter with no delay" \
+        "echo -e 'hi\n<END>' | $ANALYZER 10 typewriter logger --char-delay=0" \
+        "\\[typewriter\\] hi"
+
+    run_test "Typewriter on a virtual clock (pool)" \
+        "echo -e 'hi\nyo\n<END>' | timeout 5 $ANALYZER 10 typewriter logger --virtual-clock --pool=2" \
+        "\\[logger\\] yo"
+
+    run_test "Negative char delay rejected" \
+        "$ANALYZER 10 typewriter --char-delay=-5" \
+        "Invalid option: --char-delay" \
+        "true"
 }
 
 # ================================================================================
@@ -222,6 +252,10 @@ test_pipeline_chains() {
         "echo -e 'hi\n<END>' | $ANALYZER 25 uppercaser rotator flipper expander logger" \
         "\\[logger\\]"
         
+    run_test "Fused geometric chain built once" \
+        "echo -e 'abcd\n<END>' | $ANALYZER 20 rotator flipper expander rotator logger --fuse" \
+        "\\[logger\\] dc b a "$'\n'"Pipeline shutdown complete"
+        
     run_test "Multiple input lines through pipeline" \
         "echo -e 'line1\nline2\n<END>' | $ANALYZER 10 uppercaser logger" \
         "\\[logger\\] LINE1.*\\[logger\\] LINE2"
@@ -316,6 +350,45 @@ test_string_lengths() {
     run_test "Maximum string processing (1023 chars)" \
         "echo -e '${max_string}\n<END>' | $ANALYZER 30 logger" \
         "\\[logger\\] ${max_string}"
+        
+    # Lines have no length limit - a 3000 char line stays one item
+    local huge_string
+    huge_string=$(printf 'Y%.0s' {1..3000})  # 3000 Y's
+    run_test "Line longer than 1024 chars (3000 chars)" \
+        "echo -e '${huge_string}\n<END>' | $ANALYZER 30 logger" \
+        "\\[logger\\] ${huge_string}"$'\n'"Pipeline shutdown complete"
+        
+    # A line past PLUGIN_ROPE_MIN_LENGTH moves between these stages as a rope - it must come out like a plain string does
+    run_test "Very long line through rope stages (300000 chars)" \
+        "f=\$(mktemp) && { yes abcXYZ | head -c 300000 | tr -d '\n'; printf '\n<END>\n'; } > \$f && $ANALYZER 10 uppercaser rotator expander logger < \$f > \$f.a && $ANALYZER 10 uppercaser rotator expander logger --sharded < \$f > \$f.b && cmp -s \$f.a \$f.b && echo same; rc=\$?; rm -f \$f \$f.a \$f.b; exit \$rc" \
+        "^same\$"
+        
+    # A small record ring wraps all the time and keeps the long lines out of line - the output must not change
+    run_test "Record ring queues (--record-ring=256)" \
+        "f=\$(mktemp) && { for n in 1 30 70 200 5 0 64 3000 9; do printf '%*s\\n' \$n '' | tr ' ' x; done; echo '<END>'; } > \$f && $ANALYZER 4 uppercaser rotator expander logger --record-ring=256 --batch=3 < \$f > \$f.a && $ANALYZER 4 uppercaser rotator expander logger < \$f > \$f.b && cmp -s \$f.a \$f.b && [ \$(wc -l < \$f.a) -eq 10 ] && echo same; rc=\$?; rm -f \$f \$f.a \$f.b; exit \$rc" \
+        "^same\$"
+        
+    # Every line and result comes from the buffer pool and goes back to it - none may be left over at the end
+    run_test "Buffer pool gives every buffer back" \
+        "printf 'hello\\nworld\\n<END>\\n' | $ANALYZER 10 uppercaser rotator expander logger --buffer-stats 2>&1 >/dev/null" \
+        "Buffer pool: .* 0 bytes in flight"
+        
+    run_test "Custom record delimiter" \
+        "printf 'one;two;<END>;' | $ANALYZER 10 uppercaser logger --delim=';'" \
+        "\\[logger\\] ONE.*\\[logger\\] TWO"
+        
+    run_test "Input from a file (ends without <END>)" \
+        "f=\$(mktemp) && printf 'one\ntwo' > \$f && $ANALYZER 10 uppercaser logger --input=\$f; rc=\$?; rm -f \$f; exit \$rc" \
+        "\\[logger\\] ONE.*\\[logger\\] TWO.*Pipeline shutdown complete"
+        
+    # The end of the stream travels beside the lines, so a line that happens to read <END> is just data
+    run_test "An <END> line in a file is data" \
+        "f=\$(mktemp) && printf 'one\n<END>\ntwo\n' > \$f && $ANALYZER 10 uppercaser logger --input=\$f --pool=2; rc=\$?; rm -f \$f; exit \$rc" \
+        "\\[logger\\] ONE.*\\[logger\\] <END>.*\\[logger\\] TWO.*Pipeline shutdown complete"
+        
+    run_test "Line range from an indexed file (index built, then reused)" \
+        "f=\$(mktemp) && seq 1 100 > \$f && $ANALYZER 10 logger --input=\$f --index > /dev/null && $ANALYZER 10 logger --input=\$f --index --lines=42-43; rc=\$?; rm -f \$f \$f.idx; exit \$rc" \
+        "^\\[logger\\] 42"$'\n'"\\[logger\\] 43"$'\n'"Pipeline shutdown complete\$"
 }
 
 # ================================================================================